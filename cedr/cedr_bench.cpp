@@ -0,0 +1,410 @@
+// COMPOSE version 1.0: Copyright 2018 NTESS. This software is released under
+// the BSD license; see LICENSE in the top-level directory.
+
+// Benchmark driver for the CDRs. One invocation sweeps algorithm, problem
+// type, cells per rank, and number of tracers, each in weak and strong
+// scaling over rank counts 1, 2, 4, ..., nrank, and writes per-phase timings
+// as CSV or JSON. Each phase's time is the mean over repetitions on a rank;
+// min, max, mean, and the rank having the max are then over the ranks. The
+// phases timed here are followed by the CDR's own profile (CDR::Profile),
+// prefixed by "cdr_", per run.
+
+#include "cedr_qlt.hpp"
+#include "cedr_caas.hpp"
+#include "cedr_hybrid.hpp"
+#include "cedr_mpi.hpp"
+#include "cedr_util.hpp"
+#include "cedr_test_randomized.hpp"
+
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+namespace cedr {
+namespace bench {
+
+struct Input {
+  std::vector<std::string> algs, probs;
+  // Cells per rank. For strong scaling, the global number of cells is this
+  // times the number of ranks in the full communicator.
+  std::vector<Int> ncells;
+  std::vector<Int> ntracers;
+  bool weak, strong;
+  Int nrepeat, nwarmup;
+  // Set CDR::Options::aggregate_messages.
+  bool aggregate;
+  // Set CDR::Options::single_precision_bounds.
+  bool single_bounds;
+  // Set CDR::Options::host_tasks.
+  bool host_tasks;
+  // Use an imbalanced tree over the 1D mesh.
+  bool imbalanced;
+  // For qltcaas, the max_node_size of the mpi::NodeParallel giving the groups.
+  Int group_size;
+  bool json;
+  std::string filename;
+};
+
+// The phases, in the order that run_case times them.
+struct Phase {
+  enum Enum { setup, set, run, run_begin, run_end, get, NPHASES };
+  static const char* name (const Int i) {
+    static const char* names[] = {"setup", "set", "run", "run_begin", "run_end",
+                                  "get"};
+    return names[i];
+  }
+};
+
+typedef CDR::ProfileSummary::Stat Stat;
+
+struct Record {
+  std::string scaling, alg, prob;
+  Int nrank, ncells, ntracers;
+  std::vector<std::string> names;
+  std::vector<Stat> stats;
+};
+
+static std::vector<std::string> split (const std::string& s) {
+  std::vector<std::string> v;
+  std::stringstream ss(s);
+  std::string tok;
+  while (std::getline(ss, tok, ',')) v.push_back(tok);
+  return v;
+}
+
+static std::vector<Int> split_int (const std::string& s) {
+  std::vector<Int> v;
+  for (const auto& tok : split(s)) v.push_back(std::atoi(tok.c_str()));
+  return v;
+}
+
+static Int get_problem_type (const std::string& prob) {
+  using util::eq;
+  if (eq(prob, "shapepreserve"))
+    return ProblemType::conserve | ProblemType::shapepreserve;
+  if (eq(prob, "consistent"))
+    return ProblemType::conserve | ProblemType::consistent;
+  cedr_throw_if( ! eq(prob, "nonnegative"), "Invalid problem type " << prob);
+  return ProblemType::conserve | ProblemType::nonnegative;
+}
+
+struct InputParser {
+  Input in;
+
+  InputParser (int argc, char** argv) {
+    using util::eq;
+    in.algs = {"qlt", "caas"};
+    in.probs = {"shapepreserve"};
+    in.ncells = {1000};
+    in.ntracers = {1, 10};
+    in.weak = in.strong = true;
+    in.nrepeat = 10;
+    in.nwarmup = 2;
+    in.aggregate = false;
+    in.single_bounds = false;
+    in.host_tasks = false;
+    in.imbalanced = false;
+    in.group_size = 0;
+    in.json = false;
+    for (int i = 1; i < argc; ++i) {
+      const std::string token = argv[i];
+      const auto advance = [&] () -> std::string {
+        cedr_throw_if(i+1 >= argc, "Command line is missing an argument.");
+        return argv[++i];
+      };
+      if (eq(token, "-a", "--alg")) in.algs = split(advance());
+      else if (eq(token, "-p", "--problem")) in.probs = split(advance());
+      else if (eq(token, "-nc", "--ncells")) in.ncells = split_int(advance());
+      else if (eq(token, "-nt", "--ntracers")) in.ntracers = split_int(advance());
+      else if (eq(token, "-nr", "--nrepeat")) in.nrepeat = std::atoi(advance().c_str());
+      else if (eq(token, "-nw", "--nwarmup")) in.nwarmup = std::atoi(advance().c_str());
+      else if (eq(token, "--weak")) { in.weak = true; in.strong = false; }
+      else if (eq(token, "--strong")) { in.weak = false; in.strong = true; }
+      else if (eq(token, "--aggregate")) in.aggregate = true;
+      else if (eq(token, "--single-bounds")) in.single_bounds = true;
+      else if (eq(token, "--host-tasks")) in.host_tasks = true;
+      else if (eq(token, "--imbalanced")) in.imbalanced = true;
+      else if (eq(token, "--group-size")) in.group_size = std::atoi(advance().c_str());
+      else if (eq(token, "--json")) in.json = true;
+      else if (eq(token, "-o", "--output")) in.filename = advance();
+      else cedr_throw_if(true, "Invalid token " << token);
+    }
+    for (const auto& alg : in.algs)
+      cedr_throw_if( ! eq(alg, "qlt") && ! eq(alg, "caas") && ! eq(alg, "qltcaas"),
+                     "Invalid algorithm " << alg);
+    for (const auto& prob : in.probs) get_problem_type(prob);
+    for (const auto nc : in.ncells) cedr_throw_if(nc < 1, "ncells is < 1.");
+    for (const auto nt : in.ntracers) cedr_throw_if(nt < 1, "ntracers is < 1.");
+    cedr_throw_if(in.nrepeat < 1, "nrepeat is < 1.");
+  }
+};
+
+typedef Kokkos::DefaultExecutionSpace ES;
+typedef Kokkos::View<Real*, ES> RealList;
+typedef Kokkos::View<Long*, ES> LongList;
+
+// test::impl::get_cell_values's data, with every tracer using rhom index 0.
+struct Values {
+  Int nlclcells, ntracers;
+  RealList rhom, Qm, Qm_min, Qm_max, Qm_prev;
+
+  Values (const std::vector<Long>& gcis, const Int ntracers_)
+    : nlclcells(gcis.size()), ntracers(ntracers_),
+      rhom("rhom", nlclcells), Qm("Qm", nlclcells*ntracers),
+      Qm_min("Qm_min", nlclcells*ntracers), Qm_max("Qm_max", nlclcells*ntracers),
+      Qm_prev("Qm_prev", nlclcells*ntracers)
+  {
+    const LongList gcis_d = test::impl::make_gcis_view<ES>(gcis);
+    const auto rhom = this->rhom, Qm = this->Qm, Qm_min = this->Qm_min,
+      Qm_max = this->Qm_max, Qm_prev = this->Qm_prev;
+    const Int n = nlclcells;
+    const auto f = KOKKOS_LAMBDA (const Int& j) {
+      const Int ti = j / n, i = j % n;
+      const auto v = test::impl::get_cell_values(gcis_d(i), ti, 0);
+      if (ti == 0) rhom(i) = v.rhom;
+      Qm(j) = v.Qm;
+      Qm_min(j) = v.Qm_min;
+      Qm_max(j) = v.Qm_max;
+      Qm_prev(j) = v.Qm_prev;
+    };
+    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, n*ntracers), f);
+  }
+};
+
+template <typename CDRT>
+void set (const CDRT& cdr, const Values& v, const bool set_rhom) {
+  const Int n = v.nlclcells;
+  const auto rhom = v.rhom, Qm = v.Qm, Qm_min = v.Qm_min, Qm_max = v.Qm_max,
+    Qm_prev = v.Qm_prev;
+  if (set_rhom) {
+    const auto f = KOKKOS_LAMBDA (const Int& i) { cdr.set_rhom(i, 0, rhom(i)); };
+    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, n), f);
+  }
+  const auto f = KOKKOS_LAMBDA (const Int& j) {
+    cdr.set_Qm(j % n, j / n, Qm(j), Qm_min(j), Qm_max(j), Qm_prev(j));
+  };
+  Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, n*v.ntracers), f);
+}
+
+// Time the phases of one CDR that has finished setup.
+template <typename CDRT>
+void time_runs (const mpi::Parallel& p, CDRT& cdr, const Values& v,
+                const Input& in, Real* et) {
+  const Int n = v.nlclcells;
+  RealList Qm("Qm", n*v.ntracers);
+  set(cdr, v, true);
+  const auto timed = [&] (const Int phase, const bool record,
+                          const std::function<void()>& f) {
+    Kokkos::fence();
+    const double t0 = MPI_Wtime();
+    f();
+    Kokkos::fence();
+    if (record) et[phase] += MPI_Wtime() - t0;
+  };
+  for (Int trial = 0; trial < in.nwarmup + in.nrepeat; ++trial) {
+    const bool record = trial >= in.nwarmup;
+    if (trial == in.nwarmup) cdr.reset_profile();
+    timed(Phase::set, record, [&] () { set(cdr, v, false); });
+    MPI_Barrier(p.comm());
+    timed(Phase::run, record, [&] () { cdr.run(); });
+    set(cdr, v, false);
+    MPI_Barrier(p.comm());
+    timed(Phase::run_begin, record, [&] () { cdr.run_begin(); });
+    timed(Phase::run_end, record, [&] () { cdr.run_end(); });
+    timed(Phase::get, record, [&] () {
+      const auto f = KOKKOS_LAMBDA (const Int& j) { Qm(j) = cdr.get_Qm(j % n, j / n); };
+      Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, n*v.ntracers), f);
+    });
+  }
+  for (Int i = Phase::set; i < Phase::NPHASES; ++i)
+    et[i] /= in.nrepeat;
+}
+
+static void declare_tracers (CDR& cdr, const Record& r) {
+  const Int problem_type = get_problem_type(r.prob);
+  for (Int ti = 0; ti < r.ntracers; ++ti)
+    cdr.declare_tracer(problem_type, 0);
+  cdr.end_tracer_declarations();
+  cdr.finish_setup();
+}
+
+// Run the case described by r's inputs and fill r's timings.
+static void run_case (const mpi::Parallel::Ptr& p, const Input& in, Record& r) {
+  Real et[Phase::NPHASES] = {0};
+  CDR::Options options;
+  options.profile = true;
+  options.aggregate_messages = in.aggregate;
+  options.single_precision_bounds = in.single_bounds;
+  options.host_tasks = in.host_tasks;
+  CDR::ProfileSummary ps;
+  const double t0 = MPI_Wtime();
+  if (util::eq(r.alg, "qlt")) {
+    typedef qlt::QLT<ES> QLTT;
+    const auto tree = qlt::tree::make_tree_over_1d_mesh(p, r.ncells,
+                                                        in.imbalanced);
+    QLTT qlt(p, r.ncells, tree, options);
+    declare_tracers(qlt, r);
+    et[Phase::setup] = MPI_Wtime() - t0;
+    std::vector<Long> gcis;
+    qlt.get_owned_glblcells(gcis);
+    Values v(gcis, r.ntracers);
+    time_runs(*p, qlt, v, in, et);
+    ps = qlt.summarize_profile(*p);
+  } else if (util::eq(r.alg, "qltcaas")) {
+    typedef hybrid::QLTCAAS<ES> QLTCAAST;
+    const Int np = p->size(), rank = p->rank();
+    const Int nlcl = r.ncells/np + (rank < r.ncells % np ? 1 : 0);
+    const auto npar = std::make_shared<mpi::NodeParallel>(*p, in.group_size);
+    Int ngcells;
+    mpi::all_reduce(npar->node(), &nlcl, &ngcells, 1, MPI_SUM);
+    const auto tree = qlt::tree::make_tree_over_1d_mesh(
+      std::make_shared<mpi::Parallel>(npar->node().comm()), ngcells,
+      in.imbalanced);
+    QLTCAAST qltcaas(p, npar, ngcells, tree, options);
+    declare_tracers(qltcaas, r);
+    et[Phase::setup] = MPI_Wtime() - t0;
+    std::vector<Long> gcis;
+    qltcaas.get_owned_glblcells(gcis);
+    Values v(gcis, r.ntracers);
+    time_runs(*p, qltcaas, v, in, et);
+    ps = qltcaas.summarize_profile(*p);
+  } else {
+    typedef caas::CAAS<ES> CAAST;
+    const Int np = p->size(), rank = p->rank();
+    const Int nlcl = r.ncells/np + (rank < r.ncells % np ? 1 : 0);
+    const Long gci0 = Long(rank)*(r.ncells/np) + std::min(rank, r.ncells % np);
+    CAAST caas(p, nlcl, nullptr, options);
+    declare_tracers(caas, r);
+    et[Phase::setup] = MPI_Wtime() - t0;
+    std::vector<Long> gcis(nlcl);
+    for (Int i = 0; i < nlcl; ++i) gcis[i] = gci0 + i;
+    Values v(gcis, r.ntracers);
+    time_runs(*p, caas, v, in, et);
+    ps = caas.summarize_profile(*p);
+  }
+  Real min[Phase::NPHASES], sum[Phase::NPHASES];
+  struct { double v; int rank; } vr[Phase::NPHASES], max[Phase::NPHASES];
+  for (Int i = 0; i < Phase::NPHASES; ++i) {
+    vr[i].v = et[i];
+    vr[i].rank = p->rank();
+  }
+  mpi::all_reduce(*p, et, min, Phase::NPHASES, MPI_MIN);
+  mpi::all_reduce(*p, et, sum, Phase::NPHASES, MPI_SUM);
+  MPI_Allreduce(vr, max, Phase::NPHASES, MPI_DOUBLE_INT, MPI_MAXLOC, p->comm());
+  for (Int i = 0; i < Phase::NPHASES; ++i) {
+    Stat st;
+    st.min = min[i];
+    st.max = max[i].v;
+    st.max_rank = max[i].rank;
+    st.mean = sum[i]/p->size();
+    r.names.push_back(Phase::name(i));
+    r.stats.push_back(st);
+  }
+  // time_runs runs twice per repetition: run, and run_begin with run_end.
+  const Real nrun = 2*in.nrepeat;
+  const auto add = [&] (const std::string& name, Stat st) {
+    st.min /= nrun;
+    st.max /= nrun;
+    st.mean /= nrun;
+    r.names.push_back("cdr_" + name);
+    r.stats.push_back(st);
+  };
+  for (Int i = CDR::Profile::run; i < CDR::Profile::nphase; ++i)
+    add(CDR::Profile::get_phase_name(i), ps.time[i]);
+  add("nmsg_sent", ps.nmsg_sent);
+  add("nmsg_recvd", ps.nmsg_recvd);
+  add("nbyte_sent", ps.nbyte_sent);
+  add("nbyte_recvd", ps.nbyte_recvd);
+}
+
+static void write_csv (std::ostream& os, const std::vector<Record>& rs) {
+  os << "scaling,nrank,alg,problem,ncells,ntracers,phase,min,max,mean,max_rank\n";
+  for (const auto& r : rs)
+    for (size_t i = 0; i < r.stats.size(); ++i) {
+      const auto& st = r.stats[i];
+      os << r.scaling << "," << r.nrank << "," << r.alg << "," << r.prob << ","
+         << r.ncells << "," << r.ntracers << "," << r.names[i] << ","
+         << st.min << "," << st.max << "," << st.mean << "," << st.max_rank
+         << "\n";
+    }
+}
+
+static void write_json (std::ostream& os, const std::vector<Record>& rs) {
+  os << "{\"cases\": [";
+  for (size_t k = 0; k < rs.size(); ++k) {
+    const auto& r = rs[k];
+    os << (k ? ",\n  " : "\n  ")
+       << "{\"scaling\": \"" << r.scaling << "\", \"nrank\": " << r.nrank
+       << ", \"alg\": \"" << r.alg << "\", \"problem\": \"" << r.prob
+       << "\", \"ncells\": " << r.ncells << ", \"ntracers\": " << r.ntracers
+       << ", \"phases\": {";
+    for (size_t i = 0; i < r.stats.size(); ++i) {
+      const auto& st = r.stats[i];
+      os << (i ? ", " : "") << "\"" << r.names[i] << "\": {\"min\": "
+         << st.min << ", \"max\": " << st.max << ", \"mean\": " << st.mean
+         << ", \"max_rank\": " << st.max_rank << "}";
+    }
+    os << "}}";
+  }
+  os << "\n]}\n";
+}
+
+// Run all cases. The results are valid on the root of p.
+static std::vector<Record> run (const mpi::Parallel::Ptr& p, const Input& in) {
+  std::vector<Int> nranks;
+  for (Int n = 1; n < p->size(); n *= 2) nranks.push_back(n);
+  nranks.push_back(p->size());
+  std::vector<Record> rs;
+  for (const Int nrank : nranks) {
+    // The world root is in every subcommunicator and so gets every Record.
+    MPI_Comm comm;
+    MPI_Comm_split(p->comm(), p->rank() < nrank ? 0 : MPI_UNDEFINED, p->rank(),
+                   &comm);
+    if (comm == MPI_COMM_NULL) continue;
+    const auto sp = mpi::make_parallel(comm);
+    for (const auto& alg : in.algs)
+      for (const auto& prob : in.probs) {
+        // CAAS and QLTCAAS support only shape preservation.
+        if ( ! util::eq(alg, "qlt") && ! util::eq(prob, "shapepreserve")) continue;
+        for (const Int nc : in.ncells)
+          for (const Int nt : in.ntracers)
+            for (const bool weak : {true, false}) {
+              if ((weak && ! in.weak) || ( ! weak && ! in.strong)) continue;
+              Record r;
+              r.scaling = weak ? "weak" : "strong";
+              r.alg = alg;
+              r.prob = prob;
+              r.nrank = nrank;
+              r.ncells = nc*(weak ? nrank : p->size());
+              r.ntracers = nt;
+              run_case(sp, in, r);
+              if (p->amroot()) rs.push_back(r);
+            }
+      }
+    MPI_Comm_free(&comm);
+  }
+  return rs;
+}
+
+} // namespace bench
+} // namespace cedr
+
+int main (int argc, char** argv) {
+  MPI_Init(&argc, &argv);
+  Kokkos::initialize(argc, argv); {
+    const auto p = cedr::mpi::make_parallel(MPI_COMM_WORLD);
+    cedr::bench::InputParser inp(argc, argv);
+    const auto rs = cedr::bench::run(p, inp.in);
+    if (p->amroot()) {
+      std::ofstream ofs;
+      if ( ! inp.in.filename.empty()) ofs.open(inp.in.filename);
+      std::ostream& os = inp.in.filename.empty() ? std::cout : ofs;
+      if (inp.in.json)
+        cedr::bench::write_json(os, rs);
+      else
+        cedr::bench::write_csv(os, rs);
+    }
+  } Kokkos::finalize();
+  MPI_Finalize();
+  return 0;
+}
@@ -29,30 +29,111 @@ struct Real2 {
 template<> struct reduction_identity<Real2> {
   KOKKOS_INLINE_FUNCTION static Real2 sum() { return Real2(); }
 };
+
+template <int N>
+struct LongN {
+  cedr::Long v[N];
+  KOKKOS_INLINE_FUNCTION LongN () { for (int i = 0; i < N; ++i) v[i] = 0; }
+
+  KOKKOS_INLINE_FUNCTION void operator= (const LongN& s) {
+    for (int i = 0; i < N; ++i) v[i] = s.v[i];
+  }
+  KOKKOS_INLINE_FUNCTION void operator= (const volatile LongN& s) volatile {
+    for (int i = 0; i < N; ++i) v[i] = s.v[i];
+  }
+
+  KOKKOS_INLINE_FUNCTION LongN& operator+= (const LongN& o) {
+    for (int i = 0; i < N; ++i) v[i] += o.v[i];
+    return *this;
+  }
+};
+
+template <int N> struct reduction_identity<LongN<N> > {
+  KOKKOS_INLINE_FUNCTION static LongN<N> sum() { return LongN<N>(); }
+};
 } // namespace Kokkos
 
 namespace cedr {
 namespace caas {
 
+// Fixed-point sums for CDR::Options::reproducible_sums. A value y in (-1, 1) is
+// split into nlimb integers, each holding the next nbit bits below the binary
+// point. Integer addition is associative, so the sums are exact and
+// independent of order, and hence of the number of ranks and the thread
+// schedule. Bits below 2^-(nbit*nlimb) are dropped. A limb's magnitude is less
+// than 2^nbit, so up to 2^(63-nbit) values can be summed without overflow.
+struct FixedPoint {
+  enum : int { nbit = 32, nlimb = 3 };
+
+  KOKKOS_INLINE_FUNCTION static constexpr Real two_nbit () { return 4294967296.0; }
+
+  // Add y in (-1, 1) to the limbs s.
+  KOKKOS_INLINE_FUNCTION static void add (Real y, Long* const s) {
+    for (int l = 0; l < nlimb; ++l) {
+      // Every operation is exact: multiplication by a power of 2 and
+      // subtraction of the leading bits.
+      y *= two_nbit();
+      const Long v = static_cast<Long>(y);
+      s[l] += v;
+      y -= v;
+    }
+  }
+
+  // Convert the summed limbs s to a Real. The result depends only on the
+  // limbs, so it is the same on every rank.
+  KOKKOS_INLINE_FUNCTION static Real to_real (const Long* const s) {
+    Long c[nlimb];
+    for (int l = 0; l < nlimb; ++l) c[l] = s[l];
+    // Carry so that only the leading limb has a sign.
+    for (int l = nlimb-1; l > 0; --l) {
+      c[l-1] += c[l] >> nbit;
+      c[l] &= (Long(1) << nbit) - 1;
+    }
+    Real r = c[nlimb-1];
+    for (int l = nlimb-2; l >= 0; --l)
+      r = c[l] + r/two_nbit();
+    return r/two_nbit();
+  }
+
+  // The power of 2 that maps [-maxabs, maxabs] into (-1, 1).
+  static Real get_scale (const Real& maxabs) {
+    cedr_throw_if( ! std::isfinite(maxabs),
+                  "CAAS: reproducible_sums requires finite values; max |value| is "
+                  << maxabs);
+    if (maxabs == 0) return 1;
+    int e;
+    std::frexp(maxabs, &e);
+    return std::ldexp(1.0, -e);
+  }
+};
+
 template <typename ES>
 CAAS<ES>::CAAS (const mpi::Parallel::Ptr& p, const Int nlclcells,
-                const typename UserAllReducer::Ptr& uar)
-  : p_(p), user_reducer_(uar), nlclcells_(nlclcells), nrhomidxs_(0),
-    need_conserve_(false), finished_setup_(false)
+                const typename UserAllReducer::Ptr& uar,
+                const CDR::Options options)
+  : CDR(options), p_(p), user_reducer_(uar), nlclcells_(nlclcells),
+    nbatch_(options.nbatch), nrhomidxs_(0), need_conserve_(false),
+    finished_setup_(false), active_req_(nullptr), tb_(0), te_(0)
 {
   cedr_throw_if(nlclcells == 0, "CAAS does not support 0 cells on a rank.");
+  cedr_throw_if(nbatch_ < 1, "nbatch must be >= 1.");
+  cedr_throw_if(options.reproducible_sums && uar,
+                "CAAS does not support reproducible_sums with a UserAllReducer.");
+  prof_start(Profile::setup);
   tracer_decls_ = std::make_shared<std::vector<Decl> >();  
+  prof_stop(Profile::setup, false);
 }
 
 template <typename ES>
 void CAAS<ES>::declare_tracer(int problem_type, const Int& rhomidx) {
   cedr_throw_if( ! (problem_type & ProblemType::shapepreserve),
                 "CAAS does not support ! shapepreserve yet.");
-  cedr_throw_if(rhomidx > 0, "rhomidx > 0 is not supported yet.");
-  tracer_decls_->push_back(Decl(problem_type, rhomidx));
+  cedr_throw_if(rhomidx < 0, "rhomidx must be >= 0.");
+  for (Int bi = 0; bi < nbatch_; ++bi)
+    tracer_decls_->push_back(Decl(problem_type, rhomidx*nbatch_ + bi));
   if (problem_type & ProblemType::conserve)
     need_conserve_ = true;
-  nrhomidxs_ = std::max(nrhomidxs_, rhomidx+1);
+  nrhomidxs_ = std::max(nrhomidxs_, (rhomidx+1)*nbatch_);
 }
 
 template <typename ES>
@@ -61,11 +142,8 @@ void CAAS<ES>::end_tracer_declarations () {
   cedr_throw_if(nrhomidxs_ == 0, "#rhomidxs is 0.");
   probs_ = IntList("CAAS probs", static_cast<Int>(tracer_decls_->size()));
   probs_h_ = Kokkos::create_mirror_view(probs_);
-  //t2r_ = IntList("CAAS t2r", static_cast<Int>(tracer_decls_->size()));
-  for (Int i = 0; i < probs_.extent_int(0); ++i) {
+  for (Int i = 0; i < probs_.extent_int(0); ++i)
     probs_h_(i) = (*tracer_decls_)[i].probtype;
-    //t2r_(i) = (*tracer_decls_)[i].rhomidx;
-  }
   Kokkos::deep_copy(probs_, probs_h_);
   tracer_decls_ = nullptr;
 }
@@ -74,7 +152,7 @@ template <typename ES>
 void CAAS<ES>::get_buffers_sizes (size_t& buf1, size_t& buf2, size_t& buf3) {
   const Int e = need_conserve_ ? 1 : 0;
   const auto nslots = 4*probs_.size();
-  buf1 = nlclcells_ * ((3+e)*probs_.size() + 1);
+  buf1 = nlclcells_ * ((3+e)*probs_.size() + nrhomidxs_);
   buf2 = nslots*(user_reducer_ ? nlclcells_ : 1);
   buf3 = nslots;
 }
@@ -97,29 +175,67 @@ void CAAS<ES>::set_buffers (Real* buf1, Real* buf2) {
 
 template <typename ES>
 void CAAS<ES>::finish_setup () {
-  if (recv_.size() > 0) {
-    finished_setup_ = true;
-    return;
+  prof_start(Profile::setup);
+  if (options_.reproducible_sums) {
+    const Int nslots = 4*probs_.size();
+    fsend_ = LongList("CAAS fixed-point send", nslots*FixedPoint::nlimb);
+    frecv_ = LongList("CAAS fixed-point recv", nslots*FixedPoint::nlimb);
+    scale_ = RealList("CAAS fixed-point scale", nslots);
+    scale_h_ = Kokkos::create_mirror_view(scale_);
   }
-  size_t buf1, buf2, buf3;
-  get_buffers_sizes(buf1, buf2, buf3);
-  // (rho, Qm, Qm_min, Qm_max, [Qm_prev])
-  d_ = RealList("CAAS data", buf1);
-  // (e'Qm_clip, e'Qm, e'Qm_min, e'Qm_max, [e'Qm_prev])
-  send_ = RealList("CAAS send", buf2);
-  recv_ = RealList("CAAS recv", buf3);
+  if (recv_.size() == 0) {
+    size_t buf1, buf2, buf3;
+    get_buffers_sizes(buf1, buf2, buf3);
+    // (Qm, Qm_min, Qm_max, [Qm_prev], rhom*)
+    d_ = RealList("CAAS data", buf1);
+    // (e'Qm_clip, e'Qm, e'Qm_min, e'Qm_max, [e'Qm_prev])
+    send_ = RealList("CAAS send", buf2);
+    recv_ = RealList("CAAS recv", buf3);
+  }
+  init_requests();
   finished_setup_ = true;
+  prof_stop(Profile::setup);
+}
+
+// With persistent collectives, every full run reuses one persistent
+// all_reduce. init is collective, so every rank must make the same requests.
+template <typename ES>
+void CAAS<ES>::init_requests () {
+#ifdef COMPOSE_HAVE_MPI_ALLREDUCE_INIT
+  if (user_reducer_) return;
+  const Int nf = 4*probs_.extent_int(0);
+  preqs_ = std::make_shared<mpi::PersistentRequests>();
+  preqs_->reqs.resize(options_.reproducible_sums ? 2 : 1);
+  mpi::all_reduce_init(*p_, send_.data(), recv_.data(), nf, MPI_SUM,
+                       &preqs_->reqs[0]);
+  if (options_.reproducible_sums)
+    mpi::all_reduce_init(*p_, fsend_.data(), frecv_.data(), nf*FixedPoint::nlimb,
+                         MPI_SUM, &preqs_->reqs[1]);
+#endif
+}
+
+template <typename ES> template <typename T>
+int CAAS<ES>::start_reduce (const T* send, T* recv, const Int& count,
+                            const Int& preqi) {
+#ifdef COMPOSE_HAVE_MPI_ALLREDUCE_INIT
+  if (preqs_ && tb_ == 0 && te_ == probs_.extent_int(0)) {
+    active_req_ = &preqs_->reqs[preqi];
+    return mpi::start(active_req_);
+  }
+#endif
+  active_req_ = &reduce_req_;
+  return mpi::iall_reduce(*p_, send, recv, count, MPI_SUM, active_req_);
 }
 
 template <typename ES>
 int CAAS<ES>::get_problem_type (const Int& tracer_idx) const {
-  cedr_assert(tracer_idx >= 0 && tracer_idx < probs_.extent_int(0));
-  return probs_h_[tracer_idx];
+  cedr_assert(tracer_idx >= 0 && tracer_idx < get_num_tracers());
+  return probs_h_[tracer_idx*nbatch_];
 }
 
 template <typename ES>
 Int CAAS<ES>::get_num_tracers () const {
-  return probs_.extent_int(0);
+  return probs_.extent_int(0) / nbatch_;
 }
 
 template <typename RealList, typename IntList>
@@ -141,34 +257,39 @@ template <typename ES>
 void CAAS<ES>::reduce_locally () {
   const bool user_reduces = user_reducer_ != nullptr;
   ConstExceptGnu Int nt = probs_.size(), nlclcells = nlclcells_;
+  // Tracers tb to tb+ns-1 are packed contiguously into send.
+  ConstExceptGnu Int tb = tb_, ns = te_ - tb_;
 
   const auto probs = probs_;
   const auto send = send_;
   const auto d = d_;
   if (user_reduces) {
     const auto calc_Qm_clip = KOKKOS_LAMBDA (const Int& j) {
-      const auto k = j / nlclcells;
+      const auto ks = j / nlclcells;
+      const auto k = tb + ks;
       const auto i = j % nlclcells;
-      const auto os = (k+1)*nlclcells;
+      const auto os = k*nlclcells;
       Real Qm_clip, Qm_term;
       calc_Qm_scalars(d, probs, nt, nlclcells, k, os, i, Qm_clip, Qm_term);
       d(os+i) = Qm_clip;
-      send(nlclcells*      k  + i) = Qm_clip;
-      send(nlclcells*(nt + k) + i) = Qm_term;
+      send(nlclcells*      ks  + i) = Qm_clip;
+      send(nlclcells*(ns + ks) + i) = Qm_term;
     };
-    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, nt*nlclcells), calc_Qm_clip);
+    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, ns*nlclcells), calc_Qm_clip);
     const auto set_Qm_minmax = KOKKOS_LAMBDA (const Int& j) {
-      const auto k = 2*nt + j / nlclcells;
+      // ks in [0, 2 ns) indexes (Qm_min, Qm_max) of the selected tracers.
+      const auto ks = j / nlclcells;
       const auto i = j % nlclcells;
-      const auto os = (k-nt+1)*nlclcells;
-      send(nlclcells*k + i) = d(os+i);
+      const auto os = ((1 + ks / ns)*nt + tb + ks % ns)*nlclcells;
+      send(nlclcells*(2*ns + ks) + i) = d(os+i);
     };
-    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, 2*nt*nlclcells), set_Qm_minmax);
+    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, 2*ns*nlclcells), set_Qm_minmax);
   } else {
     using ESU = cedr::impl::ExeSpaceUtils<ES>;
     const auto calc_Qm_clip = KOKKOS_LAMBDA (const typename ESU::Member& t) {
-      const auto k = t.league_rank();
-      const auto os = (k+1)*nlclcells;
+      const auto ks = t.league_rank();
+      const auto k = tb + ks;
+      const auto os = k*nlclcells;
       const auto reduce = [&] (const Int& i, Kokkos::Real2& accum) {
         Real Qm_clip, Qm_term;
         calc_Qm_scalars(d, probs, nt, nlclcells, k, os, i, Qm_clip, Qm_term);
@@ -179,47 +300,194 @@ void CAAS<ES>::reduce_locally () {
       Kokkos::Real2 accum;
       Kokkos::parallel_reduce(Kokkos::TeamThreadRange(t, nlclcells),
                               reduce, Kokkos::Sum<Kokkos::Real2>(accum));
-      send(     k) = accum.v[0];
-      send(nt + k) = accum.v[1];
+      send(     ks) = accum.v[0];
+      send(ns + ks) = accum.v[1];
     };
-    Kokkos::parallel_for(ESU::get_default_team_policy(nt, nlclcells),
+    Kokkos::parallel_for(ESU::get_default_team_policy(ns, nlclcells),
                          calc_Qm_clip);
     const auto set_Qm_minmax = KOKKOS_LAMBDA (const typename ESU::Member& t) {
-      const auto k = 2*nt + t.league_rank();
-      const auto os = (k-nt+1)*nlclcells;
+      const auto ks = t.league_rank();
+      const auto os = ((1 + ks / ns)*nt + tb + ks % ns)*nlclcells;
       Real accum = 0;
       Kokkos::parallel_reduce(Kokkos::TeamThreadRange(t, nlclcells),
                               [&] (const Int& i, Real& accum) { accum += d(os+i); },
                               Kokkos::Sum<Real>(accum));
-      send(k) = accum;
+      send(2*ns + ks) = accum;
     };
-    Kokkos::parallel_for(ESU::get_default_team_policy(2*nt, nlclcells),
+    Kokkos::parallel_for(ESU::get_default_team_policy(2*ns, nlclcells),
                          set_Qm_minmax);
   }
 }
 
 template <typename ES>
 void CAAS<ES>::reduce_globally () {
+#ifdef COMPOSE_HAVE_MPI_ALLREDUCE_INIT
+  if (preqs_) {
+    reduce_globally_begin();
+    reduce_globally_end();
+    return;
+  }
+#endif
   const int err = mpi::all_reduce(*p_, send_.data(), recv_.data(),
-                                  send_.size(), MPI_SUM);
+                                  4*(te_ - tb_), MPI_SUM);
   cedr_throw_if(err != MPI_SUCCESS,
                 "CAAS::reduce_globally MPI_Allreduce returned " << err);
+  prof_msg(true, 4*(te_ - tb_)*sizeof(Real));
+  prof_msg(false, 4*(te_ - tb_)*sizeof(Real));
+}
+
+template <typename ES>
+void CAAS<ES>::reduce_globally_begin () {
+  // send_ must be complete before MPI reads it.
+  Kokkos::fence();
+  const int err = start_reduce(send_.data(), recv_.data(), 4*(te_ - tb_), 0);
+  cedr_throw_if(err != MPI_SUCCESS,
+                "CAAS::reduce_globally_begin MPI_Iallreduce returned " << err);
+  prof_msg(true, 4*(te_ - tb_)*sizeof(Real));
+  prof_msg(false, 4*(te_ - tb_)*sizeof(Real));
+}
+
+template <typename ES>
+void CAAS<ES>::reduce_globally_end () {
+  prof_start(Profile::wait);
+  const int err = mpi::wait(active_req_);
+  prof_stop(Profile::wait);
+  cedr_throw_if(err != MPI_SUCCESS,
+                "CAAS::reduce_globally_end MPI_Wait returned " << err);
+}
+
+// Value i of field kf = f*ns + ks, where f indexes (Qm_clip, Qm_term, Qm_min,
+// Qm_max) and ks the tracer in [tb, tb+ns). d must not have been clipped yet.
+template <typename RealList, typename IntList>
+KOKKOS_INLINE_FUNCTION static Real
+get_field_value (const RealList& d, const IntList& probs,
+                 const Int& nt, const Int& nlclcells, const Int& tb, const Int& ns,
+                 const Int& kf, const Int& i) {
+  const Int f = kf / ns, k = tb + kf % ns;
+  if (f >= 2) return d(((f - 1)*nt + k)*nlclcells + i);
+  Real Qm_clip, Qm_term;
+  calc_Qm_scalars(d, probs, nt, nlclcells, k, k*nlclcells, i, Qm_clip, Qm_term);
+  return f == 0 ? Qm_clip : Qm_term;
+}
+
+// Find the global max |value| of each field and, from it, the field's
+// fixed-point scale.
+template <typename ES>
+void CAAS<ES>::calc_fixed_scales () {
+  using ESU = cedr::impl::ExeSpaceUtils<ES>;
+  ConstExceptGnu Int nt = probs_.size(), nlclcells = nlclcells_;
+  ConstExceptGnu Int tb = tb_, ns = te_ - tb_;
+  const auto probs = probs_;
+  const auto send = send_;
+  const auto d = d_;
+  const auto calc_maxabs = KOKKOS_LAMBDA (const typename ESU::Member& t) {
+    const auto kf = t.league_rank();
+    Real accum = 0;
+    Kokkos::parallel_reduce(
+      Kokkos::TeamThreadRange(t, nlclcells),
+      [&] (const Int& i, Real& accum) {
+        const Real v = get_field_value(d, probs, nt, nlclcells, tb, ns, kf, i);
+        accum = impl::max(accum, v < 0 ? -v : v);
+      },
+      Kokkos::Max<Real>(accum));
+    send(kf) = accum;
+  };
+  Kokkos::parallel_for(ESU::get_default_team_policy(4*ns, nlclcells),
+                       calc_maxabs);
+  Kokkos::fence();
+  const int err = mpi::all_reduce(*p_, send_.data(), scale_h_.data(), 4*ns,
+                                  MPI_MAX);
+  cedr_throw_if(err != MPI_SUCCESS,
+                "CAAS::calc_fixed_scales MPI_Allreduce returned " << err);
+  prof_msg(true, 4*ns*sizeof(Real));
+  prof_msg(false, 4*ns*sizeof(Real));
+  for (Int kf = 0; kf < 4*ns; ++kf)
+    scale_h_(kf) = FixedPoint::get_scale(scale_h_(kf));
+  Kokkos::deep_copy(scale_, scale_h_);
+}
+
+// Like reduce_locally, but sum into fixed-point limbs.
+template <typename ES>
+void CAAS<ES>::reduce_locally_fixed () {
+  using ESU = cedr::impl::ExeSpaceUtils<ES>;
+  static constexpr int nlimb = FixedPoint::nlimb;
+  typedef Kokkos::LongN<4*nlimb> Accum;
+  ConstExceptGnu Int nt = probs_.size(), nlclcells = nlclcells_;
+  ConstExceptGnu Int tb = tb_, ns = te_ - tb_;
+  const auto probs = probs_;
+  const auto fsend = fsend_;
+  const auto scale = scale_;
+  const auto d = d_;
+  // One team per tracer, since the tracer's Qm is clipped in place after all
+  // four of its fields are read.
+  const auto calc_Qm_clip = KOKKOS_LAMBDA (const typename ESU::Member& t) {
+    const auto ks = t.league_rank();
+    const auto os = (tb + ks)*nlclcells;
+    const auto reduce = [&] (const Int& i, Accum& accum) {
+      Real Qm_clip = 0;
+      for (Int f = 0; f < 4; ++f) {
+        const Int kf = f*ns + ks;
+        const Real v = get_field_value(d, probs, nt, nlclcells, tb, ns, kf, i);
+        if (f == 0) Qm_clip = v;
+        FixedPoint::add(scale(kf)*v, &accum.v[f*nlimb]);
+      }
+      d(os+i) = Qm_clip;
+    };
+    Accum accum;
+    Kokkos::parallel_reduce(Kokkos::TeamThreadRange(t, nlclcells),
+                            reduce, Kokkos::Sum<Accum>(accum));
+    for (Int f = 0; f < 4; ++f)
+      for (Int l = 0; l < nlimb; ++l)
+        fsend((f*ns + ks)*nlimb + l) = accum.v[f*nlimb + l];
+  };
+  Kokkos::parallel_for(ESU::get_default_team_policy(ns, nlclcells),
+                       calc_Qm_clip);
+}
+
+template <typename ES>
+void CAAS<ES>::reduce_globally_fixed_begin () {
+  Kokkos::fence();
+  const int err = start_reduce(fsend_.data(), frecv_.data(),
+                               4*(te_ - tb_)*FixedPoint::nlimb, 1);
+  cedr_throw_if(err != MPI_SUCCESS,
+                "CAAS::reduce_globally_fixed_begin MPI_Iallreduce returned " << err);
+  prof_msg(true, 4*(te_ - tb_)*FixedPoint::nlimb*sizeof(Long));
+  prof_msg(false, 4*(te_ - tb_)*FixedPoint::nlimb*sizeof(Long));
+}
+
+template <typename ES>
+void CAAS<ES>::reduce_globally_fixed_end () {
+  prof_start(Profile::wait);
+  const int err = mpi::wait(active_req_);
+  prof_stop(Profile::wait);
+  cedr_throw_if(err != MPI_SUCCESS,
+                "CAAS::reduce_globally_fixed_end MPI_Wait returned " << err);
+  const auto frecv = frecv_;
+  const auto recv = recv_;
+  const auto scale = scale_;
+  const auto to_real = KOKKOS_LAMBDA (const Int& kf) {
+    // Division by a power of 2 is exact.
+    recv(kf) = FixedPoint::to_real(&frecv(kf*FixedPoint::nlimb)) / scale(kf);
+  };
+  Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, 4*(te_ - tb_)), to_real);
 }
 
 template <typename ES>
 void CAAS<ES>::finish_locally () {
   using ESU = cedr::impl::ExeSpaceUtils<ES>;
   ConstExceptGnu Int nt = probs_.size(), nlclcells = nlclcells_;
+  ConstExceptGnu Int tb = tb_, ns = te_ - tb_;
   const auto recv = recv_;
   const auto d = d_;
   const auto adjust_Qm = KOKKOS_LAMBDA (const typename ESU::Member& t) {
-    const auto k = t.league_rank();
-    const auto os = (k+1)*nlclcells;
-    const auto Qm_clip_sum = recv(     k);
-    const auto Qm_sum      = recv(nt + k);
+    const auto ks = t.league_rank();
+    const auto k = tb + ks;
+    const auto os = k*nlclcells;
+    const auto Qm_clip_sum = recv(     ks);
+    const auto Qm_sum      = recv(ns + ks);
     const auto m = Qm_sum - Qm_clip_sum;
     if (m < 0) {
-      const auto Qm_min_sum = recv(2*nt + k);
+      const auto Qm_min_sum = recv(2*ns + ks);
       auto fac = Qm_clip_sum - Qm_min_sum;
       if (fac > 0) {
         fac = m/fac;
@@ -232,7 +500,7 @@ void CAAS<ES>::finish_locally () {
         Kokkos::parallel_for(Kokkos::TeamThreadRange(t, nlclcells), adjust);
       }
     } else if (m > 0) {
-      const auto Qm_max_sum = recv(3*nt + k);
+      const auto Qm_max_sum = recv(3*ns + ks);
       auto fac = Qm_max_sum - Qm_clip_sum;
       if (fac > 0) {
         fac = m/fac;
@@ -246,21 +514,159 @@ void CAAS<ES>::finish_locally () {
       }
     }
   };
-  Kokkos::parallel_for(ESU::get_default_team_policy(nt, nlclcells),
+  Kokkos::parallel_for(ESU::get_default_team_policy(ns, nlclcells),
                        adjust_Qm);
 }
 
+template <typename ES>
+void CAAS<ES>::set_tracer_range (const Int& tracer_begin, const Int& tracer_end) {
+  cedr_throw_if(tracer_begin < 0 || tracer_end > get_num_tracers() ||
+                tracer_begin >= tracer_end,
+                "CAAS: tracer range [" << tracer_begin << ", " << tracer_end
+                << ") is invalid; #tracers is " << get_num_tracers());
+  tb_ = tracer_begin*nbatch_;
+  te_ = tracer_end*nbatch_;
+}
+
 template <typename ES>
 void CAAS<ES>::run () {
+  run(0, get_num_tracers());
+}
+
+template <typename ES>
+void CAAS<ES>::run (const Int& tracer_begin, const Int& tracer_end) {
+  cedr_assert(finished_setup_);
+  prof_start(Profile::run);
+  set_tracer_range(tracer_begin, tracer_end);
+  if (options_.reproducible_sums) {
+    prof_start(Profile::reduce);
+    calc_fixed_scales();
+    prof_stop(Profile::reduce, false);
+    prof_start(Profile::local);
+    reduce_locally_fixed();
+    prof_stop(Profile::local, false);
+    prof_start(Profile::reduce);
+    reduce_globally_fixed_begin();
+    reduce_globally_fixed_end();
+    prof_stop(Profile::reduce);
+  } else {
+    prof_start(Profile::local);
+    reduce_locally();
+    prof_stop(Profile::local, false);
+    prof_start(Profile::reduce);
+    user_reduce_or_else([&] () { reduce_globally(); });
+    prof_stop(Profile::reduce);
+  }
+  prof_start(Profile::local);
+  finish_locally();
+  prof_stop(Profile::local);
+  prof_stop(Profile::run);
+}
+
+template <typename ES>
+void CAAS<ES>::run_begin () {
+  run_begin(0, get_num_tracers());
+}
+
+template <typename ES>
+void CAAS<ES>::run_begin (const Int& tracer_begin, const Int& tracer_end) {
   cedr_assert(finished_setup_);
-  reduce_locally();
+  prof_start(Profile::run);
+  set_tracer_range(tracer_begin, tracer_end);
+  if (options_.reproducible_sums) {
+    // The max reduction for the scales is blocking; the sum is split-phase.
+    prof_start(Profile::reduce);
+    calc_fixed_scales();
+    prof_stop(Profile::reduce, false);
+    prof_start(Profile::local);
+    reduce_locally_fixed();
+    prof_stop(Profile::local, false);
+    prof_start(Profile::reduce);
+    reduce_globally_fixed_begin();
+  } else {
+    prof_start(Profile::local);
+    reduce_locally();
+    prof_stop(Profile::local, false);
+    prof_start(Profile::reduce);
+    user_reduce_or_else([&] () { reduce_globally_begin(); });
+  }
+  prof_stop(Profile::reduce, false);
+  prof_stop(Profile::run, false);
+}
+
+template <typename ES>
+void CAAS<ES>::run_end () {
+  prof_start(Profile::run);
+  prof_start(Profile::reduce);
   const bool user_reduces = user_reducer_ != nullptr;
-  if (user_reduces)
-    (*user_reducer_)(*p_, send_.data(), recv_.data(),
-                     nlclcells_, recv_.size(), MPI_SUM);
-  else
-    reduce_globally();
+  if (options_.reproducible_sums)
+    reduce_globally_fixed_end();
+  else if ( ! user_reduces)
+    reduce_globally_end();
+  prof_stop(Profile::reduce);
+  prof_start(Profile::local);
   finish_locally();
+  prof_stop(Profile::local);
+  prof_stop(Profile::run);
+}
+
+// Call the UserAllReducer, if there is one, or else reduce.
+template <typename ES>
+template <typename Reduce>
+void CAAS<ES>::user_reduce_or_else (const Reduce& reduce) {
+  if ( ! user_reducer_) {
+    reduce();
+    return;
+  }
+  (*user_reducer_)(*p_, send_.data(), recv_.data(),
+                   nlclcells_, 4*(te_ - tb_), MPI_SUM);
+  prof_msg(true, 4*(te_ - tb_)*sizeof(Real));
+  prof_msg(false, 4*(te_ - tb_)*sizeof(Real));
+}
+
+template <typename ES>
+NodeAwareAllReducer<ES>::NodeAwareAllReducer (const mpi::Parallel& p,
+                                              const Int max_node_size)
+  : np_(std::make_shared<mpi::NodeParallel>(p, max_node_size))
+{}
+
+template <typename ES>
+int NodeAwareAllReducer<ES>
+::operator() (const mpi::Parallel& p, Real* sendbuf, Real* rcvbuf,
+              int nlocal, int nfld, MPI_Op op) const {
+  cedr_throw_if(op != MPI_SUM, "NodeAwareAllReducer supports only MPI_SUM.");
+  if (lcl_.extent_int(0) < nfld) {
+    lcl_ = RealList("NodeAwareAllReducer lcl", nfld);
+    node_ = RealList("NodeAwareAllReducer node", nfld);
+  }
+  // Reduce over this rank's values.
+  using ESU = cedr::impl::ExeSpaceUtils<ES>;
+  const cedr::impl::Unmanaged<RealList> send(sendbuf, nlocal*nfld);
+  const auto lcl = lcl_;
+  const auto reduce = KOKKOS_LAMBDA (const typename ESU::Member& t) {
+    const auto k = t.league_rank();
+    Real accum = 0;
+    Kokkos::parallel_reduce(Kokkos::TeamThreadRange(t, nlocal),
+                            [&] (const Int& i, Real& accum) {
+                              accum += send(nlocal*k + i);
+                            },
+                            Kokkos::Sum<Real>(accum));
+    lcl(k) = accum;
+  };
+  Kokkos::parallel_for(ESU::get_default_team_policy(nfld, nlocal), reduce);
+  Kokkos::fence();
+  // Reduce over the node, then over the node leaders, then broadcast within
+  // the node. Every rank takes part in the node collectives even if an earlier
+  // call failed, so that no rank is left waiting.
+  const auto& node = np_->node();
+  int err = mpi::reduce(node, lcl_.data(), node_.data(), nfld, op, node.root());
+  if (np_->amleader()) {
+    const int e = mpi::all_reduce(*np_->leaders(), node_.data(), rcvbuf, nfld, op);
+    if (err == MPI_SUCCESS) err = e;
+  }
+  const int e = mpi::bcast(node, rcvbuf, nfld, node.root());
+  if (err == MPI_SUCCESS) err = e;
+  return err;
 }
 
 namespace test {
@@ -287,19 +693,27 @@ struct TestCAAS : public cedr::test::TestRandomized {
     }
   };
 
+  enum Reducer { mpi_allreduce, test_reducer, node_aware };
+
   TestCAAS (const mpi::Parallel::Ptr& p, const Int& ncells,
-            const bool use_own_reducer, const bool external_memory,
-            const bool verbose)
-    : TestRandomized("CAAS", p, ncells, verbose),
-      p_(p), external_memory_(external_memory)
+            const Reducer reducer, const bool external_memory,
+            const bool subsets, const bool verbose,
+            const CDR::Options options = CDR::Options(), const Int nrhom = 1)
+    : TestRandomized("CAAS", p, ncells, verbose, options, nrhom),
+      p_(p), external_memory_(external_memory), subsets_(subsets)
   {
     const auto np = p->size(), rank = p->rank();
     nlclcells_ = ncells / np;
     const Int todo = ncells - nlclcells_ * np;
     if (rank < todo) ++nlclcells_;
-    caas_ = std::make_shared<CAAST>(
-      p, nlclcells_,
-      use_own_reducer ? std::make_shared<TestAllReducer>() : nullptr);
+    typename CAAST::UserAllReducer::Ptr uar;
+    if (reducer == test_reducer)
+      uar = std::make_shared<TestAllReducer>();
+    else if (reducer == node_aware)
+      // Use small nodes so that the leader allreduce has multiple ranks.
+      uar = std::make_shared<NodeAwareAllReducer<Kokkos::DefaultExecutionSpace> >(
+        *p, 2);
+    caas_ = std::make_shared<CAAST>(p, nlclcells_, uar, options);
     init();
   }
 
@@ -325,7 +739,7 @@ struct TestCAAS : public cedr::test::TestRandomized {
         continue;
       t.idx = idx++;
       tracers.push_back(t);
-      caas_->declare_tracer(t.problem_type, 0);
+      caas_->declare_tracer(t.problem_type, t.rhomidx);
     }
     tracers_ = tracers;
     caas_->end_tracer_declarations();
@@ -340,12 +754,24 @@ struct TestCAAS : public cedr::test::TestRandomized {
   }
 
   void run_impl (const Int trial) override {
-    caas_->run();
+    // Optionally run the tracers in two separate subsets.
+    const Int nt = caas_->get_num_tracers();
+    const Int nsub = subsets_ && nt > 1 ? 2 : 1;
+    for (Int si = 0; si < nsub; ++si) {
+      const Int tb = (si*nt)/nsub, te = ((si+1)*nt)/nsub;
+      // Alternate between the blocking and split-phase interfaces.
+      if (trial % 2 == 0) {
+        caas_->run(tb, te);
+      } else {
+        caas_->run_begin(tb, te);
+        caas_->run_end();
+      }
+    }
   }
 
 private:
   mpi::Parallel::Ptr p_;
-  bool external_memory_;
+  bool external_memory_, subsets_;
   Int nlclcells_;
   CAAST::Ptr caas_;
   typename CAAST::RealList buf1_, buf2_;
@@ -358,16 +784,82 @@ private:
   }
 };
 
+// Fixed-point sums must be exact, hence independent of order, and accurate.
+static Int test_fixed_point () {
+  const Int n = 1000;
+  std::vector<Real> x(n);
+  Real maxabs = 0;
+  for (Int i = 0; i < n; ++i) {
+    // Span several orders of magnitude.
+    x[i] = (util::urand() - 0.5)*std::pow(10.0, -6*util::urand());
+    maxabs = std::max(maxabs, std::abs(x[i]));
+  }
+  const Real scale = FixedPoint::get_scale(maxabs);
+  const auto sum = [&] (const Int os, const Int stride) {
+    Long s[FixedPoint::nlimb] = {0};
+    for (Int k = 0; k < n; ++k)
+      FixedPoint::add(scale*x[(os + k*stride) % n], s);
+    return FixedPoint::to_real(s)/scale;
+  };
+  long double sum_ld = 0;
+  for (Int i = 0; i < n; ++i) sum_ld += x[i];
+  Int nerr = 0;
+  const Real s0 = sum(0, 1);
+  // Orders of the permutations i -> (os + k*stride) % n with stride coprime to n.
+  for (const Int stride : {1, 3, 7, 999})
+    for (const Int os : {0, 1, 500})
+      if (sum(os, stride) != s0) ++nerr;
+  if (std::abs(s0 - Real(sum_ld)) > 2*std::numeric_limits<Real>::epsilon()*maxabs)
+    ++nerr;
+  if (nerr) std::cout << "FAIL: caas::test_fixed_point\n";
+  return nerr;
+}
+
 Int unittest (const mpi::Parallel::Ptr& p) {
   const auto np = p->size();
   Int nerr = 0;
+  if (p->amroot()) nerr += test_fixed_point();
   for (Int nlclcells : {1, 2, 4, 11}) {
+    CDR::Options options;
+    options.profile = true;
     Long ncells = np*nlclcells;
     if (ncells > np) ncells -= np/2;
-    for (const bool own_reducer : {false, true})
+    for (const auto reducer : {TestCAAS::mpi_allreduce, TestCAAS::test_reducer,
+                               TestCAAS::node_aware})
       for (const bool external_memory : {false, true})
-        nerr += TestCAAS(p, ncells, own_reducer, external_memory, false)
-          .run<TestCAAS::CAAST>(1, false);
+        for (const bool subsets : {false, true})
+          nerr += TestCAAS(p, ncells, reducer, external_memory, subsets, false,
+                           options)
+            .run<TestCAAS::CAAST>(1, false);
+    options.reproducible_sums = true;
+    for (const bool subsets : {false, true})
+      nerr += TestCAAS(p, ncells, TestCAAS::mpi_allreduce, false, subsets, false,
+                       options)
+        .run<TestCAAS::CAAST>(1, false);
+    // Tracers of two densities in one instance.
+    options.reproducible_sums = false;
+    for (const bool external_memory : {false, true})
+      nerr += TestCAAS(p, ncells, TestCAAS::mpi_allreduce, external_memory, true,
+                       false, options, 2)
+        .run<TestCAAS::CAAST>(1, false);
+  }
+  { // A batch of problems in one instance vs. each alone. Reproducible sums
+    // make the comparison independent of the size of the allreduce.
+    typedef TestCAAS::CAAST CAAST;
+    typedef ProblemType PT;
+    const Int nlclcells = 7;
+    std::vector<Long> gcis(nlclcells);
+    for (Int i = 0; i < nlclcells; ++i) gcis[i] = p->rank()*nlclcells + i;
+    const std::vector<int> probs = {
+      PT::conserve | PT::shapepreserve, PT::shapepreserve,
+      PT::conserve | PT::shapepreserve};
+    CDR::Options options;
+    options.reproducible_sums = true;
+    nerr += cedr::test::test_batch<CAAST>(
+      "CAAS", *p, gcis, probs, 4, options,
+      [&] (const CDR::Options& o) {
+        return std::make_shared<CAAST>(p, nlclcells, nullptr, o);
+      });
   }
   return nerr;
 }
@@ -377,13 +869,17 @@ Int unittest (const mpi::Parallel::Ptr& p) {
 
 #ifdef KOKKOS_ENABLE_SERIAL
 template class cedr::caas::CAAS<Kokkos::Serial>;
+template class cedr::caas::NodeAwareAllReducer<Kokkos::Serial>;
 #endif
 #ifdef KOKKOS_ENABLE_OPENMP
 template class cedr::caas::CAAS<Kokkos::OpenMP>;
+template class cedr::caas::NodeAwareAllReducer<Kokkos::OpenMP>;
 #endif
 #ifdef KOKKOS_ENABLE_CUDA
 template class cedr::caas::CAAS<Kokkos::Cuda>;
+template class cedr::caas::NodeAwareAllReducer<Kokkos::Cuda>;
 #endif
 #ifdef KOKKOS_ENABLE_THREADS
 template class cedr::caas::CAAS<Kokkos::Threads>;
+template class cedr::caas::NodeAwareAllReducer<Kokkos::Threads>;
 #endif
@@ -33,8 +33,10 @@ public:
                            MPI_Op op) const = 0;
   };
 
+  // If options.reproducible_sums, r must be null.
   CAAS(const mpi::Parallel::Ptr& p, const Int nlclcells,
-       const typename UserAllReducer::Ptr& r = nullptr);
+       const typename UserAllReducer::Ptr& r = nullptr,
+       const CDR::Options options = CDR::Options());
 
   void declare_tracer(int problem_type, const Int& rhomidx) override;
 
@@ -61,12 +63,39 @@ public:
 
   void run() override;
 
+  // run_begin() starts the global reduction with MPI_Iallreduce. If a
+  // UserAllReducer is provided, the reduction is done in run_begin().
+  void run_begin() override;
+  void run_end() override;
+
+  // Run only tracers tracer_begin to tracer_end-1, leaving the others
+  // untouched. The global reduction has 4*nbatch*(tracer_end - tracer_begin)
+  // values, and the UserAllReducer, if provided, is called with that nfld.
+  void run(const Int& tracer_begin, const Int& tracer_end);
+  void run_begin(const Int& tracer_begin, const Int& tracer_end);
+
   KOKKOS_INLINE_FUNCTION
   Real get_Qm(const Int& lclcellidx, const Int& tracer_idx) const override;
 
+  // Access batch instance batchidx; see CDR::Options::nbatch.
+  KOKKOS_INLINE_FUNCTION
+  void set_batch_rhom(const Int& lclcellidx, const Int& batchidx,
+                      const Int& rhomidx, const Real& rhom) const;
+
+  KOKKOS_INLINE_FUNCTION
+  void set_batch_Qm(const Int& lclcellidx, const Int& batchidx,
+                    const Int& tracer_idx,
+                    const Real& Qm, const Real& Qm_min, const Real& Qm_max,
+                    const Real Qm_prev = std::numeric_limits<Real>::infinity()) const;
+
+  KOKKOS_INLINE_FUNCTION
+  Real get_batch_Qm(const Int& lclcellidx, const Int& batchidx,
+                    const Int& tracer_idx) const;
+
 protected:
   typedef cedr::impl::Unmanaged<RealList> UnmanagedRealList;
   typedef Kokkos::View<Int*, Kokkos::LayoutLeft, Device> IntList;
+  typedef Kokkos::View<Long*, Kokkos::LayoutLeft, Device> LongList;
 
   struct Decl {
     int probtype;
@@ -78,24 +107,74 @@ protected:
   mpi::Parallel::Ptr p_;
   typename UserAllReducer::Ptr user_reducer_;
 
-  Int nlclcells_, nrhomidxs_;
+  // nrhomidxs_ and probs_ count batch instances: declared tracer t is
+  // tracers t*nbatch_ to (t+1)*nbatch_-1 below, and likewise for rhoms.
+  Int nlclcells_, nbatch_, nrhomidxs_;
   std::shared_ptr<std::vector<Decl> > tracer_decls_;
   bool need_conserve_;
-  IntList probs_, t2r_;
+  IntList probs_;
   typename IntList::HostMirror probs_h_;
   RealList d_, send_, recv_;
   bool finished_setup_;
+  mpi::Request reduce_req_;
+#ifdef COMPOSE_HAVE_MPI_ALLREDUCE_INIT
+  // Persistent all_reduces over all tracers, as Reals and as fixed-point limbs,
+  // made in finish_setup. Runs over a tracer subrange use nonpersistent ones.
+  mpi::PersistentRequests::Ptr preqs_;
+#endif
+  // The request reduce_globally*_end waits on.
+  mpi::Request* active_req_;
+  // Tracers [tb_, te_), counting batch instances, are being run.
+  Int tb_, te_;
+  // For reproducible sums: the fixed-point sums and the per-field scales.
+  LongList fsend_, frecv_;
+  RealList scale_;
+  typename RealList::HostMirror scale_h_;
+
+  void set_tracer_range(const Int& tracer_begin, const Int& tracer_end);
+  void init_requests();
+  // Start the sum of send into recv, with persistent request preqi if possible.
+  template <typename T>
+  int start_reduce(const T* send, T* recv, const Int& count, const Int& preqi);
 
   void reduce_globally();
+  void reduce_globally_begin();
+  void reduce_globally_end();
+  template <typename Reduce> void user_reduce_or_else(const Reduce& reduce);
 
 PRIVATE_CUDA:
   void reduce_locally();
   void finish_locally();
+  void calc_fixed_scales();
+  void reduce_locally_fixed();
+  void reduce_globally_fixed_begin();
+  void reduce_globally_fixed_end();
 
 private:
   void get_buffers_sizes(size_t& buf1, size_t& buf2, size_t& buf3);
 };
 
+// A UserAllReducer that reduces hierarchically: over the ranks on each
+// shared-memory node, then over the node leaders, and then broadcasts the
+// result to the ranks on each node. Only #nodes ranks take part in the
+// inter-node allreduce.
+template <typename ExeSpace = Kokkos::DefaultExecutionSpace>
+class NodeAwareAllReducer : public CAAS<ExeSpace>::UserAllReducer {
+public:
+  typedef typename CAAS<ExeSpace>::RealList RealList;
+
+  // Collective on p. The p passed to operator() must be this one.
+  // max_node_size is passed to mpi::NodeParallel.
+  NodeAwareAllReducer(const mpi::Parallel& p, const Int max_node_size = 0);
+
+  int operator()(const mpi::Parallel& p, Real* sendbuf, Real* rcvbuf,
+                 int nlocal, int nfld, MPI_Op op) const override;
+
+private:
+  mpi::NodeParallel::Ptr np_;
+  mutable RealList lcl_, node_;
+};
+
 namespace test {
 Int unittest(const mpi::Parallel::Ptr& p);
 } // namespace test
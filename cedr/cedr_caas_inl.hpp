@@ -13,9 +13,7 @@ namespace caas {
 template <typename ES> KOKKOS_INLINE_FUNCTION
 void CAAS<ES>::set_rhom (const Int& lclcellidx, const Int& rhomidx,
                          const Real& rhom) const {
-  cedr_kernel_assert(lclcellidx >= 0 && lclcellidx < nlclcells_);
-  cedr_kernel_assert(rhomidx >= 0 && rhomidx < nrhomidxs_);
-  d_(lclcellidx) = rhom;
+  set_batch_rhom(lclcellidx, 0, rhomidx, rhom);
 }
 
 template <typename ES> KOKKOS_INLINE_FUNCTION
@@ -23,21 +21,52 @@ void CAAS<ES>
 ::set_Qm (const Int& lclcellidx, const Int& tracer_idx,
           const Real& Qm, const Real& Qm_min, const Real& Qm_max,
           const Real Qm_prev) const {
+  set_batch_Qm(lclcellidx, 0, tracer_idx, Qm, Qm_min, Qm_max, Qm_prev);
+}
+
+template <typename ES> KOKKOS_INLINE_FUNCTION
+Real CAAS<ES>::get_Qm (const Int& lclcellidx, const Int& tracer_idx) const {
+  return get_batch_Qm(lclcellidx, 0, tracer_idx);
+}
+
+template <typename ES> KOKKOS_INLINE_FUNCTION
+void CAAS<ES>::set_batch_rhom (const Int& lclcellidx, const Int& batchidx,
+                               const Int& rhomidx, const Real& rhom) const {
   cedr_kernel_assert(lclcellidx >= 0 && lclcellidx < nlclcells_);
-  cedr_kernel_assert(tracer_idx >= 0 && tracer_idx < probs_.extent_int(0));
+  cedr_kernel_assert(batchidx >= 0 && batchidx < nbatch_);
+  const Int ri = rhomidx*nbatch_ + batchidx;
+  cedr_kernel_assert(ri >= 0 && ri < nrhomidxs_);
+  // The rhoms follow the tracer data.
+  const Int nf = (need_conserve_ ? 4 : 3)*probs_.extent_int(0);
+  d_((nf + ri)*nlclcells_ + lclcellidx) = rhom;
+}
+
+template <typename ES> KOKKOS_INLINE_FUNCTION
+void CAAS<ES>
+::set_batch_Qm (const Int& lclcellidx, const Int& batchidx,
+                const Int& tracer_idx,
+                const Real& Qm, const Real& Qm_min, const Real& Qm_max,
+                const Real Qm_prev) const {
+  cedr_kernel_assert(lclcellidx >= 0 && lclcellidx < nlclcells_);
+  cedr_kernel_assert(batchidx >= 0 && batchidx < nbatch_);
+  const Int ti = tracer_idx*nbatch_ + batchidx;
+  cedr_kernel_assert(ti >= 0 && ti < probs_.extent_int(0));
   const Int nt = probs_.size();
-  d_((1 +               tracer_idx)*nlclcells_ + lclcellidx) = Qm;
-  d_((1 +   nt + tracer_idx)*nlclcells_ + lclcellidx) = Qm_min;
-  d_((1 + 2*nt + tracer_idx)*nlclcells_ + lclcellidx) = Qm_max;
+  d_((       ti)*nlclcells_ + lclcellidx) = Qm;
+  d_((  nt + ti)*nlclcells_ + lclcellidx) = Qm_min;
+  d_((2*nt + ti)*nlclcells_ + lclcellidx) = Qm_max;
   if (need_conserve_)
-    d_((1 + 3*nt + tracer_idx)*nlclcells_ + lclcellidx) = Qm_prev;
+    d_((3*nt + ti)*nlclcells_ + lclcellidx) = Qm_prev;
 }
 
 template <typename ES> KOKKOS_INLINE_FUNCTION
-Real CAAS<ES>::get_Qm (const Int& lclcellidx, const Int& tracer_idx) const {
+Real CAAS<ES>::get_batch_Qm (const Int& lclcellidx, const Int& batchidx,
+                             const Int& tracer_idx) const {
   cedr_kernel_assert(lclcellidx >= 0 && lclcellidx < nlclcells_);
-  cedr_kernel_assert(tracer_idx >= 0 && tracer_idx < probs_.extent_int(0));
-  return d_((1 + tracer_idx)*nlclcells_ + lclcellidx);
+  cedr_kernel_assert(batchidx >= 0 && batchidx < nbatch_);
+  const Int ti = tracer_idx*nbatch_ + batchidx;
+  cedr_kernel_assert(ti >= 0 && ti < probs_.extent_int(0));
+  return d_(ti*nlclcells_ + lclcellidx);
 }
 
 } // namespace caas
@@ -0,0 +1,83 @@
+// COMPOSE version 1.0: Copyright 2018 NTESS. This software is released under
+// the BSD license; see LICENSE in the top-level directory.
+
+#include "cedr_cdr.hpp"
+#include "cedr_util.hpp"
+
+#include <cstdio>
+
+namespace cedr {
+
+const char* CDR::Profile::get_phase_name (const Int phase) {
+  static const char* names[] = {"setup", "run", "l2r", "r2l", "local", "reduce",
+                                "wait"};
+  cedr_assert(phase >= 0 && phase < nphase);
+  return names[phase];
+}
+
+void CDR::Profile::reset () {
+  for (Int i = 0; i < nphase; ++i) {
+    time[i] = 0;
+    ncall[i] = 0;
+  }
+  nmsg_sent = nmsg_recvd = nbyte_sent = nbyte_recvd = 0;
+}
+
+void CDR::set_profiling (const bool on, const bool kokkos_tools_regions) {
+  prof_->on = on;
+  prof_->regions = on && kokkos_tools_regions;
+}
+
+CDR::ProfileSummary CDR::summarize_profile (const mpi::Parallel& p) const {
+  static const Int np = Profile::nphase, n = 2*np + 4;
+  const auto& pr = prof_->p;
+  Real v[n], min[n], sum[n];
+  for (Int i = 0; i < np; ++i) {
+    v[i] = pr.time[i];
+    v[np+i] = pr.ncall[i];
+  }
+  v[2*np] = pr.nmsg_sent; v[2*np+1] = pr.nmsg_recvd;
+  v[2*np+2] = pr.nbyte_sent; v[2*np+3] = pr.nbyte_recvd;
+  mpi::all_reduce(p, v, min, n, MPI_MIN);
+  mpi::all_reduce(p, v, sum, n, MPI_SUM);
+  struct { double v; int rank; } vr[n], max[n];
+  for (Int i = 0; i < n; ++i) {
+    vr[i].v = v[i];
+    vr[i].rank = p.rank();
+  }
+  MPI_Allreduce(vr, max, n, MPI_DOUBLE_INT, MPI_MAXLOC, p.comm());
+  ProfileSummary s;
+  const auto set = [&] (ProfileSummary::Stat& st, const Int i) {
+    st.min = min[i];
+    st.max = max[i].v;
+    st.max_rank = max[i].rank;
+    st.mean = sum[i]/p.size();
+  };
+  for (Int i = 0; i < np; ++i) {
+    set(s.time[i], i);
+    set(s.ncall[i], np+i);
+  }
+  set(s.nmsg_sent, 2*np); set(s.nmsg_recvd, 2*np+1);
+  set(s.nbyte_sent, 2*np+2); set(s.nbyte_recvd, 2*np+3);
+  return s;
+}
+
+void CDR::ProfileSummary::print (std::ostream& os) const {
+  char buf[128];
+  const auto prrow = [&] (const char* name, const Stat& st, const Real ncall) {
+    snprintf(buf, sizeof(buf), "%-12s %10.3e %10.3e %10.3e %6d %10.1f\n",
+             name, st.min, st.max, st.mean, st.max_rank, ncall);
+    os << buf;
+  };
+  snprintf(buf, sizeof(buf), "%-12s %10s %10s %10s %6s %10s\n",
+           "", "min", "max", "mean", "argmax", "ncall");
+  os << buf;
+  for (Int i = 0; i < Profile::nphase; ++i)
+    prrow(Profile::get_phase_name(i), time[i], ncall[i].mean);
+  prrow("nmsg_sent", nmsg_sent, 0);
+  prrow("nmsg_recvd", nmsg_recvd, 0);
+  prrow("nbyte_sent", nbyte_sent, 0);
+  prrow("nbyte_recvd", nbyte_recvd, 0);
+}
+
+} // namespace cedr
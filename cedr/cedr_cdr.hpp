@@ -25,12 +25,97 @@ struct CDR {
     // the level of 10 to 1000 times numeric_limits<Real>::epsilon().
     bool prefer_numerical_mass_conservation_to_numerical_bounds;
 
+    // Make the result bit-for-bit independent of the number of ranks and the
+    // thread schedule. CAAS then computes its global sums in fixed-point
+    // arithmetic, at the cost of a second, small allreduce. QLT's sums are
+    // determined by the tree alone, so QLT is reproducible regardless.
+    bool reproducible_sums;
+
+    // Turn on profiling at construction so that setup is profiled, too. See
+    // set_profiling.
+    bool profile;
+
+    // QLT: where a rank pair exchanges messages at several levels, merge
+    // messages across levels whenever no receive comes between them, so that
+    // fewer, larger messages are on the critical path. Setup then communicates
+    // with each comm partner.
+    bool aggregate_messages;
+
+    // QLT: send the bound data of the leaves-to-root sweep, Qm_min and Qm_max
+    // or q_min and q_max, in single precision. Mass data remain double, so
+    // conservation is unaffected. A bound is rounded inward, so a bound that is
+    // satisfied remains so; but a node problem that is feasible only to within
+    // the rounding is solved as a safety problem, so bounds are then met only to
+    // single precision.
+    bool single_precision_bounds;
+
+    // QLT and CAAS: solve nbatch independent problems, e.g., one per vertical
+    // level, in each run. A tracer is declared once and has nbatch instances,
+    // as does each rhom; instance bi of a tracer is tied to instance bi of its
+    // rhom. Use the set_batch_{rhom,Qm} and get_batch_Qm methods of QLT and
+    // CAAS to access instance bi; the CDR methods access instance 0. All
+    // instances share the tree and communication schedule, and each message
+    // carries every instance. Instance bi of tracer t is solved as the tracer
+    // t*nbatch + bi, so QLT's slot data are (tracer, batch, field): each
+    // instance keeps a tracer's field layout, which the node kernels and
+    // message packing use unchanged, and consecutive threads take a tracer's
+    // instances.
+    Int nbatch;
+
+    // QLT, on the host with OpenMP: run the on-rank part of each sweep as
+    // OpenMP tasks over the tree rather than level by level, so that a node is
+    // processed as soon as its kids (leaves-to-root) or parent (root-to-leaves)
+    // are, without a barrier per level. This helps most on deep or imbalanced
+    // trees, whose upper levels have too few nodes to occupy the threads. MPI
+    // calls are made only by the master thread. Results are bit-for-bit the
+    // same as without. Ignored on the GPU and without OpenMP.
+    bool host_tasks;
+
     Options ()
-      : prefer_numerical_mass_conservation_to_numerical_bounds(false)
+      : prefer_numerical_mass_conservation_to_numerical_bounds(false),
+        reproducible_sums(false), profile(false), aggregate_messages(false),
+        single_precision_bounds(false), nbatch(1), host_tasks(false)
     {}
   };
 
-  CDR (const Options options = Options()) : options_(options) {}
+  // Per-instance profile. Phases nest: l2r and r2l are parts of run, and
+  // local, reduce, and wait are parts of those.
+  struct Profile {
+    enum Phase {
+      setup,  // Construction through finish_setup.
+      run,    // run, or run_begin and run_end.
+      l2r,    // QLT leaves-to-root sweep.
+      r2l,    // QLT root-to-leaves sweep.
+      local,  // On-rank computation: QLT's combining of kids' data and QPs;
+              // CAAS's local reductions and final update.
+      reduce, // CAAS global reduction.
+      wait,   // Blocked in an MPI wait.
+      nphase
+    };
+    static const char* get_phase_name(const Int phase);
+
+    Real time[nphase]; // Wall-clock seconds.
+    Long ncall[nphase];
+    Long nmsg_sent, nmsg_recvd, nbyte_sent, nbyte_recvd;
+
+    Profile () { reset(); }
+    void reset();
+  };
+
+  // Profile counters over the ranks of a communicator.
+  struct ProfileSummary {
+    struct Stat {
+      Real min, max, mean;
+      Int max_rank; // The lowest rank having the max.
+    };
+    Stat time[Profile::nphase], ncall[Profile::nphase];
+    Stat nmsg_sent, nmsg_recvd, nbyte_sent, nbyte_recvd;
+    void print(std::ostream& os) const;
+  };
+
+  CDR (const Options options = Options())
+    : options_(options), prof_(std::make_shared<ProfileState>())
+  { prof_->on = options.profile; }
 
   virtual void print(std::ostream& os) const {}
 
@@ -40,7 +125,10 @@ struct CDR {
   // index in the caller's numbering. Once end_tracer_declarations is called, it
   // is an error to call declare_tracer again.
   //   Associate the tracer with a rhom index. In many problems, there will be
-  // only one rhom, so rhomidx is always 0.
+  // only one rhom, so rhomidx is always 0. Tracers tied to different total
+  // densities, e.g., dry and moist air mass, can share one CDR instance, and
+  // thus one global reduction per run; use rhomidx 0, 1, ..., and call set_rhom
+  // for each.
   //   It is an error to call this function from a parallel region.
   virtual void declare_tracer(int problem_type, const Int& rhomidx) = 0;
 
@@ -97,12 +185,64 @@ struct CDR {
   // call this function from a parallel region.
   virtual void run() = 0;
 
+  // Optional split-phase form of run(). run_begin() does the local work and
+  // starts the communication; run_end() completes it. Between the two calls,
+  // the caller may do other work, but it must not call set_{rhom,Qm} or
+  // get_Qm. The default implementation does all the work in run_begin(). It is
+  // an error to call these functions from a parallel region.
+  virtual void run_begin () { run(); }
+  virtual void run_end () {}
+
   // Get a cell's tracer mass Qm after the QLT algorithm has run.
   KOKKOS_FUNCTION
   virtual Real get_Qm(const Int& lclcellidx, const Int& tracer_idx) const = 0;
 
+  // Switch profiling on or off. It is off by default, and its cost when on is
+  // a clock read per phase entry and exit. Optionally, also mark each phase as
+  // a Kokkos Tools region named "CEDR::<phase>". Copies of this CDR share its
+  // profile. On the GPU, the time of a kernel that is still running when a
+  // phase ends is attributed to a later phase.
+  void set_profiling(const bool on, const bool kokkos_tools_regions = false);
+  bool get_profiling () const { return prof_->on; }
+  // This rank's counters.
+  const Profile& get_profile () const { return prof_->p; }
+  void reset_profile () { prof_->p.reset(); }
+  // Collective on p. Gather the counters' statistics over p's ranks.
+  ProfileSummary summarize_profile(const mpi::Parallel& p) const;
+
 protected:
   Options options_;
+
+  // Time a phase. If ! count, the phase's time accumulates, but its call count
+  // does not increase, as for run_begin.
+  void prof_start (const Profile::Phase phase) const {
+    if ( ! prof_->on) return;
+    if (prof_->regions)
+      Kokkos::Profiling::pushRegion(std::string("CEDR::") +
+                                    Profile::get_phase_name(phase));
+    prof_->t0[phase] = MPI_Wtime();
+  }
+  void prof_stop (const Profile::Phase phase, const bool count = true) const {
+    if ( ! prof_->on) return;
+    prof_->p.time[phase] += MPI_Wtime() - prof_->t0[phase];
+    if (count) ++prof_->p.ncall[phase];
+    if (prof_->regions) Kokkos::Profiling::popRegion();
+  }
+  // Count a posted send or receive of nbyte bytes.
+  void prof_msg (const bool sent, const Long nbyte) const {
+    if ( ! prof_->on) return;
+    if (sent) { ++prof_->p.nmsg_sent; prof_->p.nbyte_sent += nbyte; }
+    else { ++prof_->p.nmsg_recvd; prof_->p.nbyte_recvd += nbyte; }
+  }
+
+private:
+  struct ProfileState {
+    Profile p;
+    Real t0[Profile::nphase];
+    bool on, regions;
+    ProfileState () : on(false), regions(false) {}
+  };
+  std::shared_ptr<ProfileState> prof_;
 };
 } // namespace cedr
 
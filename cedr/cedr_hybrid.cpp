@@ -0,0 +1,197 @@
+// COMPOSE version 1.0: Copyright 2018 NTESS. This software is released under
+// the BSD license; see LICENSE in the top-level directory.
+
+#include "cedr_hybrid.hpp"
+#include "cedr_test_randomized.hpp"
+
+namespace cedr {
+namespace hybrid {
+
+template <typename ES>
+QLTCAAS<ES>::QLTCAAS (const mpi::Parallel::Ptr& p,
+                      const mpi::NodeParallel::Ptr& np,
+                      const Int& ncells, const qlt::tree::Node::Ptr& tree,
+                      CDR::Options options)
+  : Super(std::make_shared<mpi::Parallel>(np->node().comm()), ncells, tree,
+          options),
+    p_all_(p), np_(np)
+{
+  cedr_throw_if(options.reproducible_sums,
+                "QLTCAAS does not support reproducible_sums.");
+}
+
+template <typename ES>
+void QLTCAAS<ES>::declare_tracer (int problem_type, const Int& rhomidx) {
+  cedr_throw_if( ! (problem_type & ProblemType::shapepreserve),
+                "QLTCAAS does not support ! shapepreserve.");
+  Super::declare_tracer(problem_type, rhomidx);
+}
+
+template <typename ES>
+void QLTCAAS<ES>::finish_setup () {
+  const Int nt = this->md_.a_h.trcr2prob.size();
+  send_ = RealList("QLTCAAS send", 4*nt);
+  recv_ = RealList("QLTCAAS recv", 4*nt);
+  Super::finish_setup();
+}
+
+template <typename ES> void QLTCAAS<ES>
+::root_compute (const Int& l2rndps, const Int& r2lndps) const {
+  typedef CDR::Profile P;
+  const Int root = this->get_root_node();
+  const Int os = root >= 0 ? this->ns_->node_h(root)->offset : -1;
+  const Int nt = this->md_.a_h.trcr2prob.size();
+  const auto a = this->md_.a_d;
+  const auto l2r_data = this->bd_.l2r_data;
+  const auto r2l_data = this->bd_.r2l_data;
+  const auto send = send_;
+  const auto recv = recv_;
+  // The group root is a CAAS cell; the other ranks contribute nothing.
+  const auto calc_Qm_clip = KOKKOS_LAMBDA (const Int& k) {
+    if (os < 0) {
+      for (Int j = 0; j < 4; ++j) send(j*nt + k) = 0;
+      return;
+    }
+    const Real* const d = &l2r_data(os*l2rndps + a.trcr2bl2r(k));
+    const Real Qm_min = d[0], Qm = d[1], Qm_max = d[2];
+    send(     k) = cedr::impl::min(Qm_max, cedr::impl::max(Qm_min, Qm));
+    send(  nt+k) = a.trcr2prob(k) & ProblemType::conserve ? d[3] : Qm;
+    send(2*nt+k) = Qm_min;
+    send(3*nt+k) = Qm_max;
+  };
+  Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, nt), calc_Qm_clip);
+  Kokkos::fence();
+  this->prof_start(P::reduce);
+  mpi::all_reduce(*p_all_, send.data(), recv.data(), 4*nt, MPI_SUM);
+  this->prof_msg(true, 4*nt*sizeof(Real));
+  this->prof_msg(false, 4*nt*sizeof(Real));
+  this->prof_stop(P::reduce);
+  if (root < 0) return;
+  // Distribute the global mass discrepancy over the roots in proportion to
+  // their capacities, as CAAS does over cells.
+  const auto adjust_Qm = KOKKOS_LAMBDA (const Int& k) {
+    const Real* const d = &l2r_data(os*l2rndps + a.trcr2bl2r(k));
+    const Real Qm_min = d[0], Qm_max = d[2];
+    Real Qm = cedr::impl::min(Qm_max, cedr::impl::max(Qm_min, d[1]));
+    const Real Qm_clip_sum = recv(k), m = recv(nt+k) - Qm_clip_sum;
+    if (m < 0) {
+      const Real fac = Qm_clip_sum - recv(2*nt+k);
+      if (fac > 0) Qm = cedr::impl::max(Qm_min, Qm + (m/fac)*(Qm - Qm_min));
+    } else if (m > 0) {
+      const Real fac = recv(3*nt+k) - Qm_clip_sum;
+      if (fac > 0) Qm = cedr::impl::min(Qm_max, Qm + (m/fac)*(Qm_max - Qm));
+    }
+    r2l_data(os*r2lndps + a.trcr2br2l(k)) = Qm;
+  };
+  Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, nt), adjust_Qm);
+  if ( ! cedr::impl::OnGpu<ES>::value) Kokkos::fence();
+}
+
+namespace test {
+struct TestQLTCAAS : public cedr::test::TestRandomized {
+  typedef QLTCAAS<Kokkos::DefaultExecutionSpace> QLTCAAST;
+
+  // Groups of at most max_group_size ranks, each rank having nlclcells cells.
+  TestQLTCAAS (const mpi::Parallel::Ptr& p, const Int max_group_size,
+               const Int nlclcells, const CDR::Options options = CDR::Options(),
+               const Int nrhom = 1)
+    : TestRandomized("QLTCAAS", p, p->size()*nlclcells, false, options, nrhom)
+  {
+    const auto np = std::make_shared<mpi::NodeParallel>(*p, max_group_size);
+    const Int ngcells = np->node().size()*nlclcells;
+    // Number the groups' cells consecutively, in order of the leaders' ranks.
+    std::vector<Int> ngcells_lcl(p->size(), 0), ngcells_gbl(p->size());
+    if (np->amleader()) ngcells_lcl[np->leaders()->rank()] = ngcells;
+    mpi::all_reduce(*p, ngcells_lcl.data(), ngcells_gbl.data(), p->size(),
+                    MPI_SUM);
+    Int li = np->amleader() ? np->leaders()->rank() : 0;
+    mpi::bcast(np->node(), &li, 1, np->node().root());
+    gci0_ = 0;
+    for (Int i = 0; i < li; ++i) gci0_ += ngcells_gbl[i];
+    const auto tree = qlt::tree::make_tree_over_1d_mesh(
+      std::make_shared<mpi::Parallel>(np->node().comm()), ngcells);
+    cdr_ = std::make_shared<QLTCAAST>(p, np, ngcells, tree, options);
+    init();
+  }
+
+  CDR& get_cdr () override { return *cdr_; }
+
+  void init_numbering () override {
+    cdr_->get_owned_glblcells(gcis_);
+    for (auto& gci : gcis_) gci += gci0_;
+  }
+
+  void init_tracers () override {
+    // As for CAAS, keep only the tracers it supports.
+    std::vector<TestRandomized::Tracer> tracers;
+    Int idx = 0;
+    for (auto& t : tracers_) {
+      if ( ! (t.problem_type & ProblemType::shapepreserve) ||
+           ! t.local_should_hold)
+        continue;
+      t.idx = idx++;
+      tracers.push_back(t);
+      cdr_->declare_tracer(t.problem_type, t.rhomidx);
+    }
+    tracers_ = tracers;
+    cdr_->end_tracer_declarations();
+    cdr_->finish_setup();
+  }
+
+  void run_impl (const Int trial) override { cdr_->run(); }
+
+private:
+  Long gci0_;
+  typename QLTCAAST::Ptr cdr_;
+};
+
+Int unittest (const mpi::Parallel::Ptr& p) {
+  typedef TestQLTCAAS::QLTCAAST QLTCAAST;
+  Int nerr = 0;
+  for (const Int max_group_size : {1, 2, 3})
+    for (const Int nlclcells : {1, 2, 7}) {
+      CDR::Options options;
+      options.profile = true;
+      nerr += TestQLTCAAS(p, max_group_size, nlclcells, options)
+        .run<QLTCAAST>(1, false);
+      // Tracers of two densities in one instance.
+      nerr += TestQLTCAAS(p, max_group_size, nlclcells, options, 2)
+        .run<QLTCAAST>(1, false);
+    }
+  { // A batch of problems in one instance vs. each alone. The allreduce's sums
+    // can depend on its size, so the results agree only to rounding.
+    typedef ProblemType PT;
+    const auto np = std::make_shared<mpi::NodeParallel>(*p, 2);
+    const Int ngcells = 3*np->node().size();
+    const auto tree = qlt::tree::make_tree_over_1d_mesh(
+      std::make_shared<mpi::Parallel>(np->node().comm()), ngcells);
+    std::vector<Long> gcis;
+    QLTCAAST(p, np, ngcells, tree).get_owned_glblcells(gcis);
+    const std::vector<int> probs = {
+      PT::conserve | PT::shapepreserve, PT::shapepreserve,
+      PT::conserve | PT::shapepreserve | PT::consistent};
+    nerr += cedr::test::test_batch<QLTCAAST>(
+      "QLTCAAS", *p, gcis, probs, 4, CDR::Options(),
+      [&] (const CDR::Options& o) {
+        return std::make_shared<QLTCAAST>(p, np, ngcells, tree, o);
+      },
+      1e2*std::numeric_limits<Real>::epsilon());
+  }
+  return nerr;
+}
+} // namespace test
+} // namespace hybrid
+} // namespace cedr
+
+#ifdef KOKKOS_ENABLE_SERIAL
+template class cedr::hybrid::QLTCAAS<Kokkos::Serial>;
+#endif
+#ifdef KOKKOS_ENABLE_OPENMP
+template class cedr::hybrid::QLTCAAS<Kokkos::OpenMP>;
+#endif
+#ifdef KOKKOS_ENABLE_CUDA
+template class cedr::hybrid::QLTCAAS<Kokkos::Cuda>;
+#endif
+#ifdef KOKKOS_ENABLE_THREADS
+template class cedr::hybrid::QLTCAAS<Kokkos::Threads>;
+#endif
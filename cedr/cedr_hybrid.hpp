@@ -0,0 +1,64 @@
+// COMPOSE version 1.0: Copyright 2018 NTESS. This software is released under
+// the BSD license; see LICENSE in the top-level directory.
+
+#ifndef INCLUDE_CEDR_HYBRID_HPP
+#define INCLUDE_CEDR_HYBRID_HPP
+
+#include "cedr_qlt.hpp"
+
+namespace cedr {
+// QLT within groups of ranks, CAAS across them.
+namespace hybrid {
+
+// The caller partitions the ranks into groups, e.g., shared-memory nodes, with
+// an mpi::NodeParallel and builds a QLT tree over each group's cells, as for a
+// QLT on the group's ranks. The root of each group's tree is one cell of a CAAS
+// problem over the groups: the roots' clipped masses and bounds are summed
+// in one allreduce of 4 values per tracer over all ranks, and each root's CAAS
+// mass is then distributed over the group's cells by the QLT root-to-leaves
+// sweep. Thus the upper levels of a global tree, whose cost is mostly network
+// latency, are replaced by the allreduce, and no other message leaves a group.
+// The correction across groups is global, as in CAAS, while within a group it
+// has QLT's locality.
+//   As in CAAS, only problems having shapepreserve are supported, and the
+// result is not reproducible across rank counts, so
+// CDR::Options::reproducible_sums is not supported.
+template <typename ExeSpace = Kokkos::DefaultExecutionSpace>
+class QLTCAAS : public qlt::QLT<ExeSpace> {
+public:
+  typedef qlt::QLT<ExeSpace> Super;
+  typedef QLTCAAS<ExeSpace> Me;
+  typedef std::shared_ptr<Me> Ptr;
+  typedef typename Super::RealList RealList;
+
+  // Collective on p. The groups are the node() Parallels of np; see
+  // mpi::NodeParallel. ncells and tree are over this rank's group only and are
+  // otherwise as for QLT; thus cell indices are 0:ncells-1 within each group,
+  // and the methods taking a lclcellidx take the group QLT's. In particular,
+  // get_owned_glblcells gives group-local indices; a caller that needs indices
+  // unique over all ranks must offset them by the group's first cell.
+  QLTCAAS(const mpi::Parallel::Ptr& p, const mpi::NodeParallel::Ptr& np,
+          const Int& ncells, const qlt::tree::Node::Ptr& tree,
+          CDR::Options options = CDR::Options());
+
+  void declare_tracer(int problem_type, const Int& rhomidx) override;
+
+  void finish_setup() override;
+
+protected:
+  void root_compute(const Int& l2rndps, const Int& r2lndps) const override;
+
+private:
+  mpi::Parallel::Ptr p_all_;
+  mpi::NodeParallel::Ptr np_;
+  // (e'Qm_clip, e'Qm, e'Qm_min, e'Qm_max) over the group roots, per tracer.
+  RealList send_, recv_;
+};
+
+namespace test {
+Int unittest(const mpi::Parallel::Ptr& p);
+} // namespace test
+} // namespace hybrid
+} // namespace cedr
+
+#endif
@@ -20,6 +20,14 @@
 # define ConstExceptGnu const
 #endif
 
+// Ask the compiler to vectorize the following loop. The loop must have no
+// loop-carried dependences.
+#if defined _OPENMP && ! defined __CUDA_ARCH__
+# define cedr_pragma_simd _Pragma("omp simd")
+#else
+# define cedr_pragma_simd
+#endif
+
 namespace cedr {
 namespace impl {
 
@@ -104,12 +104,26 @@ Int test_1eq_bc_qp () {
   static const Int N = 16;
   Real w[N], a[N], b, xlo[N], xhi[N], y[N], x[N], al, au;
 
+  // Each n's problems, in structure-of-arrays layout after transposing, for
+  // the batched solvers.
+  std::vector<Real> bw, ba, bb, bxlo, bxhi, by, bx, bx_caas;
+  std::vector<Int> binfo;
+
   auto run = [&] () {
     const Int info = solve_1eq_bc_qp(n, w, a, b, xlo, xhi, y, x);
     const bool ok = test::check_1eq_bc_qp_foc(
       "unittest", n, w, a, b, xlo, xhi, y, x, verbose);
     if ( ! ok) ++nerr;
 
+    bw.insert(bw.end(), w, w + n);
+    ba.insert(ba.end(), a, a + n);
+    bb.push_back(b);
+    bxlo.insert(bxlo.end(), xlo, xlo + n);
+    bxhi.insert(bxhi.end(), xhi, xhi + n);
+    by.insert(by.end(), y, y + n);
+    bx.insert(bx.end(), x, x + n);
+    binfo.push_back(info);
+
     if (n == 2) {
       // This version never returns 0.
       Real x2[2];
@@ -142,6 +156,47 @@ Int test_1eq_bc_qp () {
       if (verbose) pr(puf(rd) pu(n) pu(b) pu(m));
       ++nerr;
     }
+    bx_caas.insert(bx_caas.end(), x, x + n);
+  };
+
+  // Solve the collected problems with the batched solvers and check that the
+  // results match the scalar ones.
+  auto run_batch = [&] () {
+    const Int nprob = bb.size();
+    const auto transpose = [&] (std::vector<Real>& v) {
+      std::vector<Real> t(v.size());
+      for (Int k = 0; k < nprob; ++k)
+        for (Int i = 0; i < n; ++i)
+          t[i*nprob + k] = v[k*n + i];
+      v.swap(t);
+    };
+    for (auto* v : {&bw, &ba, &bxlo, &bxhi, &by, &bx, &bx_caas})
+      transpose(*v);
+    std::vector<Real> x_batch(nprob*n);
+    std::vector<Int> info_batch(nprob);
+    solve_1eq_bc_qp_batch(nprob, n, bw.data(), ba.data(), bb.data(),
+                          bxlo.data(), bxhi.data(), by.data(), x_batch.data(),
+                          info_batch.data());
+    for (Int k = 0; k < nprob; ++k)
+      if (info_batch[k] != binfo[k]) {
+        if (verbose) pr(puf(n) pu(k) pu(binfo[k]) pu(info_batch[k]));
+        ++nerr;
+      }
+    Real rd = cedr::util::reldif(bx.data(), x_batch.data(), nprob*n);
+    if (rd > 1e2*std::numeric_limits<Real>::epsilon()) {
+      if (verbose) pr("solve_1eq_bc_qp_batch" pu(n) pu(rd));
+      ++nerr;
+    }
+    caas_batch(nprob, n, ba.data(), bb.data(), bxlo.data(), bxhi.data(),
+               by.data(), x_batch.data());
+    rd = cedr::util::reldif(bx_caas.data(), x_batch.data(), nprob*n);
+    if (rd > 1e2*std::numeric_limits<Real>::epsilon()) {
+      if (verbose) pr("caas_batch" pu(n) pu(rd));
+      ++nerr;
+    }
+    for (auto* v : {&bw, &ba, &bb, &bxlo, &bxhi, &by, &bx, &bx_caas})
+      v->clear();
+    binfo.clear();
   };
 
   auto gena = [&] () {
@@ -216,6 +271,7 @@ Int test_1eq_bc_qp () {
       geny(false);
       run();
     }
+    run_batch();
   }
 
   return  nerr;
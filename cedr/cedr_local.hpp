@@ -45,6 +45,25 @@ void caas(const Int n, const Real* a, const Real b,
           const Real* y, Real* x,
           const bool clip = true);
 
+// Batched forms of solve_1eq_bc_qp and caas for nprob independent problems of
+// the same size n. The arrays are in structure-of-arrays layout: entry i of
+// problem k is at index i*nprob + k, and b and info have one entry per
+// problem. Problems are processed in groups of impl::simd_batch_width, and the
+// loops over a group are vectorized. Each problem's result and info are the
+// same as those of the scalar routine.
+KOKKOS_INLINE_FUNCTION
+void solve_1eq_bc_qp_batch(const Int nprob, const Int n, const Real* w,
+                           const Real* a, const Real* b,
+                           const Real* xlo, const Real* xhi,
+                           const Real* y, Real* x, Int* info,
+                           const Int max_its = 100);
+
+KOKKOS_INLINE_FUNCTION
+void caas_batch(const Int nprob, const Int n, const Real* a, const Real* b,
+                const Real* xlo, const Real* xhi,
+                const Real* y, Real* x,
+                const bool clip = true);
+
 struct Method { enum Enum { least_squares, caas }; };
 
 // Solve
@@ -305,6 +305,225 @@ void caas (const Int n, const Real* a, const Real b,
       x[i] = cedr::impl::max(xlo[i], cedr::impl::min(xhi[i], x[i]));
 }
 
+namespace impl {
+enum : int { simd_batch_width = 8 };
+
+// Run solve_1eq_bc_qp on problems [k0, k0 + nl) of a batch, nl <=
+// simd_batch_width. The problems advance in lockstep. A problem that is done is
+// masked out of the remaining x updates and control logic, but the arithmetic
+// for the active ones is the same as in the scalar routine.
+KOKKOS_INLINE_FUNCTION
+void solve_1eq_bc_qp_group (const Int nprob, const Int n, const Real* w,
+                            const Real* a, const Real* b,
+                            const Real* xlo, const Real* xhi,
+                            const Real* y, Real* x, Int* info,
+                            const Int max_its, const Int k0, const Int nl) {
+  static const Int nw = simd_batch_width;
+  Real r_tol[nw], r[nw], r_lambda[nw], lambda[nw], lamlo[nw], lamhi[nw],
+    lamlo_feas[nw], lamhi_feas[nw];
+  bool active[nw], prev_step_bisect[nw];
+  Int nbisect[nw];
+  b += k0;
+  info += k0;
+
+  // calc_r_tol.
+  for (Int l = 0; l < nl; ++l) r_tol[l] = std::abs(b[l]);
+  for (Int i = 0; i < n; ++i) {
+    const Int o = i*nprob + k0;
+    cedr_pragma_simd
+    for (Int l = 0; l < nl; ++l)
+      r_tol[l] = cedr::impl::max(r_tol[l], std::abs(a[o+l]*y[o+l]));
+  }
+  for (Int l = 0; l < nl; ++l)
+    r_tol[l] = 1e1*std::numeric_limits<Real>::epsilon()*std::abs(r_tol[l]);
+
+  // check_lu.
+  for (Int l = 0; l < nl; ++l) r[l] = -b[l];
+  for (Int i = 0; i < n; ++i) {
+    const Int o = i*nprob + k0;
+    cedr_pragma_simd
+    for (Int l = 0; l < nl; ++l) {
+      x[o+l] = xlo[o+l];
+      r[l] += a[o+l]*x[o+l];
+    }
+  }
+  Int nactive = 0;
+  for (Int l = 0; l < nl; ++l) {
+    active[l] = false;
+    if (std::abs(r[l]) <= r_tol[l]) info[l] = 1;
+    else if (r[l] > 0) info[l] = -1;
+    else active[l] = true;
+    r[l] = -b[l];
+  }
+  for (Int i = 0; i < n; ++i) {
+    const Int o = i*nprob + k0;
+    cedr_pragma_simd
+    for (Int l = 0; l < nl; ++l) {
+      x[o+l] = active[l] ? xhi[o+l] : x[o+l];
+      r[l] += a[o+l]*xhi[o+l];
+    }
+  }
+  for (Int l = 0; l < nl; ++l) {
+    if ( ! active[l]) continue;
+    if (std::abs(r[l]) <= r_tol[l]) info[l] = 1;
+    else if (r[l] < 0) info[l] = -1;
+    else {
+      info[l] = -2;
+      ++nactive;
+      continue;
+    }
+    active[l] = false;
+  }
+  if (nactive == 0) return;
+
+  const Real wall_dist = 1e-3;
+
+  // Get lambda endpoints.
+  for (Int i = 0; i < n; ++i) {
+    const Int o = i*nprob + k0;
+    cedr_pragma_simd
+    for (Int l = 0; l < nl; ++l) {
+      const Real rq = w[o+l]/a[o+l];
+      const Real lamlo_i = rq*(xlo[o+l] - y[o+l]);
+      const Real lamhi_i = rq*(xhi[o+l] - y[o+l]);
+      lamlo[l] = i == 0 ? lamlo_i : cedr::impl::min(lamlo[l], lamlo_i);
+      lamhi[l] = i == 0 ? lamhi_i : cedr::impl::max(lamhi[l], lamhi_i);
+    }
+  }
+  for (Int l = 0; l < nl; ++l) {
+    lamlo_feas[l] = lamlo[l];
+    lamhi_feas[l] = lamhi[l];
+    lambda[l] = lamlo[l] <= 0 && lamhi[l] >= 0 ? 0 : lamlo[l];
+    prev_step_bisect[l] = false;
+    nbisect[l] = 0;
+  }
+
+  // Bisection-safeguarded Newton iteration for r(lambda) = 0.
+  for (Int iteration = 0; iteration < max_its && nactive > 0; ++iteration) {
+    // calc_r. This is the expensive part, so it's the part we vectorize.
+    for (Int l = 0; l < nl; ++l) r[l] = r_lambda[l] = 0;
+    for (Int i = 0; i < n; ++i) {
+      const Int o = i*nprob + k0;
+      cedr_pragma_simd
+      for (Int l = 0; l < nl; ++l) {
+        const Real q = a[o+l]/w[o+l];
+        const Real x_trial = y[o+l] + lambda[l]*q;
+        const Real lo = xlo[o+l], hi = xhi[o+l];
+        const bool in = ! (x_trial < lo) && ! (x_trial > hi);
+        const Real xi = x_trial < lo ? lo : (x_trial > hi ? hi : x_trial);
+        x[o+l] = active[l] ? xi : x[o+l];
+        r_lambda[l] += in ? a[o+l]*q : 0;
+        r[l] += a[o+l]*xi;
+      }
+    }
+    // The per-problem control logic of solve_1eq_bc_qp.
+    for (Int l = 0; l < nl; ++l) {
+      if ( ! active[l]) continue;
+      r[l] -= b[l];
+      if (std::abs(r[l]) <= r_tol[l]) {
+        info[l] = 1;
+        active[l] = false;
+        --nactive;
+        continue;
+      }
+      if (nbisect[l] > 64) {
+        info[l] = (lamhi[l] == lamhi_feas[l] || lamlo[l] == lamlo_feas[l]) ? -1 : 1;
+        active[l] = false;
+        --nactive;
+        continue;
+      }
+      if (r[l] > 0)
+        lamhi[l] = lambda[l];
+      else
+        lamlo[l] = lambda[l];
+      if (r_lambda[l] != 0)
+        lambda[l] -= r[l]/r_lambda[l];
+      else
+        lambda[l] = lamlo[l];
+      const Real D = prev_step_bisect[l] ? 0 : wall_dist*(lamhi[l] - lamlo[l]);
+      if (lambda[l] - lamlo[l] < D || lamhi[l] - lambda[l] < D) {
+        lambda[l] = 0.5*(lamlo[l] + lamhi[l]);
+        ++nbisect[l];
+        prev_step_bisect[l] = true;
+      } else {
+        prev_step_bisect[l] = false;
+      }
+    }
+  }
+}
+
+// Run caas on problems [k0, k0 + nl) of a batch, nl <= simd_batch_width.
+KOKKOS_INLINE_FUNCTION
+void caas_group (const Int nprob, const Int n, const Real* a, const Real* b,
+                 const Real* xlo, const Real* xhi,
+                 const Real* y, Real* x,
+                 const bool clip, const Int k0, const Int nl) {
+  static const Int nw = simd_batch_width;
+  Real dm[nw], fac[nw];
+  b += k0;
+  for (Int l = 0; l < nl; ++l) {
+    dm[l] = b[l];
+    fac[l] = 0;
+  }
+  for (Int i = 0; i < n; ++i) {
+    const Int o = i*nprob + k0;
+    cedr_pragma_simd
+    for (Int l = 0; l < nl; ++l) {
+      x[o+l] = cedr::impl::max(xlo[o+l], cedr::impl::min(xhi[o+l], y[o+l]));
+      dm[l] -= a[o+l]*x[o+l];
+    }
+  }
+  // The room to move toward the bound in the direction of dm. If dm == 0, fac
+  // stays 0 and x doesn't change.
+  for (Int i = 0; i < n; ++i) {
+    const Int o = i*nprob + k0;
+    cedr_pragma_simd
+    for (Int l = 0; l < nl; ++l)
+      fac[l] += (dm[l] > 0 ? a[o+l]*(xhi[o+l] - x[o+l]) :
+                 dm[l] < 0 ? a[o+l]*(x[o+l] - xlo[o+l]) :
+                 0);
+  }
+  for (Int l = 0; l < nl; ++l)
+    fac[l] = fac[l] > 0 ? dm[l]/fac[l] : 0;
+  for (Int i = 0; i < n; ++i) {
+    const Int o = i*nprob + k0;
+    cedr_pragma_simd
+    for (Int l = 0; l < nl; ++l)
+      x[o+l] += fac[l]*(dm[l] > 0 ? xhi[o+l] - x[o+l] : x[o+l] - xlo[o+l]);
+  }
+  // Clip again for numerics.
+  if (clip)
+    for (Int i = 0; i < n; ++i) {
+      const Int o = i*nprob + k0;
+      cedr_pragma_simd
+      for (Int l = 0; l < nl; ++l)
+        x[o+l] = cedr::impl::max(xlo[o+l], cedr::impl::min(xhi[o+l], x[o+l]));
+    }
+}
+} // namespace impl
+
+KOKKOS_INLINE_FUNCTION
+void solve_1eq_bc_qp_batch (const Int nprob, const Int n, const Real* w,
+                            const Real* a, const Real* b,
+                            const Real* xlo, const Real* xhi,
+                            const Real* y, Real* x, Int* info,
+                            const Int max_its) {
+  for (Int k0 = 0; k0 < nprob; k0 += impl::simd_batch_width)
+    impl::solve_1eq_bc_qp_group(
+      nprob, n, w, a, b, xlo, xhi, y, x, info, max_its, k0,
+      cedr::impl::min<Int>(impl::simd_batch_width, nprob - k0));
+}
+
+KOKKOS_INLINE_FUNCTION
+void caas_batch (const Int nprob, const Int n, const Real* a, const Real* b,
+                 const Real* xlo, const Real* xhi,
+                 const Real* y, Real* x,
+                 const bool clip) {
+  for (Int k0 = 0; k0 < nprob; k0 += impl::simd_batch_width)
+    impl::caas_group(nprob, n, a, b, xlo, xhi, y, x, clip, k0,
+                     cedr::impl::min<Int>(impl::simd_batch_width, nprob - k0));
+}
+
 KOKKOS_INLINE_FUNCTION
 Int solve_1eq_nonneg (const Int n, const Real* a, const Real b, const Real* y, Real* x,
                       const Real* w,  const Method::Enum method) {
@@ -23,6 +23,35 @@ Int Parallel::rank () const {
   return pid;
 }
 
+NodeParallel::NodeParallel (const Parallel& p, const Int max_node_size)
+  : leaders_comm_(MPI_COMM_NULL)
+{
+  MPI_Comm_split_type(p.comm(), MPI_COMM_TYPE_SHARED, p.rank(), MPI_INFO_NULL,
+                      &node_comm_);
+  int node_rank;
+  MPI_Comm_rank(node_comm_, &node_rank);
+  if (max_node_size > 0) {
+    MPI_Comm sub;
+    MPI_Comm_split(node_comm_, node_rank / max_node_size, node_rank, &sub);
+    MPI_Comm_free(&node_comm_);
+    node_comm_ = sub;
+    MPI_Comm_rank(node_comm_, &node_rank);
+  }
+  MPI_Comm_split(p.comm(), node_rank == 0 ? 0 : MPI_UNDEFINED, p.rank(),
+                 &leaders_comm_);
+  node_ = std::make_shared<Parallel>(node_comm_);
+  if (leaders_comm_ != MPI_COMM_NULL)
+    leaders_ = std::make_shared<Parallel>(leaders_comm_);
+}
+
+NodeParallel::~NodeParallel () {
+  int fin;
+  MPI_Finalized(&fin);
+  if (fin) return;
+  MPI_Comm_free(&node_comm_);
+  if (leaders_comm_ != MPI_COMM_NULL) MPI_Comm_free(&leaders_comm_);
+}
+
 #ifdef COMPOSE_DEBUG_MPI
 Request::Request () : unfreed(0) {}
 Request::~Request () {
@@ -43,7 +72,38 @@ Request::~Request () {
 
 template <> MPI_Datatype get_type<int>() { return MPI_INT; }
 template <> MPI_Datatype get_type<double>() { return MPI_DOUBLE; }
-template <> MPI_Datatype get_type<long>() { return MPI_LONG_INT; }
+template <> MPI_Datatype get_type<long>() { return MPI_LONG; }
+
+int start (Request* req) {
+#ifdef COMPOSE_DEBUG_MPI
+  req->unfreed++;
+#endif
+  return MPI_Start(&req->request);
+}
+
+int startall (int count, Request* reqs) {
+#ifdef COMPOSE_DEBUG_MPI
+  std::vector<MPI_Request> vreqs(count);
+  for (int i = 0; i < count; ++i) {
+    vreqs[i] = reqs[i].request;
+    reqs[i].unfreed++;
+  }
+  return MPI_Startall(count, vreqs.data());
+#else
+  return MPI_Startall(count, reinterpret_cast<MPI_Request*>(reqs));
+#endif
+}
+
+int request_free (Request* req) {
+  return MPI_Request_free(&req->request);
+}
+
+PersistentRequests::~PersistentRequests () {
+  int fin;
+  MPI_Finalized(&fin);
+  if (fin) return;
+  for (auto& r : reqs) request_free(&r);
+}
 
 int waitany (int count, Request* reqs, int* index, MPI_Status* stats) {
 #ifdef COMPOSE_DEBUG_MPI
@@ -60,6 +120,31 @@ int waitany (int count, Request* reqs, int* index, MPI_Status* stats) {
 #endif
 }
 
+int testany (int count, Request* reqs, int* index, int* flag, MPI_Status* stats) {
+#ifdef COMPOSE_DEBUG_MPI
+  std::vector<MPI_Request> vreqs(count);
+  for (int i = 0; i < count; ++i) vreqs[i] = reqs[i].request;
+  const auto out = MPI_Testany(count, vreqs.data(), index, flag,
+                               stats ? stats : MPI_STATUS_IGNORE);
+  for (int i = 0; i < count; ++i) reqs[i].request = vreqs[i];
+  if (*flag && *index != MPI_UNDEFINED) reqs[*index].unfreed--;
+  return out;
+#else
+  return MPI_Testany(count, reinterpret_cast<MPI_Request*>(reqs), index, flag,
+                     stats ? stats : MPI_STATUS_IGNORE);
+#endif
+}
+
+int wait (Request* req, MPI_Status* stat) {
+#ifdef COMPOSE_DEBUG_MPI
+  const auto out = MPI_Wait(&req->request, stat ? stat : MPI_STATUS_IGNORE);
+  req->unfreed--;
+  return out;
+#else
+  return MPI_Wait(reinterpret_cast<MPI_Request*>(req), stat ? stat : MPI_STATUS_IGNORE);
+#endif
+}
+
 int waitall (int count, Request* reqs, MPI_Status* stats) {
 #ifdef COMPOSE_DEBUG_MPI
   std::vector<MPI_Request> vreqs(count);
@@ -5,12 +5,24 @@
 #define INCLUDE_CEDR_MPI_HPP
 
 #include <memory>
+#include <vector>
 
 #include <mpi.h>
 
 #include "compose_config.hpp"
 #include "cedr.hpp"
 
+// Persistent collectives are in MPI 4 and, as MPIX_ functions, in Open MPI's
+// pcollreq extension before it.
+#if MPI_VERSION >= 4
+# define COMPOSE_HAVE_MPI_ALLREDUCE_INIT
+#elif defined OPEN_MPI
+# include <mpi-ext.h>
+# if defined OMPI_HAVE_MPI_EXT_PCOLLREQ && OMPI_HAVE_MPI_EXT_PCOLLREQ
+#  define COMPOSE_HAVE_MPI_ALLREDUCE_INIT
+# endif
+#endif
+
 namespace cedr {
 namespace mpi {
 
@@ -26,6 +38,27 @@ public:
   bool amroot () const { return rank() == root(); }
 };
 
+// Ranks of a Parallel grouped by shared-memory node, for node-aware
+// collectives. node() holds the ranks on this rank's node, and its root is the
+// node's leader. leaders() holds the leader of each node and is null on ranks
+// that are not leaders.
+class NodeParallel {
+  MPI_Comm node_comm_, leaders_comm_;
+  std::shared_ptr<Parallel> node_, leaders_;
+public:
+  typedef std::shared_ptr<NodeParallel> Ptr;
+  // Collective on p. If max_node_size > 0, a shared-memory node is further
+  // split into groups of at most that many ranks; this is useful to emulate
+  // multiple nodes in testing or to group by socket.
+  NodeParallel(const Parallel& p, const Int max_node_size = 0);
+  ~NodeParallel();
+  NodeParallel(const NodeParallel&) = delete;
+  NodeParallel& operator=(const NodeParallel&) = delete;
+  const Parallel& node () const { return *node_; }
+  const Parallel* leaders () const { return leaders_.get(); }
+  bool amleader () const { return leaders_ != nullptr; }
+};
+
 struct Request {
   MPI_Request request;
 
@@ -47,6 +80,14 @@ int reduce(const Parallel& p, const T* sendbuf, T* rcvbuf, int count, MPI_Op op,
 template <typename T>
 int all_reduce(const Parallel& p, const T* sendbuf, T* rcvbuf, int count, MPI_Op op);
 
+template <typename T>
+int bcast(const Parallel& p, T* buf, int count, int root);
+
+// Nonblocking all_reduce. Complete it with wait.
+template <typename T>
+int iall_reduce(const Parallel& p, const T* sendbuf, T* rcvbuf, int count, MPI_Op op,
+                Request* ireq);
+
 template <typename T>
 int isend(const Parallel& p, const T* buf, int count, int dest, int tag,
           Request* ireq = nullptr);
@@ -55,8 +96,50 @@ template <typename T>
 int irecv(const Parallel& p, T* buf, int count, int src, int tag,
           Request* ireq = nullptr);
 
+// Persistent point-to-point requests. Start one with start or startall and
+// complete each start with a wait function. The request remains valid until
+// request_free.
+template <typename T>
+int send_init(const Parallel& p, const T* buf, int count, int dest, int tag,
+              Request* ireq);
+
+template <typename T>
+int recv_init(const Parallel& p, T* buf, int count, int src, int tag,
+              Request* ireq);
+
+#ifdef COMPOSE_HAVE_MPI_ALLREDUCE_INIT
+// Persistent all_reduce. This is collective, as is each start.
+template <typename T>
+int all_reduce_init(const Parallel& p, const T* sendbuf, T* rcvbuf, int count,
+                    MPI_Op op, Request* ireq);
+#endif
+
+int start(Request* req);
+
+int startall(int count, Request* reqs);
+
+int request_free(Request* req);
+
+// A list of persistent requests, freed on destruction. Each start must be
+// completed before then.
+struct PersistentRequests {
+  typedef std::shared_ptr<PersistentRequests> Ptr;
+
+  std::vector<Request> reqs;
+
+  PersistentRequests () {}
+  ~PersistentRequests();
+  PersistentRequests(const PersistentRequests&) = delete;
+  PersistentRequests& operator=(const PersistentRequests&) = delete;
+};
+
 int waitany(int count, Request* reqs, int* index, MPI_Status* stats = nullptr);
 
+int testany(int count, Request* reqs, int* index, int* flag,
+            MPI_Status* stats = nullptr);
+
+int wait(Request* req, MPI_Status* stat = nullptr);
+
 int waitall(int count, Request* reqs, MPI_Status* stats = nullptr);
 
 template<typename T>
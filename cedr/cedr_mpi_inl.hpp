@@ -20,6 +20,24 @@ int all_reduce (const Parallel& p, const T* sendbuf, T* rcvbuf, int count, MPI_O
   return MPI_Allreduce(const_cast<T*>(sendbuf), rcvbuf, count, dt, op, p.comm());
 }
 
+template <typename T>
+int bcast (const Parallel& p, T* buf, int count, int root) {
+  MPI_Datatype dt = get_type<T>();
+  return MPI_Bcast(buf, count, dt, root, p.comm());
+}
+
+template <typename T>
+int iall_reduce (const Parallel& p, const T* sendbuf, T* rcvbuf, int count, MPI_Op op,
+                 Request* ireq) {
+  MPI_Datatype dt = get_type<T>();
+  int ret = MPI_Iallreduce(const_cast<T*>(sendbuf), rcvbuf, count, dt, op, p.comm(),
+                           &ireq->request);
+#ifdef COMPOSE_DEBUG_MPI
+  ireq->unfreed++;
+#endif
+  return ret;
+}
+
 template <typename T>
 int isend (const Parallel& p, const T* buf, int count, int dest, int tag,
            Request* ireq) {
@@ -47,6 +65,36 @@ int irecv (const Parallel& p, T* buf, int count, int src, int tag, Request* ireq
   return ret;
 }
 
+template <typename T>
+int send_init (const Parallel& p, const T* buf, int count, int dest, int tag,
+               Request* ireq) {
+  MPI_Datatype dt = get_type<T>();
+  return MPI_Send_init(const_cast<T*>(buf), count, dt, dest, tag, p.comm(),
+                       &ireq->request);
+}
+
+template <typename T>
+int recv_init (const Parallel& p, T* buf, int count, int src, int tag,
+               Request* ireq) {
+  MPI_Datatype dt = get_type<T>();
+  return MPI_Recv_init(buf, count, dt, src, tag, p.comm(), &ireq->request);
+}
+
+#ifdef COMPOSE_HAVE_MPI_ALLREDUCE_INIT
+template <typename T>
+int all_reduce_init (const Parallel& p, const T* sendbuf, T* rcvbuf, int count,
+                     MPI_Op op, Request* ireq) {
+  MPI_Datatype dt = get_type<T>();
+#if MPI_VERSION >= 4
+  return MPI_Allreduce_init(const_cast<T*>(sendbuf), rcvbuf, count, dt, op,
+                            p.comm(), MPI_INFO_NULL, &ireq->request);
+#else
+  return MPIX_Allreduce_init(const_cast<T*>(sendbuf), rcvbuf, count, dt, op,
+                             p.comm(), MPI_INFO_NULL, &ireq->request);
+#endif
+}
+#endif
+
 template<typename T>
 int gather (const Parallel& p, const T* sendbuf, int sendcount,
             T* recvbuf, int recvcount, int root) {
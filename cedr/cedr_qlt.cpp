@@ -4,77 +4,18 @@
 #include "cedr_qlt.hpp"
 #include "cedr_test_randomized.hpp"
 
-#include <sys/time.h>
-
 #include <cassert>
 #include <cmath>
+#include <cstring>
 
 #include <set>
 #include <limits>
 #include <algorithm>
+#include <thread>
 
 namespace cedr {
 namespace qlt {
 
-class Timer {
-public:
-  enum Op { tree, analyze, qltrun, qltrunl2r, qltrunr2l, snp, waitall,
-            total, NTIMERS };
-  static inline void init () {
-#ifdef COMPOSE_QLT_TIME
-    for (int i = 0; i < NTIMERS; ++i) {
-      et_[i] = 0;
-      cnt_[i] = 0;
-    }
-#endif
-  }
-  static inline void reset (const Op op) {
-#ifdef COMPOSE_QLT_TIME
-    et_[op] = 0;
-    cnt_[op] = 0;
-#endif
-  }
-  static inline void start (const Op op) {
-#ifdef COMPOSE_QLT_TIME
-    gettimeofday(&t_start_[op], 0);
-    ++cnt_[op];
-#endif
-  }
-  static inline void stop (const Op op) {
-#ifdef COMPOSE_QLT_TIME
-    timeval t2;
-    gettimeofday(&t2, 0);
-    const timeval& t1 = t_start_[op];
-    static const double us = 1.0e6;
-    et_[op] += (t2.tv_sec*us + t2.tv_usec - t1.tv_sec*us - t1.tv_usec)/us;
-#endif
-  }
-# define tpr(op) do {                                                   \
-    printf("%-20s %10.3e %10.1f (%4d %10.3e)\n",                        \
-           #op, et_[op], 100*et_[op]/tot, cnt_[op], et_[op]/cnt_[op]);  \
-  } while (0)
-  static void print () {
-#ifdef COMPOSE_QLT_TIME
-    const double tot = et_[total];
-    tpr(tree); tpr(analyze);
-    tpr(qltrun); tpr(qltrunl2r); tpr(qltrunr2l); tpr(snp); tpr(waitall);
-    printf("%-20s %10.3e %10.1f\n", "total", tot, 100.0);
-#endif
-  }
-#undef tpr
-private:
-#ifdef COMPOSE_QLT_TIME
-  static timeval t_start_[NTIMERS];
-  static double et_[NTIMERS];
-  static int cnt_[NTIMERS];
-#endif
-};
-#ifdef COMPOSE_QLT_TIME
-timeval Timer::t_start_[Timer::NTIMERS];
-double Timer::et_[Timer::NTIMERS];
-int Timer::cnt_[Timer::NTIMERS];
-#endif
-
 namespace impl {
 void NodeSets::print (std::ostream& os) const {
   std::stringstream ss;
@@ -104,92 +45,135 @@ void NodeSets::print (std::ostream& os) const {
   os << ss.str();
 }
 
-// Find tree depth, assign ranks to non-leaf nodes, and init 'reserved'.
-Int init_tree (const Int& my_rank, const tree::Node::Ptr& node, Int& id) {
-  node->reserved = -1;
-  Int depth = 0;
-  for (Int i = 0; i < node->nkids; ++i) {
-    cedr_assert(node.get() == node->kids[i]->parent);
-    depth = std::max(depth, init_tree(my_rank, node->kids[i], id));
+// The nodes of t in post-order, kid 0 before kid 1.
+void postorder (const tree::FlatTree& t, std::vector<Int>& order) {
+  const Int nn = t.nnode();
+  order.clear();
+  order.reserve(nn);
+  // Each stack entry is a node and the number of its kids already pushed.
+  std::vector<std::pair<Int,Int> > stack(1, std::make_pair(t.root, 0));
+  while ( ! stack.empty()) {
+    auto& e = stack.back();
+    const Int i = e.first;
+    if (e.second < 2 && t.kids[2*i + e.second] >= 0) {
+      const Int k = t.kids[2*i + e.second];
+      ++e.second;
+      cedr_throw_if(k >= nn, "FlatTree node " << i << " has kid " << k);
+      stack.push_back(std::make_pair(k, 0));
+      cedr_throw_if(static_cast<Int>(stack.size()) > nn, "FlatTree has a cycle.");
+      continue;
+    }
+    order.push_back(i);
+    stack.pop_back();
   }
-  if (node->nkids) {
-    if (node->rank < 0) node->rank = node->kids[0]->rank;
-    node->cellidx = id++;
-  } else {
-    cedr_throw_if(node->rank == my_rank && (node->cellidx < 0 || node->cellidx >= id),
-                  "cellidx is " << node->cellidx << " but should be between " <<
-                  0 << " and " << id);
+}
+
+// Scratch data for analyzing a FlatTree.
+struct TreeWork {
+  std::vector<Int> rank, id, nkids, level, reserved;
+  std::vector<char> need_parent_ns_node;
+};
+
+// Find tree depth, assign ranks and ids to non-leaf nodes, and init 'reserved'.
+Int init_tree (const Int& my_rank, const tree::FlatTree& t,
+               const std::vector<Int>& order, const Int ncells, TreeWork& w) {
+  const Int nn = t.nnode();
+  w.rank = t.rank;
+  w.id.resize(nn);
+  w.nkids.resize(nn);
+  w.reserved.assign(nn, -1);
+  std::vector<Int> depth(nn, 0);
+  Int id = ncells;
+  for (const Int i : order) {
+    const Int* const kids = &t.kids[2*i];
+    w.nkids[i] = (kids[0] >= 0) + (kids[1] >= 0);
+    cedr_throw_if(kids[0] < 0 && kids[1] >= 0,
+                  "FlatTree node " << i << " has kid 1 but not kid 0.");
+    for (Int k = 0; k < w.nkids[i]; ++k)
+      depth[i] = std::max(depth[i], depth[kids[k]]);
+    ++depth[i];
+    if (w.nkids[i]) {
+      if (w.rank[i] < 0) w.rank[i] = w.rank[kids[0]];
+      w.id[i] = id++;
+    } else {
+      w.id[i] = t.cellidx[i];
+      cedr_throw_if(w.rank[i] == my_rank && (t.cellidx[i] < 0 || t.cellidx[i] >= ncells),
+                    "cellidx is " << t.cellidx[i] << " but should be between " <<
+                    0 << " and " << ncells);
+    }
   }
-  return depth + 1;
+  return depth[t.root];
 }
 
-void level_schedule_and_collect (
-  NodeSets& ns, const Int& my_rank, const tree::Node::Ptr& node, Int& level,
-  bool& need_parent_ns_node)
-{
-  cedr_assert(node->rank != -1);
-  level = -1;
-  bool make_ns_node = false;
-  for (Int i = 0; i < node->nkids; ++i) {
-    Int kid_level;
-    bool kid_needs_ns_node;
-    level_schedule_and_collect(ns, my_rank, node->kids[i], kid_level,
-                               kid_needs_ns_node);
-    level = std::max(level, kid_level);
-    if (kid_needs_ns_node) make_ns_node = true;
-  }
-  ++level;
-  if (node->level >= 0) {
-    // The caller built only partial trees and so must provide the
-    // level.
-    level = node->level;
-    cedr_assert(level < static_cast<Int>(ns.levels.size()));
-  }
-  // Is parent node needed for isend?
-  const bool node_is_owned = node->rank == my_rank;
-  need_parent_ns_node = node_is_owned;
-  if (node_is_owned || make_ns_node) {
-    cedr_assert(node->reserved == -1);
+void level_schedule_and_collect (NodeSets& ns, const Int& my_rank,
+                                 const tree::FlatTree& t,
+                                 const std::vector<Int>& order, TreeWork& w) {
+  const Int nn = t.nnode();
+  w.level.resize(nn);
+  w.need_parent_ns_node.resize(nn);
+  for (const Int ni : order) {
+    const Int* const tkids = &t.kids[2*ni];
+    const Int nkids = w.nkids[ni];
+    cedr_assert(w.rank[ni] != -1);
+    Int level = -1;
+    bool make_ns_node = false;
+    for (Int i = 0; i < nkids; ++i) {
+      level = std::max(level, w.level[tkids[i]]);
+      if (w.need_parent_ns_node[tkids[i]]) make_ns_node = true;
+    }
+    ++level;
+    if ( ! t.level.empty() && t.level[ni] >= 0) {
+      // The caller built only partial trees and so must provide the
+      // level.
+      level = t.level[ni];
+      cedr_assert(level < static_cast<Int>(ns.levels.size()));
+    }
+    w.level[ni] = level;
+    // Is parent node needed for isend?
+    const bool node_is_owned = w.rank[ni] == my_rank;
+    w.need_parent_ns_node[ni] = node_is_owned;
+    if ( ! (node_is_owned || make_ns_node)) continue;
+    cedr_assert(w.reserved[ni] == -1);
     const auto ns_node_idx = ns.alloc();
     // Levels hold only owned nodes.
     if (node_is_owned) ns.levels[level].nodes.push_back(ns_node_idx);
-    node->reserved = ns_node_idx;
+    w.reserved[ni] = ns_node_idx;
     NodeSets::Node* ns_node = ns.node_h(ns_node_idx);
-    ns_node->rank = node->rank;
-    if (node->nkids == 0) ns_node->id = node->cellidx;
+    ns_node->rank = w.rank[ni];
+    if (nkids == 0) ns_node->id = w.id[ni];
     if (node_is_owned) {
       // If this node is owned, it needs to have information about all kids.
-      ns_node->nkids = node->nkids;
-      for (Int i = 0; i < node->nkids; ++i) {
-        const auto& kid = node->kids[i];
-        if (kid->reserved == -1) {
+      ns_node->nkids = nkids;
+      for (Int i = 0; i < nkids; ++i) {
+        const Int kid = tkids[i];
+        if (w.reserved[kid] == -1) {
           // This kid isn't owned by this rank. But need it for irecv.
           const auto ns_kid_idx = ns.alloc();
           NodeSets::Node* ns_kid = ns.node_h(ns_kid_idx);
-          kid->reserved = ns_kid_idx;
+          w.reserved[kid] = ns_kid_idx;
           ns_node = ns.node_h(ns_node_idx);
           ns_node->kids[i] = ns_kid_idx;
-          cedr_assert(kid->rank != my_rank);
-          ns_kid->rank = kid->rank;
-          ns_kid->id = kid->cellidx;
+          cedr_assert(w.rank[kid] != my_rank);
+          ns_kid->rank = w.rank[kid];
+          ns_kid->id = w.id[kid];
           // The kid may have kids in the original tree, but in the tree pruned
           // according to rank, it does not.
           ns_kid->nkids = 0;
         } else {
           // This kid is owned by this rank, so fill in its parent pointer.
-          NodeSets::Node* ns_kid = ns.node_h(kid->reserved);
+          NodeSets::Node* ns_kid = ns.node_h(w.reserved[kid]);
           ns_node = ns.node_h(ns_node_idx);
-          ns_node->kids[i] = kid->reserved;
+          ns_node->kids[i] = w.reserved[kid];
           ns_kid->parent = ns_node_idx;
         }
       }
     } else {
       // This node is not owned. Update the owned kids with its parent.
       ns_node->nkids = 0;
-      for (Int i = 0; i < node->nkids; ++i) {
-        const auto& kid = node->kids[i];
-        if (kid->reserved >= 0 && kid->rank == my_rank) {
-          const auto ns_kid_idx = kid->reserved;
+      for (Int i = 0; i < nkids; ++i) {
+        const Int kid = tkids[i];
+        if (w.reserved[kid] >= 0 && w.rank[kid] == my_rank) {
+          const auto ns_kid_idx = w.reserved[kid];
           ns_node->kids[ns_node->nkids++] = ns_kid_idx;
           NodeSets::Node* ns_kid = ns.node_h(ns_kid_idx);
           ns_kid->parent = ns_node_idx;
@@ -199,13 +183,6 @@ void level_schedule_and_collect (
   }
 }
 
-void level_schedule_and_collect (NodeSets& ns, const Int& my_rank,
-                                 const tree::Node::Ptr& tree) {
-  Int iunused;
-  bool bunused;
-  level_schedule_and_collect(ns, my_rank, tree, iunused, bunused);
-}
-
 void consolidate (NodeSets& ns) {
   auto levels = ns.levels;
   ns.levels.clear();
@@ -250,10 +227,277 @@ void init_offsets (const Int my_rank, std::vector<RankNode>& rns,
   }
 }
 
-// Set up comm data. Consolidate so that there is only one message between me
+// Index of the message in mmds whose buffer contains slot offset, or -1.
+Int find_msg (const std::vector<NodeSets::Level::MPIMetaData>& mmds,
+              const Int offset) {
+  const auto it = std::upper_bound(
+    mmds.begin(), mmds.end(), offset,
+    [] (const Int& os, const NodeSets::Level::MPIMetaData& mmd) {
+      return os < mmd.offset;
+    });
+  if (it == mmds.begin()) return -1;
+  const auto& mmd = *(it - 1);
+  if (offset >= mmd.offset + mmd.size) return -1;
+  return static_cast<Int>(it - 1 - mmds.begin());
+}
+
+// Invert a node -> message map into a message -> nodes CSR list.
+void init_msg2nodes (const std::vector<Int>& node2msg, const Int nmsg,
+                     const Int nmsg_per_node, std::vector<Int>& ptr,
+                     std::vector<Int>& nodes) {
+  ptr.assign(nmsg + 1, 0);
+  for (const auto& e : node2msg)
+    if (e >= 0) ++ptr[e+1];
+  for (Int i = 0; i < nmsg; ++i) ptr[i+1] += ptr[i];
+  nodes.resize(ptr[nmsg]);
+  std::vector<Int> fill(ptr.begin(), ptr.end() - 1);
+  for (size_t i = 0; i < node2msg.size(); ++i)
+    if (node2msg[i] >= 0)
+      nodes[fill[node2msg[i]]++] = i / nmsg_per_node;
+}
+
+// Record which messages each node in the level depends on, so that run() can
+// combine or solve a node as soon as its messages arrive and send a message as
+// soon as all of its nodes are done.
+void init_deps (const NodeSets& ns, NodeSets::Level& lvl) {
+  const Int nnode = lvl.nodes.size();
+  lvl.node2me.assign(nnode, -1);
+  lvl.node2kids.assign(2*nnode, -1);
+  for (Int i = 0; i < nnode; ++i) {
+    const auto n = ns.node_h(lvl.nodes[i]);
+    if (n->parent >= 0 && ns.node_h(n->parent)->rank != n->rank) {
+      lvl.node2me[i] = find_msg(lvl.me, n->offset);
+      cedr_assert(lvl.node2me[i] >= 0);
+    }
+    for (Int k = 0; k < n->nkids; ++k) {
+      const auto kid = ns.node_h(n->kids[k]);
+      if (kid->rank == n->rank) continue;
+      lvl.node2kids[2*i + k] = find_msg(lvl.kids, kid->offset);
+      cedr_assert(lvl.node2kids[2*i + k] >= 0);
+    }
+  }
+  init_msg2nodes(lvl.node2me, lvl.me.size(), 1, lvl.me2nodesptr, lvl.me2nodes);
+  init_msg2nodes(lvl.node2kids, lvl.kids.size(), 2, lvl.kids2nodesptr,
+                 lvl.kids2nodes);
+  lvl.node_cnt.resize(nnode);
+  lvl.msg_cnt.resize(std::max(lvl.me.size(), lvl.kids.size()));
+  lvl.ready.resize(nnode);
+}
+
+// Group levels for the GPU. A level joins the group below it in l2r if it
+// receives nothing and the level below sends nothing, and similarly in r2l.
+void init_groups (NodeSets& ns) {
+  const Int nlev = ns.levels.size();
+  for (Int il = 0; il < nlev; ++il) {
+    auto& lvl = ns.levels[il];
+    lvl.l2r_group = (il > 0 && lvl.l2r_recv.empty() &&
+                     ns.levels[il-1].l2r_send.empty() ?
+                     ns.levels[il-1].l2r_group : il);
+  }
+  for (Int il = nlev-1; il >= 0; --il) {
+    auto& lvl = ns.levels[il];
+    lvl.r2l_group = (il < nlev-1 && lvl.r2l_recv.empty() &&
+                     ns.levels[il+1].r2l_send.empty() ?
+                     ns.levels[il+1].r2l_group : il);
+  }
+}
+
+// The buffers this rank exchanges with one comm partner as the me or the kids
+// side, in level order. l2r[k] and r2l[k] say whether buffers k and k+1 travel
+// in one message in that sweep.
+struct PartnerBufs {
+  std::vector<Int> level, offset, size;
+  std::vector<char> l2r, r2l;
+  // This side's and the partner's proposed links; see agree_on_links.
+  std::vector<Int> mine, theirs;
+};
+typedef std::map<Int, PartnerBufs> Partners;
+
+void collect_bufs (const NodeSets& ns, const bool me_side, Partners& ps) {
+  for (size_t il = 0; il < ns.levels.size(); ++il)
+    for (const auto& mmd : me_side ? ns.levels[il].me : ns.levels[il].kids) {
+      auto& pb = ps[mmd.rank];
+      pb.level.push_back(il);
+      pb.offset.push_back(mmd.offset);
+      pb.size.push_back(mmd.size);
+    }
+  for (auto& e : ps) {
+    const Int nlink = e.second.level.size() - 1;
+    e.second.l2r.assign(nlink, 0);
+    e.second.r2l.assign(nlink, 0);
+  }
+}
+
+// Whether no level in [lb, le) receives me (r2l) or kids (l2r) buffers.
+bool no_recv (const NodeSets& ns, const bool me, const Int lb, const Int le) {
+  for (Int il = lb; il < le; ++il)
+    if ( ! (me ? ns.levels[il].me : ns.levels[il].kids).empty())
+      return false;
+  return true;
+}
+
+// A rank pair can exchange buffers at several levels. Buffers k and k+1 can
+// travel in one message in a sweep if the sender receives nothing between
+// sending them: the me side sends buffer k+1 later in l2r, and the kids side
+// sends buffer k later in r2l. The receiver then waits for the message where it
+// used to wait for the first of the buffers, and the sender sends it before it
+// next waits, so the schedule stays deadlock free. Each side proposes the links
+// for the sweep in which it sends. A leaf's buffer cannot be moved to be
+// contiguous with another level's, so the me side vetoes links from the leaf
+// level.
+void agree_on_links (const Parallel& p, const NodeSets& ns, Partners& me,
+                     Partners& kids) {
+  enum : Int { link = 1, veto = 2 };
+  size_t nreq = 0;
+  for (auto* ps : {&me, &kids})
+    for (auto& e : *ps) {
+      auto& pb = e.second;
+      const Int nlink = pb.l2r.size();
+      pb.mine.resize(nlink);
+      pb.theirs.resize(nlink);
+      for (Int k = 0; k < nlink; ++k) {
+        if (ps == &me)
+          pb.mine[k] = (pb.level[k] == 0 ? veto :
+                        no_recv(ns, false, pb.level[k]+1, pb.level[k+1]+1) ? link : 0);
+        else
+          pb.mine[k] = no_recv(ns, true, pb.level[k], pb.level[k+1]) ? link : 0;
+      }
+      if (nlink > 0) nreq += 2;
+    }
+  std::vector<mpi::Request> reqs(nreq);
+  nreq = 0;
+  for (auto* ps : {&me, &kids})
+    for (auto& e : *ps) {
+      auto& pb = e.second;
+      const Int nlink = pb.l2r.size();
+      if (nlink == 0) continue;
+      const int send_tag = (ps == &me ? NodeSets::mpitag_kid_links :
+                            NodeSets::mpitag_parent_links);
+      const int recv_tag = (ps == &me ? NodeSets::mpitag_parent_links :
+                            NodeSets::mpitag_kid_links);
+      mpi::isend(p, pb.mine.data(), nlink, e.first, send_tag, &reqs[nreq++]);
+      mpi::irecv(p, pb.theirs.data(), nlink, e.first, recv_tag, &reqs[nreq++]);
+    }
+  mpi::waitall(reqs.size(), reqs.data());
+  for (auto* ps : {&me, &kids})
+    for (auto& e : *ps) {
+      auto& pb = e.second;
+      const auto& kid_side = ps == &me ? pb.mine : pb.theirs;
+      const auto& parent_side = ps == &me ? pb.theirs : pb.mine;
+      for (size_t k = 0; k < pb.l2r.size(); ++k) {
+        if (kid_side[k] & veto) continue;
+        pb.l2r[k] = kid_side[k] & link;
+        pb.r2l[k] = parent_side[k] & link;
+      }
+    }
+}
+
+// Renumber the slots so that each run of buffers linked in either sweep is
+// contiguous and in level order. Leaf slots are in no run and so keep their
+// offsets.
+void make_runs_contiguous (NodeSets& ns, Partners& me, Partners& kids) {
+  std::vector<std::vector<std::pair<Int,Int> > > runs;
+  std::vector<Int> slot2run(ns.nslots, -1);
+  for (auto* ps : {&me, &kids})
+    for (const auto& it : *ps) {
+      const auto& pb = it.second;
+      const Int n = pb.level.size();
+      for (Int s = 0, e; s < n; s = e + 1) {
+        for (e = s; e+1 < n && (pb.l2r[e] || pb.r2l[e]); ++e) ;
+        if (e == s) continue;
+        runs.push_back(std::vector<std::pair<Int,Int> >());
+        for (Int k = s; k <= e; ++k) {
+          runs.back().push_back(std::make_pair(pb.offset[k], pb.size[k]));
+          for (Int i = 0; i < pb.size[k]; ++i)
+            slot2run[pb.offset[k] + i] = runs.size() - 1;
+        }
+      }
+    }
+  if (runs.empty()) return;
+  // Place each run where its first slot in the old numbering is.
+  std::vector<Int> old2new(ns.nslots, -1);
+  Int os = 0;
+  for (Int s = 0; s < ns.nslots; ++s) {
+    if (old2new[s] >= 0) continue;
+    if (slot2run[s] < 0) {
+      old2new[s] = os++;
+      continue;
+    }
+    for (const auto& buf : runs[slot2run[s]])
+      for (Int i = 0; i < buf.second; ++i)
+        old2new[buf.first + i] = os++;
+  }
+  cedr_assert(os == ns.nslots);
+  for (Int i = 0; i < ns.nnode(); ++i) {
+    auto n = ns.node_h(i);
+    if (n->offset >= 0) n->offset = old2new[n->offset];
+  }
+  const auto by_offset = [] (const NodeSets::Level::MPIMetaData& a,
+                             const NodeSets::Level::MPIMetaData& b) {
+    return a.offset < b.offset;
+  };
+  for (auto& lvl : ns.levels)
+    for (auto* bufs : {&lvl.me, &lvl.kids}) {
+      for (auto& mmd : *bufs) mmd.offset = old2new[mmd.offset];
+      std::sort(bufs->begin(), bufs->end(), by_offset);
+    }
+  for (auto* ps : {&me, &kids})
+    for (auto& e : *ps)
+      for (auto& o : e.second.offset) o = old2new[o];
+}
+
+// Make the messages of each sweep. A run of buffers linked in a sweep is one
+// message. It is listed with its highest-level buffer on the me side, where it
+// is sent in l2r and first needed in r2l, and with its lowest-level buffer on
+// the kids side, where it is first needed in l2r and sent in r2l.
+void init_msgs (NodeSets& ns, const Partners& me, const Partners& kids) {
+  typedef NodeSets::Level Level;
+  for (auto& lvl : ns.levels) {
+    lvl.l2r_recv.clear(); lvl.l2r_send.clear();
+    lvl.r2l_recv.clear(); lvl.r2l_send.clear();
+    lvl.me2l2r.assign(lvl.me.size(), -1);
+    lvl.me2r2l.assign(lvl.me.size(), -1);
+    lvl.kids2l2r.assign(lvl.kids.size(), -1);
+    lvl.kids2r2l.assign(lvl.kids.size(), -1);
+  }
+  for (const bool me_side : {true, false})
+    for (const auto& it : me_side ? me : kids)
+      for (const bool l2r : {true, false}) {
+        const auto& pb = it.second;
+        const auto& link = l2r ? pb.l2r : pb.r2l;
+        const Int n = pb.level.size();
+        for (Int s = 0, e; s < n; s = e + 1) {
+          Int size = pb.size[s];
+          for (e = s; e+1 < n && link[e]; ++e) size += pb.size[e+1];
+          const Int a = me_side ? e : s;
+          auto& lvl = ns.levels[pb.level[a]];
+          auto& msgs = (me_side ? (l2r ? lvl.l2r_send : lvl.r2l_recv) :
+                        (l2r ? lvl.l2r_recv : lvl.r2l_send));
+          auto& buf2msg = (me_side ? (l2r ? lvl.me2l2r : lvl.me2r2l) :
+                           (l2r ? lvl.kids2l2r : lvl.kids2r2l));
+          Level::Message m;
+          m.rank = it.first;
+          m.offset = pb.offset[s];
+          m.size = size;
+          m.part = find_msg(me_side ? lvl.me : lvl.kids, pb.offset[a]);
+          cedr_assert(m.part >= 0);
+          buf2msg[m.part] = msgs.size();
+          msgs.push_back(m);
+        }
+      }
+  for (auto& lvl : ns.levels) {
+    lvl.kids_req.resize(lvl.l2r_recv.size());
+    lvl.me_recv_req.resize(lvl.r2l_recv.size());
+  }
+}
+
+// Set up comm data. Consolidate so that there is only one buffer between me
 // and another rank per level. Determine an offset for each node, to be
-// multiplied by data-size factors later, for use in data buffers.
-void init_comm (const Int my_rank, NodeSets& ns) {
+// multiplied by data-size factors later, for use in data buffers. If
+// aggregate, merge messages across levels where possible; otherwise, each
+// buffer is a message.
+void init_comm (const Parallel& p, NodeSets& ns, const bool aggregate) {
+  const Int my_rank = p.rank();
   ns.nslots = 0;
   for (auto& lvl : ns.levels) {
     Int nkids = 0;
@@ -276,11 +520,19 @@ void init_comm (const Int my_rank, NodeSets& ns) {
     }
 
     init_offsets(my_rank, me, lvl.me, ns.nslots);
-    lvl.me_send_req.resize(lvl.me.size());
-    lvl.me_recv_req.resize(lvl.me.size());
     init_offsets(my_rank, kids, lvl.kids, ns.nslots);
-    lvl.kids_req.resize(lvl.kids.size());
   }
+  Partners me, kids;
+  collect_bufs(ns, true, me);
+  collect_bufs(ns, false, kids);
+  if (aggregate) {
+    agree_on_links(p, ns, me, kids);
+    make_runs_contiguous(ns, me, kids);
+  }
+  init_msgs(ns, me, kids);
+  for (auto& lvl : ns.levels)
+    init_deps(ns, lvl);
+  init_groups(ns);
 }
 
 // Analyze the tree to extract levels. Levels are run from 0 to #level - 1. Each
@@ -292,23 +544,162 @@ void init_comm (const Int my_rank, NodeSets& ns) {
 // this rank, and those with which owned nodes must communicate.
 //   Once this function is done, the tree can be deleted.
 NodeSets::ConstPtr analyze (const Parallel::Ptr& p, const Int& ncells,
-                            const tree::Node::Ptr& tree) {
+                            const tree::FlatTree& tree,
+                            const bool aggregate = false) {
+  const Int nn = tree.nnode();
+  cedr_throw_if(tree.root < 0 || tree.root >= nn, "FlatTree root is " << tree.root);
+  cedr_throw_if(static_cast<Int>(tree.kids.size()) != 2*nn ||
+                static_cast<Int>(tree.cellidx.size()) != nn ||
+                ! (tree.level.empty() || static_cast<Int>(tree.level.size()) == nn),
+                "FlatTree arrays have inconsistent sizes.");
   const auto nodesets = std::make_shared<NodeSets>();
-  cedr_assert( ! tree->parent);
-  Int id = ncells;
-  Int depth = init_tree(p->rank(), tree, id);
-  if (tree->level >= 0) {
+  std::vector<Int> order;
+  postorder(tree, order);
+  TreeWork w;
+  Int depth = init_tree(p->rank(), tree, order, ncells, w);
+  if ( ! tree.level.empty() && tree.level[tree.root] >= 0) {
     // If level is provided, don't trust depth from init_tree. Partial trees can
     // make depth too small.
-    depth = tree->level + 1;
+    depth = tree.level[tree.root] + 1;
   }
   nodesets->levels.resize(depth);
-  level_schedule_and_collect(*nodesets, p->rank(), tree);
+  level_schedule_and_collect(*nodesets, p->rank(), tree, order, w);
   consolidate(*nodesets);
-  init_comm(p->rank(), *nodesets);
+  init_comm(*p, *nodesets, aggregate);
   return nodesets;
 }
 
+NodeSets::ConstPtr analyze (const Parallel::Ptr& p, const Int& ncells,
+                            const tree::Node::Ptr& tree,
+                            const bool aggregate = false) {
+  cedr_assert( ! tree->parent);
+  return analyze(p, ncells, tree::flatten(tree), aggregate);
+}
+
+// Make the DAG for CDR::Options::host_tasks. A message is a run of contiguous
+// slots, so each slot communicated in a sweep maps to the one message that
+// carries it, whichever level the message is listed in.
+std::shared_ptr<TaskDag> make_task_dag (const NodeSets& ns) {
+  typedef NodeSets::Level Level;
+  const auto td = std::make_shared<TaskDag>();
+  const Int nlev = ns.levels.size();
+  const auto map_slots = [&] (std::vector<Level::Message> Level::* msgs,
+                              std::vector<Int>* lvlptr,
+                              std::vector<TaskDag::Msg>* list) {
+    std::vector<Int> slot2msg(ns.nslots, -1);
+    if (lvlptr) lvlptr->assign(1, 0);
+    Int m = 0;
+    for (Int il = 0; il < nlev; ++il) {
+      const auto& lvl_msgs = ns.levels[il].*msgs;
+      for (size_t mi = 0; mi < lvl_msgs.size(); ++mi, ++m) {
+        for (Int i = 0; i < lvl_msgs[mi].size; ++i)
+          slot2msg[lvl_msgs[mi].offset + i] = m;
+        if (list) list->push_back(TaskDag::Msg{il, static_cast<Int>(mi)});
+      }
+      if (lvlptr) lvlptr->push_back(m);
+    }
+    return slot2msg;
+  };
+  const auto l2r_recv = map_slots(&Level::l2r_recv, &td->l2r_recv_lvlptr, nullptr);
+  const auto r2l_recv = map_slots(&Level::r2l_recv, &td->r2l_recv_lvlptr, nullptr);
+  const auto l2r_send = map_slots(&Level::l2r_send, nullptr, &td->l2r_send);
+  const auto r2l_send = map_slots(&Level::r2l_send, nullptr, &td->r2l_send);
+
+  std::vector<Int> node2task(ns.nnode(), -1);
+  for (const auto& lvl : ns.levels)
+    for (const auto& idx : lvl.nodes)
+      if (ns.node_h(idx)->nkids) {
+        node2task[idx] = td->nodes.size();
+        td->nodes.push_back(idx);
+      }
+  const Int ntask = td->nodes.size();
+  td->parent.assign(ntask, -1);
+  td->kids.assign(2*ntask, -1);
+  td->l2r_ndep.assign(ntask, 0);
+  td->task2l2r_send.assign(ntask, -1);
+  td->task2r2l_send.assign(2*ntask, -1);
+  td->l2r_send_ndep.assign(td->l2r_send.size(), 0);
+  td->r2l_send_ndep.assign(td->r2l_send.size(), 0);
+  // (message, task) pairs, to be sorted into the recv2task lists.
+  std::vector<std::pair<Int,Int> > l2r_deps, r2l_deps;
+  for (Int t = 0; t < ntask; ++t) {
+    const auto n = ns.node_h(td->nodes[t]);
+    for (Int k = 0; k < n->nkids; ++k) {
+      const auto kid = ns.node_h(n->kids[k]);
+      if (kid->rank == n->rank) {
+        td->kids[2*t + k] = node2task[n->kids[k]];
+        if (kid->nkids) ++td->l2r_ndep[t];
+        continue;
+      }
+      const Int mr = l2r_recv[kid->offset], ms = r2l_send[kid->offset];
+      cedr_assert(mr >= 0 && ms >= 0);
+      l2r_deps.push_back(std::make_pair(mr, t));
+      ++td->l2r_ndep[t];
+      td->task2r2l_send[2*t + k] = ms;
+      ++td->r2l_send_ndep[ms];
+    }
+    if (n->parent < 0) {
+      td->r2l_ready.push_back(t);
+    } else if (ns.node_h(n->parent)->rank == n->rank) {
+      td->parent[t] = node2task[n->parent];
+    } else {
+      const Int ms = l2r_send[n->offset], mr = r2l_recv[n->offset];
+      cedr_assert(ms >= 0 && mr >= 0);
+      td->task2l2r_send[t] = ms;
+      ++td->l2r_send_ndep[ms];
+      r2l_deps.push_back(std::make_pair(mr, t));
+    }
+    if (td->l2r_ndep[t] == 0) td->l2r_ready.push_back(t);
+  }
+  cedr_assert(td->r2l_ready.size() <= 1);
+  const auto make_lists = [] (std::vector<std::pair<Int,Int> >& deps,
+                              const Int nmsg, std::vector<Int>& ptr,
+                              std::vector<Int>& list) {
+    std::stable_sort(deps.begin(), deps.end(),
+                     [] (const std::pair<Int,Int>& a, const std::pair<Int,Int>& b)
+                     { return a.first < b.first; });
+    ptr.assign(nmsg + 1, 0);
+    list.resize(deps.size());
+    for (size_t i = 0; i < deps.size(); ++i) {
+      ++ptr[deps[i].first + 1];
+      list[i] = deps[i].second;
+    }
+    for (Int m = 0; m < nmsg; ++m) ptr[m+1] += ptr[m];
+  };
+  make_lists(l2r_deps, td->l2r_recv_lvlptr.back(), td->l2r_recv2taskptr,
+             td->l2r_recv2task);
+  make_lists(r2l_deps, td->r2l_recv_lvlptr.back(), td->r2l_recv2taskptr,
+             td->r2l_recv2task);
+  const auto order_sends = [&] (const std::vector<TaskDag::Msg>& msgs,
+                                 std::vector<Level::Message> Level::* lvl_msgs,
+                                 const bool ascending, std::vector<Int>& prev,
+                                 std::vector<Int>& next) {
+    const Int nmsg = msgs.size();
+    prev.assign(nmsg, -1);
+    next.assign(nmsg, -1);
+    std::map<Int,Int> last;
+    for (Int i = 0; i < nmsg; ++i) {
+      const Int m = ascending ? i : nmsg - 1 - i;
+      const Int rank = (ns.levels[msgs[m].lvl].*lvl_msgs)[msgs[m].mi].rank;
+      const auto it = last.find(rank);
+      if (it != last.end()) {
+        prev[m] = it->second;
+        next[it->second] = m;
+      }
+      last[rank] = m;
+    }
+  };
+  order_sends(td->l2r_send, &Level::l2r_send, true, td->l2r_send_prev,
+              td->l2r_send_next);
+  order_sends(td->r2l_send, &Level::r2l_send, false, td->r2l_send_prev,
+              td->r2l_send_next);
+  td->cnt.resize(ntask);
+  td->msg_cnt.resize(std::max(td->l2r_send.size(), td->r2l_send.size()));
+  td->msg_state.resize(td->msg_cnt.size());
+  td->npending = td->ndone = 0;
+  return td;
+}
+
 // Check that the offsets are self consistent.
 Int check_comm (const NodeSets& ns) {
   Int nerr = 0;
@@ -329,6 +720,54 @@ Int check_comm (const NodeSets& ns) {
   return nerr;
 }
 
+// Check that the message dependency data account for every slot in every
+// message.
+Int check_deps (const NodeSets& ns) {
+  Int nerr = 0;
+  for (const auto& lvl : ns.levels) {
+    for (size_t i = 0; i < lvl.me.size(); ++i)
+      if (lvl.me2nodesptr[i+1] - lvl.me2nodesptr[i] != lvl.me[i].size)
+        ++nerr;
+    for (size_t i = 0; i < lvl.kids.size(); ++i)
+      if (lvl.kids2nodesptr[i+1] - lvl.kids2nodesptr[i] != lvl.kids[i].size)
+        ++nerr;
+  }
+  return nerr;
+}
+
+// Check that, in each sweep, the messages carry every buffer exactly once and
+// are each listed with one of the buffers they carry.
+Int check_msgs (const NodeSets& ns) {
+  Int nerr = 0;
+  for (const bool me_side : {true, false})
+    for (const bool l2r : {true, false}) {
+      std::vector<Int> cnt(ns.nslots, 0);
+      for (const auto& lvl : ns.levels) {
+        const auto& bufs = me_side ? lvl.me : lvl.kids;
+        const auto& msgs = (me_side ? (l2r ? lvl.l2r_send : lvl.r2l_recv) :
+                            (l2r ? lvl.l2r_recv : lvl.r2l_send));
+        const auto& buf2msg = (me_side ? (l2r ? lvl.me2l2r : lvl.me2r2l) :
+                               (l2r ? lvl.kids2l2r : lvl.kids2r2l));
+        for (const auto& b : bufs)
+          for (Int i = 0; i < b.size; ++i) ++cnt[b.offset + i];
+        for (size_t i = 0; i < msgs.size(); ++i) {
+          const auto& m = msgs[i];
+          const auto& b = bufs[m.part];
+          if (buf2msg[m.part] != static_cast<Int>(i) || b.rank != m.rank ||
+              b.offset < m.offset || b.offset + b.size > m.offset + m.size)
+            ++nerr;
+          for (Int j = 0; j < m.size; ++j) --cnt[m.offset + j];
+        }
+        for (size_t j = 0; j < buf2msg.size(); ++j)
+          if (buf2msg[j] >= 0 && msgs[buf2msg[j]].part != static_cast<Int>(j))
+            ++nerr;
+      }
+      for (const auto& c : cnt)
+        if (c != 0) ++nerr;
+    }
+  return nerr;
+}
+
 // Check that there are the correct number of leaf nodes, and that their offsets
 // all come first and are ordered the same as ns->levels[0]->nodes.
 Int check_leaf_nodes (const Parallel::Ptr& p, const NodeSets& ns,
@@ -369,8 +808,8 @@ Int test_comm_pattern (const Parallel::Ptr& p, const NodeSets& ns,
   for (size_t il = 0; il < ns.levels.size(); ++il) {
     auto& lvl = ns.levels[il];
     // Set up receives.
-    for (size_t i = 0; i < lvl.kids.size(); ++i) {
-      const auto& mmd = lvl.kids[i];
+    for (size_t i = 0; i < lvl.l2r_recv.size(); ++i) {
+      const auto& mmd = lvl.l2r_recv[i];
       mpi::irecv(*p, &data[mmd.offset], mmd.size, mmd.rank, NodeSets::mpitag,
                  &lvl.kids_req[i]);
     }
@@ -384,8 +823,7 @@ Int test_comm_pattern (const Parallel::Ptr& p, const NodeSets& ns,
         data[n->offset] += data[ns.node_h(n->kids[i])->offset];
     }
     // Send to parents.
-    for (size_t i = 0; i < lvl.me.size(); ++i) {
-      const auto& mmd = lvl.me[i];
+    for (const auto& mmd : lvl.l2r_send) {
       mpi::isend(*p, &data[mmd.offset], mmd.size, mmd.rank, NodeSets::mpitag);
     }
   }
@@ -393,8 +831,8 @@ Int test_comm_pattern (const Parallel::Ptr& p, const NodeSets& ns,
   for (size_t il = ns.levels.size(); il > 0; --il) {
     auto& lvl = ns.levels[il-1];
     // Get the global sum from parent.
-    for (size_t i = 0; i < lvl.me.size(); ++i) {
-      const auto& mmd = lvl.me[i];
+    for (size_t i = 0; i < lvl.r2l_recv.size(); ++i) {
+      const auto& mmd = lvl.r2l_recv[i];
       mpi::irecv(*p, &data[mmd.offset], mmd.size, mmd.rank, NodeSets::mpitag,
                  &lvl.me_recv_req[i]);
     }    
@@ -407,8 +845,7 @@ Int test_comm_pattern (const Parallel::Ptr& p, const NodeSets& ns,
         data[ns.node_h(n->kids[i])->offset] = data[n->offset];
     }
     // Send.
-    for (size_t i = 0; i < lvl.kids.size(); ++i) {
-      const auto& mmd = lvl.kids[i];
+    for (const auto& mmd : lvl.r2l_send) {
       mpi::isend(*p, &data[mmd.offset], mmd.size, mmd.rank, NodeSets::mpitag);
     }
   }
@@ -433,6 +870,12 @@ Int unittest (const Parallel::Ptr& p, const NodeSets::ConstPtr& ns,
   ne = check_comm(*ns);
   if (ne && p->amroot()) pr("check_comm failed");
   nerr += ne;
+  ne = check_deps(*ns);
+  if (ne && p->amroot()) pr("check_deps failed");
+  nerr += ne;
+  ne = check_msgs(*ns);
+  if (ne && p->amroot()) pr("check_msgs failed");
+  nerr += ne;
   ne = check_leaf_nodes(p, *ns, ncells);
   if (ne && p->amroot()) pr("check_leaf_nodes failed");
   nerr += ne;
@@ -445,6 +888,9 @@ Int unittest (const Parallel::Ptr& p, const NodeSets::ConstPtr& ns,
 }
 } // namespace impl
 
+// Kinds of items in an l2r slot, for Options::single_precision_bounds.
+struct L2rField { enum : Int { mass, lower, upper }; };
+
 template <typename ES>
 void QLT<ES>::init (const std::string& name, IntList& d,
                     typename IntList::HostMirror& h, size_t n) {
@@ -478,12 +924,18 @@ void QLT<ES>::MetaData::init (const MetaDataBuilder& mdb) {
   Me::init("trcr2prob", a_d_.trcr2prob, a_h_.trcr2prob, ntracers);
   std::copy(mdb.trcr2prob.begin(), mdb.trcr2prob.end(), a_h_.trcr2prob.data());
   Kokkos::deep_copy(a_d_.trcr2prob, a_h_.trcr2prob);
+  Me::init("trcr2rhom", a_d_.trcr2rhom, a_h_.trcr2rhom, ntracers);
+  std::copy(mdb.trcr2rhom.begin(), mdb.trcr2rhom.end(), a_h_.trcr2rhom.data());
+  Kokkos::deep_copy(a_d_.trcr2rhom, a_h_.trcr2rhom);
+  a_h_.nbatch = mdb.nbatch;
+  a_h_.nrhom = 0;
+  for (const auto ri : mdb.trcr2rhom) a_h_.nrhom = std::max(a_h_.nrhom, ri+1);
 
   Me::init("bidx2trcr", a_d_.bidx2trcr, a_h_.bidx2trcr, ntracers);
   Me::init("trcr2bl2r", a_d_.trcr2bl2r, a_h_.trcr2bl2r, ntracers);
   Me::init("trcr2br2l", a_d_.trcr2br2l, a_h_.trcr2br2l, ntracers);
   a_h_.prob2trcrptr[0] = 0;
-  a_h_.prob2bl2r[0] = 1; // rho is at 0.
+  a_h_.prob2bl2r[0] = a_h_.nrhom; // The rhoms are at the start.
   a_h_.prob2br2l[0] = 0;
   for (Int pi = 0; pi < nprobtypes; ++pi) {
     a_h_.prob2trcrptr[pi+1] = a_h_.prob2trcrptr[pi];
@@ -510,15 +962,36 @@ void QLT<ES>::MetaData::init (const MetaDataBuilder& mdb) {
     a_h_.trcr2bidx(a_h_.bidx2trcr(ti)) = ti;
   Kokkos::deep_copy(a_d_.trcr2bidx, a_h_.trcr2bidx);
 
+  const Int l2rndps = a_h_.prob2bl2r[nprobtypes];
+  Me::init("l2rkind", a_d_.l2rkind, a_h_.l2rkind, l2rndps);
+  for (Int i = 0; i < l2rndps; ++i) a_h_.l2rkind(i) = L2rField::mass;
+  for (Int ti = 0; ti < ntracers; ++ti) {
+    if (a_h_.trcr2prob(ti) & ProblemType::nonnegative) continue;
+    a_h_.l2rkind(a_h_.trcr2bl2r(ti)    ) = L2rField::lower;
+    a_h_.l2rkind(a_h_.trcr2bl2r(ti) + 2) = L2rField::upper;
+  }
+  Kokkos::deep_copy(a_d_.l2rkind, a_h_.l2rkind);
+  a_h_.l2rnmass = 0;
+  for (Int i = 0; i < l2rndps; ++i)
+    if (a_h_.l2rkind(i) == L2rField::mass) ++a_h_.l2rnmass;
+  // Two floats per Real, rounded up.
+  a_h_.l2rnpk = a_h_.l2rnmass + (l2rndps - a_h_.l2rnmass + 1)/2;
+
   a_h = a_h_;
 
   // Won't default construct Unmanaged, so have to do pointer stuff and raw
   // array copy explicitly.
   a_d.trcr2prob = a_d_.trcr2prob;
+  a_d.trcr2rhom = a_d_.trcr2rhom;
+  a_d.nbatch = a_h_.nbatch;
+  a_d.nrhom = a_h_.nrhom;
   a_d.bidx2trcr = a_d_.bidx2trcr;
   a_d.trcr2bidx = a_d_.trcr2bidx;
   a_d.trcr2bl2r = a_d_.trcr2bl2r;
   a_d.trcr2br2l = a_d_.trcr2br2l;
+  a_d.l2rkind = a_d_.l2rkind;
+  a_d.l2rnmass = a_h_.l2rnmass;
+  a_d.l2rnpk = a_h_.l2rnpk;
   std::copy(a_h_.prob2trcrptr, a_h_.prob2trcrptr + nprobtypes + 1,
             a_d.prob2trcrptr);
   std::copy(a_h_.prob2bl2r, a_h_.prob2bl2r + nprobtypes + 1, a_d.prob2bl2r);
@@ -575,25 +1048,43 @@ void init_device_data (const impl::NodeSets& ns, impl::NodeSetsHostData& h,
 
 template <typename ES>
 void QLT<ES>::init (const Parallel::Ptr& p, const Int& ncells,
-                    const tree::Node::Ptr& tree) {
+                    const tree::FlatTree& tree) {
   p_ = p;
-  Timer::start(Timer::analyze);
-  ns_ = impl::analyze(p, ncells, tree);
+  ns_ = impl::analyze(p, ncells, tree, options_.aggregate_messages);
   nshd_ = std::make_shared<impl::NodeSetsHostData>();
   nsdd_ = std::make_shared<impl::NodeSetsDeviceData<ES> >();
   init_device_data(*ns_, *nshd_, *nsdd_);
   init_ordinals();
-  Timer::stop(Timer::analyze);
+  cedr_throw_if(options_.nbatch < 1, "nbatch must be >= 1.");
   mdb_ = std::make_shared<MetaDataBuilder>();
+  mdb_->nbatch = options_.nbatch;
 }
 
 template <typename ES>
 void QLT<ES>::init_ordinals () {
   gci2lci_ = std::make_shared<Gci2LciMap>();
+  auto& m = *gci2lci_;
+  const Int n = ns_->levels[0].nodes.size();
+  Int lo = std::numeric_limits<Int>::max(), hi = -1;
   for (const auto& idx : ns_->levels[0].nodes) {
-    const auto n = ns_->node_h(idx);
-    (*gci2lci_)[n->id] = n->offset;
+    lo = std::min(lo, ns_->node_h(idx)->id);
+    hi = std::max(hi, ns_->node_h(idx)->id);
+  }
+  m.gci0 = lo;
+  if (n > 0 && hi - lo + 1 <= 2*n) {
+    m.direct.assign(hi - lo + 1, -1);
+    for (const auto& idx : ns_->levels[0].nodes) {
+      const auto nd = ns_->node_h(idx);
+      m.direct[nd->id - lo] = nd->offset;
+    }
+    return;
+  }
+  m.sorted.reserve(n);
+  for (const auto& idx : ns_->levels[0].nodes) {
+    const auto nd = ns_->node_h(idx);
+    m.sorted.push_back(std::make_pair(nd->id, nd->offset));
   }
+  std::sort(m.sorted.begin(), m.sorted.end());
 }
 
 template <typename ES>
@@ -601,7 +1092,20 @@ QLT<ES>::QLT (const Parallel::Ptr& p, const Int& ncells, const tree::Node::Ptr&
               Options options)
   : CDR(options)
 {
+  prof_start(Profile::setup);
+  init(p, ncells, tree::flatten(tree));
+  prof_stop(Profile::setup, false);
+  cedr_throw_if(nlclcells() == 0, "QLT does not support 0 cells on a rank.");
+}
+
+template <typename ES>
+QLT<ES>::QLT (const Parallel::Ptr& p, const Int& ncells, const tree::FlatTree& tree,
+              Options options)
+  : CDR(options)
+{
+  prof_start(Profile::setup);
   init(p, ncells, tree);
+  prof_stop(Profile::setup, false);
   cedr_throw_if(nlclcells() == 0, "QLT does not support 0 cells on a rank.");
 }
 
@@ -629,29 +1133,47 @@ void QLT<ES>::get_owned_glblcells (std::vector<Long>& gcis) const {
 
 // For global cell index cellidx, i.e., the globally unique ordinal associated
 // with a cell in the caller's tree, return this rank's local index for
-// it. This is not an efficient operation.
+// it. This is a table lookup if this rank's gcis are dense, e.g., contiguous,
+// and a binary search otherwise.
 template <typename ES>
 Int QLT<ES>::gci2lci (const Int& gci) const {
-  const auto it = gci2lci_->find(gci);
-  if (it == gci2lci_->end()) {
+  const auto& m = *gci2lci_;
+  Int lci = -1;
+  if ( ! m.direct.empty()) {
+    const Int i = gci - m.gci0;
+    if (i >= 0 && i < static_cast<Int>(m.direct.size())) lci = m.direct[i];
+  } else {
+    const auto it = std::lower_bound(
+      m.sorted.begin(), m.sorted.end(), gci,
+      [] (const std::pair<Int,Int>& e, const Int& gci) { return e.first < gci; });
+    if (it != m.sorted.end() && it->first == gci) lci = it->second;
+  }
+  const bool found = lci >= 0;
+  if ( ! found) {
     pr(puf(gci));
     std::vector<Long> gcis;
     get_owned_glblcells(gcis);
     mprarr(gcis);
   }
-  cedr_throw_if(it == gci2lci_->end(), "gci " << gci << " not in gci2lci map.");
-  return it->second;
+  cedr_throw_if( ! found, "gci " << gci << " not in gci2lci map.");
+  return lci;
 }
 
 template <typename ES>
 void QLT<ES>::declare_tracer (int problem_type, const Int& rhomidx) {
   cedr_throw_if( ! mdb_, "end_tracer_declarations was already called; "
                  "it is an error to call declare_tracer now.");
-  cedr_throw_if(rhomidx > 0, "rhomidx > 0 is not supported yet.");
+  cedr_throw_if(rhomidx < 0, "rhomidx must be >= 0.");
   // For its exception side effect, and to get canonical problem type, since
   // some possible problem types map to the same canonical one:
   problem_type = md_.get_problem_type(md_.get_problem_type_idx(problem_type));
-  mdb_->trcr2prob.push_back(problem_type);
+  // The batch instances of a tracer are consecutive bulk tracers of the same
+  // problem type, so they are adjacent in each slot.
+  const Int nb = mdb_->nbatch;
+  for (Int bi = 0; bi < nb; ++bi) {
+    mdb_->trcr2prob.push_back(problem_type);
+    mdb_->trcr2rhom.push_back(rhomidx*nb + bi);
+  }
 }
 
 template <typename ES>
@@ -676,149 +1198,648 @@ void QLT<ES>::set_buffers (Real* buf1, Real* buf2) {
 
 template <typename ES>
 void QLT<ES>::finish_setup () {
-  if (bd_.inited()) return;
-  size_t l2r_sz, r2l_sz;
-  get_buffers_sizes(l2r_sz, r2l_sz);
-  bd_.init(l2r_sz, r2l_sz);
+  prof_start(Profile::setup);
+  if ( ! bd_.inited()) {
+    size_t l2r_sz, r2l_sz;
+    get_buffers_sizes(l2r_sz, r2l_sz);
+    bd_.init(l2r_sz, r2l_sz);
+  }
+  if (l2r_packed())
+    l2r_pack_ = RealList("QLT l2r_pack", md_.a_h.l2rnpk*ns_->nslots);
+  init_requests();
+#ifdef KOKKOS_ENABLE_OPENMP
+  if (options_.host_tasks && ! cedr::impl::OnGpu<ES>::value)
+    td_ = impl::make_task_dag(*ns_);
+#endif
+  prof_stop(Profile::setup);
+}
+
+// Every run sends and receives the same messages, with the same partners,
+// offsets, and sizes, so make each request once.
+template <typename ES>
+void QLT<ES>::init_requests () {
+  const Int l2rndps = md_.a_h.prob2bl2r[md_.nprobtypes];
+  const Int r2lndps = md_.a_h.prob2br2l[md_.nprobtypes];
+  const bool packed = l2r_packed();
+  Real* const l2rbuf = packed ? l2r_pack_.data() : bd_.l2r_data.data();
+  Real* const r2lbuf = bd_.r2l_data.data();
+  const Int l2rmdps = packed ? md_.a_h.l2rnpk : l2rndps;
+  typedef impl::NodeSets::Level::Message Message;
+  const auto init = [&] (const std::vector<Message>& msgs,
+                         Real* const buf, const Int& ndps, const bool send,
+                         mpi::PersistentRequests& preqs) {
+    preqs.reqs.resize(msgs.size());
+    for (size_t i = 0; i < msgs.size(); ++i) {
+      const auto& mmd = msgs[i];
+      if (send)
+        mpi::send_init(*p_, buf + mmd.offset*ndps, mmd.size*ndps, mmd.rank,
+                       impl::NodeSets::mpitag, &preqs.reqs[i]);
+      else
+        mpi::recv_init(*p_, buf + mmd.offset*ndps, mmd.size*ndps, mmd.rank,
+                       impl::NodeSets::mpitag, &preqs.reqs[i]);
+    }
+  };
+  reqs_ = std::make_shared<std::vector<LevelRequests> >(ns_->levels.size());
+  for (size_t il = 0; il < ns_->levels.size(); ++il) {
+    const auto& lvl = ns_->levels[il];
+    auto& lr = (*reqs_)[il];
+    init(lvl.l2r_recv, l2rbuf, l2rmdps, false, lr.l2r_recv);
+    init(lvl.l2r_send, l2rbuf, l2rmdps, true, lr.l2r_send);
+    init(lvl.r2l_recv, r2lbuf, r2lndps, false, lr.r2l_recv);
+    init(lvl.r2l_send, r2lbuf, r2lndps, true, lr.r2l_send);
+  }
+}
+
+// Complete the l2r or r2l sends of every level. A send must complete before its
+// buffer is written again and before its request is restarted.
+template <typename ES>
+void QLT<ES>::wait_sends (const bool l2r) const {
+  prof_start(Profile::wait);
+  for (auto& lr : *reqs_) {
+    auto& reqs = l2r ? lr.l2r_send.reqs : lr.r2l_send.reqs;
+    if (reqs.size()) mpi::waitall(reqs.size(), reqs.data());
+  }
+  prof_stop(Profile::wait);
 }
 
 template <typename ES>
 int QLT<ES>::get_problem_type (const Int& tracer_idx) const {
-  cedr_throw_if(tracer_idx < 0 || tracer_idx > md_.a_h.trcr2prob.extent_int(0),
+  cedr_throw_if(tracer_idx < 0 || tracer_idx >= get_num_tracers(),
                 "tracer_idx is out of bounds: " << tracer_idx);
-  return md_.a_h.trcr2prob[tracer_idx];
+  return md_.a_h.trcr2prob[tracer_idx*md_.a_h.nbatch];
 }
 
 template <typename ES>
 Int QLT<ES>::get_num_tracers () const {
-  return md_.a_h.trcr2prob.size();
+  return md_.a_h.trcr2prob.size() / md_.a_h.nbatch;
+}
+
+// Round v to a float toward the inside of the bound: up for a lower bound and
+// down for an upper one. Thus a bound never loosens.
+KOKKOS_INLINE_FUNCTION
+float round_bound_inward (const Real& v, const bool lower) {
+  typedef std::numeric_limits<float> L;
+  float f = (v > L::max() ? L::infinity() :
+             (v < -L::max() ? -L::infinity() : static_cast<float>(v)));
+  if (lower ? f < v : f > v)
+    f = nextafterf(f, lower ? L::infinity() : -L::infinity());
+  return f;
+}
+
+// Pack l2r slot os into pack: the mass items as Reals, then the bounds as
+// floats.
+template <typename Data, typename MDArrays>
+KOKKOS_INLINE_FUNCTION
+void l2r_pack_slot (const Data& l2r_data, const Data& pack, const MDArrays& a,
+                    const Int& l2rndps, const Int& os) {
+  const Real* const s = &l2r_data(os*l2rndps);
+  Real* const p = &pack(os*a.l2rnpk);
+  char* const pb = reinterpret_cast<char*>(p + a.l2rnmass);
+  for (Int i = 0, im = 0, ib = 0; i < l2rndps; ++i) {
+    const Int kind = a.l2rkind(i);
+    if (kind == L2rField::mass) {
+      p[im++] = s[i];
+    } else {
+      const float f = round_bound_inward(s[i], kind == L2rField::lower);
+      memcpy(pb + sizeof(float)*ib++, &f, sizeof(float));
+    }
+  }
+}
+
+template <typename Data, typename MDArrays>
+KOKKOS_INLINE_FUNCTION
+void l2r_unpack_slot (const Data& l2r_data, const Data& pack, const MDArrays& a,
+                      const Int& l2rndps, const Int& os) {
+  Real* const s = &l2r_data(os*l2rndps);
+  const Real* const p = &pack(os*a.l2rnpk);
+  const char* const pb = reinterpret_cast<const char*>(p + a.l2rnmass);
+  for (Int i = 0, im = 0, ib = 0; i < l2rndps; ++i) {
+    if (a.l2rkind(i) == L2rField::mass) {
+      s[i] = p[im++];
+    } else {
+      float f;
+      memcpy(&f, pb + sizeof(float)*ib++, sizeof(float));
+      s[i] = f;
+    }
+  }
+}
+
+// Pack or unpack the l2r slots [os, os+n). Both fence so that MPI or the host
+// can use the data.
+template <typename ES> void QLT<ES>
+::l2r_pack (const Int& os, const Int& n, const Int& l2rndps) const {
+  const auto l2r_data = bd_.l2r_data;
+  const typename BulkData::UnmanagedRealList pack = l2r_pack_;
+  const auto a = md_.a_d;
+  const auto f = KOKKOS_LAMBDA (const Int& i) {
+    l2r_pack_slot(l2r_data, pack, a, l2rndps, i);
+  };
+  Kokkos::parallel_for(Kokkos::RangePolicy<ES>(os, os+n), f);
+  Kokkos::fence();
+}
+
+template <typename ES> void QLT<ES>
+::l2r_unpack (const Int& os, const Int& n, const Int& l2rndps) const {
+  const auto l2r_data = bd_.l2r_data;
+  const typename BulkData::UnmanagedRealList pack = l2r_pack_;
+  const auto a = md_.a_d;
+  const auto f = KOKKOS_LAMBDA (const Int& i) {
+    l2r_unpack_slot(l2r_data, pack, a, l2rndps, i);
+  };
+  Kokkos::parallel_for(Kokkos::RangePolicy<ES>(os, os+n), f);
+  Kokkos::fence();
 }
 
 template <typename ES> void QLT<ES>
 ::l2r_recv (const impl::NodeSets::Level& lvl, const Int& l2rndps) const {
-  for (size_t i = 0; i < lvl.kids.size(); ++i) {
-    const auto& mmd = lvl.kids[i];
-    mpi::irecv(*p_, bd_.l2r_data.data() + mmd.offset*l2rndps, mmd.size*l2rndps,
-               mmd.rank, impl::NodeSets::mpitag, &lvl.kids_req[i]);
+  const Int ndps = l2r_packed() ? md_.a_h.l2rnpk : l2rndps;
+  auto& reqs = get_requests(lvl).l2r_recv.reqs;
+  mpi::startall(reqs.size(), reqs.data());
+  for (const auto& mmd : lvl.l2r_recv)
+    prof_msg(false, mmd.size*ndps*sizeof(Real));
+}
+
+template <typename NodeSetsDD, typename Data, typename MDArrays>
+KOKKOS_INLINE_FUNCTION
+void l2r_combine_node_field (const NodeSetsDD& d, const Data& l2r_data,
+                             const MDArrays& a, const Int& l2rndps,
+                             const Int& il, const Int& fi) {
+  const auto node_idx = d.lvl(il);
+  const auto& n = d.node(node_idx);
+  if ( ! n.nkids) return;
+  cedr_kernel_assert(n.nkids == 2);
+  if (fi < a.nrhom) {
+    // Total densities.
+    l2r_data(n.offset*l2rndps + fi) =
+      (l2r_data(d.node(n.kids[0]).offset*l2rndps + fi) +
+       l2r_data(d.node(n.kids[1]).offset*l2rndps + fi));
+  } else {
+    // Tracers. Order by bulk index for efficiency of memory access.
+    const Int bi = fi - a.nrhom; // bulk index
+    const Int ti = a.bidx2trcr(bi); // tracer index
+    const Int problem_type = a.trcr2prob(ti);
+    const bool nonnegative = problem_type & ProblemType::nonnegative;
+    const bool shapepreserve = problem_type & ProblemType::shapepreserve;
+    const bool conserve = problem_type & ProblemType::conserve;
+    const Int bdi = a.trcr2bl2r(ti);
+    Real* const me = &l2r_data(n.offset*l2rndps + bdi);
+    const auto& kid0 = d.node(n.kids[0]);
+    const auto& kid1 = d.node(n.kids[1]);
+    const Real* const k0 = &l2r_data(kid0.offset*l2rndps + bdi);
+    const Real* const k1 = &l2r_data(kid1.offset*l2rndps + bdi);
+    if (nonnegative) {
+      me[0] = k0[0] + k1[0];
+      if (conserve) me[1] = k0[1] + k1[1];
+    } else {
+      me[0] = shapepreserve ? k0[0] + k1[0] : cedr::impl::min(k0[0], k1[0]);
+      me[1] = k0[1] + k1[1];
+      me[2] = shapepreserve ? k0[2] + k1[2] : cedr::impl::max(k0[2], k1[2]);
+      if (conserve) me[3] = k0[3] + k1[3] ;
+    }
   }
-  Timer::start(Timer::waitall);
-  mpi::waitall(lvl.kids_req.size(), lvl.kids_req.data());
-  Timer::stop(Timer::waitall);
 }
 
+// Levels having at most this much work are run by one team, with a barrier
+// between levels, so that a run of them costs one kernel launch.
+static const Int max_fused_level_work = 4096;
+
+// Combine all the nodes in levels [lvlb, lvle) on the GPU, where a kernel launch
+// per message would cost more than it saves. No fence is done; the caller must
+// fence before MPI reads the data.
 template <typename ES> void QLT<ES>
-::l2r_combine_kid_data (const Int& lvlidx, const Int& l2rndps) const {
-  if (cedr::impl::OnGpu<ES>::value) {
-    const auto d = *nsdd_;
-    const auto l2r_data = bd_.l2r_data;
-    const auto a = md_.a_d;
-    const Int ntracer = a.trcr2prob.size();
-    const Int nfield = ntracer + 1;
-    const Int lvl_os = nshd_->lvlptr(lvlidx);
-    const Int N = nfield*(nshd_->lvlptr(lvlidx+1) - lvl_os);
-    const auto combine_kid_data = KOKKOS_LAMBDA (const Int& k) {
-      const Int il = lvl_os + k / nfield;
-      const Int fi = k % nfield;
-      const auto node_idx = d.lvl(il);
-      const auto& n = d.node(node_idx);
-      if ( ! n.nkids) return;
-      cedr_kernel_assert(n.nkids == 2);
-      if (fi == 0) {
-        // Total density.
-        l2r_data(n.offset*l2rndps) =
-          (l2r_data(d.node(n.kids[0]).offset*l2rndps) +
-           l2r_data(d.node(n.kids[1]).offset*l2rndps));
-      } else {
-        // Tracers. Order by bulk index for efficiency of memory access.
-        const Int bi = fi - 1; // bulk index
-        const Int ti = a.bidx2trcr(bi); // tracer (user) index
-        const Int problem_type = a.trcr2prob(ti);
-        const bool nonnegative = problem_type & ProblemType::nonnegative;
-        const bool shapepreserve = problem_type & ProblemType::shapepreserve;
-        const bool conserve = problem_type & ProblemType::conserve;
-        const Int bdi = a.trcr2bl2r(ti);
-        Real* const me = &l2r_data(n.offset*l2rndps + bdi);
-        const auto& kid0 = d.node(n.kids[0]);
-        const auto& kid1 = d.node(n.kids[1]);
-        const Real* const k0 = &l2r_data(kid0.offset*l2rndps + bdi);
-        const Real* const k1 = &l2r_data(kid1.offset*l2rndps + bdi);
-        if (nonnegative) {
-          me[0] = k0[0] + k1[0];
-          if (conserve) me[1] = k0[1] + k1[1];
-        } else {
-          me[0] = shapepreserve ? k0[0] + k1[0] : cedr::impl::min(k0[0], k1[0]);
-          me[1] = k0[1] + k1[1];
-          me[2] = shapepreserve ? k0[2] + k1[2] : cedr::impl::max(k0[2], k1[2]);
-          if (conserve) me[3] = k0[3] + k1[3] ;
+::l2r_combine_kid_data (const Int& lvlb, const Int& lvle, const Int& l2rndps) const {
+  using ESU = cedr::impl::ExeSpaceUtils<ES>;
+  prof_start(Profile::local);
+  const auto d = *nsdd_;
+  const auto l2r_data = bd_.l2r_data;
+  const auto a = md_.a_d;
+  const Int ntracer = a.trcr2prob.size();
+  const Int nfield = ntracer + a.nrhom;
+  const auto& lvlptr = nshd_->lvlptr;
+  for (Int il = lvlb; il < lvle; ) {
+    // Find the run of small levels starting at il.
+    Int ie = il, max_work = 0;
+    for ( ; ie < lvle; ++ie) {
+      const Int work = nfield*(lvlptr(ie+1) - lvlptr(ie));
+      if (work > max_fused_level_work) break;
+      max_work = std::max(max_work, work);
+    }
+    if (ie - il > 1) {
+      const auto combine_levels = KOKKOS_LAMBDA (const typename ESU::Member& t) {
+        for (Int l = il; l < ie; ++l) {
+          const Int lvl_os = d.lvlptr(l);
+          const Int N = nfield*(d.lvlptr(l+1) - lvl_os);
+          Kokkos::parallel_for(Kokkos::TeamThreadRange(t, N), [&] (const Int& k) {
+            l2r_combine_node_field(d, l2r_data, a, l2rndps, lvl_os + k / nfield,
+                                   k % nfield);
+          });
+          t.team_barrier();
         }
+      };
+      Kokkos::parallel_for(ESU::get_default_team_policy(1, max_work),
+                           combine_levels);
+      il = ie;
+    } else {
+      const Int lvl_os = lvlptr(il);
+      const Int N = nfield*(lvlptr(il+1) - lvl_os);
+      const auto combine_kid_data = KOKKOS_LAMBDA (const Int& k) {
+        l2r_combine_node_field(d, l2r_data, a, l2rndps, lvl_os + k / nfield,
+                               k % nfield);
+      };
+      Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, N), combine_kid_data);
+      ++il;
+    }
+  }
+  prof_stop(Profile::local);
+}
+
+// Combine the kids' data into node n's.
+template <typename ES> void QLT<ES>
+::l2r_combine_node (const impl::NodeSets::Node& n, const Int& l2rndps) const {
+  if ( ! n.nkids) return;
+  cedr_assert(n.nkids == 2);
+  // Total densities.
+  for (Int ri = 0; ri < md_.a_d.nrhom; ++ri)
+    bd_.l2r_data(n.offset*l2rndps + ri) =
+      (bd_.l2r_data(ns_->node_h(n.kids[0])->offset*l2rndps + ri) +
+       bd_.l2r_data(ns_->node_h(n.kids[1])->offset*l2rndps + ri));
+  // Tracers.
+  for (Int pti = 0; pti < md_.nprobtypes; ++pti) {
+    const Int problem_type = md_.get_problem_type(pti);
+    const bool nonnegative = problem_type & ProblemType::nonnegative;
+    const bool shapepreserve = problem_type & ProblemType::shapepreserve;
+    const bool conserve = problem_type & ProblemType::conserve;
+    const Int bis = md_.a_d.prob2trcrptr[pti], bie = md_.a_d.prob2trcrptr[pti+1];
+    for (Int bi = bis; bi < bie; ++bi) {
+      const Int bdi = md_.a_d.trcr2bl2r(md_.a_d.bidx2trcr(bi));
+      Real* const me = &bd_.l2r_data(n.offset*l2rndps + bdi);
+      const auto kid0 = ns_->node_h(n.kids[0]);
+      const auto kid1 = ns_->node_h(n.kids[1]);
+      const Real* const k0 = &bd_.l2r_data(kid0->offset*l2rndps + bdi);
+      const Real* const k1 = &bd_.l2r_data(kid1->offset*l2rndps + bdi);
+      if (nonnegative) {
+        me[0] = k0[0] + k1[0];
+        if (conserve) me[1] = k0[1] + k1[1];
+      } else {
+        me[0] = shapepreserve ? k0[0] + k1[0] : cedr::impl::min(k0[0], k1[0]);
+        me[1] = k0[1] + k1[1];
+        me[2] = shapepreserve ? k0[2] + k1[2] : cedr::impl::max(k0[2], k1[2]);
+        if (conserve) me[3] = k0[3] + k1[3] ;
       }
-    };
-    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, N), combine_kid_data);
+    }
+  }
+}
+
+// Combine the nodes lvl.nodes[lvl.ready[0:nready-1]].
+template <typename ES> void QLT<ES>
+::l2r_combine_kid_data (const impl::NodeSets::Level& lvl, const Int& nready,
+                        const Int& l2rndps) const {
+  prof_start(Profile::local);
+#ifdef KOKKOS_ENABLE_OPENMP
+# pragma omp parallel for
+#endif
+  for (Int ri = 0; ri < nready; ++ri)
+    l2r_combine_node(*ns_->node_h(lvl.nodes[lvl.ready[ri]]), l2rndps);
+  prof_stop(Profile::local);
+}
+
+template <typename ES> void QLT<ES>
+::l2r_send_to_parent (const impl::NodeSets::Level& lvl, const Int& mi,
+                      const Int& l2rndps, const bool pack) const {
+  const auto& mmd = lvl.l2r_send[mi];
+  const bool packed = l2r_packed();
+  if (packed && pack) l2r_pack(mmd.offset, mmd.size, l2rndps);
+  mpi::start(&get_requests(lvl).l2r_send.reqs[mi]);
+  prof_msg(true, mmd.size*(packed ? md_.a_h.l2rnpk : l2rndps)*sizeof(Real));
+}
+
+template <typename ES> void QLT<ES>
+::l2r_send_to_parents (const impl::NodeSets::Level& lvl, const Int& l2rndps) const {
+  for (size_t i = 0; i < lvl.l2r_send.size(); ++i)
+    l2r_send_to_parent(lvl, i, l2rndps);
+}
+
+// Combine the nodes lvl.nodes[lvl.ready[0:nready-1]], then send each message to
+// a parent once all of its nodes are combined. A message carrying buffers of
+// lower levels, too, is sent with its buffer in this level.
+template <typename ES> void QLT<ES>
+::l2r_combine_and_send (const impl::NodeSets::Level& lvl, const Int& nready,
+                        const Int& l2rndps) const {
+  if (nready == 0) return;
+  l2r_combine_kid_data(lvl, nready, l2rndps);
+  for (Int i = 0; i < nready; ++i) {
+    const Int bi = lvl.node2me[lvl.ready[i]];
+    if (bi >= 0 && --lvl.msg_cnt[bi] == 0 && lvl.me2l2r[bi] >= 0)
+      l2r_send_to_parent(lvl, lvl.me2l2r[bi], l2rndps);
+  }
+}
+
+// The leaves-to-root sweep processes a level in the order messages arrive. On
+// the host, a node is combined once all of its kids' data are available, and a
+// message to a parent is sent once all of its nodes are combined. On the GPU,
+// the level is combined in one kernel once all of its messages have arrived.
+template <typename ES> void QLT<ES>
+::l2r_begin_level (const Int& lvlidx, const Int& l2rndps) const {
+  const auto& lvl = ns_->levels[lvlidx];
+  if (lvl.l2r_recv.size()) l2r_recv(lvl, l2rndps);
+  if (cedr::impl::OnGpu<ES>::value) return;
+  for (size_t i = 0; i < lvl.me.size(); ++i)
+    lvl.msg_cnt[i] = lvl.me[i].size;
+  // Nodes with no kids on other ranks, or whose kids' buffers arrived in a
+  // lower level's message, are ready now.
+  const Int nnode = lvl.nodes.size();
+  Int nready = 0;
+  for (Int i = 0; i < nnode; ++i) {
+    lvl.node_cnt[i] = 0;
+    for (Int k = 0; k < 2; ++k) {
+      const Int bi = lvl.node2kids[2*i + k];
+      if (bi >= 0 && lvl.kids2l2r[bi] >= 0) ++lvl.node_cnt[i];
+    }
+    if (lvl.node_cnt[i] == 0) lvl.ready[nready++] = i;
+  }
+  l2r_combine_and_send(lvl, nready, l2rndps);
+}
+
+template <typename ES> void QLT<ES>
+::l2r_recvd_msg (const Int& lvlidx, const Int& mi, const Int& l2rndps) const {
+  const auto& lvl = ns_->levels[lvlidx];
+  if (l2r_packed())
+    l2r_unpack(lvl.l2r_recv[mi].offset, lvl.l2r_recv[mi].size, l2rndps);
+  if (cedr::impl::OnGpu<ES>::value) return;
+  const Int bi = lvl.l2r_recv[mi].part;
+  Int nready = 0;
+  for (Int j = lvl.kids2nodesptr[bi]; j < lvl.kids2nodesptr[bi+1]; ++j) {
+    const Int ni = lvl.kids2nodes[j];
+    if (--lvl.node_cnt[ni] == 0) lvl.ready[nready++] = ni;
+  }
+  l2r_combine_and_send(lvl, nready, l2rndps);
+}
+
+// On the GPU, a level group is combined once its highest level is reached.
+template <typename ES> void QLT<ES>
+::l2r_end_level (const Int& lvlidx, const Int& l2rndps) const {
+  if ( ! cedr::impl::OnGpu<ES>::value) return;
+  const auto& lvl = ns_->levels[lvlidx];
+  const Int nlev = ns_->levels.size();
+  if (lvlidx+1 < nlev && ns_->levels[lvlidx+1].l2r_group == lvl.l2r_group)
+    return;
+  l2r_combine_kid_data(lvl.l2r_group, lvlidx+1, l2rndps);
+  if (lvl.l2r_send.size()) {
     Kokkos::fence();
-  } else {
-    const auto& lvl = ns_->levels[lvlidx];
-    const Int n_lvl_nodes = lvl.nodes.size();
+    l2r_send_to_parents(lvl, l2rndps);
+  }
+}
+
+// Advance the leaves-to-root sweep. If wait, block until the sweep is done;
+// otherwise, return as soon as a message that has not yet arrived is
+// needed. Return whether the sweep is done.
+template <typename ES>
+bool QLT<ES>::l2r_progress (const bool wait) {
+  if (td_) return l2r_progress_tasks(wait);
+  const Int l2rndps = md_.a_h.prob2bl2r[md_.nprobtypes];
+  const Int nlev = ns_->levels.size();
+  for ( ; rs_.il < nlev; ++rs_.il, rs_.nmsg = -1) {
+    const auto& lvl = ns_->levels[rs_.il];
+    if (rs_.nmsg < 0) {
+      l2r_begin_level(rs_.il, l2rndps);
+      rs_.nmsg = 0;
+    }
+    const Int nmsg = lvl.l2r_recv.size();
+    for ( ; rs_.nmsg < nmsg; ++rs_.nmsg) {
+      int mi, flag = 1;
+      prof_start(Profile::wait);
+      auto* const reqs = get_requests(lvl).l2r_recv.reqs.data();
+      if (wait)
+        mpi::waitany(nmsg, reqs, &mi);
+      else
+        mpi::testany(nmsg, reqs, &mi, &flag);
+      prof_stop(Profile::wait);
+      if ( ! flag) return false;
+      l2r_recvd_msg(rs_.il, mi, l2rndps);
+    }
+    l2r_end_level(rs_.il, l2rndps);
+  }
+  return true;
+}
+
 #ifdef KOKKOS_ENABLE_OPENMP
-#   pragma omp parallel for
+// For Options::host_tasks. Tasks that are ready to run are in a stack shared by
+// the threads. Every thread pops and runs tasks; the master thread, between
+// tasks, also polls for messages and starts the queued sends, as it alone calls
+// MPI. A thread that finds no task yields, so that idle threads do not slow
+// the others on an oversubscribed node. Counts shared among the threads are
+// updated atomically.
+static Int atomic_decrement (Int& cnt) {
+  Int v;
+# pragma omp atomic capture seq_cst
+  v = --cnt;
+  return v;
+}
+
+static Int atomic_read (const Int& v) {
+  Int r;
+# pragma omp atomic read seq_cst
+  r = v;
+  return r;
+}
+
+static void task_push (const impl::TaskDag& td, const Int& t) {
+# pragma omp atomic seq_cst
+  ++td.npending;
+# pragma omp critical (cedr_qlt_ready)
+  td.ready.push_back(t);
+}
+
+static Int task_pop (const impl::TaskDag& td) {
+  Int t = -1;
+# pragma omp critical (cedr_qlt_ready)
+  if ( ! td.ready.empty()) {
+    t = td.ready.back();
+    td.ready.pop_back();
+  }
+  return t;
+}
+
+static void send_push (const impl::TaskDag& td, const Int& m) {
+# pragma omp critical (cedr_qlt_sendq)
+  td.sendq.push_back(m);
+}
+
+static void send_take (const impl::TaskDag& td, std::vector<Int>& sendq) {
+  sendq.clear();
+# pragma omp critical (cedr_qlt_sendq)
+  sendq.swap(td.sendq);
+}
 #endif
-    for (Int ni = 0; ni < n_lvl_nodes; ++ni) {
-      const auto lvlidx = lvl.nodes[ni];
-      const auto n = ns_->node_h(lvlidx);
-      if ( ! n->nkids) continue;
-      cedr_assert(n->nkids == 2);
-      // Total density.
-      bd_.l2r_data(n->offset*l2rndps) =
-        (bd_.l2r_data(ns_->node_h(n->kids[0])->offset*l2rndps) +
-         bd_.l2r_data(ns_->node_h(n->kids[1])->offset*l2rndps));
-      // Tracers.
-      for (Int pti = 0; pti < md_.nprobtypes; ++pti) {
-        const Int problem_type = md_.get_problem_type(pti);
-        const bool nonnegative = problem_type & ProblemType::nonnegative;
-        const bool shapepreserve = problem_type & ProblemType::shapepreserve;
-        const bool conserve = problem_type & ProblemType::conserve;
-        const Int bis = md_.a_d.prob2trcrptr[pti], bie = md_.a_d.prob2trcrptr[pti+1];
-        for (Int bi = bis; bi < bie; ++bi) {
-          const Int bdi = md_.a_d.trcr2bl2r(md_.a_d.bidx2trcr(bi));
-          Real* const me = &bd_.l2r_data(n->offset*l2rndps + bdi);
-          const auto kid0 = ns_->node_h(n->kids[0]);
-          const auto kid1 = ns_->node_h(n->kids[1]);
-          const Real* const k0 = &bd_.l2r_data(kid0->offset*l2rndps + bdi);
-          const Real* const k1 = &bd_.l2r_data(kid1->offset*l2rndps + bdi);
-          if (nonnegative) {
-            me[0] = k0[0] + k1[0];
-            if (conserve) me[1] = k0[1] + k1[1];
-          } else {
-            me[0] = shapepreserve ? k0[0] + k1[0] : cedr::impl::min(k0[0], k1[0]);
-            me[1] = k0[1] + k1[1];
-            me[2] = shapepreserve ? k0[2] + k1[2] : cedr::impl::max(k0[2], k1[2]);
-            if (conserve) me[3] = k0[3] + k1[3] ;
-          }
+
+// Mark send message m ready, and start it and the ready messages after it to
+// the same rank if every message before it is started. The caller has packed
+// l2r messages.
+template <typename ES> void QLT<ES>
+::send_in_order (const bool l2r, const Int& m, const Int& ndps) const {
+  const auto& td = *td_;
+  const auto& prev = l2r ? td.l2r_send_prev : td.r2l_send_prev;
+  const auto& next = l2r ? td.l2r_send_next : td.r2l_send_next;
+  auto& state = td.msg_state;
+  state[m] = 1;
+  if (prev[m] >= 0 && state[prev[m]] != 2) return;
+  for (Int k = m; k >= 0 && state[k] == 1; k = next[k]) {
+    state[k] = 2;
+    if (l2r)
+      l2r_send_to_parent(ns_->levels[td.l2r_send[k].lvl], td.l2r_send[k].mi,
+                         ndps, false);
+    else
+      r2l_send_to_kid(ns_->levels[td.r2l_send[k].lvl], td.r2l_send[k].mi, ndps);
+  }
+}
+
+// With host tasks, a task combines its node and then, if it is its parent's
+// last dependency, continues with the parent, so that a chain up the tree is
+// one task. A send message whose last node is combined is packed and queued for
+// the master thread.
+template <typename ES> void QLT<ES>
+::l2r_run_task (Int t, const Int& l2rndps) const {
+#ifdef KOKKOS_ENABLE_OPENMP
+  const auto& td = *td_;
+  while (t >= 0) {
+    l2r_combine_node(*ns_->node_h(td.nodes[t]), l2rndps);
+    const Int m = td.task2l2r_send[t];
+    if (m >= 0 && atomic_decrement(td.msg_cnt[m]) == 0) {
+      if (l2r_packed()) {
+        const typename BulkData::UnmanagedRealList pack = l2r_pack_;
+        const auto& mmd = ns_->levels[td.l2r_send[m].lvl].l2r_send[td.l2r_send[m].mi];
+        for (Int i = mmd.offset; i < mmd.offset + mmd.size; ++i)
+          l2r_pack_slot(bd_.l2r_data, pack, md_.a_d, l2rndps, i);
+      }
+      send_push(td, m);
+    }
+    const Int pt = td.parent[t];
+    t = pt >= 0 && atomic_decrement(td.cnt[pt]) == 0 ? pt : -1;
+#   pragma omp atomic seq_cst
+    ++td.ndone;
+  }
+#endif
+}
+
+// Start the queued sends and receive the messages that have arrived, pushing
+// the tasks they release. Return whether the sweep is done, and set suspend if
+// not wait and nothing remains to be done until another message arrives.
+template <typename ES>
+bool QLT<ES>::l2r_poll_tasks (const bool wait, bool& suspend) {
+#ifdef KOKKOS_ENABLE_OPENMP
+  const auto& td = *td_;
+  const Int l2rndps = md_.a_h.prob2bl2r[md_.nprobtypes];
+  const Int nlev = ns_->levels.size();
+  // Read the counts before taking the queued sends, so that every send queued
+  // by a task counted here is started.
+  const Int ndone = atomic_read(td.ndone), npending = atomic_read(td.npending);
+  send_take(td, td.sendq_master);
+  for (const Int m : td.sendq_master) send_in_order(true, m, l2rndps);
+  if (ndone == static_cast<Int>(td.nodes.size()) &&
+      rs_.nmsg == td.l2r_recv_lvlptr.back())
+    return true;
+  bool recvd = false;
+  for (Int il = 0; il < nlev; ++il) {
+    const auto& lvl = ns_->levels[il];
+    const Int n = lvl.l2r_recv.size();
+    if ( ! n) continue;
+    int mi, flag;
+    mpi::testany(n, get_requests(lvl).l2r_recv.reqs.data(), &mi, &flag);
+    if ( ! flag || mi == MPI_UNDEFINED) continue;
+    recvd = true;
+    ++rs_.nmsg;
+    const auto& mmd = lvl.l2r_recv[mi];
+    if (l2r_packed()) {
+      const typename BulkData::UnmanagedRealList pack = l2r_pack_;
+      for (Int i = mmd.offset; i < mmd.offset + mmd.size; ++i)
+        l2r_unpack_slot(bd_.l2r_data, pack, md_.a_d, l2rndps, i);
+    }
+    const Int m = td.l2r_recv_lvlptr[il] + mi;
+    for (Int j = td.l2r_recv2taskptr[m]; j < td.l2r_recv2taskptr[m+1]; ++j) {
+      const Int t = td.l2r_recv2task[j];
+      if (atomic_decrement(td.cnt[t]) == 0) task_push(td, t);
+    }
+  }
+  suspend = ! wait && ! recvd && npending == 0;
+#endif
+  return false;
+}
+
+// The leaves-to-root sweep with host tasks. If not wait, return once no task is
+// ready or running and no message has arrived. Return whether the sweep is
+// done.
+template <typename ES>
+bool QLT<ES>::l2r_progress_tasks (const bool wait) {
+  bool done = false;
+#ifdef KOKKOS_ENABLE_OPENMP
+  const auto& td = *td_;
+  const Int l2rndps = md_.a_h.prob2bl2r[md_.nprobtypes];
+  if (rs_.nmsg < 0) {
+    for (const auto& lvl : ns_->levels)
+      if (lvl.l2r_recv.size()) l2r_recv(lvl, l2rndps);
+    std::copy(td.l2r_ndep.begin(), td.l2r_ndep.end(), td.cnt.begin());
+    std::copy(td.l2r_send_ndep.begin(), td.l2r_send_ndep.end(),
+              td.msg_cnt.begin());
+    td.ready.assign(td.l2r_ready.rbegin(), td.l2r_ready.rend());
+    td.npending = td.ready.size();
+    td.ndone = 0;
+    td.sendq.clear();
+    std::fill(td.msg_state.begin(), td.msg_state.end(), 0);
+    // Messages carrying only leaves are ready now.
+    for (size_t m = 0; m < td.l2r_send.size(); ++m)
+      if (td.msg_cnt[m] == 0) {
+        if (l2r_packed()) {
+          const auto& mmd = ns_->levels[td.l2r_send[m].lvl].l2r_send[td.l2r_send[m].mi];
+          l2r_pack(mmd.offset, mmd.size, l2rndps);
         }
+        send_in_order(true, m, l2rndps);
       }
+    rs_.nmsg = 0;
+  }
+  prof_start(Profile::local);
+  Int stop = 0;
+# pragma omp parallel
+  for (;;) {
+#   pragma omp master
+    {
+      bool suspend = false;
+      done = l2r_poll_tasks(wait, suspend);
+      if (done || suspend) {
+#       pragma omp atomic write seq_cst
+        stop = 1;
+      }
+    }
+    if (atomic_read(stop)) break;
+    const Int t = task_pop(td);
+    if (t < 0) {
+      std::this_thread::yield();
+      continue;
     }
+    l2r_run_task(t, l2rndps);
+#   pragma omp atomic seq_cst
+    --td.npending;
   }
+  prof_stop(Profile::local);
+#endif
+  return done;
 }
 
-template <typename ES> void QLT<ES>
-::l2r_send_to_parents (const impl::NodeSets::Level& lvl, const Int& l2rndps) const {
-  for (size_t i = 0; i < lvl.me.size(); ++i) {
-    const auto& mmd = lvl.me[i];
-    mpi::isend(*p_, bd_.l2r_data.data() + mmd.offset*l2rndps, mmd.size*l2rndps,
-               mmd.rank, impl::NodeSets::mpitag);
-  }  
+template <typename ES>
+Int QLT<ES>::get_root_node () const {
+  if (ns_->levels.empty() || ns_->levels.back().nodes.size() != 1 ||
+      ns_->node_h(ns_->levels.back().nodes[0])->parent >= 0)
+    return -1;
+  return ns_->levels.back().nodes[0];
 }
 
 template <typename ES> void QLT<ES>
 ::root_compute (const Int& l2rndps, const Int& r2lndps) const {
-  if (ns_->levels.empty() || ns_->levels.back().nodes.size() != 1 ||
-      ns_->node_h(ns_->levels.back().nodes[0])->parent >= 0)
-    return;
+  const Int node_idx = get_root_node();
+  if (node_idx < 0) return;
   const auto d = *nsdd_;
   const auto l2r_data = bd_.l2r_data;
   const auto r2l_data = bd_.r2l_data;
   const auto a = md_.a_d;
-  const Int nlev = nshd_->lvlptr.size() - 1;
-  const Int node_idx = nshd_->lvl(nshd_->lvlptr(nlev-1));
   const Int ntracer = a.trcr2prob.size();
   const auto compute = KOKKOS_LAMBDA (const Int& bi) {
     const auto& n = d.node(node_idx);
@@ -842,19 +1863,16 @@ template <typename ES> void QLT<ES>
     }
   };
   Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, ntracer), compute);
-  Kokkos::fence();
+  // On the GPU, the next operation is a kernel in the same stream.
+  if ( ! cedr::impl::OnGpu<ES>::value) Kokkos::fence();
 }
 
 template <typename ES> void QLT<ES>
 ::r2l_recv (const impl::NodeSets::Level& lvl, const Int& r2lndps) const {
-  for (size_t i = 0; i < lvl.me.size(); ++i) {
-    const auto& mmd = lvl.me[i];
-    mpi::irecv(*p_, bd_.r2l_data.data() + mmd.offset*r2lndps, mmd.size*r2lndps,
-               mmd.rank, impl::NodeSets::mpitag, &lvl.me_recv_req[i]);
-  }
-  Timer::start(Timer::waitall);
-  mpi::waitall(lvl.me_recv_req.size(), lvl.me_recv_req.data());
-  Timer::stop(Timer::waitall);
+  auto& reqs = get_requests(lvl).r2l_recv.reqs;
+  mpi::startall(reqs.size(), reqs.data());
+  for (const auto& mmd : lvl.r2l_recv)
+    prof_msg(false, mmd.size*r2lndps*sizeof(Real));
 }
 
 template <typename Data> KOKKOS_INLINE_FUNCTION
@@ -866,7 +1884,7 @@ void r2l_solve_qp_set_q (
   l2r_data(os*l2rndps + l2rbdi + 0) = q_min;
   l2r_data(os*l2rndps + l2rbdi + 2) = q_max;
   r2l_data(os*r2lndps + r2lbdi + 1) = q_min;
-  r2l_data(os*r2lndps + r2lbdi + 2) = q_max; 
+  r2l_data(os*r2lndps + r2lbdi + 2) = q_max;
 }
 
 template <typename Data> KOKKOS_INLINE_FUNCTION
@@ -875,135 +1893,377 @@ void r2l_solve_qp_solve_node_problem (
   const impl::NodeSets::Node& n,
   const impl::NodeSets::Node& k0, const impl::NodeSets::Node& k1,
   const Int& l2rndps, const Int& r2lndps,
-  const Int& l2rbdi, const Int& r2lbdi,
+  const Int& l2rbdi, const Int& r2lbdi, const Int& rhomidx,
   const bool prefer_mass_con_to_bounds)
 {
   impl::solve_node_problem(
     problem_type,
-     l2r_data( n.offset*l2rndps),
+     l2r_data( n.offset*l2rndps + rhomidx),
     &l2r_data( n.offset*l2rndps + l2rbdi),
      r2l_data( n.offset*r2lndps + r2lbdi),
-     l2r_data(k0.offset*l2rndps),
+     l2r_data(k0.offset*l2rndps + rhomidx),
     &l2r_data(k0.offset*l2rndps + l2rbdi),
      r2l_data(k0.offset*r2lndps + r2lbdi),
-     l2r_data(k1.offset*l2rndps),
+     l2r_data(k1.offset*l2rndps + rhomidx),
     &l2r_data(k1.offset*l2rndps + l2rbdi),
      r2l_data(k1.offset*r2lndps + r2lbdi),
     prefer_mass_con_to_bounds);
 }
 
+template <typename NodeSetsDD, typename Data, typename MDArrays>
+KOKKOS_INLINE_FUNCTION
+void r2l_solve_qp_node_tracer (const NodeSetsDD& d, const Data& l2r_data,
+                               const Data& r2l_data, const MDArrays& a,
+                               const Int& l2rndps, const Int& r2lndps,
+                               const Int& il, const Int& bi,
+                               const bool prefer_mass_con_to_bounds) {
+  const auto node_idx = d.lvl(il);
+  const auto& n = d.node(node_idx);
+  if ( ! n.nkids) return;
+  const Int ti = a.bidx2trcr(bi);
+  const Int problem_type = a.trcr2prob(ti);
+  const Int l2rbdi = a.trcr2bl2r(a.bidx2trcr(bi));
+  const Int r2lbdi = a.trcr2br2l(a.bidx2trcr(bi));
+  cedr_kernel_assert(n.nkids == 2);
+  if ((problem_type & ProblemType::consistent) &&
+      ! (problem_type & ProblemType::shapepreserve)) {
+    // Pass q_{min,max} info along. l2r data are updated for use in
+    // solve_node_problem. r2l data are updated for use in isend.
+    const Real q_min = r2l_data(n.offset*r2lndps + r2lbdi + 1);
+    const Real q_max = r2l_data(n.offset*r2lndps + r2lbdi + 2);
+    l2r_data(n.offset*l2rndps + l2rbdi + 0) = q_min;
+    l2r_data(n.offset*l2rndps + l2rbdi + 2) = q_max;
+    for (Int k = 0; k < 2; ++k)
+      r2l_solve_qp_set_q(l2r_data, r2l_data, d.node(n.kids[k]).offset,
+                         l2rndps, r2lndps, l2rbdi, r2lbdi, q_min, q_max);
+  }
+  r2l_solve_qp_solve_node_problem(
+    l2r_data, r2l_data, problem_type, n, d.node(n.kids[0]), d.node(n.kids[1]),
+    l2rndps, r2lndps, l2rbdi, r2lbdi, a.trcr2rhom(ti),
+    prefer_mass_con_to_bounds);
+}
+
+// Solve the QPs for all the nodes in levels lvle-1 down to lvlb, for the
+// GPU. As in l2r_combine_kid_data, runs of small levels are fused, and no fence
+// is done.
 template <typename ES> void QLT<ES>
-::r2l_solve_qp (const Int& lvlidx, const Int& l2rndps, const Int& r2lndps) const {
-  Timer::start(Timer::snp);
+::r2l_solve_qp (const Int& lvlb, const Int& lvle, const Int& l2rndps,
+                const Int& r2lndps) const {
+  using ESU = cedr::impl::ExeSpaceUtils<ES>;
+  prof_start(Profile::local);
   const bool prefer_mass_con_to_bounds =
     options_.prefer_numerical_mass_conservation_to_numerical_bounds;
-  if (cedr::impl::OnGpu<ES>::value) {
-    const auto d = *nsdd_;
-    const auto l2r_data = bd_.l2r_data;
-    const auto r2l_data = bd_.r2l_data;
-    const auto a = md_.a_d;
-    const Int ntracer = a.trcr2prob.size();
-    const Int lvl_os = nshd_->lvlptr(lvlidx);
-    const Int N = ntracer*(nshd_->lvlptr(lvlidx+1) - lvl_os);
-    const auto solve_qp = KOKKOS_LAMBDA (const Int& k) {
-      const Int il = lvl_os + k / ntracer;
-      const Int bi = k % ntracer;
-      const auto node_idx = d.lvl(il);
-      const auto& n = d.node(node_idx);
-      if ( ! n.nkids) return;
-      const Int ti = a.bidx2trcr(bi);
-      const Int problem_type = a.trcr2prob(ti);
-      const Int l2rbdi = a.trcr2bl2r(a.bidx2trcr(bi));
-      const Int r2lbdi = a.trcr2br2l(a.bidx2trcr(bi));
-      cedr_kernel_assert(n.nkids == 2);
+  const auto d = *nsdd_;
+  const auto l2r_data = bd_.l2r_data;
+  const auto r2l_data = bd_.r2l_data;
+  const auto a = md_.a_d;
+  const Int ntracer = a.trcr2prob.size();
+  const auto& lvlptr = nshd_->lvlptr;
+  for (Int il = lvle; il > lvlb; ) {
+    // Find the run of small levels il-1 down to ie.
+    Int ie = il, max_work = 0;
+    for ( ; ie > lvlb; --ie) {
+      const Int work = ntracer*(lvlptr(ie) - lvlptr(ie-1));
+      if (work > max_fused_level_work) break;
+      max_work = std::max(max_work, work);
+    }
+    if (il - ie > 1) {
+      const auto solve_levels = KOKKOS_LAMBDA (const typename ESU::Member& t) {
+        for (Int l = il-1; l >= ie; --l) {
+          const Int lvl_os = d.lvlptr(l);
+          const Int N = ntracer*(d.lvlptr(l+1) - lvl_os);
+          Kokkos::parallel_for(Kokkos::TeamThreadRange(t, N), [&] (const Int& k) {
+            r2l_solve_qp_node_tracer(d, l2r_data, r2l_data, a, l2rndps, r2lndps,
+                                     lvl_os + k / ntracer, k % ntracer,
+                                     prefer_mass_con_to_bounds);
+          });
+          t.team_barrier();
+        }
+      };
+      Kokkos::parallel_for(ESU::get_default_team_policy(1, max_work),
+                           solve_levels);
+      il = ie;
+    } else {
+      const Int lvl_os = lvlptr(il-1);
+      const Int N = ntracer*(lvlptr(il) - lvl_os);
+      const auto solve_qp = KOKKOS_LAMBDA (const Int& k) {
+        r2l_solve_qp_node_tracer(d, l2r_data, r2l_data, a, l2rndps, r2lndps,
+                                 lvl_os + k / ntracer, k % ntracer,
+                                 prefer_mass_con_to_bounds);
+      };
+      Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, N), solve_qp);
+      --il;
+    }
+  }
+  prof_stop(Profile::local);
+}
+
+// Solve node n's QPs, giving its kids' data.
+template <typename ES> void QLT<ES>
+::r2l_solve_node_qp (const impl::NodeSets::Node& n, const Int& l2rndps,
+                     const Int& r2lndps,
+                     const bool prefer_mass_con_to_bounds) const {
+  if ( ! n.nkids) return;
+  for (Int pti = 0; pti < md_.nprobtypes; ++pti) {
+    const Int problem_type = md_.get_problem_type(pti);
+    const Int bis = md_.a_d.prob2trcrptr[pti], bie = md_.a_d.prob2trcrptr[pti+1];
+    for (Int bi = bis; bi < bie; ++bi) {
+      const Int l2rbdi = md_.a_d.trcr2bl2r(md_.a_d.bidx2trcr(bi));
+      const Int r2lbdi = md_.a_d.trcr2br2l(md_.a_d.bidx2trcr(bi));
+      cedr_assert(n.nkids == 2);
       if ((problem_type & ProblemType::consistent) &&
           ! (problem_type & ProblemType::shapepreserve)) {
-        // Pass q_{min,max} info along. l2r data are updated for use in
-        // solve_node_problem. r2l data are updated for use in isend.
-        const Real q_min = r2l_data(n.offset*r2lndps + r2lbdi + 1);
-        const Real q_max = r2l_data(n.offset*r2lndps + r2lbdi + 2);
-        l2r_data(n.offset*l2rndps + l2rbdi + 0) = q_min;
-        l2r_data(n.offset*l2rndps + l2rbdi + 2) = q_max;
+        const Real q_min = bd_.r2l_data(n.offset*r2lndps + r2lbdi + 1);
+        const Real q_max = bd_.r2l_data(n.offset*r2lndps + r2lbdi + 2);
+        bd_.l2r_data(n.offset*l2rndps + l2rbdi + 0) = q_min;
+        bd_.l2r_data(n.offset*l2rndps + l2rbdi + 2) = q_max;
         for (Int k = 0; k < 2; ++k)
-          r2l_solve_qp_set_q(l2r_data, r2l_data, d.node(n.kids[k]).offset,
+          r2l_solve_qp_set_q(bd_.l2r_data, bd_.r2l_data,
+                             ns_->node_h(n.kids[k])->offset,
                              l2rndps, r2lndps, l2rbdi, r2lbdi, q_min, q_max);
       }
       r2l_solve_qp_solve_node_problem(
-        l2r_data, r2l_data, problem_type, n, d.node(n.kids[0]), d.node(n.kids[1]),
-        l2rndps, r2lndps, l2rbdi, r2lbdi, prefer_mass_con_to_bounds);
-    };
-    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, N), solve_qp);
-    Kokkos::fence();
-  } else {
-    const auto& lvl = ns_->levels[lvlidx];
-    const Int n_lvl_nodes = lvl.nodes.size();
+        bd_.l2r_data, bd_.r2l_data, problem_type, n, *ns_->node_h(n.kids[0]),
+        *ns_->node_h(n.kids[1]), l2rndps, r2lndps, l2rbdi, r2lbdi,
+        md_.a_d.trcr2rhom(md_.a_d.bidx2trcr(bi)), prefer_mass_con_to_bounds);
+    }
+  }
+}
+
+// Solve the QPs for the nodes lvl.nodes[lvl.ready[0:nready-1]].
+template <typename ES> void QLT<ES>
+::r2l_solve_qp (const impl::NodeSets::Level& lvl, const Int& nready,
+                const Int& l2rndps, const Int& r2lndps) const {
+  prof_start(Profile::local);
+  const bool prefer_mass_con_to_bounds =
+    options_.prefer_numerical_mass_conservation_to_numerical_bounds;
 #ifdef KOKKOS_ENABLE_OPENMP
-#   pragma omp parallel for
+# pragma omp parallel for
 #endif
-    for (Int ni = 0; ni < n_lvl_nodes; ++ni) {
-      const auto lvlidx = lvl.nodes[ni];
-      const auto n = ns_->node_h(lvlidx);
-      if ( ! n->nkids) continue;
-      for (Int pti = 0; pti < md_.nprobtypes; ++pti) {
-        const Int problem_type = md_.get_problem_type(pti);
-        const Int bis = md_.a_d.prob2trcrptr[pti], bie = md_.a_d.prob2trcrptr[pti+1];
-        for (Int bi = bis; bi < bie; ++bi) {
-          const Int l2rbdi = md_.a_d.trcr2bl2r(md_.a_d.bidx2trcr(bi));
-          const Int r2lbdi = md_.a_d.trcr2br2l(md_.a_d.bidx2trcr(bi));
-          cedr_assert(n->nkids == 2);
-          if ((problem_type & ProblemType::consistent) &&
-              ! (problem_type & ProblemType::shapepreserve)) {
-            const Real q_min = bd_.r2l_data(n->offset*r2lndps + r2lbdi + 1);
-            const Real q_max = bd_.r2l_data(n->offset*r2lndps + r2lbdi + 2);
-            bd_.l2r_data(n->offset*l2rndps + l2rbdi + 0) = q_min;
-            bd_.l2r_data(n->offset*l2rndps + l2rbdi + 2) = q_max;
-            for (Int k = 0; k < 2; ++k)
-              r2l_solve_qp_set_q(bd_.l2r_data, bd_.r2l_data,
-                                 ns_->node_h(n->kids[k])->offset,
-                                 l2rndps, r2lndps, l2rbdi, r2lbdi, q_min, q_max);
-          }
-          r2l_solve_qp_solve_node_problem(
-            bd_.l2r_data, bd_.r2l_data, problem_type, *n, *ns_->node_h(n->kids[0]),
-            *ns_->node_h(n->kids[1]), l2rndps, r2lndps, l2rbdi, r2lbdi,
-            prefer_mass_con_to_bounds);
+  for (Int ri = 0; ri < nready; ++ri)
+    r2l_solve_node_qp(*ns_->node_h(lvl.nodes[lvl.ready[ri]]), l2rndps, r2lndps,
+                      prefer_mass_con_to_bounds);
+  prof_stop(Profile::local);
+}
+
+template <typename ES> void QLT<ES>
+::r2l_send_to_kid (const impl::NodeSets::Level& lvl, const Int& mi,
+                   const Int& r2lndps) const {
+  mpi::start(&get_requests(lvl).r2l_send.reqs[mi]);
+  prof_msg(true, lvl.r2l_send[mi].size*r2lndps*sizeof(Real));
+}
+
+template <typename ES> void QLT<ES>
+::r2l_send_to_kids (const impl::NodeSets::Level& lvl, const Int& r2lndps) const {
+  for (size_t i = 0; i < lvl.r2l_send.size(); ++i)
+    r2l_send_to_kid(lvl, i, r2lndps);
+}
+
+// Process a level rootward-to-leafward in the order messages arrive. A node's
+// QP is solved once its parent's data are available, and a message to kids is
+// sent once all of the nodes having kids in it are solved.
+template <typename ES> void QLT<ES>
+::r2l_run_level (const impl::NodeSets::Level& lvl, const Int& l2rndps,
+                 const Int& r2lndps) const {
+  const Int nnode = lvl.nodes.size(), nmsg = lvl.r2l_recv.size();
+  if (nmsg) r2l_recv(lvl, r2lndps);
+  for (size_t i = 0; i < lvl.kids.size(); ++i)
+    lvl.msg_cnt[i] = lvl.kids[i].size;
+  // Nodes whose parent is on this rank, that are the root, or whose parent's
+  // buffer arrived in a higher level's message are ready now.
+  Int nready = 0;
+  for (Int i = 0; i < nnode; ++i)
+    if (lvl.node2me[i] < 0 || lvl.me2r2l[lvl.node2me[i]] < 0)
+      lvl.ready[nready++] = i;
+  for (Int im = 0; ; ++im) {
+    if (nready) {
+      r2l_solve_qp(lvl, nready, l2rndps, r2lndps);
+      for (Int i = 0; i < nready; ++i)
+        for (Int k = 0; k < 2; ++k) {
+          const Int bi = lvl.node2kids[2*lvl.ready[i] + k];
+          if (bi >= 0 && --lvl.msg_cnt[bi] == 0 && lvl.kids2r2l[bi] >= 0)
+            r2l_send_to_kid(lvl, lvl.kids2r2l[bi], r2lndps);
         }
-      }
+      nready = 0;
     }
+    if (im == nmsg) break;
+    int mi;
+    prof_start(Profile::wait);
+    mpi::waitany(nmsg, get_requests(lvl).r2l_recv.reqs.data(), &mi);
+    prof_stop(Profile::wait);
+    const Int bi = lvl.r2l_recv[mi].part;
+    for (Int j = lvl.me2nodesptr[bi]; j < lvl.me2nodesptr[bi+1]; ++j)
+      lvl.ready[nready++] = lvl.me2nodes[j];
   }
-  Timer::stop(Timer::snp);
 }
 
+// With host tasks, a task solves its node's QPs and then continues with one kid
+// and pushes the other, queuing each send message whose last kid it gives.
 template <typename ES> void QLT<ES>
-::r2l_send_to_kids (const impl::NodeSets::Level& lvl, const Int& r2lndps) const {
-  for (size_t i = 0; i < lvl.kids.size(); ++i) {
-    const auto& mmd = lvl.kids[i];
-    mpi::isend(*p_, bd_.r2l_data.data() + mmd.offset*r2lndps, mmd.size*r2lndps,
-               mmd.rank, impl::NodeSets::mpitag);
+::r2l_run_task (Int t, const Int& l2rndps, const Int& r2lndps) const {
+#ifdef KOKKOS_ENABLE_OPENMP
+  const auto& td = *td_;
+  const bool prefer_mass_con_to_bounds =
+    options_.prefer_numerical_mass_conservation_to_numerical_bounds;
+  while (t >= 0) {
+    r2l_solve_node_qp(*ns_->node_h(td.nodes[t]), l2rndps, r2lndps,
+                      prefer_mass_con_to_bounds);
+    Int next = -1;
+    for (Int k = 0; k < 2; ++k) {
+      const Int m = td.task2r2l_send[2*t + k];
+      if (m >= 0 && atomic_decrement(td.msg_cnt[m]) == 0) send_push(td, m);
+      const Int kt = td.kids[2*t + k];
+      if (kt < 0) continue;
+      if (next < 0) next = kt;
+      else task_push(td, kt);
+    }
+#   pragma omp atomic seq_cst
+    ++td.ndone;
+    t = next;
+  }
+#endif
+}
+
+// As l2r_poll_tasks, for the root-to-leaves sweep.
+template <typename ES> bool QLT<ES>
+::r2l_poll_tasks (const Int& r2lndps, Int& nrecvd) const {
+#ifdef KOKKOS_ENABLE_OPENMP
+  const auto& td = *td_;
+  const Int nlev = ns_->levels.size();
+  const Int ndone = atomic_read(td.ndone);
+  send_take(td, td.sendq_master);
+  for (const Int m : td.sendq_master) send_in_order(false, m, r2lndps);
+  if (ndone == static_cast<Int>(td.nodes.size()) &&
+      nrecvd == td.r2l_recv_lvlptr.back())
+    return true;
+  for (Int il = 0; il < nlev; ++il) {
+    const auto& lvl = ns_->levels[il];
+    const Int n = lvl.r2l_recv.size();
+    if ( ! n) continue;
+    int mi, flag;
+    mpi::testany(n, get_requests(lvl).r2l_recv.reqs.data(), &mi, &flag);
+    if ( ! flag || mi == MPI_UNDEFINED) continue;
+    ++nrecvd;
+    const Int m = td.r2l_recv_lvlptr[il] + mi;
+    for (Int j = td.r2l_recv2taskptr[m]; j < td.r2l_recv2taskptr[m+1]; ++j)
+      task_push(td, td.r2l_recv2task[j]);
   }
+#endif
+  return false;
+}
+
+// The root-to-leaves sweep with host tasks, organized as l2r_progress_tasks.
+template <typename ES> void QLT<ES>
+::r2l_run_tasks (const Int& l2rndps, const Int& r2lndps) const {
+#ifdef KOKKOS_ENABLE_OPENMP
+  const auto& td = *td_;
+  // Post the receives in the order the levels are run.
+  for (Int il = ns_->levels.size() - 1; il >= 0; --il)
+    if (ns_->levels[il].r2l_recv.size()) r2l_recv(ns_->levels[il], r2lndps);
+  std::copy(td.r2l_send_ndep.begin(), td.r2l_send_ndep.end(),
+            td.msg_cnt.begin());
+  std::fill(td.msg_state.begin(), td.msg_state.end(), 0);
+  td.ready = td.r2l_ready;
+  td.npending = td.ready.size();
+  td.ndone = 0;
+  td.sendq.clear();
+  prof_start(Profile::local);
+  Int stop = 0, nrecvd = 0;
+# pragma omp parallel
+  for (;;) {
+#   pragma omp master
+    if (r2l_poll_tasks(r2lndps, nrecvd)) {
+#     pragma omp atomic write seq_cst
+      stop = 1;
+    }
+    if (atomic_read(stop)) break;
+    const Int t = task_pop(td);
+    if (t >= 0) r2l_run_task(t, l2rndps, r2lndps);
+    else std::this_thread::yield();
+  }
+  prof_stop(Profile::local);
+#endif
 }
 
 template <typename ES>
-void QLT<ES>::run () {
-  cedr_assert(bd_.inited());
-  Timer::start(Timer::qltrunl2r);
-  // Number of data per slot.
+void QLT<ES>::r2l_run () const {
   const Int l2rndps = md_.a_h.prob2bl2r[md_.nprobtypes];
   const Int r2lndps = md_.a_h.prob2br2l[md_.nprobtypes];
-  for (size_t il = 0; il < ns_->levels.size(); ++il) {
-    auto& lvl = ns_->levels[il];
-    if (lvl.kids.size()) l2r_recv(lvl, l2rndps);
-    l2r_combine_kid_data(il, l2rndps);    
-    if (lvl.me.size()) l2r_send_to_parents(lvl, l2rndps);
-  }
-  Timer::stop(Timer::qltrunl2r); Timer::start(Timer::qltrunr2l);
+  prof_start(Profile::r2l);
+  // The QPs write to the l2r buffers of sent messages.
+  wait_sends(true);
   root_compute(l2rndps, r2lndps);
-  for (size_t il = ns_->levels.size(); il > 0; --il) {
-    auto& lvl = ns_->levels[il-1];
-    if (lvl.me.size()) r2l_recv(lvl, r2lndps);
-    r2l_solve_qp(il-1, l2rndps, r2lndps);
-    if (lvl.kids.size()) r2l_send_to_kids(lvl, r2lndps);
+  // On the host, each node is processed as soon as its data arrive, level by
+  // level or, with host tasks, over the whole tree at once. On the GPU, each
+  // level group is processed once its data arrive, and the only fences are
+  // before sends and at the end.
+  if (td_) {
+    r2l_run_tasks(l2rndps, r2lndps);
+    wait_sends(false);
+    prof_stop(Profile::r2l);
+    return;
   }
-  Timer::stop(Timer::qltrunr2l);
+  for (Int il = ns_->levels.size() - 1; il >= 0; --il) {
+    auto& lvl = ns_->levels[il];
+    if ( ! cedr::impl::OnGpu<ES>::value) {
+      r2l_run_level(lvl, l2rndps, r2lndps);
+      continue;
+    }
+    if (lvl.r2l_recv.size()) {
+      r2l_recv(lvl, r2lndps);
+      auto& reqs = get_requests(lvl).r2l_recv.reqs;
+      prof_start(Profile::wait);
+      mpi::waitall(reqs.size(), reqs.data());
+      prof_stop(Profile::wait);
+    }
+    if (il > 0 && ns_->levels[il-1].r2l_group == lvl.r2l_group) continue;
+    r2l_solve_qp(il, lvl.r2l_group+1, l2rndps, r2lndps);
+    if (lvl.r2l_send.size()) {
+      Kokkos::fence();
+      r2l_send_to_kids(lvl, r2lndps);
+    }
+  }
+  if (cedr::impl::OnGpu<ES>::value) Kokkos::fence();
+  wait_sends(false);
+  prof_stop(Profile::r2l);
+}
+
+template <typename ES>
+void QLT<ES>::run () {
+  cedr_assert(bd_.inited());
+  cedr_throw_if(rs_.active, "run was called between run_begin and run_end.");
+  rs_ = RunState();
+  prof_start(Profile::run);
+  prof_start(Profile::l2r);
+  l2r_progress(true);
+  prof_stop(Profile::l2r);
+  r2l_run();
+  prof_stop(Profile::run);
+}
+
+template <typename ES>
+void QLT<ES>::run_begin () {
+  cedr_assert(bd_.inited());
+  cedr_throw_if(rs_.active, "run_begin was called twice without run_end.");
+  rs_ = RunState();
+  rs_.active = true;
+  prof_start(Profile::run);
+  prof_start(Profile::l2r);
+  l2r_progress(false);
+  prof_stop(Profile::l2r, false);
+  prof_stop(Profile::run, false);
+}
+
+template <typename ES>
+void QLT<ES>::run_end () {
+  cedr_throw_if( ! rs_.active, "run_end was called without run_begin.");
+  prof_start(Profile::run);
+  prof_start(Profile::l2r);
+  l2r_progress(true);
+  prof_stop(Profile::l2r);
+  rs_.active = false;
+  r2l_run();
+  prof_stop(Profile::run);
 }
 
 namespace test {
@@ -1015,14 +2275,16 @@ public:
 
   TestQLT (const Parallel::Ptr& p, const tree::Node::Ptr& tree,
            const Int& ncells, const bool external_memory, const bool verbose,
-           CDR::Options options)
-    : TestRandomized("QLT", p, ncells, verbose, options),
+           CDR::Options options, const Int nrhom = 1)
+    : TestRandomized("QLT", p, ncells, verbose, options, nrhom),
       qlt_(p, ncells, tree, options), tree_(tree), external_memory_(external_memory)
   {
     if (verbose) qlt_.print(std::cout);
     init();
   }
 
+  const QLTT& get_qlt () const { return qlt_; }
+
 private:
   QLTT qlt_;
   tree::Node::Ptr tree_;
@@ -1060,7 +2322,7 @@ private:
 
   void init_tracers () override {
     for (const auto& t : tracers_)
-      qlt_.declare_tracer(t.problem_type, 0);
+      qlt_.declare_tracer(t.problem_type, t.rhomidx);
     qlt_.end_tracer_declarations();
     if (external_memory_) {
       size_t l2r_sz, r2l_sz;
@@ -1082,17 +2344,16 @@ private:
   
   void run_impl (const Int trial) override {
     MPI_Barrier(p_->comm());
-    Timer::start(Timer::qltrun);
-    qlt_.run();
-    MPI_Barrier(p_->comm());
-    Timer::stop(Timer::qltrun);
-    if (trial == 0) {
-      Timer::reset(Timer::qltrun);
-      Timer::reset(Timer::qltrunl2r);
-      Timer::reset(Timer::qltrunr2l);
-      Timer::reset(Timer::waitall);
-      Timer::reset(Timer::snp);
+    // Alternate between the blocking and split-phase interfaces.
+    if (trial % 2 == 0) {
+      qlt_.run();
+    } else {
+      qlt_.run_begin();
+      qlt_.run_end();
     }
+    MPI_Barrier(p_->comm());
+    // Don't count the first trial's warmup.
+    if (trial == 0) qlt_.reset_profile();
   }
 };
 
@@ -1100,12 +2361,24 @@ private:
 Int test_qlt (const Parallel::Ptr& p, const tree::Node::Ptr& tree,
               const Int& ncells, const Int nrepeat,
               const bool write, const bool external_memory,
-              const bool prefer_mass_con_to_bounds, const bool verbose) {
+              const bool prefer_mass_con_to_bounds, const bool verbose,
+              const bool print_profile, const bool aggregate_messages,
+              const Int nrhom, const bool single_precision_bounds,
+              const bool host_tasks) {
   CDR::Options options;
   options.prefer_numerical_mass_conservation_to_numerical_bounds =
     prefer_mass_con_to_bounds;
-  return TestQLT(p, tree, ncells, external_memory, verbose, options)
-    .run<TestQLT::QLTT>(nrepeat, write);
+  options.profile = true;
+  options.aggregate_messages = aggregate_messages;
+  options.single_precision_bounds = single_precision_bounds;
+  options.host_tasks = host_tasks;
+  TestQLT t(p, tree, ncells, external_memory, verbose, options, nrhom);
+  const Int nerr = t.run<TestQLT::QLTT>(nrepeat, write);
+  if (print_profile) {
+    const auto s = t.get_qlt().summarize_profile(*p);
+    if (p->amroot()) s.print(std::cout);
+  }
+  return nerr;
 }
 } // namespace test
 
@@ -1232,12 +2505,368 @@ Int unittest (const Parallel::Ptr& p) {
 } // namespace test
 } // namespace oned
 
+tree::FlatTree tree::flatten (const Node::Ptr& tree) {
+  FlatTree t;
+  t.root = 0;
+  bool has_level = false;
+  // Number nodes in pre-order.
+  std::vector<std::pair<const Node*, Int> > stack(1, std::make_pair(tree.get(), -1));
+  while ( ! stack.empty()) {
+    const auto node = stack.back().first;
+    const Int parent_slot = stack.back().second;
+    stack.pop_back();
+    const Int i = t.nnode();
+    if (parent_slot >= 0) t.kids[parent_slot] = i;
+    t.rank.push_back(node->rank);
+    t.cellidx.push_back(node->cellidx);
+    t.level.push_back(node->level);
+    if (node->level >= 0) has_level = true;
+    t.kids.push_back(-1);
+    t.kids.push_back(-1);
+    // Push kid 1 first so that kid 0 gets the next index.
+    for (Int k = node->nkids - 1; k >= 0; --k) {
+      cedr_assert(node == node->kids[k]->parent);
+      stack.push_back(std::make_pair(node->kids[k].get(), 2*i + k));
+    }
+  }
+  if ( ! has_level) t.level.clear();
+  return t;
+}
+
+tree::FlatTree tree::make_partial_tree (const FlatTree& t, const Int rank) {
+  const Int nn = t.nnode();
+  std::vector<Int> order;
+  impl::postorder(t, order);
+  // Resolve ranks and levels as analyze does, and find parents.
+  std::vector<Int> nrank(t.rank), level(nn, 0), parent(nn, -1);
+  for (const Int i : order) {
+    const Int* const kids = &t.kids[2*i];
+    for (Int k = 0; k < 2 && kids[k] >= 0; ++k) {
+      parent[kids[k]] = i;
+      level[i] = std::max(level[i], level[kids[k]] + 1);
+    }
+    if (kids[0] >= 0 && nrank[i] < 0) nrank[i] = nrank[kids[0]];
+    if ( ! t.level.empty() && t.level[i] >= 0) level[i] = t.level[i];
+  }
+  // keep is 1 for owned nodes and their ancestors, whose kids are kept, and 2
+  // for the other kids of those, which are cut below.
+  std::vector<char> keep(nn, 0);
+  keep[t.root] = 1;
+  for (Int i = 0; i < nn; ++i) {
+    if (nrank[i] != rank) continue;
+    for (Int j = i; j >= 0 && keep[j] != 1; j = parent[j]) keep[j] = 1;
+  }
+  FlatTree pt;
+  pt.root = 0;
+  std::vector<std::pair<Int,Int> > stack(1, std::make_pair(t.root, -1));
+  while ( ! stack.empty()) {
+    const Int i = stack.back().first, parent_slot = stack.back().second;
+    stack.pop_back();
+    const Int j = pt.nnode();
+    if (parent_slot >= 0) pt.kids[parent_slot] = j;
+    const bool cut = keep[i] != 1, leaf = t.kids[2*i] < 0;
+    pt.rank.push_back(nrank[i]);
+    pt.level.push_back(level[i]);
+    pt.cellidx.push_back(leaf ? t.cellidx[i] : -1);
+    pt.kids.push_back(-1);
+    pt.kids.push_back(-1);
+    if (cut) continue;
+    for (Int k = 1; k >= 0; --k) {
+      const Int kid = t.kids[2*i + k];
+      if (kid < 0) continue;
+      if ( ! keep[kid]) keep[kid] = 2;
+      stack.push_back(std::make_pair(kid, 2*j + k));
+    }
+  }
+  return pt;
+}
+
 tree::Node::Ptr tree::make_tree_over_1d_mesh (const Parallel::Ptr& p, const Int& ncells,
                                               const bool imbalanced) {
   return oned::make_tree(oned::Mesh(ncells, p), imbalanced);
 }
 
+namespace tree {
+namespace graph {
+// A graph in CSR format with edge weights.
+struct Graph {
+  std::vector<Int> xadj, adjncy;
+  std::vector<Long> wgt;
+  Int nv () const { return static_cast<Int>(xadj.size()) - 1; }
+};
+
+// A subtree and the number of cells in it.
+struct Item {
+  Node::Ptr node;
+  Long ncell;
+  Item () : ncell(0) {}
+};
+
+// Breadth-first traversal from start over the unvisited vertices of g, visiting
+// neighbors in order of decreasing edge weight. Append the vertices to order,
+// if provided, and return the last one.
+Int bfs (const Graph& g, const Int start, std::vector<char>& visited,
+         std::vector<Int>* order) {
+  std::vector<Int> q(1, start), nbrs;
+  visited[start] = 1;
+  for (size_t qi = 0; qi < q.size(); ++qi) {
+    const Int v = q[qi];
+    nbrs.clear();
+    for (Int j = g.xadj[v]; j < g.xadj[v+1]; ++j)
+      if ( ! visited[g.adjncy[j]]) nbrs.push_back(j);
+    std::stable_sort(nbrs.begin(), nbrs.end(),
+                     [&] (const Int& a, const Int& b) { return g.wgt[a] > g.wgt[b]; });
+    for (const Int j : nbrs) {
+      const Int u = g.adjncy[j];
+      if (visited[u]) continue;
+      visited[u] = 1;
+      q.push_back(u);
+    }
+  }
+  if (order) order->insert(order->end(), q.begin(), q.end());
+  return q.back();
+}
+
+// Order the vertices of g so that each connected component is traversed
+// breadth first from a pseudo-peripheral vertex.
+void bfs_order (const Graph& g, std::vector<Int>& order) {
+  const Int nv = g.nv();
+  order.clear();
+  std::vector<char> visited(nv, 0), trial(nv, 0);
+  for (Int v = 0; v < nv; ++v) {
+    if (visited[v]) continue;
+    // The last vertex of a traversal is far from the start.
+    trial = visited;
+    const Int start = bfs(g, v, trial, nullptr);
+    bfs(g, start, visited, &order);
+  }
+}
+
+// Build a tree over items[b:e-1], splitting so the halves' cell counts are as
+// close as possible.
+Node::Ptr make_balanced (const std::vector<Item>& items, const Int b, const Int e) {
+  if (e - b == 1) return items[b].node;
+  Long total = 0;
+  for (Int i = b; i < e; ++i) total += items[i].ncell;
+  Int m = b+1;
+  Long prefix = items[b].ncell;
+  for (Int i = b+1; i < e-1; ++i) {
+    const Long next = prefix + items[i].ncell;
+    if (std::abs(2*next - total) >= std::abs(2*prefix - total)) break;
+    prefix = next;
+    m = i+1;
+  }
+  const auto n = std::make_shared<Node>();
+  n->nkids = 2;
+  n->kids[0] = make_balanced(items, b, m);
+  n->kids[1] = make_balanced(items, m, e);
+  for (Int k = 0; k < 2; ++k) n->kids[k]->parent = n.get();
+  return n;
+}
+
+// items are partitioned into ngroup groups by item2group, and g is the graph
+// over items. Make one subtree per group, in groups, and return the graph over
+// groups in gg, with edge weights summed over the edges of g that connect
+// groups. A group having no items gets an empty Item.
+void merge_groups (const std::vector<Item>& items, const std::vector<Int>& item2group,
+                   const Int ngroup, const Graph& g,
+                   std::vector<Item>& groups, Graph& gg) {
+  const Int ni = items.size();
+  std::vector<Int> gptr(ngroup+1, 0), gitems(ni), item2lcl(ni);
+  for (Int i = 0; i < ni; ++i) ++gptr[item2group[i]+1];
+  for (Int gi = 0; gi < ngroup; ++gi) gptr[gi+1] += gptr[gi];
+  {
+    std::vector<Int> cnt(gptr.begin(), gptr.end()-1);
+    for (Int i = 0; i < ni; ++i) {
+      const Int gi = item2group[i];
+      item2lcl[i] = cnt[gi] - gptr[gi];
+      gitems[cnt[gi]++] = i;
+    }
+  }
+  groups.assign(ngroup, Item());
+  std::vector<std::map<Int,Long> > gadj(ngroup);
+  Graph lg;
+  std::vector<Int> order;
+  std::vector<Item> lclitems;
+  for (Int gi = 0; gi < ngroup; ++gi) {
+    const Int n = gptr[gi+1] - gptr[gi];
+    if (n == 0) continue;
+    // Subgraph of g induced by this group's items.
+    lg.xadj.assign(1, 0);
+    lg.adjncy.clear();
+    lg.wgt.clear();
+    for (Int k = 0; k < n; ++k) {
+      const Int i = gitems[gptr[gi] + k];
+      for (Int j = g.xadj[i]; j < g.xadj[i+1]; ++j) {
+        const Int u = g.adjncy[j], gu = item2group[u];
+        if (gu == gi) {
+          lg.adjncy.push_back(item2lcl[u]);
+          lg.wgt.push_back(g.wgt[j]);
+        } else {
+          gadj[gi][gu] += g.wgt[j];
+        }
+      }
+      lg.xadj.push_back(lg.adjncy.size());
+    }
+    bfs_order(lg, order);
+    lclitems.clear();
+    for (Int k = 0; k < n; ++k) {
+      const auto& item = items[gitems[gptr[gi] + order[k]]];
+      if ( ! item.node) continue;
+      lclitems.push_back(item);
+      groups[gi].ncell += item.ncell;
+    }
+    if (lclitems.empty()) continue;
+    groups[gi].node = make_balanced(lclitems, 0, lclitems.size());
+  }
+  gg.xadj.assign(1, 0);
+  gg.adjncy.clear();
+  gg.wgt.clear();
+  for (Int gi = 0; gi < ngroup; ++gi) {
+    for (const auto& e : gadj[gi]) {
+      gg.adjncy.push_back(e.first);
+      gg.wgt.push_back(e.second);
+    }
+    gg.xadj.push_back(gg.adjncy.size());
+  }
+}
+
+// Drop empty items, which have no edges, and the corresponding vertices of g.
+void compress (std::vector<Item>& items, Graph& g) {
+  const Int ni = items.size();
+  std::vector<Int> old2new(ni, -1);
+  Int nn = 0;
+  for (Int i = 0; i < ni; ++i)
+    if (items[i].node) old2new[i] = nn++;
+  if (nn == ni) return;
+  Graph c;
+  c.xadj.assign(1, 0);
+  for (Int i = 0; i < ni; ++i) {
+    if (old2new[i] < 0) continue;
+    items[old2new[i]] = items[i];
+    for (Int j = g.xadj[i]; j < g.xadj[i+1]; ++j) {
+      c.adjncy.push_back(old2new[g.adjncy[j]]);
+      c.wgt.push_back(g.wgt[j]);
+    }
+    c.xadj.push_back(c.adjncy.size());
+  }
+  items.resize(nn);
+  g = c;
+}
+} // namespace graph
+
+Node::Ptr make_tree_over_graph (const Parallel::Ptr& p, const Int& ncells,
+                                const std::vector<Int>& xadj,
+                                const std::vector<Int>& adjncy,
+                                const std::vector<Int>& cell2rank,
+                                const std::vector<Int>& rank2node) {
+  using namespace graph;
+  const Int nrank = p->size();
+  cedr_throw_if(ncells < 1, "make_tree_over_graph: ncells is " << ncells);
+  cedr_throw_if(static_cast<Int>(xadj.size()) != ncells+1 ||
+                xadj[0] != 0 || xadj[ncells] != static_cast<Int>(adjncy.size()),
+                "make_tree_over_graph: xadj is inconsistent with ncells and adjncy.");
+  cedr_throw_if(static_cast<Int>(cell2rank.size()) != ncells,
+                "make_tree_over_graph: cell2rank.size() != ncells");
+  cedr_throw_if( ! rank2node.empty() && static_cast<Int>(rank2node.size()) != nrank,
+                "make_tree_over_graph: rank2node.size() != #ranks");
+  for (Int i = 0; i < ncells; ++i)
+    cedr_throw_if(cell2rank[i] < 0 || cell2rank[i] >= nrank,
+                  "make_tree_over_graph: cell " << i << " has rank " << cell2rank[i]);
+  for (const Int u : adjncy)
+    cedr_throw_if(u < 0 || u >= ncells,
+                  "make_tree_over_graph: adjncy has cell " << u);
+  // Cells.
+  std::vector<Item> cells(ncells);
+  for (Int i = 0; i < ncells; ++i) {
+    const auto n = std::make_shared<Node>();
+    n->rank = cell2rank[i];
+    n->cellidx = i;
+    cells[i].node = n;
+    cells[i].ncell = 1;
+  }
+  Graph g;
+  g.xadj = xadj;
+  g.adjncy = adjncy;
+  g.wgt.assign(adjncy.size(), 1);
+  // Cells -> ranks.
+  std::vector<Item> ranks;
+  Graph rg;
+  merge_groups(cells, cell2rank, nrank, g, ranks, rg);
+  // Ranks -> nodes.
+  std::vector<Int> r2n(rank2node);
+  if (r2n.empty())
+    for (Int r = 0; r < nrank; ++r) r2n.push_back(r);
+  Int nnode = 0;
+  for (const Int n : r2n) {
+    cedr_throw_if(n < 0, "make_tree_over_graph: rank2node has node " << n);
+    nnode = std::max(nnode, n+1);
+  }
+  std::vector<Item> nodes;
+  Graph ng;
+  merge_groups(ranks, r2n, nnode, rg, nodes, ng);
+  // Nodes -> root.
+  compress(nodes, ng);
+  std::vector<Item> root;
+  Graph unused;
+  merge_groups(nodes, std::vector<Int>(nodes.size(), 0), 1, ng, root, unused);
+  return root[0].node;
+}
+
+std::vector<Int> get_rank2node (const Parallel::Ptr& p, const Int max_node_size) {
+  mpi::NodeParallel np(*p, max_node_size);
+  Int node = np.amleader() ? np.leaders()->rank() : -1;
+  mpi::bcast(np.node(), &node, 1, np.node().root());
+  std::vector<Int> lcl(p->size(), -1), rank2node(p->size());
+  lcl[p->rank()] = node;
+  mpi::all_reduce(*p, lcl.data(), rank2node.data(), p->size(), MPI_MAX);
+  return rank2node;
+}
+} // namespace tree
+
 namespace test {
+// Renumber the nodes of t by reversing their order. The analysis must not
+// depend on the numbering.
+tree::FlatTree reverse_numbering (const tree::FlatTree& t) {
+  const Int nn = t.nnode();
+  tree::FlatTree r;
+  r.root = nn - 1 - t.root;
+  r.kids.resize(2*nn);
+  r.rank.resize(nn);
+  r.cellidx.resize(nn);
+  if ( ! t.level.empty()) r.level.resize(nn);
+  for (Int i = 0; i < nn; ++i) {
+    const Int j = nn - 1 - i;
+    for (Int k = 0; k < 2; ++k)
+      r.kids[2*j + k] = t.kids[2*i + k] >= 0 ? nn - 1 - t.kids[2*i + k] : -1;
+    r.rank[j] = t.rank[i];
+    r.cellidx[j] = t.cellidx[i];
+    if ( ! t.level.empty()) r.level[j] = t.level[i];
+  }
+  return r;
+}
+
+Int compare (const impl::NodeSets& a, const impl::NodeSets& b) {
+  if (a.nslots != b.nslots || a.levels.size() != b.levels.size()) return 1;
+  Int nerr = 0;
+  for (size_t il = 0; il < a.levels.size(); ++il) {
+    const auto& la = a.levels[il];
+    const auto& lb = b.levels[il];
+    if (la.nodes.size() != lb.nodes.size() || la.me.size() != lb.me.size() ||
+        la.kids.size() != lb.kids.size()) {
+      ++nerr;
+      continue;
+    }
+    for (size_t i = 0; i < la.nodes.size(); ++i) {
+      const auto na = a.node_h(la.nodes[i]), nb = b.node_h(lb.nodes[i]);
+      if (na->id != nb->id || na->rank != nb->rank || na->offset != nb->offset ||
+          na->nkids != nb->nkids)
+        ++nerr;
+    }
+  }
+  return nerr;
+}
+
 Int unittest_NodeSets (const Parallel::Ptr& p) {
   using Mesh = oned::Mesh;
   const Int szs[] = { p->size(), 3*p->size() };
@@ -1250,13 +2879,40 @@ Int unittest_NodeSets (const Parallel::Ptr& p) {
         Mesh m(szs[is], p, dists[id]);
         tree::Node::Ptr tree = make_tree(m, imbalanced);
         impl::NodeSets::ConstPtr nodesets = impl::analyze(p, m.ncell(), tree);
+        const auto flat = reverse_numbering(tree::flatten(tree));
         tree = nullptr;
         nerr += impl::unittest(p, nodesets, m.ncell());
+        nerr += compare(*nodesets, *impl::analyze(p, m.ncell(), flat));
+        const auto aggregated = impl::analyze(p, m.ncell(), flat, true);
+        nerr += impl::unittest(p, aggregated, m.ncell());
+        QLT<Kokkos::DefaultExecutionSpace> qlt(p, m.ncell(), flat);
+        std::vector<Long> gcis;
+        qlt.get_owned_glblcells(gcis);
+        for (size_t i = 0; i < gcis.size(); ++i)
+          if (qlt.gci2lci(gcis[i]) != static_cast<Int>(i)) ++nerr;
+        // This rank's partial tree must give the same NodeSets and local cell
+        // numbering as the full tree.
+        const auto partial = reverse_numbering(
+          tree::make_partial_tree(flat, p->rank()));
+        if (partial.nnode() > flat.nnode()) ++nerr;
+        for (Int i = 0; i < partial.nnode(); ++i)
+          if (partial.rank[i] < 0 || partial.level[i] < 0) ++nerr;
+        const auto ns_partial = impl::analyze(p, m.ncell(), partial);
+        nerr += compare(*nodesets, *ns_partial);
+        nerr += impl::unittest(p, ns_partial, m.ncell());
+        nerr += compare(*aggregated, *impl::analyze(p, m.ncell(), partial, true));
+        QLT<Kokkos::DefaultExecutionSpace> qlt_partial(p, m.ncell(), partial);
+        std::vector<Long> gcis_partial;
+        qlt_partial.get_owned_glblcells(gcis_partial);
+        if (gcis_partial != gcis) ++nerr;
+        for (size_t i = 0; i < gcis.size(); ++i)
+          if (qlt_partial.gci2lci(gcis[i]) != static_cast<Int>(i)) ++nerr;
       }
   return nerr;
 }
 
-Int unittest_QLT (const Parallel::Ptr& p, const bool write_requested=false) {
+Int unittest_QLT (const Parallel::Ptr& p, const bool write_requested,
+                  const bool aggregate, const bool host_tasks = false) {
   using Mesh = oned::Mesh;
   const Int szs[] = { p->size(), 2*p->size(), 7*p->size(), 21*p->size() };
   const Mesh::ParallelDecomp::Enum dists[] = { Mesh::ParallelDecomp::contiguous,
@@ -1277,7 +2933,8 @@ Int unittest_QLT (const Parallel::Ptr& p, const bool write_requested=false) {
           const bool write = (write_requested && m.ncell() < 3000 &&
                               is == islim-1 && id == idlim-1);
           nerr += test::test_qlt(p, tree, m.ncell(), 1, write, external_memory,
-                                 prefer_mass_con_to_bounds, false);
+                                 prefer_mass_con_to_bounds, false, false,
+                                 aggregate, 1, false, host_tasks);
         }
       }
     }
@@ -1285,6 +2942,169 @@ Int unittest_QLT (const Parallel::Ptr& p, const bool write_requested=false) {
   return nerr;
 }
 
+// Check that the leaves of each subtree that spans multiple ranks (nodes) are
+// the union of whole ranks (nodes). Return the number of leaves in node.
+Long check_graph_tree (const tree::Node& node, const std::vector<Int>& cell2rank,
+                       const std::vector<Int>& rank2node,
+                       const std::vector<Long>& rank_ncell,
+                       const std::vector<Long>& node_ncell,
+                       std::vector<Int>& cells, Int& nerr) {
+  if ( ! node.nkids) {
+    if (node.cellidx < 0 || node.cellidx >= static_cast<Int>(cells.size()) ||
+        node.rank != cell2rank[node.cellidx])
+      ++nerr;
+    else
+      ++cells[node.cellidx];
+    return 1;
+  }
+  Long nleaf = 0;
+  std::map<Int,Long> rank_cnt;
+  for (Int k = 0; k < node.nkids; ++k) {
+    if (node.kids[k]->parent != &node) ++nerr;
+    nleaf += check_graph_tree(*node.kids[k], cell2rank, rank2node, rank_ncell,
+                              node_ncell, cells, nerr);
+  }
+  // Count this subtree's cells per rank on the way back up.
+  std::vector<const tree::Node*> stack(1, &node);
+  while ( ! stack.empty()) {
+    const auto n = stack.back();
+    stack.pop_back();
+    if ( ! n->nkids) ++rank_cnt[n->rank];
+    for (Int k = 0; k < n->nkids; ++k) stack.push_back(n->kids[k].get());
+  }
+  if (rank_cnt.size() > 1) {
+    std::map<Int,Long> node_cnt;
+    for (const auto& e : rank_cnt) {
+      if (e.second != rank_ncell[e.first]) ++nerr;
+      node_cnt[rank2node[e.first]] += e.second;
+    }
+    if (node_cnt.size() > 1)
+      for (const auto& e : node_cnt)
+        if (e.second != node_ncell[e.first]) ++nerr;
+  }
+  return nleaf;
+}
+
+// Build trees over a doubly periodic nx x ny grid with blocked and scattered
+// decompositions, check their structure, and run QLT on them.
+Int unittest_graph_tree (const Parallel::Ptr& p, const bool aggregate,
+                         const Int nrhom = 1,
+                         const bool single_precision_bounds = false) {
+  const Int np = p->size(), nx = 2*np + 1, ny = 5, ncells = nx*ny;
+  std::vector<Int> xadj(1, 0), adjncy;
+  for (Int j = 0; j < ny; ++j)
+    for (Int i = 0; i < nx; ++i) {
+      adjncy.push_back(j*nx + (i+1) % nx);
+      adjncy.push_back(j*nx + (i+nx-1) % nx);
+      adjncy.push_back(((j+1) % ny)*nx + i);
+      adjncy.push_back(((j+ny-1) % ny)*nx + i);
+      xadj.push_back(adjncy.size());
+    }
+  Int nerr = 0;
+  for (const bool blocked : {true, false}) {
+    std::vector<Int> cell2rank(ncells);
+    for (Int ci = 0; ci < ncells; ++ci)
+      cell2rank[ci] = blocked ? std::min(np-1, (ci % nx)/2) : (ci + ci/nx) % np;
+    // Emulate nodes of 2 ranks, and use the actual nodes.
+    std::vector<Int> rank2node(np);
+    for (Int r = 0; r < np; ++r) rank2node[r] = r/2;
+    for (const auto& r2n : {rank2node, tree::get_rank2node(p)}) {
+      const auto tree = tree::make_tree_over_graph(p, ncells, xadj, adjncy,
+                                                     cell2rank, r2n);
+      std::vector<Long> rank_ncell(np, 0), node_ncell(np, 0);
+      for (Int ci = 0; ci < ncells; ++ci) {
+        ++rank_ncell[cell2rank[ci]];
+        ++node_ncell[r2n[cell2rank[ci]]];
+      }
+      std::vector<Int> cells(ncells, 0);
+      Int ne = 0;
+      if (tree->parent) ++ne;
+      check_graph_tree(*tree, cell2rank, r2n, rank_ncell, node_ncell, cells, ne);
+      for (Int ci = 0; ci < ncells; ++ci)
+        if (cells[ci] != 1) ++ne;
+      if (ne && p->amroot()) std::cerr << "FAIL: make_tree_over_graph structure\n";
+      nerr += ne;
+      nerr += test::test_qlt(p, tree, ncells, 1, false, false, false, false,
+                             false, aggregate, nrhom, single_precision_bounds);
+    }
+  }
+  return nerr;
+}
+
+// Solve a batch of problems in one QLT and compare with solving each alone.
+Int unittest_batch (const Parallel::Ptr& p) {
+  typedef QLT<Kokkos::DefaultExecutionSpace> QLTT;
+  typedef ProblemType PT;
+  const Int ncells = std::max(42, 3*p->size()), nbatch = 5;
+  const auto tree = tree::make_tree_over_1d_mesh(p, ncells);
+  std::vector<Long> gcis;
+  QLTT(p, ncells, tree).get_owned_glblcells(gcis);
+  const std::vector<int> probs = {
+    PT::conserve | PT::shapepreserve, PT::shapepreserve,
+    PT::conserve | PT::consistent, PT::consistent,
+    PT::conserve | PT::nonnegative, PT::nonnegative};
+  Int nerr = 0;
+  for (const bool aggregate : {false, true}) {
+    CDR::Options options;
+    options.aggregate_messages = aggregate;
+    nerr += cedr::test::test_batch<QLTT>(
+      "QLT", *p, gcis, probs, nbatch, options,
+      [&] (const CDR::Options& o) { return std::make_shared<QLTT>(p, ncells, tree, o); });
+  }
+  return nerr;
+}
+
+// Run with and without host tasks on imbalanced trees, with and without
+// message aggregation and single-precision bounds. The results must be
+// bit-for-bit the same.
+Int unittest_host_tasks (const Parallel::Ptr& p) {
+  typedef QLT<Kokkos::DefaultExecutionSpace> QLTT;
+  typedef Kokkos::View<Real*, Kokkos::DefaultExecutionSpace> RealList;
+  typedef ProblemType PT;
+  using Mesh = oned::Mesh;
+  const std::vector<int> probs = {
+    PT::conserve | PT::shapepreserve, PT::shapepreserve,
+    PT::conserve | PT::consistent, PT::consistent,
+    PT::conserve | PT::nonnegative, PT::nonnegative};
+  const Int nt = probs.size();
+  Int nerr = 0;
+  for (const Int nc : {p->size(), 7*p->size(), 100*p->size()})
+    for (const auto dist : {Mesh::ParallelDecomp::contiguous,
+                            Mesh::ParallelDecomp::pseudorandom})
+      for (const bool aggregate : {false, true})
+        for (const bool single_precision_bounds : {false, true}) {
+          Mesh m(nc, p, dist);
+          const auto tree = make_tree(m, true);
+          RealList Qm[2];
+          for (const bool host_tasks : {false, true}) {
+            CDR::Options options;
+            options.aggregate_messages = aggregate;
+            options.single_precision_bounds = single_precision_bounds;
+            options.host_tasks = host_tasks;
+            QLTT qlt(p, nc, tree, options);
+            for (Int ti = 0; ti < nt; ++ti) qlt.declare_tracer(probs[ti], ti % 2);
+            qlt.end_tracer_declarations();
+            qlt.finish_setup();
+            std::vector<Long> gcis;
+            qlt.get_owned_glblcells(gcis);
+            const Int n = gcis.size();
+            const auto gcis_d = cedr::test::impl::make_gcis_view<
+              Kokkos::DefaultExecutionSpace>(gcis);
+            Qm[host_tasks] = RealList("Qm", nt*n);
+            // Twice, to check that the work space is reset between runs.
+            for (Int trial = 0; trial < 2; ++trial)
+              cedr::test::impl::run_batch(qlt, gcis_d, nt, 1, 0, Qm[host_tasks]);
+          }
+          const auto a = Kokkos::create_mirror_view(Qm[0]);
+          const auto b = Kokkos::create_mirror_view(Qm[1]);
+          Kokkos::deep_copy(a, Qm[0]);
+          Kokkos::deep_copy(b, Qm[1]);
+          for (Int i = 0; i < a.extent_int(0); ++i)
+            if (a(i) != b(i)) ++nerr;
+        }
+  return nerr;
+}
+
 Int run_unit_and_randomized_tests (const Parallel::Ptr& p, const Input& in) {
   Int nerr = 0;
   if (in.unittest) {
@@ -1298,9 +3118,43 @@ Int run_unit_and_randomized_tests (const Parallel::Ptr& p, const Input& in) {
     ne = unittest_NodeSets(p);
     if (ne && p->amroot()) std::cerr << "FAIL: oned::unittest_NodeSets()\n";
     nerr += ne;
-    ne = unittest_QLT(p, in.write);
+    ne = unittest_QLT(p, in.write, false);
     if (ne && p->amroot()) std::cerr << "FAIL: oned::unittest_QLT()\n";
     nerr += ne;
+    ne = unittest_graph_tree(p, false);
+    if (ne && p->amroot()) std::cerr << "FAIL: unittest_graph_tree()\n";
+    nerr += ne;
+    // Again with message aggregation, reseeding so that the tests see the same
+    // data as above.
+    srand(p->rank());
+    ne = unittest_QLT(p, false, true);
+    if (ne && p->amroot()) std::cerr << "FAIL: oned::unittest_QLT(aggregate)\n";
+    nerr += ne;
+    ne = unittest_graph_tree(p, true);
+    if (ne && p->amroot()) std::cerr << "FAIL: unittest_graph_tree(aggregate)\n";
+    nerr += ne;
+    // Tracers of two densities in one instance.
+    srand(p->rank());
+    ne = unittest_graph_tree(p, false, 2);
+    if (ne && p->amroot()) std::cerr << "FAIL: unittest_graph_tree(nrhom 2)\n";
+    nerr += ne;
+    // Bounds sent in single precision.
+    srand(p->rank());
+    ne = unittest_graph_tree(p, false, 2, true);
+    if (ne && p->amroot())
+      std::cerr << "FAIL: unittest_graph_tree(single_precision_bounds)\n";
+    nerr += ne;
+    ne = unittest_batch(p);
+    if (ne && p->amroot()) std::cerr << "FAIL: unittest_batch()\n";
+    nerr += ne;
+    ne = unittest_host_tasks(p);
+    if (ne && p->amroot()) std::cerr << "FAIL: unittest_host_tasks()\n";
+    nerr += ne;
+    // Randomized tests with host tasks, again with the same data.
+    srand(p->rank());
+    ne = unittest_QLT(p, false, true, true);
+    if (ne && p->amroot()) std::cerr << "FAIL: oned::unittest_QLT(host_tasks)\n";
+    nerr += ne;
     if (p->amroot()) std::cout << "\n";
   }
   // Performance test.
@@ -1309,13 +3163,9 @@ Int run_unit_and_randomized_tests (const Parallel::Ptr& p, const Input& in) {
                  (in.pseudorandom ?
                   oned::Mesh::ParallelDecomp::pseudorandom :
                   oned::Mesh::ParallelDecomp::contiguous));
-    Timer::init();
-    Timer::start(Timer::total); Timer::start(Timer::tree);
     tree::Node::Ptr tree = make_tree(m, false);
-    Timer::stop(Timer::tree);
-    test::test_qlt(p, tree, in.ncells, in.nrepeat, false, false, false, in.verbose);
-    Timer::stop(Timer::total);
-    if (p->amroot()) Timer::print();
+    test::test_qlt(p, tree, in.ncells, in.nrepeat, false, false, false, in.verbose,
+                   true);
   }
   return nerr;
 }
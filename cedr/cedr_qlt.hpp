@@ -26,7 +26,10 @@ namespace impl {
 struct NodeSets {
   typedef std::shared_ptr<const NodeSets> ConstPtr;
   
-  enum : int { mpitag = 42 };
+  enum : int { mpitag = 42,
+               // Setup messages to agree on message aggregation, from the kid
+               // and parent sides of a rank pair.
+               mpitag_kid_links = 43, mpitag_parent_links = 44 };
 
   // A node in the tree that is relevant to this rank.
   struct Node {
@@ -68,12 +71,53 @@ struct NodeSets {
       Int offset; // Offset to start of buffer for this comm.
       Int size;   // Size of this buffer in units of offsets.
     };
+
+    // A message sent or received in this level. It carries buffer part of me
+    // or kids and, with message aggregation, the buffers of other levels
+    // exchanged with the same partner, which are then contiguous with it.
+    struct Message : public MPIMetaData {
+      Int part; // Index into me or kids of this level's buffer.
+    };
     
     // The nodes in the level.
     std::vector<Int> nodes;
-    // MPI information for this level.
+    // MPI information for this level, one buffer per comm partner.
     std::vector<MPIMetaData> me, kids;
-    mutable std::vector<mpi::Request> me_send_req, me_recv_req, kids_req;
+    // The messages of each sweep. In l2r, kids are received and me sent; in
+    // r2l, me are received and kids sent. Without aggregation, each buffer is
+    // one message.
+    std::vector<Message> l2r_recv, l2r_send, r2l_recv, r2l_send;
+    //   me2l2r[j] is the index into l2r_send of the message that carries
+    // me[j], or -1 if a message in another level carries it; similarly for the
+    // others.
+    std::vector<Int> me2l2r, me2r2l, kids2l2r, kids2r2l;
+    // Requests for l2r_recv and r2l_recv in the communication tests. QLT::run
+    // uses persistent requests instead.
+    mutable std::vector<mpi::Request> kids_req, me_recv_req;
+
+    // Dependency information to process nodes as their messages arrive rather
+    // than after all of a level's messages arrive.
+    //   node2me[i] is the index into me of the buffer that carries nodes[i]
+    // to and from its parent, or -1 if the parent is on this rank.
+    std::vector<Int> node2me;
+    //   node2kids[2*i + k] is the index into kids of the buffer that carries
+    // kid k of nodes[i], or -1 if the kid is on this rank or does not exist.
+    std::vector<Int> node2kids;
+    //   kids2nodes(kids2nodesptr[j] : kids2nodesptr[j+1]-1) lists the indices
+    // into nodes of the nodes that have a kid carried by buffer kids[j]. A
+    // node appears once per such kid.
+    std::vector<Int> kids2nodesptr, kids2nodes;
+    //   Same for me messages.
+    std::vector<Int> me2nodesptr, me2nodes;
+    // Work space for run().
+    mutable std::vector<Int> node_cnt, msg_cnt, ready;
+
+    // On the GPU, runs of levels are processed together, without a fence or
+    // MPI call between levels. l2r_group is the lowest level in this level's
+    // l2r group, in which only the lowest level receives and only the highest
+    // sends. r2l_group is the highest level in this level's r2l group, in
+    // which only the highest level receives and only the lowest sends.
+    Int l2r_group, r2l_group;
   };
   
   // Levels. nodes[0] is level 0, the leaf level.
@@ -119,6 +163,56 @@ struct NodeSetsDeviceData {
 };
 
 typedef impl::NodeSetsDeviceData<Kokkos::DefaultHostExecutionSpace> NodeSetsHostData;
+
+// For CDR::Options::host_tasks: this rank's nodes having kids, as a DAG whose
+// tasks run each sweep on the host. Leaves have nothing to compute and so are
+// not tasks. Each kind of message is indexed over all levels in level order.
+struct TaskDag {
+  struct Msg { Int lvl, mi; };
+
+  // nodes[t] is the index into NodeSets of task t's node. parent[t] is the
+  // task of its parent, or -1 if the parent is on another rank or t is the
+  // root. kids[2t+k] is the task of kid k, or -1 if the kid is a leaf or on
+  // another rank.
+  std::vector<Int> nodes, parent, kids;
+  // Messages l2r_recv_lvlptr[l] : l2r_recv_lvlptr[l+1]-1 are level l's
+  // l2r_recv messages; similarly for r2l_recv. l2r_send[m] is the level and
+  // index in the level of send message m; similarly for r2l_send.
+  std::vector<Int> l2r_recv_lvlptr, r2l_recv_lvlptr;
+  std::vector<Msg> l2r_send, r2l_send;
+
+  // Leaves to root. Task t waits on l2r_ndep[t] kids, those that are tasks or
+  // on other ranks. l2r_recv2task(l2r_recv2taskptr[m] : l2r_recv2taskptr[m+1]-1)
+  // lists the tasks having a kid in received message m, once per kid.
+  // task2l2r_send[t] is the message that carries t to its parent, or -1, and
+  // send message m waits on l2r_send_ndep[m] tasks. l2r_ready lists the tasks
+  // that wait on nothing.
+  std::vector<Int> l2r_ndep, l2r_recv2taskptr, l2r_recv2task, task2l2r_send,
+    l2r_send_ndep, l2r_ready;
+  // Root to leaves. A task waits on just its parent or a received message.
+  // r2l_recv2task lists the tasks in each received message.
+  // task2r2l_send[2t+k] is the message that carries kid k of t, or -1, and send
+  // message m waits on r2l_send_ndep[m] kids. r2l_ready lists the tasks that
+  // wait on nothing, i.e., the root if it is a task here.
+  std::vector<Int> r2l_recv2taskptr, r2l_recv2task, task2r2l_send,
+    r2l_send_ndep, r2l_ready;
+  // MPI matches the messages between a pair of ranks in the order they are
+  // sent and received, and all of a sweep's receives are posted at the start,
+  // so each rank sends to a partner in level order, as without tasks:
+  // l2r_send_prev[m] and l2r_send_next[m] are the send messages before and
+  // after m to the same rank, or -1; similarly for r2l.
+  std::vector<Int> l2r_send_prev, l2r_send_next, r2l_send_prev, r2l_send_next;
+
+  // Work space for run(). cnt and msg_cnt are the remaining dependencies of
+  // tasks and send messages. ready is the stack of tasks ready to run, and
+  // npending is the number of tasks ready or running. sendq holds the send
+  // messages ready for the master thread to start, which it takes into
+  // sendq_master. ndone is the number of nodes done. msg_state is 0, 1 if
+  // ready but waiting on an earlier message, and 2 if started.
+  mutable std::vector<Int> cnt, msg_cnt, ready, sendq, sendq_master;
+  mutable std::vector<char> msg_state;
+  mutable Int npending, ndone;
+};
 } // namespace impl
 
 namespace tree {
@@ -137,10 +231,61 @@ struct Node {
   Node () : parent(nullptr), rank(-1), cellidx(-1), nkids(0), reserved(-1), level(-1) {}
 };
 
+// A tree in flat arrays, an alternative to a tree of Nodes that needs no
+// per-node allocation. Node i's kids are kids[2i] and kids[2i+1], where -1
+// means no kid; a node with one kid has it in kids[2i]. rank[i] is the owning
+// rank; for a non-leaf node, -1 means the rank of kid 0. cellidx[i] is the cell
+// of a leaf node and is ignored otherwise. level is optional and, if not empty,
+// has the meaning of Node::level, with -1 for nodes not providing one.
+struct FlatTree {
+  std::vector<Int> kids, rank, level;
+  std::vector<Long> cellidx;
+  Int root;
+
+  FlatTree () : root(-1) {}
+  Int nnode () const { return static_cast<Int>(rank.size()); }
+};
+
+// Convert a tree of Nodes to a FlatTree. The root node has index 0.
+FlatTree flatten(const Node::Ptr& tree);
+
+// Cut from a global tree the partial tree that rank needs: the nodes rank owns,
+// all their ancestors, and the kids of those nodes, in the global tree's kid
+// order. A kid that is cut below becomes a leaf with cellidx -1. Every node of
+// the result has rank and level set. This takes time linear in the global tree;
+// its purpose is to define, and test, what a caller that builds partial trees
+// directly must provide.
+FlatTree make_partial_tree(const FlatTree& tree, const Int rank);
+
 // Utility to make a tree over a 1D mesh. For testing, it can be useful to
 // create an imbalanced tree.
 Node::Ptr make_tree_over_1d_mesh(const Parallel::Ptr& p, const Int& ncells,
                                  const bool imbalanced = false);
+
+// Make a tree over a mesh given its cell adjacency graph and cell-to-rank
+// ownership, e.g., a cubed-sphere mesh's element graph. Each rank's cells form
+// one subtree, balanced and ordered by a breadth-first traversal of the graph
+// so that neighboring cells are near each other. Rank subtrees are then
+// combined into one subtree per shared-memory node, and node subtrees into the
+// root, each also balanced by cell count and ordered by the graph of ranks or
+// nodes weighted by the number of cut edges. Thus only the top of the tree
+// crosses nodes, and messages up to that point stay on a node.
+//   All inputs are global and must be the same on every rank:
+//   ncells is the number of cells, with global cell indices 0:ncells-1.
+//   The neighbors of cell i are adjncy[xadj[i] : xadj[i+1]-1].
+//   cell2rank[i] is the rank that owns cell i.
+//   rank2node[r] is the node of rank r; see get_rank2node. If rank2node is
+// empty, each rank is its own node.
+Node::Ptr make_tree_over_graph(const Parallel::Ptr& p, const Int& ncells,
+                               const std::vector<Int>& xadj,
+                               const std::vector<Int>& adjncy,
+                               const std::vector<Int>& cell2rank,
+                               const std::vector<Int>& rank2node = std::vector<Int>());
+
+// Collective on p. Return the rank2node argument for make_tree_over_graph
+// based on the ranks' shared-memory nodes. max_node_size is passed to
+// mpi::NodeParallel.
+std::vector<Int> get_rank2node(const Parallel::Ptr& p, const Int max_node_size = 0);
 } // namespace tree
 
 template <typename ExeSpace = Kokkos::DefaultExecutionSpace>
@@ -153,10 +298,19 @@ public:
   
   // Set up QLT topology and communication data structures based on a tree. Both
   // ncells and tree refer to the global mesh, not just this processor's
-  // part. The tree must be identical across ranks.
+  // part. The tree is either the full tree, identical across ranks, or this
+  // rank's partial tree, as tree::make_partial_tree makes: the nodes this rank
+  // owns, their ancestors, and the kids of those, with rank and level set in
+  // every node. Setup takes time linear in the size of the tree passed, so with
+  // a partial tree it is linear in the local cells and the tree's depth.
   QLT(const Parallel::Ptr& p, const Int& ncells, const tree::Node::Ptr& tree,
       CDR::Options options = Options());
 
+  // Same, but with the tree in flat arrays. The tree can be deleted once the
+  // constructor returns.
+  QLT(const Parallel::Ptr& p, const Int& ncells, const tree::FlatTree& tree,
+      CDR::Options options = Options());
+
   void print(std::ostream& os) const override;
 
   // Number of cells owned by this rank.
@@ -170,7 +324,8 @@ public:
 
   // For global cell index cellidx, i.e., the globally unique ordinal associated
   // with a cell in the caller's tree, return this rank's local index for
-  // it. This is not an efficient operation.
+  // it. This is a table lookup if this rank's gcis are dense, e.g., contiguous,
+  // and a binary search otherwise.
   Int gci2lci(const Int& gci) const;
 
   void declare_tracer(int problem_type, const Int& rhomidx) override;
@@ -199,9 +354,30 @@ public:
 
   void run() override;
 
+  // run_begin() does as much of the leaves-to-root sweep as the data already
+  // received permit, without blocking. run_end() completes the sweep and then
+  // does the root-to-leaves sweep.
+  void run_begin() override;
+  void run_end() override;
+
   KOKKOS_INLINE_FUNCTION
   Real get_Qm(const Int& lclcellidx, const Int& tracer_idx) const override;
 
+  // Access batch instance batchidx; see CDR::Options::nbatch.
+  KOKKOS_INLINE_FUNCTION
+  void set_batch_rhom(const Int& lclcellidx, const Int& batchidx,
+                      const Int& rhomidx, const Real& rhom) const;
+
+  KOKKOS_INLINE_FUNCTION
+  void set_batch_Qm(const Int& lclcellidx, const Int& batchidx,
+                    const Int& tracer_idx,
+                    const Real& Qm, const Real& Qm_min, const Real& Qm_max,
+                    const Real Qm_prev = std::numeric_limits<Real>::infinity()) const;
+
+  KOKKOS_INLINE_FUNCTION
+  Real get_batch_Qm(const Int& lclcellidx, const Int& batchidx,
+                    const Int& tracer_idx) const;
+
 protected:
   typedef Kokkos::View<Int*, Device> IntList;
   typedef cedr::impl::Const<IntList> ConstIntList;
@@ -212,7 +388,10 @@ protected:
 
   struct MetaDataBuilder {
     typedef std::shared_ptr<MetaDataBuilder> Ptr;
-    std::vector<int> trcr2prob;
+    // Per bulk tracer; see MetaData::Arrays.
+    std::vector<int> trcr2prob, trcr2rhom;
+    Int nbatch;
+    MetaDataBuilder () : nbatch(1) {}
   };
 
 PROTECTED_CUDA:
@@ -221,8 +400,16 @@ PROTECTED_CUDA:
 
     template <typename IntListT>
     struct Arrays {
+      // With CDR::Options::nbatch > 1, each declared tracer t is the nbatch
+      // bulk tracers t*nbatch + bi, and each rhom r is the nbatch bulk rhoms
+      // r*nbatch + bi. A tracer below is a bulk tracer.
+      Int nbatch;
       // trcr2prob(i) is the ProblemType of tracer i.
       IntListT trcr2prob;
+      // trcr2rhom(i) is the rhom index of tracer i. The nrhom rhoms are at the
+      // start of each l2r slot.
+      IntListT trcr2rhom;
+      Int nrhom;
       // bidx2trcr(prob2trcrptr(i) : prob2trcrptr(i+1)-1) is the list of
       // tracers having ProblemType index i. bidx2trcr is the permutation
       // from the user's tracer index to the bulk data's ordering (bidx).
@@ -238,6 +425,11 @@ PROTECTED_CUDA:
       // Same for r2l bulk data.
       Int prob2br2l[nprobtypes + 1];
       IntListT trcr2br2l;
+      // For Options::single_precision_bounds: l2rkind(i) is the L2rField of
+      // item i of an l2r slot. A packed slot has the l2rnmass mass items as
+      // Reals followed by the bounds as floats, for l2rnpk Reals in all.
+      IntListT l2rkind;
+      Int l2rnmass, l2rnpk;
     };
 
     KOKKOS_INLINE_FUNCTION static int get_problem_type(const int& idx);
@@ -256,19 +448,19 @@ PROTECTED_CUDA:
       // categories are tracked by QLT; which of the original problems being
       // solved is not important.
       enum {
-        // l2r: rhom, (Qm_min, Qm, Qm_max)*; r2l: Qm*
+        // l2r: rhom*, (Qm_min, Qm, Qm_max)*; r2l: Qm*
         s  = ProblemType::shapepreserve,
         st = ProblemType::shapepreserve | ProblemType::consistent,
-        // l2r: rhom, (Qm_min, Qm, Qm_max, Qm_prev)*; r2l: Qm*
+        // l2r: rhom*, (Qm_min, Qm, Qm_max, Qm_prev)*; r2l: Qm*
         cs  = ProblemType::conserve | s,
         cst = ProblemType::conserve | st,
-        // l2r: rhom, (q_min, Qm, q_max)*; r2l: (Qm, q_min, q_max)*
+        // l2r: rhom*, (q_min, Qm, q_max)*; r2l: (Qm, q_min, q_max)*
         t = ProblemType::consistent,
-        // l2r: rhom, (q_min, Qm, q_max, Qm_prev)*; r2l: (Qm, q_min, q_max)*
+        // l2r: rhom*, (q_min, Qm, q_max, Qm_prev)*; r2l: (Qm, q_min, q_max)*
         ct = ProblemType::conserve | t,
-        // l2r: rhom, Qm*; r2l: Qm*
+        // l2r: rhom*, Qm*; r2l: Qm*
         nn = ProblemType::nonnegative,
-        // l2r: rhom, (Qm, Qm_prev)*; r2l: Qm*
+        // l2r: rhom*, (Qm, Qm_prev)*; r2l: Qm*
         cnn = ProblemType::conserve | nn
       };
     };
@@ -302,10 +494,17 @@ PROTECTED_CUDA:
   };
 
 protected:
-  void init(const Parallel::Ptr& p, const Int& ncells, const tree::Node::Ptr& tree);
+  void init(const Parallel::Ptr& p, const Int& ncells, const tree::FlatTree& tree);
 
   void init_ordinals();
 
+  // Set the root's r2l data from its l2r data. Every rank calls this once per
+  // run, after the leaves-to-root sweep, so a subclass can replace it with a
+  // collective that couples this tree's root to others.
+  virtual void root_compute(const Int& l2rndps, const Int& r2lndps) const;
+  // The index of the root node if this rank has it; otherwise -1.
+  Int get_root_node() const;
+
   /// Pointer data for initialization and host computation.
   Parallel::Ptr p_;
   // Tree and communication topology.
@@ -313,8 +512,14 @@ protected:
   // Data extracted from ns_ for use in run() on device.
   std::shared_ptr<impl::NodeSetsDeviceData<ExeSpace> > nsdd_;
   std::shared_ptr<impl::NodeSetsHostData> nshd_;
-  // Globally unique cellidx -> rank-local index.
-  typedef std::map<Int,Int> Gci2LciMap;
+  // Globally unique cellidx -> rank-local index. If the gcis span no more than
+  // twice their number, direct[gci - gci0] is the lci, or -1 in a gap;
+  // otherwise, sorted has (gci, lci) pairs sorted by gci.
+  struct Gci2LciMap {
+    Int gci0;
+    std::vector<Int> direct;
+    std::vector<std::pair<Int,Int> > sorted;
+  };
   std::shared_ptr<Gci2LciMap> gci2lci_;
   // Temporary to collect caller's tracer information prior to calling
   // end_tracer_declarations().
@@ -323,15 +528,70 @@ protected:
   // Constructed in end_tracer_declarations().
   MetaData md_;
   BulkData bd_;
+  // l2r messages packed for Options::single_precision_bounds, l2rnpk per slot.
+  RealList l2r_pack_;
+  // Persistent requests for each level's messages, made in finish_setup once
+  // the buffers are fixed. Copies of this QLT share them. Every send is
+  // complete when run or run_end returns, so they are inactive between runs.
+  struct LevelRequests {
+    mpi::PersistentRequests l2r_recv, l2r_send, r2l_recv, r2l_send;
+  };
+  std::shared_ptr<std::vector<LevelRequests> > reqs_;
+  // For Options::host_tasks, made in finish_setup; null if tasks are not used.
+  std::shared_ptr<const impl::TaskDag> td_;
+  // State of the leaves-to-root sweep, which can be suspended and resumed.
+  struct RunState {
+    bool active; // Between run_begin and run_end.
+    Int il;      // Current level.
+    Int nmsg;    // Number of messages received in level il; -1 if not started.
+    RunState () : active(false), il(0), nmsg(-1) {}
+  };
+  RunState rs_;
 
 PRIVATE_CUDA:
+  bool l2r_packed() const { return options_.single_precision_bounds; }
+  void init_requests();
+  LevelRequests& get_requests (const impl::NodeSets::Level& lvl) const {
+    return (*reqs_)[&lvl - ns_->levels.data()];
+  }
+  void wait_sends(const bool l2r) const;
+  void l2r_pack(const Int& os, const Int& n, const Int& l2rndps) const;
+  void l2r_unpack(const Int& os, const Int& n, const Int& l2rndps) const;
   void l2r_recv(const impl::NodeSets::Level& lvl, const Int& l2rndps) const;
-  void l2r_combine_kid_data(const Int& lvlidx, const Int& l2rndps) const;
+  void l2r_combine_kid_data(const Int& lvlb, const Int& lvle, const Int& l2rndps) const;
+  void l2r_combine_kid_data(const impl::NodeSets::Level& lvl, const Int& nready,
+                            const Int& l2rndps) const;
+  void l2r_combine_node(const impl::NodeSets::Node& n, const Int& l2rndps) const;
+  void l2r_send_to_parent(const impl::NodeSets::Level& lvl, const Int& mi,
+                          const Int& l2rndps, const bool pack = true) const;
   void l2r_send_to_parents(const impl::NodeSets::Level& lvl, const Int& l2rndps) const;
-  void root_compute(const Int& l2rndps, const Int& r2lndps) const;
+  void l2r_combine_and_send(const impl::NodeSets::Level& lvl, const Int& nready,
+                            const Int& l2rndps) const;
+  void l2r_begin_level(const Int& lvlidx, const Int& l2rndps) const;
+  void l2r_recvd_msg(const Int& lvlidx, const Int& mi, const Int& l2rndps) const;
+  void l2r_end_level(const Int& lvlidx, const Int& l2rndps) const;
+  bool l2r_progress(const bool wait);
+  void l2r_run_task(Int t, const Int& l2rndps) const;
+  void send_in_order(const bool l2r, const Int& m, const Int& ndps) const;
+  bool l2r_poll_tasks(const bool wait, bool& suspend);
+  bool l2r_progress_tasks(const bool wait);
   void r2l_recv(const impl::NodeSets::Level& lvl, const Int& r2lndps) const;
-  void r2l_solve_qp(const Int& lvlidx, const Int& l2rndps, const Int& r2lndps) const;
+  void r2l_solve_qp(const Int& lvlb, const Int& lvle, const Int& l2rndps,
+                    const Int& r2lndps) const;
+  void r2l_solve_qp(const impl::NodeSets::Level& lvl, const Int& nready,
+                    const Int& l2rndps, const Int& r2lndps) const;
+  void r2l_solve_node_qp(const impl::NodeSets::Node& n, const Int& l2rndps,
+                         const Int& r2lndps,
+                         const bool prefer_mass_con_to_bounds) const;
+  void r2l_send_to_kid(const impl::NodeSets::Level& lvl, const Int& mi,
+                       const Int& r2lndps) const;
   void r2l_send_to_kids(const impl::NodeSets::Level& lvl, const Int& r2lndps) const;
+  void r2l_run_level(const impl::NodeSets::Level& lvl, const Int& l2rndps,
+                     const Int& r2lndps) const;
+  void r2l_run_task(Int t, const Int& l2rndps, const Int& r2lndps) const;
+  bool r2l_poll_tasks(const Int& r2lndps, Int& nrecvd) const;
+  void r2l_run_tasks(const Int& l2rndps, const Int& r2lndps) const;
+  void r2l_run() const;
 };
 
 namespace test {
@@ -353,7 +613,17 @@ Int test_qlt(const Parallel::Ptr& p, const tree::Node::Ptr& tree, const Int& nce
              const bool external_memory,
              // Set CDR::Options.prefer_numerical_mass_conservation_to_numerical_bounds.
              const bool prefer_mass_con_to_bounds,
-             const bool verbose);
+             const bool verbose,
+             // Print the summary of the runs' profile.
+             const bool print_profile = false,
+             // Set CDR::Options.aggregate_messages.
+             const bool aggregate_messages = false,
+             // Number of total densities; tracer i uses rhom i % nrhom.
+             const Int nrhom = 1,
+             // Set CDR::Options.single_precision_bounds.
+             const bool single_precision_bounds = false,
+             // Set CDR::Options.host_tasks.
+             const bool host_tasks = false);
 } // namespace test
 } // namespace qlt
 } // namespace cedr
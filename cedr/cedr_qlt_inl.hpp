@@ -14,8 +14,7 @@ namespace qlt {
 template <typename ES> KOKKOS_INLINE_FUNCTION
 void QLT<ES>::set_rhom (const Int& lclcellidx, const Int& rhomidx,
                         const Real& rhom) const {
-  const Int ndps = md_.a_d.prob2bl2r[md_.nprobtypes];
-  bd_.l2r_data(ndps*lclcellidx) = rhom;  
+  set_batch_rhom(lclcellidx, 0, rhomidx, rhom);
 }
 
 template <typename ES> KOKKOS_INLINE_FUNCTION
@@ -23,13 +22,39 @@ void QLT<ES>::set_Qm (const Int& lclcellidx, const Int& tracer_idx,
                       const Real& Qm,
                       const Real& Qm_min, const Real& Qm_max,
                       const Real Qm_prev) const {
+  set_batch_Qm(lclcellidx, 0, tracer_idx, Qm, Qm_min, Qm_max, Qm_prev);
+}
+
+template <typename ES> KOKKOS_INLINE_FUNCTION
+Real QLT<ES>::get_Qm (const Int& lclcellidx, const Int& tracer_idx) const {
+  return get_batch_Qm(lclcellidx, 0, tracer_idx);
+}
+
+template <typename ES> KOKKOS_INLINE_FUNCTION
+void QLT<ES>::set_batch_rhom (const Int& lclcellidx, const Int& batchidx,
+                              const Int& rhomidx, const Real& rhom) const {
+  const Int nb = md_.a_d.nbatch;
+  cedr_kernel_assert(batchidx >= 0 && batchidx < nb);
+  cedr_kernel_assert(rhomidx >= 0 && rhomidx*nb < md_.a_d.nrhom);
+  const Int ndps = md_.a_d.prob2bl2r[md_.nprobtypes];
+  bd_.l2r_data(ndps*lclcellidx + rhomidx*nb + batchidx) = rhom;
+}
+
+template <typename ES> KOKKOS_INLINE_FUNCTION
+void QLT<ES>::set_batch_Qm (const Int& lclcellidx, const Int& batchidx,
+                            const Int& tracer_idx,
+                            const Real& Qm,
+                            const Real& Qm_min, const Real& Qm_max,
+                            const Real Qm_prev) const {
+  cedr_kernel_assert(batchidx >= 0 && batchidx < md_.a_d.nbatch);
+  const Int ti = tracer_idx*md_.a_d.nbatch + batchidx; // bulk tracer
   const Int ndps = md_.a_d.prob2bl2r[md_.nprobtypes];
   Real* bd; {
-    const Int bdi = md_.a_d.trcr2bl2r(tracer_idx);
+    const Int bdi = md_.a_d.trcr2bl2r(ti);
     bd = &bd_.l2r_data(ndps*lclcellidx + bdi);
   }
   {
-    const Int problem_type = md_.a_d.trcr2prob(tracer_idx);
+    const Int problem_type = md_.a_d.trcr2prob(ti);
     Int next = 0;
     if (problem_type & ProblemType::shapepreserve) {
       bd[0] = Qm_min;
@@ -37,7 +62,8 @@ void QLT<ES>::set_Qm (const Int& lclcellidx, const Int& tracer_idx,
       bd[2] = Qm_max;
       next = 3;
     } else if (problem_type & ProblemType::consistent) {
-      const Real rhom = bd_.l2r_data(ndps*lclcellidx);
+      const Real rhom = bd_.l2r_data(ndps*lclcellidx +
+                                     md_.a_d.trcr2rhom(ti));
       bd[0] = Qm_min / rhom;
       bd[1] = Qm;
       bd[2] = Qm_max / rhom;
@@ -57,9 +83,12 @@ void QLT<ES>::set_Qm (const Int& lclcellidx, const Int& tracer_idx,
 }
 
 template <typename ES> KOKKOS_INLINE_FUNCTION
-Real QLT<ES>::get_Qm (const Int& lclcellidx, const Int& tracer_idx) const {
+Real QLT<ES>::get_batch_Qm (const Int& lclcellidx, const Int& batchidx,
+                            const Int& tracer_idx) const {
+  cedr_kernel_assert(batchidx >= 0 && batchidx < md_.a_d.nbatch);
+  const Int ti = tracer_idx*md_.a_d.nbatch + batchidx; // bulk tracer
   const Int ndps = md_.a_d.prob2br2l[md_.nprobtypes];
-  const Int bdi = md_.a_d.trcr2br2l(tracer_idx);
+  const Int bdi = md_.a_d.trcr2br2l(ti);
   return bd_.r2l_data(ndps*lclcellidx + bdi);
 }
 
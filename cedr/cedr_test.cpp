@@ -3,9 +3,11 @@
 
 #include "cedr_qlt.hpp"
 #include "cedr_caas.hpp"
+#include "cedr_hybrid.hpp"
 #include "cedr_mpi.hpp"
 #include "cedr_util.hpp"
 #include "cedr_test.hpp"
+#include "cedr_workspace.hpp"
 
 #include <stdexcept>
 #include <sstream>
@@ -42,6 +44,9 @@ struct InputParser {
     qin.pseudorandom = false;
     qin.verbose = false;
     tin.ncells = 0;
+    tin.miniapp = false;
+    tin.nsteps = 0;
+    tin.cdr = "qlt";
     for (ArgAdvancer aa(argc, argv); aa.more(); aa.incr()) {
       const char* token = aa.token();
       if (eq(token, "-t", "--unittest")) qin.unittest = true;
@@ -54,12 +59,19 @@ struct InputParser {
       else if (eq(token, "--proc-random")) qin.pseudorandom = true;
       else if (eq(token, "-v", "--verbose")) qin.verbose = true;
       else if (eq(token, "-t1d", "--transport1dtest")) tin.ncells = 1;
+      else if (eq(token, "-t1dm", "--transport1dminiapp")) {
+        tin.ncells = 1;
+        tin.miniapp = true;
+      }
+      else if (eq(token, "-ns", "--nsteps")) tin.nsteps = std::atoi(aa.advance());
+      else if (eq(token, "-cdr")) tin.cdr = aa.advance();
       else cedr_throw_if(true, "Invalid token " << token);
     }
 
     if (tin.ncells) {
       tin.ncells = qin.ncells;
       tin.verbose = qin.verbose;
+      tin.ntracers = qin.ntracers;
     }
 
     cedr_throw_if(qin.tracer_type < 0 || qin.tracer_type >= 4,
@@ -91,11 +103,19 @@ int main (int argc, char** argv) {
     if (inp.qin.unittest) {
       nerr += cedr::local::unittest();
       nerr += cedr::caas::test::unittest(p);
+      nerr += cedr::hybrid::test::unittest(p);
+      nerr += cedr::test::workspace::unittest(p);
     }
+    // Reseed so the QLT tests' data do not depend on the tests run before them.
+    srand(p->rank());
     if (inp.qin.unittest || inp.qin.perftest)
       nerr += cedr::qlt::test::run_unit_and_randomized_tests(p, inp.qin);
-    if (inp.tin.ncells > 0)
-      nerr += cedr::test::transport1d::run(p, inp.tin);
+    if (inp.tin.ncells > 0) {
+      if (inp.tin.miniapp)
+        nerr += cedr::test::transport1d::run_miniapp(p, inp.tin);
+      else
+        nerr += cedr::test::transport1d::run(p, inp.tin);
+    }
     {
       int gnerr;
       cedr::mpi::all_reduce(*p, &nerr, &gnerr, 1, MPI_SUM);
@@ -7,6 +7,8 @@
 #include "cedr.hpp"
 #include "cedr_mpi.hpp"
 
+#include <string>
+
 namespace cedr {
 namespace test {
 namespace transport1d {
@@ -14,10 +16,24 @@ namespace transport1d {
 struct Input {
   Int ncells;
   bool verbose;
+  // Miniapp only.
+  bool miniapp;
+  Int ntracers;
+  // If <= 0, run one revolution.
+  Int nsteps;
+  // "qlt" or "caas".
+  std::string cdr;
 };
 
+// Serial test of QLT and CAAS in 1D transport. Writes out_transport1d.py.
 Int run(const mpi::Parallel::Ptr& p, const Input& in);
 
+// Miniapp: 1D periodic transport on a mesh partitioned over the ranks of p,
+// with Kokkos-parallel interpolation, halo exchange, and property preservation
+// by QLT or CAAS at every step. Report throughput in cell-tracers per second,
+// and return the number of mass-conservation and bound errors.
+Int run_miniapp(const mpi::Parallel::Ptr& p, const Input& in);
+
 } // namespace transport1d
 } // namespace test
 } // namespace cedr
@@ -6,6 +6,7 @@
 #include "cedr_caas.hpp"
 
 #include <algorithm>
+#include <functional>
 
 namespace cedr {
 namespace test {
@@ -22,7 +23,7 @@ inline Real get_slope (const Real x[2], const Real y[2]) {
   return (y[1] - y[0]) / (x[1] - x[0]);
 }
 
-inline void
+KOKKOS_INLINE_FUNCTION void
 get_cubic (Real dx, Real v1, Real s1, Real v2, Real s2, Real c[4]) {
   Real dx2 = dx*dx;
   Real dx3 = dx2*dx;
@@ -259,7 +260,7 @@ public:
 // - better, more canonical IC
 // - optional tree imbalance
 // - optional mesh nonuniformity
-// - parallel?
+// (run_miniapp is the parallel version.)
 Int run (const mpi::Parallel::Ptr& parallel, const Input& in) {
   cedr_throw_if(parallel->size() > 1, "run_1d_transport_test runs in serial only.");
   Int nerr = 0;
@@ -327,6 +328,286 @@ Int run (const mpi::Parallel::Ptr& parallel, const Input& in) {
   return nerr;
 }
 
+
+namespace miniapp {
+typedef Kokkos::DefaultExecutionSpace ES;
+typedef Kokkos::View<Real*, ES> RealList;
+typedef Kokkos::View<Int*, ES> IntList;
+// y(ti, nhalo + i) is tracer ti's mixing ratio in local cell i.
+typedef Kokkos::View<Real**, Kokkos::LayoutRight, ES> Field;
+
+// The departure point of cell i is courant cells to its left, within the
+// stencil (i-2, i-1, i, i+1).
+enum { nhalo = 2 };
+static const Real courant = 0.7;
+
+// Contiguous partition, the same as the one make_tree_over_1d_mesh assumes, so
+// the QLT tree and the halo exchange agree on cell ownership.
+struct Decomp {
+  Int ncells, gci0, nlcl, left, right;
+
+  Decomp (const mpi::Parallel& p, const Int ncells_) : ncells(ncells_) {
+    const Int np = p.size(), rank = p.rank(), chunk = ncells/np;
+    gci0 = rank*chunk;
+    nlcl = rank == np - 1 ? ncells - gci0 : chunk;
+    left = (rank + np - 1) % np;
+    right = (rank + 1) % np;
+  }
+};
+
+// Exchange nhalo cells with each neighbor.
+class HaloExchange {
+  const mpi::Parallel& p_;
+  const Decomp& d_;
+  Int ntracers_;
+  // Layout is (side, tracer, halo cell), with side 0 the left.
+  RealList send_, recv_;
+  RealList::HostMirror send_h_, recv_h_;
+
+public:
+  HaloExchange (const mpi::Parallel& p, const Decomp& d, const Int ntracers)
+    : p_(p), d_(d), ntracers_(ntracers),
+      send_("send", 2*ntracers*nhalo), recv_("recv", 2*ntracers*nhalo),
+      send_h_(Kokkos::create_mirror_view(send_)),
+      recv_h_(Kokkos::create_mirror_view(recv_))
+  {}
+
+  void run (const Field& y) {
+    const Int nt = ntracers_, nlcl = d_.nlcl, n = nt*nhalo;
+    const auto send = send_, recv = recv_;
+    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, 2*n),
+                         KOKKOS_LAMBDA (const Int& j) {
+      const Int side = j / n, ti = (j % n) / nhalo, h = j % nhalo;
+      send(j) = y(ti, side == 0 ? nhalo + h : nlcl + h);
+    });
+    Kokkos::deep_copy(send_h_, send_);
+    // Tag 0 goes left, and tag 1 goes right, so that one or two ranks, for
+    // which left and right are the same, work.
+    mpi::Request reqs[4];
+    mpi::irecv(p_, recv_h_.data(), n, d_.left, 1, &reqs[0]);
+    mpi::irecv(p_, recv_h_.data() + n, n, d_.right, 0, &reqs[1]);
+    mpi::isend(p_, send_h_.data(), n, d_.left, 0, &reqs[2]);
+    mpi::isend(p_, send_h_.data() + n, n, d_.right, 1, &reqs[3]);
+    mpi::waitall(4, reqs);
+    Kokkos::deep_copy(recv_, recv_h_);
+    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, 2*n),
+                         KOKKOS_LAMBDA (const Int& j) {
+      const Int side = j / n, ti = (j % n) / nhalo, h = j % nhalo;
+      y(ti, side == 0 ? h : nhalo + nlcl + h) = recv(j);
+    });
+  }
+};
+
+struct Phase {
+  enum Enum { halo, interp, cdr, get, nphase };
+  static const char* name (const Int i) {
+    static const char* names[] = {"halo", "interp", "cdr", "get"};
+    return names[i];
+  }
+};
+
+// Tracer ti's initial condition, also the exact solution shifted by the
+// distance traveled.
+static Real eval_ic (const Int ti, const Real x) {
+  typedef InitialCondition IC;
+  const IC::Enum ics[] = {IC::sin, IC::bell, IC::rect};
+  const Real xp = interp::to_periodic_core(0, 1, x);
+  return IC::eval(ics[ti % 3], xp);
+}
+
+// Global mass, min, and max of each tracer.
+static void calc_stats (const mpi::Parallel& p, const Decomp& d,
+                        const Field& y, std::vector<Real>& mass,
+                        std::vector<Real>& min, std::vector<Real>& max) {
+  const Int nt = y.extent_int(0);
+  const auto y_h = Kokkos::create_mirror_view(y);
+  Kokkos::deep_copy(y_h, y);
+  std::vector<Real> lmass(nt, 0), lmin(nt), lmax(nt);
+  const Real h = 1.0/d.ncells;
+  for (Int ti = 0; ti < nt; ++ti) {
+    lmin[ti] = lmax[ti] = y_h(ti, nhalo);
+    for (Int i = 0; i < d.nlcl; ++i) {
+      const Real v = y_h(ti, nhalo + i);
+      lmass[ti] += v*h;
+      lmin[ti] = std::min(lmin[ti], v);
+      lmax[ti] = std::max(lmax[ti], v);
+    }
+  }
+  mass.resize(nt); min.resize(nt); max.resize(nt);
+  mpi::all_reduce(p, lmass.data(), mass.data(), nt, MPI_SUM);
+  mpi::all_reduce(p, lmin.data(), min.data(), nt, MPI_MIN);
+  mpi::all_reduce(p, lmax.data(), max.data(), nt, MPI_MAX);
+}
+
+// Take nsteps steps of the semi-Lagrangian scheme with property preservation
+// by cdr. lcis(i) is local cell i's index in cdr. Accumulate phase times in et.
+template <typename CDRT>
+void step (const mpi::Parallel& p, const Decomp& d, CDRT& cdr,
+           const IntList& lcis, const Field& y, const Int nsteps,
+           Real et[Phase::nphase]) {
+  const Int nt = y.extent_int(0), nlcl = d.nlcl, n = nt*nlcl;
+  const Real h = 1.0/d.ncells, t = 1 - courant;
+  HaloExchange halo(p, d, nt);
+  {
+    const auto f = KOKKOS_LAMBDA (const Int& i) { cdr.set_rhom(lcis(i), 0, h); };
+    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, nlcl), f);
+  }
+  const auto timed = [&] (const Int phase, const std::function<void()>& f) {
+    Kokkos::fence();
+    const double t0 = MPI_Wtime();
+    f();
+    Kokkos::fence();
+    et[phase] += MPI_Wtime() - t0;
+  };
+  for (Int si = 0; si < nsteps; ++si) {
+    timed(Phase::halo, [&] () { halo.run(y); });
+    // Interpolate at the departure points, and give the CDR the results and
+    // the domain of dependence's bounds.
+    timed(Phase::interp, [&] () {
+      const auto f = KOKKOS_LAMBDA (const Int& j) {
+        const Int ti = j / nlcl, i = j % nlcl;
+        Real s[4], lo, hi;
+        for (Int k = 0; k < 4; ++k) s[k] = y(ti, nhalo + i - 2 + k);
+        lo = hi = s[0];
+        for (Int k = 1; k < 4; ++k) {
+          lo = cedr::impl::min(lo, s[k]);
+          hi = cedr::impl::max(hi, s[k]);
+        }
+        Real c[4];
+        interp::get_cubic(1, s[1], 0.5*(s[2] - s[0]), s[2], 0.5*(s[3] - s[1]), c);
+        const Real v = ((c[0]*t + c[1])*t + c[2])*t + c[3];
+        cdr.set_Qm(lcis(i), ti, v*h, lo*h, hi*h, s[2]*h);
+      };
+      Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, n), f);
+    });
+    timed(Phase::cdr, [&] () { cdr.run(); });
+    timed(Phase::get, [&] () {
+      const auto f = KOKKOS_LAMBDA (const Int& j) {
+        const Int ti = j / nlcl, i = j % nlcl;
+        y(ti, nhalo + i) = cdr.get_Qm(lcis(i), ti)/h;
+      };
+      Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, n), f);
+    });
+  }
+}
+
+template <typename CDRT>
+void declare_tracers (CDRT& cdr, const Int ntracers) {
+  for (Int ti = 0; ti < ntracers; ++ti)
+    cdr.declare_tracer(ProblemType::conserve | ProblemType::shapepreserve, 0);
+  cdr.end_tracer_declarations();
+  cdr.finish_setup();
+}
+
+static void print_stat (const mpi::Parallel& p, const char* name, const Real v,
+                        const Real scale) {
+  Real min, max, sum;
+  mpi::all_reduce(p, &v, &min, 1, MPI_MIN);
+  mpi::all_reduce(p, &v, &max, 1, MPI_MAX);
+  mpi::all_reduce(p, &v, &sum, 1, MPI_SUM);
+  if (p.amroot())
+    printf("  %-7s min %10.3e max %10.3e mean %10.3e s/step\n", name,
+           min*scale, max*scale, sum*scale/p.size());
+}
+} // namespace miniapp
+
+Int run_miniapp (const mpi::Parallel::Ptr& parallel, const Input& in) {
+  using namespace miniapp;
+  const mpi::Parallel& p = *parallel;
+  cedr_throw_if(in.ncells < nhalo*p.size(),
+                "run_miniapp needs at least " << nhalo << " cells per rank.");
+  cedr_throw_if(in.ntracers < 1, "run_miniapp needs at least 1 tracer.");
+  const Decomp d(p, in.ncells);
+  const Int nt = in.ntracers,
+    nsteps = in.nsteps > 0 ? in.nsteps : Int(std::ceil(in.ncells/courant));
+  const Real h = 1.0/in.ncells;
+
+  Field y("y", nt, d.nlcl + 2*nhalo);
+  {
+    const auto y_h = Kokkos::create_mirror_view(y);
+    for (Int ti = 0; ti < nt; ++ti)
+      for (Int i = 0; i < d.nlcl; ++i)
+        y_h(ti, nhalo + i) = eval_ic(ti, (d.gci0 + i + 0.5)*h);
+    Kokkos::deep_copy(y, y_h);
+  }
+  std::vector<Real> mass0, min0, max0;
+  calc_stats(p, d, y, mass0, min0, max0);
+
+  Real et[Phase::nphase] = {0};
+  IntList lcis("lcis", d.nlcl);
+  const auto lcis_h = Kokkos::create_mirror_view(lcis);
+  if (util::eq(in.cdr, "qlt")) {
+    typedef qlt::QLT<ES> QLTT;
+    const auto tree = qlt::tree::make_tree_over_1d_mesh(parallel, in.ncells);
+    QLTT qlt(parallel, in.ncells, tree);
+    cedr_assert(qlt.nlclcells() == d.nlcl);
+    declare_tracers(qlt, nt);
+    for (Int i = 0; i < d.nlcl; ++i) lcis_h(i) = qlt.gci2lci(d.gci0 + i);
+    Kokkos::deep_copy(lcis, lcis_h);
+    step(p, d, qlt, lcis, y, nsteps, et);
+  } else {
+    cedr_throw_if( ! util::eq(in.cdr, "caas"),
+                   "run_miniapp: cdr must be qlt or caas, not " << in.cdr);
+    typedef caas::CAAS<ES> CAAST;
+    CAAST caas(parallel, d.nlcl);
+    declare_tracers(caas, nt);
+    for (Int i = 0; i < d.nlcl; ++i) lcis_h(i) = i;
+    Kokkos::deep_copy(lcis, lcis_h);
+    step(p, d, caas, lcis, y, nsteps, et);
+  }
+
+  // Check mass conservation and global bounds, and measure the error against
+  // the exact solution.
+  Int nerr = 0;
+  std::vector<Real> mass, min, max;
+  calc_stats(p, d, y, mass, min, max);
+  Real l1err = 0, l1 = 0;
+  {
+    const auto y_h = Kokkos::create_mirror_view(y);
+    Kokkos::deep_copy(y_h, y);
+    Real lcl[2] = {0}, glbl[2];
+    for (Int ti = 0; ti < nt; ++ti)
+      for (Int i = 0; i < d.nlcl; ++i) {
+        const Real ye = eval_ic(ti, (d.gci0 + i + 0.5 - nsteps*courant)*h);
+        lcl[0] += std::abs(y_h(ti, nhalo + i) - ye);
+        lcl[1] += std::abs(ye);
+      }
+    mpi::all_reduce(p, lcl, glbl, 2, MPI_SUM);
+    l1err = glbl[0];
+    l1 = glbl[1];
+  }
+  for (Int ti = 0; ti < nt; ++ti) {
+    const Real tol = 1e3*std::numeric_limits<Real>::epsilon();
+    const bool mass_ok = std::abs(mass[ti] - mass0[ti]) <= tol*std::abs(mass0[ti]),
+      bounds_ok = min[ti] >= min0[ti] - tol && max[ti] <= max0[ti] + tol;
+    if ( ! mass_ok || ! bounds_ok) {
+      ++nerr;
+      if (p.amroot())
+        printf("run_miniapp: tracer %d mass relerr %1.3e min %1.3e (%1.3e)"
+               " max %1.3e (%1.3e)\n", ti,
+               std::abs(mass[ti] - mass0[ti])/std::abs(mass0[ti]),
+               min[ti], min0[ti], max[ti], max0[ti]);
+    }
+  }
+
+  Real tot = 0;
+  for (Int i = 0; i < Phase::nphase; ++i) tot += et[i];
+  Real tot_max;
+  mpi::all_reduce(p, &tot, &tot_max, 1, MPI_MAX);
+  if (p.amroot()) {
+    printf("t1d miniapp: cdr %s nrank %d ncells %d ntracers %d nsteps %d"
+           " courant %1.2f\n", in.cdr.c_str(), p.size(), in.ncells, nt, nsteps,
+           courant);
+    printf("  L1 relerr %1.3e\n", l1err/l1);
+  }
+  for (Int i = 0; i < Phase::nphase; ++i)
+    print_stat(p, Phase::name(i), et[i], 1.0/nsteps);
+  if (p.amroot())
+    printf("  %1.3e s/step, %1.3e cell-tracers/s\n", tot_max/nsteps,
+           Real(in.ncells)*nt*nsteps/tot_max);
+  return nerr;
+}
+
 } // namespace transport1d
 } // namespace test
 } // namespace cedr
@@ -8,7 +8,7 @@ namespace test {
 
 std::string TestRandomized::Tracer::str () const {
   std::stringstream ss;
-  ss << "(ti " << idx;
+  ss << "(ti " << idx << " ri " << rhomidx;
   if (problem_type & PT::conserve) ss << " c";
   if (problem_type & PT::shapepreserve) ss << " s";
   if (problem_type & PT::consistent) ss << " t";
@@ -41,6 +41,7 @@ void TestRandomized::init_tracers_vector () {
       const bool shapepreserve = t.problem_type & PT::shapepreserve;
       const bool nonnegative = t.problem_type & PT::nonnegative;
       t.idx = tracer_idx++;
+      t.rhomidx = t.idx % nrhom_;
       t.perturbation_type = perturb;
       t.safe_should_hold = true;
       t.no_change_should_hold = perturb == 0;
@@ -53,15 +54,17 @@ void TestRandomized::init_tracers_vector () {
 static Real urand () { return rand() / ((Real) RAND_MAX + 1.0); }
 
 void TestRandomized::generate_rho (Values& v) {
-  auto r = v.rhom();
   const Int n = v.ncells();
-  for (Int i = 0; i < n; ++i)
-    r[i] = 0.5*(1 + urand());
+  for (Int ri = 0; ri < v.nrhom(); ++ri) {
+    auto r = v.rhom(ri);
+    for (Int i = 0; i < n; ++i)
+      r[i] = 0.5*(1 + urand());
+  }
 }
 
 void TestRandomized::generate_Q (const Tracer& t, Values& v) {
-  Real* rhom = v.rhom(), * Qm_min = v.Qm_min(t.idx), * Qm = v.Qm(t.idx),
-    * Qm_max = v.Qm_max(t.idx), * Qm_prev = v.Qm_prev(t.idx);
+  Real* rhom = v.rhom(t.rhomidx), * Qm_min = v.Qm_min(t.idx),
+    * Qm = v.Qm(t.idx), * Qm_max = v.Qm_max(t.idx), * Qm_prev = v.Qm_prev(t.idx);
   const Int n = v.ncells();
   const bool nonneg_only = t.problem_type & ProblemType::nonnegative;
   for (Int i = 0; i < n; ++i) {
@@ -132,7 +135,7 @@ void TestRandomized
   Real rhom, Qm, Qm_max; {
     Real Qm_sum_lcl[3] = {0};
     for (Int i = 0; i < v.ncells(); ++i) {
-      Qm_sum_lcl[0] += v.rhom()[i];
+      Qm_sum_lcl[0] += v.rhom(t.rhomidx)[i];
       Qm_sum_lcl[1] += v.Qm(t.idx)[i];
       Qm_sum_lcl[2] += v.Qm_max(t.idx)[i];
     }
@@ -142,9 +145,10 @@ void TestRandomized
   }
   Real Qm_max_safety = 0;
   if (safety_problem && v.ncells()) {
-    Real q_safety_lcl = v.Qm_max(t.idx)[0] / v.rhom()[0];
+    const Real* const r = v.rhom(t.rhomidx);
+    Real q_safety_lcl = v.Qm_max(t.idx)[0] / r[0];
     for (Int i = 1; i < v.ncells(); ++i)
-      q_safety_lcl = std::max(q_safety_lcl, v.Qm_max(t.idx)[i] / v.rhom()[i]);
+      q_safety_lcl = std::max(q_safety_lcl, v.Qm_max(t.idx)[i] / r[i]);
     Real q_safety_gbl = 0;
     mpi::all_reduce(*p_, &q_safety_lcl, &q_safety_gbl, 1, MPI_MAX);
     Qm_max_safety = q_safety_gbl*rhom;
@@ -298,8 +302,13 @@ Int TestRandomized
   static const Real ulp3 = 3*eps;
   const auto prefer_mass_con_to_bounds =
     options_.prefer_numerical_mass_conservation_to_numerical_bounds;
-  const Real lv_tol = prefer_mass_con_to_bounds ? 100*eps : 0;
-  const Real safety_tol = prefer_mass_con_to_bounds ? 100*eps : ulp3;
+  Real lv_tol = prefer_mass_con_to_bounds ? 100*eps : 0;
+  Real safety_tol = prefer_mass_con_to_bounds ? 100*eps : ulp3;
+  if (options_.single_precision_bounds) {
+    // Bounds are met only to single precision in problems that are feasible
+    // only to within the bounds' rounding.
+    lv_tol = safety_tol = 100*std::numeric_limits<float>::epsilon();
+  }
   Int nerr = 0;
   std::vector<Real> lcl_mass(2*ts.size()), q_min_lcl(ts.size()), q_max_lcl(ts.size());
   std::vector<Int> t_ok(ts.size(), 1), local_violated(ts.size(), 0);
@@ -310,8 +319,8 @@ Int TestRandomized
     const bool safe_only = ! t.local_should_hold;
     const bool nonneg_only = t.problem_type & ProblemType::nonnegative;
     const Int n = v.ncells();
-    const Real* rhom = v.rhom(), * Qm_min = v.Qm_min(t.idx), * Qm = v.Qm(t.idx),
-      * Qm_max = v.Qm_max(t.idx), * Qm_prev = v.Qm_prev(t.idx);
+    const Real* rhom = v.rhom(t.rhomidx), * Qm_min = v.Qm_min(t.idx),
+      * Qm = v.Qm(t.idx), * Qm_max = v.Qm_max(t.idx), * Qm_prev = v.Qm_prev(t.idx);
 
     q_min_lcl[ti] =  1e3;
     q_max_lcl[ti] = -1e3;
@@ -356,8 +365,8 @@ Int TestRandomized
     const bool nonneg_only = t.problem_type & ProblemType::nonnegative;
     if (safe_only) {
       const Int n = v.ncells();
-      const Real* rhom = v.rhom(), * Qm_min = v.Qm_min(t.idx), * Qm = v.Qm(t.idx),
-        * Qm_max = v.Qm_max(t.idx);
+      const Real* rhom = v.rhom(t.rhomidx), * Qm_min = v.Qm_min(t.idx),
+        * Qm = v.Qm(t.idx), * Qm_max = v.Qm_max(t.idx);
       const Real q_min = nonneg_only ? 0 : q_min_gbl[ti], q_max = q_max_gbl[ti];
       for (Int i = 0; i < n; ++i) {
         const Real delta = (q_max - q_min)*safety_tol;
@@ -411,12 +420,37 @@ Int TestRandomized
 
   return nerr;
 }
-  
+
+Int TestRandomized::check_profile (const CDR& cdr) const {
+  typedef CDR::Profile P;
+  const auto& lp = cdr.get_profile();
+  const auto s = cdr.summarize_profile(*p_);
+  Int nerr = 0;
+  // The phases nest, and run was timed.
+  const Real tol = 1e-9;
+  for (const Int phase : {P::l2r, P::r2l, P::local, P::reduce, P::wait})
+    if (lp.time[phase] > lp.time[P::run] + tol) ++nerr;
+  if (lp.ncall[P::run] < 1) ++nerr;
+  // Every message is counted by its sender and its receiver.
+  if (s.nmsg_sent.mean != s.nmsg_recvd.mean ||
+      s.nbyte_sent.mean != s.nbyte_recvd.mean)
+    ++nerr;
+  if (s.time[P::run].min > lp.time[P::run] ||
+      s.time[P::run].max < lp.time[P::run] ||
+      s.time[P::run].max_rank < 0 || s.time[P::run].max_rank >= p_->size())
+    ++nerr;
+  if (nerr && p_->amroot()) {
+    std::cout << "FAIL " << cdr_name_ << ": profile\n";
+    s.print(std::cout);
+  }
+  return nerr;
+}
+
 TestRandomized
 ::TestRandomized (const std::string& name, const mpi::Parallel::Ptr& p,
                   const Int& ncells, const bool verbose,
-                  const CDR::Options options)
-  : cdr_name_(name), options_(options), p_(p), ncells_(ncells),
+                  const CDR::Options options, const Int nrhom)
+  : cdr_name_(name), options_(options), p_(p), ncells_(ncells), nrhom_(nrhom),
     write_inited_(false)
 {}
 
@@ -15,7 +15,9 @@ class TestRandomized {
 public:
   TestRandomized(const std::string& cdr_name, const mpi::Parallel::Ptr& p,
                  const Int& ncells, const bool verbose = false,
-                 const CDR::Options options = CDR::Options());
+                 const CDR::Options options = CDR::Options(),
+                 // Number of total densities. Tracer i uses rhom i % nrhom.
+                 const Int nrhom = 1);
 
   // The subclass should call this, probably in its constructor.
   void init();
@@ -32,6 +34,7 @@ protected:
     typedef ProblemType PT;
     
     Int idx;
+    Int rhomidx;
     Int problem_type;
     Int perturbation_type;
     bool no_change_should_hold, safe_should_hold, local_should_hold;
@@ -40,32 +43,34 @@ protected:
     std::string str() const;
 
     Tracer ()
-      : idx(-1), problem_type(-1), perturbation_type(-1), no_change_should_hold(false),
+      : idx(-1), rhomidx(0), problem_type(-1), perturbation_type(-1), no_change_should_hold(false),
         safe_should_hold(true), local_should_hold(true), write(false)
     {}
   };
 
   struct ValuesPartition {
     Int ncells () const { return ncells_; }
-    KIF Real* rhom () const { return v_; }
-    KIF Real* Qm_min  (const Int& ti) const { return v_ + ncells_*(1 + 4*ti    ); }
-    KIF Real* Qm      (const Int& ti) const { return v_ + ncells_*(1 + 4*ti + 1); }
-    KIF Real* Qm_max  (const Int& ti) const { return v_ + ncells_*(1 + 4*ti + 2); }
-    KIF Real* Qm_prev (const Int& ti) const { return v_ + ncells_*(1 + 4*ti + 3); }
+    Int nrhom () const { return nrhom_; }
+    KIF Real* rhom (const Int& ri = 0) const { return v_ + ncells_*ri; }
+    KIF Real* Qm_min  (const Int& ti) const { return v_ + ncells_*(nrhom_ + 4*ti    ); }
+    KIF Real* Qm      (const Int& ti) const { return v_ + ncells_*(nrhom_ + 4*ti + 1); }
+    KIF Real* Qm_max  (const Int& ti) const { return v_ + ncells_*(nrhom_ + 4*ti + 2); }
+    KIF Real* Qm_prev (const Int& ti) const { return v_ + ncells_*(nrhom_ + 4*ti + 3); }
   protected:
-    void init (const Int ncells, Real* v) {
+    void init (const Int ncells, const Int nrhom, Real* v) {
       ncells_ = ncells;
+      nrhom_ = nrhom;
       v_ = v;
     }
   private:
-    Int ncells_;
+    Int ncells_, nrhom_;
     Real* v_;
   };
 
   struct Values : public ValuesPartition {
-    Values (const Int ntracers, const Int ncells)
-      : v_((4*ntracers + 1)*ncells)
-    { init(ncells, v_.data()); }
+    Values (const Int ntracers, const Int ncells, const Int nrhom = 1)
+      : v_((4*ntracers + nrhom)*ncells)
+    { init(ncells, nrhom, v_.data()); }
     Real* data () { return v_.data(); }
     size_t size () const { return v_.size(); }
   private:
@@ -78,7 +83,7 @@ PRIVATE_CUDA:
     // This Values object is the source of data and gets updated by sync_host.
     ValuesDevice (Values& v)
       : rar_(v.data(), v.size())
-    { init(v.ncells(), rar_.device_ptr()); }
+    { init(v.ncells(), v.nrhom(), rar_.device_ptr()); }
     // Values -> device.
     void sync_device () { rar_.sync_device(); }
     // Update Values from device.
@@ -98,7 +103,7 @@ protected:
   };
 
   const mpi::Parallel::Ptr p_;
-  const Int ncells_;
+  const Int ncells_, nrhom_;
   // Global mesh entity IDs, 1-1 with reduction array index or QLT leaf node.
   std::vector<Long> gcis_;
   std::vector<Tracer> tracers_;
@@ -145,8 +150,23 @@ private:
   static std::string get_tracer_name(const Tracer& t);
   Int check(const std::string& cdr_name, const mpi::Parallel& p,
             const std::vector<Tracer>& ts, const Values& v);
+  // Check the consistency of the CDR's profile.
+  Int check_profile(const CDR& cdr) const;
 };
 
+// Check that a CDR with CDR::Options::nbatch = nbatch gives, for each batch
+// instance, bit-for-bit the result of a CDR having just that instance's data.
+// make(options) returns a shared_ptr to a new CDRT for this rank's cells,
+// which are gcis in local order. Tracer i has ProblemType probs[i] and rhom
+// index i % 2. If tol > 0, the results must instead agree to relative error
+// tol.
+template <typename CDRT, typename MakeCDR,
+          typename ExeSpace = Kokkos::DefaultExecutionSpace>
+Int test_batch(const std::string& cdr_name, const mpi::Parallel& p,
+               const std::vector<Long>& gcis, const std::vector<int>& probs,
+               const Int nbatch, CDR::Options options, const MakeCDR& make,
+               const Real tol = 0);
+
 } // namespace test
 } // namespace cedr
 
@@ -13,7 +13,7 @@ template <typename CDRT, typename ES>
 Int TestRandomized::run (const Int nrepeat, const bool write) {
   const Int nt = tracers_.size(), nlclcells = gcis_.size();
 
-  Values v(nt, nlclcells);
+  Values v(nt, nlclcells, nrhom_);
   generate_rho(v);
   for (const auto& t : tracers_) {
     generate_Q(t, v);
@@ -29,11 +29,12 @@ Int TestRandomized::run (const Int nrepeat, const bool write) {
   vd.sync_device();
 
   {
-    const auto rhom = vd.rhom();
-    const auto set_rhom = KOKKOS_LAMBDA (const Int& i) {
-      cdr.set_rhom(i, 0, rhom[i]);
+    const auto set_rhom = KOKKOS_LAMBDA (const Int& j) {
+      const auto ri = j / nlclcells;
+      const auto i = j % nlclcells;
+      cdr.set_rhom(i, ri, vd.rhom(ri)[i]);
     };
-    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, nlclcells), set_rhom);
+    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, nrhom_*nlclcells), set_rhom);
   }
   // repeat > 1 runs the same values repeatedly for performance
   // meaurement.
@@ -60,7 +61,128 @@ Int TestRandomized::run (const Int nrepeat, const bool write) {
   if (write)
     for (const auto& t : tracers_)
       write_post(t, v);
-  return check(cdr_name_, *p_, tracers_, v);
+  Int nerr = check(cdr_name_, *p_, tracers_, v);
+  if (get_cdr().get_profiling()) nerr += check_profile(get_cdr());
+  return nerr;
+}
+
+namespace impl {
+// Copy gcis to a View in ES.
+template <typename ES>
+Kokkos::View<Long*, ES> make_gcis_view (const std::vector<Long>& gcis) {
+  const Int n = gcis.size();
+  Kokkos::View<Long*, ES> gcis_d("gcis", n);
+  const auto gcis_h = Kokkos::create_mirror_view(gcis_d);
+  for (Int i = 0; i < n; ++i) gcis_h(i) = gcis[i];
+  Kokkos::deep_copy(gcis_d, gcis_h);
+  return gcis_d;
+}
+
+// Cell data that depend only on the global cell index x, the rhom index ri or
+// tracer ti, and a batch index b, so that the problem is the same for any
+// decomposition or batching. q_prev is in the bounds, so the global problem is
+// feasible; q is perturbed out of bounds in some cells.
+struct CellValues {
+  Real rhom, Qm, Qm_min, Qm_max, Qm_prev;
+};
+
+KOKKOS_INLINE_FUNCTION
+Real get_rhom (const Real x, const Int ri, const Real b = 0) {
+  return 1 + 0.5*std::sin(0.1*x + ri + 0.3*b);
+}
+
+KOKKOS_INLINE_FUNCTION
+CellValues get_cell_values (const Real x, const Int ti, const Int ri,
+                            const Real b = 0) {
+  CellValues v;
+  v.rhom = get_rhom(x, ri, b);
+  const Real q_prev = 0.5 + 0.3*std::sin(0.3*x + ti + b),
+    q = q_prev + 0.3*std::sin(1.7*x + 2*ti + 0.7*b);
+  v.Qm = q*v.rhom;
+  v.Qm_min = 0.1*v.rhom;
+  v.Qm_max = 0.9*v.rhom;
+  v.Qm_prev = q_prev*v.rhom;
+  return v;
+}
+
+// Set the cell values for batch index bi0 + bi, with tracer ti using rhom
+// index ti % 2, run, and copy the results to Qm. A CDR having nbatch 1 is
+// accessed through the CDR methods.
+template <typename CDRT, typename ES>
+void run_batch (CDRT& cdr, const Kokkos::View<Long*, ES>& gcis,
+                const Int ntracer, const Int nbatch, const Int bi0,
+                const Kokkos::View<Real*, ES>& Qm) {
+  const Int n = gcis.extent_int(0);
+  {
+    const auto f = KOKKOS_LAMBDA (const Int& j) {
+      const Int i = j % n, bi = (j / n) % nbatch, ri = j / (n*nbatch);
+      const Real rhom = get_rhom(gcis(i), ri, bi0 + bi);
+      if (nbatch == 1) cdr.set_rhom(i, ri, rhom);
+      else cdr.set_batch_rhom(i, bi, ri, rhom);
+    };
+    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, 2*nbatch*n), f);
+  }
+  {
+    const auto f = KOKKOS_LAMBDA (const Int& j) {
+      const Int i = j % n, bi = (j / n) % nbatch, ti = j / (n*nbatch);
+      const auto v = get_cell_values(gcis(i), ti, ti % 2, bi0 + bi);
+      if (nbatch == 1)
+        cdr.set_Qm(i, ti, v.Qm, v.Qm_min, v.Qm_max, v.Qm_prev);
+      else
+        cdr.set_batch_Qm(i, bi, ti, v.Qm, v.Qm_min, v.Qm_max, v.Qm_prev);
+    };
+    Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, ntracer*nbatch*n), f);
+  }
+  cdr.run();
+  const auto f = KOKKOS_LAMBDA (const Int& j) {
+    const Int i = j % n, bi = (j / n) % nbatch, ti = j / (n*nbatch);
+    Qm(j) = nbatch == 1 ? cdr.get_Qm(i, ti) : cdr.get_batch_Qm(i, bi, ti);
+  };
+  Kokkos::parallel_for(Kokkos::RangePolicy<ES>(0, ntracer*nbatch*n), f);
+}
+} // namespace impl
+
+template <typename CDRT, typename MakeCDR, typename ES>
+Int test_batch (const std::string& cdr_name, const mpi::Parallel& p,
+                const std::vector<Long>& gcis, const std::vector<int>& probs,
+                const Int nbatch, CDR::Options options, const MakeCDR& make,
+                const Real tol) {
+  typedef Kokkos::View<Real*, ES> RealList;
+  const Int n = gcis.size(), nt = probs.size();
+  const auto gcis_d = impl::make_gcis_view<ES>(gcis);
+
+  const auto setup = [&] (const Int nb) {
+    options.nbatch = nb;
+    const auto cdr = make(options);
+    for (Int ti = 0; ti < nt; ++ti) cdr->declare_tracer(probs[ti], ti % 2);
+    cdr->end_tracer_declarations();
+    cdr->finish_setup();
+    return cdr;
+  };
+
+  Int nerr = 0;
+  const auto cdrb = setup(nbatch), cdr1 = setup(1);
+  if (cdrb->get_num_tracers() != nt) ++nerr;
+  for (Int ti = 0; ti < nt; ++ti)
+    if (cdrb->get_problem_type(ti) != cdr1->get_problem_type(ti)) ++nerr;
+  RealList Qmb("Qmb", nt*nbatch*n);
+  impl::run_batch(*cdrb, gcis_d, nt, nbatch, 0, Qmb);
+  const auto Qmb_h = Kokkos::create_mirror_view(Qmb);
+  Kokkos::deep_copy(Qmb_h, Qmb);
+  for (Int bi = 0; bi < nbatch; ++bi) {
+    RealList Qm("Qm", nt*n);
+    impl::run_batch(*cdr1, gcis_d, nt, 1, bi, Qm);
+    const auto Qm_h = Kokkos::create_mirror_view(Qm);
+    Kokkos::deep_copy(Qm_h, Qm);
+    for (Int ti = 0; ti < nt; ++ti)
+      for (Int i = 0; i < n; ++i)
+        if (std::abs(Qm_h(ti*n + i) - Qmb_h((ti*nbatch + bi)*n + i)) >
+            tol*std::abs(Qm_h(ti*n + i)))
+          ++nerr;
+  }
+  if (nerr && p.amroot())
+    std::cerr << "FAIL: " << cdr_name << " test_batch nerr " << nerr << "\n";
+  return nerr;
 }
 
 } // namespace test
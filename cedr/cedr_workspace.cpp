@@ -0,0 +1,170 @@
+// COMPOSE version 1.0: Copyright 2018 NTESS. This software is released under
+// the BSD license; see LICENSE in the top-level directory.
+
+#include "cedr_workspace.hpp"
+#include "cedr_qlt.hpp"
+#include "cedr_caas.hpp"
+#include "cedr_util.hpp"
+#include "cedr_test_randomized.hpp"
+
+#include <algorithm>
+#include <map>
+
+namespace cedr {
+
+static size_t align (const size_t n, const size_t a) { return ((n + a - 1)/a)*a; }
+
+template <typename ES>
+void Workspace<ES>::add (CDR& cdr, const Int alias_group) {
+  cedr_throw_if(buf_.size() > 0, "Workspace::add: called after allocate.");
+  Entry e;
+  e.cdr = &cdr;
+  e.group = alias_group;
+  cdr.get_buffers_sizes(e.buf1, e.buf2);
+  entries_.push_back(e);
+}
+
+template <typename ES>
+void Workspace<ES>::allocate () {
+  cedr_throw_if(buf_.size() > 0, "Workspace::allocate: called twice.");
+  // Lay out each CDR's buf1, then each ungrouped buf2, then one buf2 per
+  // alias group.
+  std::vector<size_t> os1(entries_.size()), os2(entries_.size());
+  std::map<Int, size_t> group_sz, group_os;
+  size_t n = 0, nua = 0;
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const auto& e = entries_[i];
+    os1[i] = n;
+    n += align(e.buf1, alignment);
+    nua += align(e.buf1, alignment) + align(e.buf2, alignment);
+  }
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const auto& e = entries_[i];
+    if (e.group >= 0) {
+      auto& sz = group_sz[e.group];
+      sz = std::max(sz, align(e.buf2, alignment));
+      continue;
+    }
+    os2[i] = n;
+    n += align(e.buf2, alignment);
+  }
+  for (const auto& g : group_sz) {
+    group_os[g.first] = n;
+    n += g.second;
+  }
+  size_ = n;
+  unaliased_size_ = nua;
+  buf_ = RealList("CEDR Workspace", std::max<size_t>(n, 1));
+  Real* const b = buf_.data();
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const auto& e = entries_[i];
+    e.cdr->set_buffers(b + os1[i],
+                       b + (e.group >= 0 ? group_os[e.group] : os2[i]));
+  }
+}
+
+namespace test {
+namespace workspace {
+typedef Kokkos::DefaultExecutionSpace ES;
+typedef Kokkos::View<Real*, ES> RealList;
+
+// Set a feasible problem determined by the global cell indices, run it, and
+// get the result.
+template <typename CDRT>
+static RealList run (CDRT& cdr, const std::vector<Long>& gcis,
+                     const Int ntracers) {
+  RealList Qm("Qm", gcis.size()*ntracers);
+  test::impl::run_batch(cdr, test::impl::make_gcis_view<ES>(gcis), ntracers, 1,
+                        0, Qm);
+  return Qm;
+}
+
+static Int compare (const RealList& a, const RealList& b) {
+  const auto a_h = Kokkos::create_mirror_view(a);
+  const auto b_h = Kokkos::create_mirror_view(b);
+  Kokkos::deep_copy(a_h, a);
+  Kokkos::deep_copy(b_h, b);
+  Int nerr = a_h.extent_int(0) == b_h.extent_int(0) ? 0 : 1;
+  for (Int i = 0; i < std::min(a_h.extent_int(0), b_h.extent_int(0)); ++i)
+    if (a_h(i) != b_h(i)) ++nerr;
+  return nerr;
+}
+
+// Two QLTs and a CAAS with their own buffers and the same three in a
+// Workspace, with buf2 aliased among all three, must give the same results.
+Int unittest (const mpi::Parallel::Ptr& p) {
+  typedef qlt::QLT<ES> QLTT;
+  typedef caas::CAAS<ES> CAAST;
+  const Int ncells = std::max(42, 3*p->size()), np = p->size(),
+    rank = p->rank(), ntracers[] = {2, 3, 2};
+  const int probs[] = {
+    ProblemType::conserve | ProblemType::shapepreserve,
+    ProblemType::conserve | ProblemType::nonnegative,
+    ProblemType::conserve | ProblemType::shapepreserve};
+  const auto tree = qlt::tree::make_tree_over_1d_mesh(p, ncells);
+  const Int nlcl = ncells/np + (rank < ncells % np ? 1 : 0);
+  const Long gci0 = Long(rank)*(ncells/np) + std::min(rank, ncells % np);
+  std::vector<Long> caas_gcis(nlcl);
+  for (Int i = 0; i < nlcl; ++i) caas_gcis[i] = gci0 + i;
+
+  const auto declare = [&] (CDR& cdr, const Int i) {
+    for (Int ti = 0; ti < ntracers[i]; ++ti)
+      cdr.declare_tracer(probs[i], ti % 2);
+    cdr.end_tracer_declarations();
+  };
+
+  RealList ref[3];
+  {
+    QLTT q0(p, ncells, tree), q1(p, ncells, tree);
+    CAAST c(p, nlcl);
+    declare(q0, 0); declare(q1, 1); declare(c, 2);
+    q0.finish_setup(); q1.finish_setup(); c.finish_setup();
+    std::vector<Long> gcis;
+    q0.get_owned_glblcells(gcis);
+    ref[0] = run(q0, gcis, ntracers[0]);
+    ref[1] = run(q1, gcis, ntracers[1]);
+    ref[2] = run(c, caas_gcis, ntracers[2]);
+  }
+
+  Int nerr = 0;
+  {
+    QLTT q0(p, ncells, tree), q1(p, ncells, tree);
+    CAAST c(p, nlcl);
+    declare(q0, 0); declare(q1, 1); declare(c, 2);
+    Workspace<ES> ws;
+    ws.add(q0, 0);
+    ws.add(q1, 0);
+    ws.add(c, 0);
+    ws.allocate();
+    q0.finish_setup(); q1.finish_setup(); c.finish_setup();
+    if (ws.size() >= ws.unaliased_size()) ++nerr;
+    std::vector<Long> gcis;
+    q0.get_owned_glblcells(gcis);
+    // Twice, so that each CDR runs after the others have overwritten the
+    // shared buffer.
+    for (Int trial = 0; trial < 2; ++trial) {
+      nerr += compare(run(q0, gcis, ntracers[0]), ref[0]);
+      nerr += compare(run(q1, gcis, ntracers[1]), ref[1]);
+      nerr += compare(run(c, caas_gcis, ntracers[2]), ref[2]);
+    }
+  }
+  if (nerr && p->amroot())
+    std::cerr << "FAIL: workspace::unittest nerr " << nerr << "\n";
+  return nerr;
+}
+} // namespace workspace
+} // namespace test
+} // namespace cedr
+
+#ifdef KOKKOS_ENABLE_SERIAL
+template class cedr::Workspace<Kokkos::Serial>;
+#endif
+#ifdef KOKKOS_ENABLE_OPENMP
+template class cedr::Workspace<Kokkos::OpenMP>;
+#endif
+#ifdef KOKKOS_ENABLE_CUDA
+template class cedr::Workspace<Kokkos::Cuda>;
+#endif
+#ifdef KOKKOS_ENABLE_THREADS
+template class cedr::Workspace<Kokkos::Threads>;
+#endif
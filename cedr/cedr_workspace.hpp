@@ -0,0 +1,65 @@
+// COMPOSE version 1.0: Copyright 2018 NTESS. This software is released under
+// the BSD license; see LICENSE in the top-level directory.
+
+#ifndef INCLUDE_CEDR_WORKSPACE_HPP
+#define INCLUDE_CEDR_WORKSPACE_HPP
+
+#include "cedr_cdr.hpp"
+
+#include <vector>
+
+namespace cedr {
+
+// One device allocation for the primary buffers of several CDRs, e.g., one QLT
+// or CAAS instance per tracer group. Use:
+//     Workspace<> ws;
+//     for each cdr: cdr.end_tracer_declarations(); ws.add(cdr, group);
+//     ws.allocate();
+//     for each cdr: cdr.finish_setup();
+// Each CDR gets non-overlapping buf1 and buf2 (see CDR::get_buffers_sizes),
+// except that CDRs added with the same alias_group >= 0 share one buf2, sized
+// for the largest. buf2 is QLT's root-to-leaves data and CAAS's reduction
+// data, so CDRs in a group must be used one at a time: no CDR in the group may
+// run between another's run and its last get_Qm. The workspace must outlive
+// the CDRs' use of the buffers.
+template <typename ExeSpace = Kokkos::DefaultExecutionSpace>
+class Workspace {
+public:
+  typedef typename cedr::impl::DeviceType<ExeSpace>::type Device;
+  typedef Kokkos::View<Real*, Device> RealList;
+
+  // Every buffer starts on a multiple of this many Reals.
+  enum { alignment = 16 };
+
+  Workspace () : size_(0), unaliased_size_(0) {}
+
+  // Register cdr, for which end_tracer_declarations has been called. It is an
+  // error to call add after allocate.
+  void add(CDR& cdr, const Int alias_group = -1);
+
+  // Make the allocation and call each CDR's set_buffers.
+  void allocate();
+
+  // Number of Reals in the allocation, and the number without aliasing.
+  size_t size () const { return size_; }
+  size_t unaliased_size () const { return unaliased_size_; }
+
+private:
+  struct Entry {
+    CDR* cdr;
+    Int group;
+    size_t buf1, buf2;
+  };
+  std::vector<Entry> entries_;
+  RealList buf_;
+  size_t size_, unaliased_size_;
+};
+
+namespace test {
+namespace workspace {
+Int unittest(const mpi::Parallel::Ptr& p);
+} // namespace workspace
+} // namespace test
+} // namespace cedr
+
+#endif
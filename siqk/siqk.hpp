@@ -9,5 +9,8 @@
 #include "siqk_intersect.hpp"
 #include "siqk_quadrature.hpp"
 #include "siqk_sqr.hpp"
+#include "siqk_remap.hpp"
+#include "siqk_io.hpp"
+#include "siqk_mesh.hpp"
 
 #endif
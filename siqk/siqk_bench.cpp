@@ -0,0 +1,275 @@
+// COMPOSE version 1.0: Copyright 2018 NTESS. This software is released under
+// the BSD license; see LICENSE in the top-level directory.
+
+// Benchmark driver for search and intersection. One invocation sweeps
+// geometry, search structure, mesh resolution, and rotation angle. Each case
+// intersects a mesh with a rotated copy of itself and writes, as CSV or JSON,
+// the search structure's build time, the number of candidate pairs per
+// element, the clip and quadrature throughputs, and the peak resident memory.
+// Times are means over repetitions. Everything runs in Kokkos's default
+// execution space, which is written with each case; to compare host and
+// device, run a host and a device build.
+
+// For get_memusage.
+#define SIQK_TIME
+#include "siqk.hpp"
+
+#include <fstream>
+#include <sstream>
+
+namespace siqk {
+namespace bench {
+
+struct Input {
+  // sphere, plane.
+  std::vector<std::string> geos;
+  // octree, index. index, CubedSphereIndex, applies only to the sphere.
+  std::vector<std::string> searches;
+  // For the sphere, a cubed sphere with nxn elements per face; for the plane,
+  // an nxn mesh.
+  std::vector<Int> ns;
+  // Rotation of the mesh against the fixed one.
+  std::vector<Real> angles;
+  // TriangleQuadrature order for integrate_overlaps.
+  Int order;
+  Int nrepeat, nwarmup;
+  bool json;
+  std::string filename;
+};
+
+struct Record {
+  std::string geo, search;
+  Int n, nelem;
+  Real angle;
+  std::vector<std::string> names;
+  std::vector<Real> values;
+};
+
+static std::vector<std::string> split (const std::string& s) {
+  std::vector<std::string> v;
+  std::stringstream ss(s);
+  std::string tok;
+  while (std::getline(ss, tok, ',')) v.push_back(tok);
+  return v;
+}
+
+static std::vector<Int> split_int (const std::string& s) {
+  std::vector<Int> v;
+  for (const auto& tok : split(s)) v.push_back(std::atoi(tok.c_str()));
+  return v;
+}
+
+static std::vector<Real> split_real (const std::string& s) {
+  std::vector<Real> v;
+  for (const auto& tok : split(s)) v.push_back(std::atof(tok.c_str()));
+  return v;
+}
+
+struct InputParser {
+  Input in;
+
+  InputParser (int argc, char** argv) {
+    in.geos = {"sphere"};
+    in.searches = {"octree"};
+    in.ns = {10, 20, 40};
+    in.angles = {M_PI*1e-1};
+    in.order = 4;
+    in.nrepeat = 5;
+    in.nwarmup = 1;
+    in.json = false;
+    for (int i = 1; i < argc; ++i) {
+      const std::string token = argv[i];
+      const auto advance = [&] () -> std::string {
+        SIQK_THROW_IF(i+1 >= argc, "Command line is missing an argument.");
+        return argv[++i];
+      };
+      if (token == "-g" || token == "--geometry") in.geos = split(advance());
+      else if (token == "-s" || token == "--search") in.searches = split(advance());
+      else if (token == "-n") in.ns = split_int(advance());
+      else if (token == "--angle") in.angles = split_real(advance());
+      else if (token == "-qo" || token == "--order") in.order = std::atoi(advance().c_str());
+      else if (token == "-nr" || token == "--nrepeat") in.nrepeat = std::atoi(advance().c_str());
+      else if (token == "-nw" || token == "--nwarmup") in.nwarmup = std::atoi(advance().c_str());
+      else if (token == "--json") in.json = true;
+      else if (token == "-o" || token == "--output") in.filename = advance();
+      else SIQK_THROW_IF(true, "Invalid token " << token);
+    }
+    for (const auto& geo : in.geos)
+      SIQK_THROW_IF(geo != "sphere" && geo != "plane",
+                    "Invalid geometry " << geo);
+    for (const auto& search : in.searches)
+      SIQK_THROW_IF(search != "octree" && search != "index",
+                    "Invalid search " << search);
+    for (const auto n : in.ns) SIQK_THROW_IF(n < 1, "n is < 1.");
+    SIQK_THROW_IF(in.nrepeat < 1, "nrepeat is < 1.");
+  }
+};
+
+// Accumulate each element's overlap area and number of quadrature points.
+struct CountingIntegrand {
+  ko::View<Real*> area;
+  ko::View<Int*> npt;
+  KOKKOS_INLINE_FUNCTION
+  void operator() (const Int k, const Int, const Int, const Real*,
+                   const Real w) const {
+    area(k) += w;
+    ++npt(k);
+  }
+};
+
+// Time the search build, candidate search, clipping, and integration of (p,e)
+// against (cp,ce), and add the results to r.
+template <typename geo, typename SearchT>
+void run_case (const ConstVec3s::HostMirror& cp, const ConstIdxs::HostMirror& ce,
+               const ConstVec3s::HostMirror& p_hm,
+               const ConstIdxs::HostMirror& e_hm, const Input& in, Record& r) {
+  sh::Mesh<ko::HostSpace> cm_hm; cm_hm.p = cp; cm_hm.e = ce;
+  test::fill_normals<geo>(cm_hm);
+  const sh::Mesh<> cm(cm_hm);
+  Vec3s p; resize_and_copy(p, p_hm);
+  Idxs e; resize_and_copy(e, e_hm);
+  const Int ne = nslices(e);
+  const ko::View<Real*> elem_area("elem_area", ne);
+  CountingIntegrand f;
+  f.area = ko::View<Real*>("area", ne);
+  f.npt = ko::View<Int*>("npt", ne);
+
+  enum { build, search, clip, integrate, ntimer };
+  Real et[ntimer] = {0};
+  Int npair = 0, npt = 0;
+  Real area = 0;
+  for (Int trial = 0; trial < in.nwarmup + in.nrepeat; ++trial) {
+    const bool record = trial >= in.nwarmup;
+    auto t = tic();
+    const SearchT st(cp, ce);
+    if (record) et[build] += toc(t);
+    t = tic();
+    CandidatePairs pairs;
+    find_candidate_pairs(st, p, e, pairs);
+    if (record) et[search] += toc(t);
+    const ko::View<Real*> pair_area("pair_area", pairs.npair());
+    t = tic();
+    calc_pair_areas<geo>(cm, p, e, pairs, pair_area, elem_area);
+    if (record) et[clip] += toc(t);
+    ko::deep_copy(f.area, 0);
+    ko::deep_copy(f.npt, 0);
+    t = tic();
+    integrate_overlaps<geo>(cm, st, p, e, in.order, f);
+    if (record) et[integrate] += toc(t);
+    npair = pairs.npair();
+  }
+  for (Int i = 0; i < ntimer; ++i) et[i] /= in.nrepeat;
+  {
+    const auto a = f.area;
+    const auto n = f.npt;
+    ko::parallel_reduce(ne, KOKKOS_LAMBDA (const Int& k, Real& s) {
+      s += a(k);
+    }, area);
+    ko::parallel_reduce(ne, KOKKOS_LAMBDA (const Int& k, Int& s) {
+      s += n(k);
+    }, npt);
+  }
+
+  const auto add = [&] (const std::string& name, const Real value) {
+    r.names.push_back(name);
+    r.values.push_back(value);
+  };
+  add("build_s", et[build]);
+  add("search_s", et[search]);
+  add("candidates_per_elem", Real(npair)/ne);
+  add("clip_s", et[clip]);
+  add("clips_per_s", et[clip] > 0 ? npair/et[clip] : 0);
+  add("integrate_s", et[integrate]);
+  add("quad_points_per_s", et[integrate] > 0 ? npt/et[integrate] : 0);
+  add("area", area);
+  add("peak_memory_mb", get_memusage());
+}
+
+static void run_case (const Input& in, Record& r) {
+  Vec3s::HostMirror cp;
+  Idxs::HostMirror ce;
+  const bool sphere = r.geo == "sphere";
+  if (sphere)
+    mesh::make_cubesphere_mesh(cp, ce, r.n);
+  else
+    mesh::make_planar_mesh(cp, ce, r.n);
+  Vec3s::HostMirror p; resize_and_copy(p, cp);
+  Idxs::HostMirror e; resize_and_copy(e, ce);
+  r.nelem = nslices(e);
+  if (sphere) {
+    // Same axis as siqk_test's cubed-sphere test.
+    const Real axis[] = {0.1, -0.3, 0.2};
+    mesh::rotate_mesh(p, axis, r.angle);
+    if (r.search == "index")
+      run_case<SphereGeometry, CubedSphereIndex>(cp, ce, p, e, in, r);
+    else
+      run_case<SphereGeometry, Octree<SphereGeometry, 10> >(cp, ce, p, e, in, r);
+  } else {
+    mesh::perturb_mesh(p, r.angle, 0, 0);
+    run_case<PlaneGeometry, Octree<PlaneGeometry, 10> >(cp, ce, p, e, in, r);
+  }
+}
+
+static void write_csv (std::ostream& os, const std::vector<Record>& rs) {
+  const std::string es = ko::DefaultExecutionSpace::name();
+  os << "exespace,geometry,search,n,angle,nelem,metric,value\n";
+  for (const auto& r : rs)
+    for (size_t i = 0; i < r.values.size(); ++i)
+      os << es << "," << r.geo << "," << r.search << "," << r.n << ","
+         << r.angle << "," << r.nelem << "," << r.names[i] << ","
+         << r.values[i] << "\n";
+}
+
+static void write_json (std::ostream& os, const std::vector<Record>& rs) {
+  os << "{\"exespace\": \"" << ko::DefaultExecutionSpace::name()
+     << "\", \"cases\": [";
+  for (size_t k = 0; k < rs.size(); ++k) {
+    const auto& r = rs[k];
+    os << (k ? ",\n  " : "\n  ")
+       << "{\"geometry\": \"" << r.geo << "\", \"search\": \"" << r.search
+       << "\", \"n\": " << r.n << ", \"angle\": " << r.angle
+       << ", \"nelem\": " << r.nelem << ", \"metrics\": {";
+    for (size_t i = 0; i < r.values.size(); ++i)
+      os << (i ? ", " : "") << "\"" << r.names[i] << "\": " << r.values[i];
+    os << "}}";
+  }
+  os << "\n]}\n";
+}
+
+static std::vector<Record> run (const Input& in) {
+  std::vector<Record> rs;
+  for (const auto& geo : in.geos)
+    for (const auto& search : in.searches) {
+      // CubedSphereIndex is only for the sphere.
+      if (geo == "plane" && search == "index") continue;
+      for (const Int n : in.ns)
+        for (const Real angle : in.angles) {
+          Record r;
+          r.geo = geo;
+          r.search = search;
+          r.n = n;
+          r.angle = angle;
+          run_case(in, r);
+          rs.push_back(r);
+        }
+    }
+  return rs;
+}
+
+} // namespace bench
+} // namespace siqk
+
+int main (int argc, char** argv) {
+  Kokkos::initialize(argc, argv); {
+    siqk::bench::InputParser inp(argc, argv);
+    const auto rs = siqk::bench::run(inp.in);
+    std::ofstream ofs;
+    if ( ! inp.in.filename.empty()) ofs.open(inp.in.filename);
+    std::ostream& os = inp.in.filename.empty() ? std::cout : ofs;
+    if (inp.in.json)
+      siqk::bench::write_json(os, rs);
+    else
+      siqk::bench::write_csv(os, rs);
+  } Kokkos::finalize();
+  return 0;
+}
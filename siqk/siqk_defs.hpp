@@ -18,15 +18,20 @@
 # include <sys/resource.h>
 #endif
 
-// Always want this for GPU.
-#define SIQK_NONRECURSIVE
-
 #ifdef KOKKOS_HAVE_CUDA
 # define KOKKOS_CONSTANT __constant__ __device__
 #else
 # define KOKKOS_CONSTANT
 #endif
 
+// Ask the compiler to vectorize the following loop. The loop must have no
+// loop-carried dependences.
+#if defined _OPENMP && ! defined __CUDA_ARCH__
+# define siqk_pragma_simd _Pragma("omp simd")
+#else
+# define siqk_pragma_simd
+#endif
+
 namespace siqk {
 namespace ko = Kokkos;
 #define pr(m) do {                              \
@@ -81,6 +81,13 @@ struct PlaneGeometry {
     return calc_area_formula(v, n);
   }
 
+  template <typename CV2s>
+  KOKKOS_INLINE_FUNCTION
+  static Real calc_area (const TriangleQuadratureRule<8>& , const CV2s& v,
+                         const Int n) {
+    return calc_area_formula(v, n);
+  }
+
   template <typename CV2s>
   KOKKOS_INLINE_FUNCTION
   static Real calc_area_formula (const CV2s& v, const Int n) {
@@ -90,6 +97,42 @@ struct PlaneGeometry {
     return 0.5*area;
   }
 
+  // Apply the order-order rule of q to each triangle of the fan triangulation
+  // of polygon v, calling f(x, w) at each point x with weight w. Summing w
+  // gives the (signed) area.
+  template <typename CV2s, typename Integrand>
+  KOKKOS_INLINE_FUNCTION
+  static void integrate (const TriangleQuadrature& q, const Int order,
+                         const CV2s& v, const Int n, const Integrand& f) {
+    RawConstVec3s coord;
+    RawConstArray weight;
+    q.get_coef(order, coord, weight);
+    Real u[2];
+    for (Int i = 1, ilim = n - 1; i < ilim; ++i) {
+      const Real jac = calc_tri_jacobian(slice(v,0), slice(v,i), slice(v,i+1));
+      for (Int k = 0, klim = nslices(coord); k < klim; ++k) {
+        bary2coord(slice(v,0), slice(v,i), slice(v,i+1), slice(coord, k), u);
+        f(u, 0.5*weight[k]*jac);
+      }
+    }
+  }
+
+  // Same, but with the order fixed at compile time.
+  template <int order, typename CV2s, typename Integrand>
+  KOKKOS_INLINE_FUNCTION
+  static void integrate (const CV2s& v, const Int n, const Integrand& f) {
+    const TriangleQuadratureRule<order> r;
+    Real u[2];
+    for (Int i = 1, ilim = n - 1; i < ilim; ++i) {
+      const Real jac = calc_tri_jacobian(slice(v,0), slice(v,i), slice(v,i+1));
+      for (Int k = 0; k < r.npts; ++k) {
+        const Real alpha[] = {r.bary[0][k], r.bary[1][k], r.bary[2][k]};
+        bary2coord(slice(v,0), slice(v,i), slice(v,i+1), alpha, u);
+        f(u, 0.5*r.weight[k]*jac);
+      }
+    }
+  }
+
   template <typename CV, typename CA>
   KOKKOS_INLINE_FUNCTION
   static void bary2coord (const CV v1, const CV v2, const CV v3, const CA alpha,
@@ -253,11 +296,11 @@ struct SphereGeometry {
   static Real calc_area (const TriangleQuadrature& q, const CV3s& v,
                          const Int n) {
     Real area = 0, u[3];
+    RawConstVec3s coord;
+    RawConstArray weight;
+    q.get_coef(8, coord, weight);
     for (Int i = 1, ilim = n - 1; i < ilim; ++i) {
       Real a = 0;
-      RawConstVec3s coord;
-      RawConstArray weight;
-      q.get_coef(8, coord, weight);
       for (Int k = 0, klim = nslices(coord); k < klim; ++k) {
         const Real jac = calc_tri_jacobian(slice(v,0), slice(v,i), slice(v,i+1),
                                            slice(coord, k), u);
@@ -268,6 +311,59 @@ struct SphereGeometry {
     return area;
   }
 
+  // Same, but with the rule built by the caller, e.g., once per kernel.
+  template <typename CV3s>
+  KOKKOS_INLINE_FUNCTION
+  static Real calc_area (const TriangleQuadratureRule<8>& r, const CV3s& v,
+                         const Int n) {
+    Real area = 0, u[3];
+    for (Int i = 1, ilim = n - 1; i < ilim; ++i) {
+      Real a = 0;
+      for (Int k = 0; k < r.npts; ++k) {
+        const Real alpha[] = {r.bary[0][k], r.bary[1][k], r.bary[2][k]};
+        const Real jac = calc_tri_jacobian(slice(v,0), slice(v,i), slice(v,i+1),
+                                           alpha, u);
+        a += r.weight[k]*jac;
+      }
+      area += 0.5*a;
+    }
+    return area;
+  }
+
+  // Apply the order-order rule of q to each triangle of the fan triangulation
+  // of spherical polygon v, calling f(x, w) at each point x on the sphere with
+  // weight w. Summing w gives calc_area to rounding.
+  template <typename CV3s, typename Integrand>
+  KOKKOS_INLINE_FUNCTION
+  static void integrate (const TriangleQuadrature& q, const Int order,
+                         const CV3s& v, const Int n, const Integrand& f) {
+    RawConstVec3s coord;
+    RawConstArray weight;
+    q.get_coef(order, coord, weight);
+    Real u[3];
+    for (Int i = 1, ilim = n - 1; i < ilim; ++i)
+      for (Int k = 0, klim = nslices(coord); k < klim; ++k) {
+        const Real jac = calc_tri_jacobian(slice(v,0), slice(v,i), slice(v,i+1),
+                                           slice(coord, k), u);
+        f(u, 0.5*weight[k]*jac);
+      }
+  }
+
+  // Same, but with the order fixed at compile time.
+  template <int order, typename CV3s, typename Integrand>
+  KOKKOS_INLINE_FUNCTION
+  static void integrate (const CV3s& v, const Int n, const Integrand& f) {
+    const TriangleQuadratureRule<order> r;
+    Real u[3];
+    for (Int i = 1, ilim = n - 1; i < ilim; ++i)
+      for (Int k = 0; k < r.npts; ++k) {
+        const Real alpha[] = {r.bary[0][k], r.bary[1][k], r.bary[2][k]};
+        const Real jac = calc_tri_jacobian(slice(v,0), slice(v,i), slice(v,i+1),
+                                           alpha, u);
+        f(u, 0.5*r.weight[k]*jac);
+      }
+  }
+
   template <typename CV, typename CA>
   KOKKOS_INLINE_FUNCTION
   static Real calc_tri_jacobian (const CV v1, const CV v2, const CV v3,
@@ -9,6 +9,9 @@
 #include "siqk_search.hpp"
 #include "siqk_quadrature.hpp"
 
+#include <vector>
+#include <algorithm>
+
 namespace siqk {
 
 // Sutherland-Hodgmann polygon clipping algorithm. Follow Foley, van Dam,
@@ -135,6 +138,52 @@ bool clip_against_poly (
   return true;
 }
 
+// Specialization of clip_against_poly for an NI-gon vi(:,0:NI-1) clipped
+// against element cp_e of m, which must have exactly NC vertices. The common
+// cases are NI = 3 or 4 and NC = 4, as in a quadrilateral mesh. Loop trip
+// counts over clip edges and input vertices are fixed, and since clipping a
+// convex NI-gon against NC half-planes yields at most NI + NC vertices, the
+// workspace is two small internal buffers. vo must hold NI + NC vertices. The
+// result is the same as from the general routine. The bound holds only in exact
+// arithmetic: on nearly coincident edges, roundoff in geo::inside can add
+// vertices, and then this returns false and the caller should use the general
+// routine.
+template <typename geo, Int NI, Int NC, typename MeshT, typename CV3s,
+          typename V3s>
+KOKKOS_INLINE_FUNCTION
+bool clip_against_poly_n (const MeshT& m, const Int cp_e, const CV3s& vi,
+                          V3s& vo, Int& no) {
+  static_assert(NI >= 3 && NC >= 3, "Polygons must have at least 3 vertices.");
+  enum { nmax = NI + NC };
+  Real buf[6*nmax];
+  RawVec3s vs[] = { RawVec3s(buf, nmax), RawVec3s(buf + 3*nmax, nmax) };
+  Int nos[] = { 0, 0 };
+
+  const auto e = slice(m.e, cp_e);
+  const auto en = slice(m.en, cp_e);
+
+  no = 0;
+  if ( ! clip_against_edge<geo>(vi, NI, vs[0], nos[0], const_slice(m.p, e[0]),
+                                const_slice(m.nml, en[0])))
+    return false;
+  if ( ! nos[0]) return true;
+
+  Int i = 0;
+  for (Int ie = 1; ie < NC-1; ++ie) {
+    if ( ! clip_against_edge<geo>(vs[i], nos[i], vs[1-i], nos[1-i],
+                                  const_slice(m.p, e[ie]),
+                                  const_slice(m.nml, en[ie])))
+      return false;
+    if ( ! nos[1-i]) return true;
+    i = 1 - i;
+  }
+
+  // The final edge writes to the caller's buffer.
+  return clip_against_edge<geo>(vs[i], nos[i], vo, no,
+                                const_slice(m.p, e[NC-1]),
+                                const_slice(m.nml, en[NC-1]));
+}
+
 // Not used for real stuff; just a convenient version for testing. In this
 // version, clip_poly is a list of clip polygon vertices. This is instead of the
 // mesh data structure.
@@ -182,6 +231,543 @@ bool clip_against_poly (
 }
 } // namespace sh
 
+// The overlap, or remap, mesh of a mesh (p,e) against a clip mesh cm: for each
+// element of (p,e), its nonempty intersections with the elements of cm. build
+// makes two passes over (p,e) in parallel in the default execution space. The
+// first counts each element's polygons and their vertices. After prefix sums
+// of the counts, the second clips again and writes the polygons directly into
+// the CSR arrays. Thus nothing caps the number of polygons per element.
+template <typename geo>
+struct OverlapMesh {
+  typedef ko::View<Int*> IntList;
+  typedef ko::View<Real*> RealList;
+
+  // Maximum number of vertices of an element of (p,e) and of a polygon.
+  enum { max_nvert = 20 };
+
+  // Element k of (p,e) has polygons ptr(k) : ptr(k+1)-1. Polygon i is the
+  // intersection with cm's element cme(i), has area area(i), and has vertices
+  //     v(vptr(i) : vptr(i+1)-1, :).
+  IntList ptr, cme, vptr;
+  RealList area;
+  Vec3s v;
+
+  // For update: cm element ci's neighbors, the elements sharing a vertex with
+  // it, including itself, are nbrs(nbrptr(ci) : nbrptr(ci+1)-1).
+  IntList nbrptr, nbrs;
+
+  // Maximum number of candidates for an element in update.
+  enum { max_ncand = 64 };
+
+  // cm must have edge normals. search is a search structure, e.g., an Octree,
+  // over cm's elements.
+  template <typename SearchT>
+  void build (const sh::Mesh<>& cm, const SearchT& search,
+              const ConstVec3s& p, const ConstIdxs& e) {
+    build_impl(cm, search, p, e, false, max_ncand);
+  }
+
+  // Rebuild the overlap mesh after (p,e) has moved, typically a fraction of a
+  // cell, since the last build or update with the same cm and elements e.
+  // Element k's candidates are first the cm elements of its last polygons and
+  // their neighbors. Then the neighbors of each candidate k intersects are
+  // added, so the candidates cover every cm element k intersects. k uses
+  // search instead only if no candidate intersects it or there are more than
+  // ncand <= max_ncand candidates. The result is the same as from build, except
+  // that an element's polygons may be in a different order. Return the number
+  // of elements that used search.
+  template <typename SearchT>
+  Int update (const sh::Mesh<>& cm, const SearchT& search,
+              const ConstVec3s& p, const ConstIdxs& e,
+              const Int ncand = max_ncand) {
+    SIQK_THROW_IF(ncand < 1 || ncand > max_ncand,
+                  "OverlapMesh::update: ncand must be in 1:" << max_ncand);
+    if (nslices(nbrptr) != nslices(cm.e) + 1)
+      calc_elem_neighbors(cm.e, nbrptr, nbrs);
+    return build_impl(cm, search, p, e, true, ncand);
+  }
+
+  Int npolygon () const { return nslices(cme); }
+  Int nvertex () const { return nslices(v); }
+
+  // Add the overlap mesh to w as arrays whose names start with prefix, and
+  // read one so written.
+  void write (io::Writer& w, const std::string& prefix) const {
+    w.add(prefix + "ptr", ptr);
+    w.add(prefix + "cme", cme);
+    w.add(prefix + "vptr", vptr);
+    w.add(prefix + "area", area);
+    w.add(prefix + "v", v);
+  }
+  void read (const io::MappedFile& f, const std::string& prefix) {
+    f.get(prefix + "ptr", ptr);
+    f.get(prefix + "cme", cme);
+    f.get(prefix + "vptr", vptr);
+    f.get(prefix + "area", area);
+    f.get(prefix + "v", v);
+    map_ = f.handle();
+  }
+
+private:
+  // The file read gave the Views, if any.
+  io::MappedFile::Handle map_;
+
+  template <typename SearchT>
+  Int build_impl(const sh::Mesh<>& cm, const SearchT& search,
+                 const ConstVec3s& p, const ConstIdxs& e,
+                 const bool incremental, const Int ncand);
+
+  static void calc_elem_neighbors(const ConstIdxs& e, IntList& nbrptr,
+                                  IntList& nbrs);
+};
+
+namespace impl {
+// Clip element k of (p,e) against each element of cm that search gives it, and
+// call fn(ci, vo, no) for each nonempty intersection with element ci.
+template <typename geo, typename Fn>
+class OverlapClipper {
+  enum { max_nvert = OverlapMesh<geo>::max_nvert };
+  const sh::Mesh<>& cm_;
+  Fn& fn_;
+  Real buf_[9*max_nvert];
+  Int ni_;
+  bool ok_;
+
+public:
+  KOKKOS_INLINE_FUNCTION
+  OverlapClipper (const sh::Mesh<>& cm, const ConstVec3s& p, const ConstIdxs& e,
+                  const Int& k, Fn& fn)
+    : cm_(cm), fn_(fn), ni_(0), ok_(true)
+  {
+    RawVec3s vi(buf_, max_nvert);
+    for (Int i = 0; i < szslice(e); ++i) {
+      if (e(k,i) == -1) break;
+      if (ni_ == max_nvert) {
+        ok_ = false;
+        break;
+      }
+      copy(slice(vi, i), slice(p, e(k,i)), 3);
+      ++ni_;
+    }
+  }
+
+  KOKKOS_INLINE_FUNCTION bool ok () const { return ok_; }
+
+  KOKKOS_INLINE_FUNCTION void operator() (const Int ci) {
+    if ( ! ok_) return;
+    RawVec3s
+      vi(buf_, max_nvert),
+      vo(buf_ + 3*max_nvert, max_nvert),
+      wrk(buf_ + 6*max_nvert, max_nvert);
+    Int no;
+    // Use the fixed-size clipper for triangles and quads against quads. If
+    // roundoff makes it run out of space, use the general one.
+    const bool quad = (szslice(cm_.e) >= 4 && cm_.e(ci,3) != -1 &&
+                       (szslice(cm_.e) == 4 || cm_.e(ci,4) == -1));
+    const bool clipped = (
+      (quad && ni_ == 4 &&
+       sh::clip_against_poly_n<geo,4,4>(cm_, ci, vi, vo, no)) ||
+      (quad && ni_ == 3 &&
+       sh::clip_against_poly_n<geo,3,4>(cm_, ci, vi, vo, no)) ||
+      sh::clip_against_poly<geo>(cm_, ci, vi, ni_, vo, no, wrk));
+    if ( ! clipped) {
+      ok_ = false;
+      return;
+    }
+    if (no) fn_(ci, vo, no);
+  }
+};
+
+struct OverlapCounter {
+  Int np, nv;
+  KOKKOS_INLINE_FUNCTION OverlapCounter () : np(0), nv(0) {}
+  KOKKOS_INLINE_FUNCTION
+  void operator() (const Int, const RawVec3s&, const Int no) {
+    ++np;
+    nv += no;
+  }
+};
+
+template <typename geo>
+struct OverlapWriter {
+  typedef OverlapMesh<geo> OM;
+  const TriangleQuadratureRule<8> quad;
+  const typename OM::IntList cme, vptr;
+  const typename OM::RealList area;
+  const Vec3s v;
+  Int ip, iv; // Next polygon and vertex.
+
+  KOKKOS_INLINE_FUNCTION
+  OverlapWriter (const OM& om, const Int ip_, const Int iv_)
+    : cme(om.cme), vptr(om.vptr), area(om.area), v(om.v), ip(ip_), iv(iv_) {}
+
+  KOKKOS_INLINE_FUNCTION
+  void operator() (const Int ci, const RawVec3s& vo, const Int no) {
+    cme(ip) = ci;
+    vptr(ip) = iv;
+    area(ip) = geo::calc_area(quad, vo, no);
+    for (Int j = 0; j < no; ++j)
+      copy(slice(v, iv + j), slice(vo, j), 3);
+    ++ip;
+    iv += no;
+  }
+};
+
+// Record whether fn was called.
+template <typename Fn>
+struct HitTracker {
+  Fn& fn;
+  bool hit;
+  KOKKOS_INLINE_FUNCTION HitTracker (Fn& fn_) : fn(fn_), hit(false) {}
+  KOKKOS_INLINE_FUNCTION
+  void operator() (const Int ci, const RawVec3s& vo, const Int no) {
+    hit = true;
+    fn(ci, vo, no);
+  }
+};
+
+typedef ko::View<const Int*> ConstIntList;
+
+KOKKOS_INLINE_FUNCTION
+bool is_in (const Int* const c, const Int n, const Int v) {
+  for (Int i = 0; i < n; ++i) if (c[i] == v) return true;
+  return false;
+}
+
+// Fill c with the cm elements of element k's last polygons and their
+// neighbors. Return the number, or -1 if there are more than nmax.
+KOKKOS_INLINE_FUNCTION
+Int get_seed_candidates (const ConstIntList& optr, const ConstIntList& ocme,
+                         const ConstIntList& nbrptr, const ConstIntList& nbrs,
+                         const Int k, Int* const c, const Int nmax) {
+  Int nc = 0;
+  for (Int i = optr(k); i < optr(k+1); ++i) {
+    const Int ci = ocme(i);
+    for (Int j = nbrptr(ci); j < nbrptr(ci+1); ++j) {
+      const Int v = nbrs(j);
+      if (is_in(c, nc, v)) continue;
+      if (nc == nmax) return -1;
+      c[nc++] = v;
+    }
+  }
+  return nc;
+}
+
+// Clip against the candidates c[0:nc-1] in order. When a cm element has a
+// nonempty intersection, append its neighbors that are not yet candidates, so
+// that the candidates grow until they cover the connected set of cm elements
+// the element intersects. Return false if no candidate intersects or if there
+// are more than nmax candidates.
+template <typename Clipper, typename Fn>
+KOKKOS_INLINE_FUNCTION
+bool clip_and_grow (Clipper& clipper, HitTracker<Fn>& ht, Int* const c,
+                    Int nc, const Int nmax, const ConstIntList& nbrptr,
+                    const ConstIntList& nbrs) {
+  bool any = false;
+  for (Int i = 0; i < nc; ++i) {
+    ht.hit = false;
+    clipper(c[i]);
+    if ( ! ht.hit) continue;
+    any = true;
+    for (Int j = nbrptr(c[i]); j < nbrptr(c[i]+1); ++j) {
+      const Int v = nbrs(j);
+      if (is_in(c, nc, v)) continue;
+      if (nc == nmax) return false;
+      c[nc++] = v;
+    }
+  }
+  return any;
+}
+} // namespace impl
+
+template <typename geo> template <typename SearchT>
+Int OverlapMesh<geo>
+::build_impl (const sh::Mesh<>& cm, const SearchT& search, const ConstVec3s& p,
+              const ConstIdxs& e, const bool incremental, const Int ncand) {
+  const Int ne = nslices(e);
+  assert( ! incremental || nslices(ptr) == ne + 1);
+  // Last step's polygons and cm's neighbors, for update.
+  const impl::ConstIntList optr = ptr, ocme = cme, nptr = nbrptr, nbr = nbrs;
+  // Count. In update, also determine which elements must use search.
+  const IntList np("OverlapMesh ptr", ne+1), nv("OverlapMesh nv", ne+1);
+  const ko::View<bool*> use_search("OverlapMesh use_search", ne);
+  Int nfail = 0;
+  ko::parallel_reduce(ne, KOKKOS_LAMBDA (const Int& k, Int& nf) {
+    impl::OverlapCounter cnt;
+    bool ok = true, searched = true;
+    if (incremental) {
+      Int c[max_ncand];
+      const Int nc = impl::get_seed_candidates(optr, ocme, nptr, nbr, k, c,
+                                               ncand);
+      if (nc > 0) {
+        impl::HitTracker<impl::OverlapCounter> ht(cnt);
+        impl::OverlapClipper<geo, impl::HitTracker<impl::OverlapCounter> >
+          clipper(cm, p, e, k, ht);
+        searched = ! impl::clip_and_grow(clipper, ht, c, nc, ncand, nptr,
+                                         nbr);
+        ok = clipper.ok();
+      }
+    }
+    if (searched) {
+      cnt = impl::OverlapCounter();
+      Real ebb[6];
+      SearchT::calc_bb(p, const_slice(e, k), szslice(e), ebb);
+      impl::OverlapClipper<geo, impl::OverlapCounter>
+        clipper(cm, p, e, k, cnt);
+      search.apply(ebb, clipper);
+      ok = clipper.ok();
+    }
+    use_search(k) = searched;
+    np(k) = cnt.np;
+    nv(k) = cnt.nv;
+    if ( ! ok) ++nf;
+  }, nfail);
+  SIQK_THROW_IF(nfail > 0, "OverlapMesh::build: " << nfail << " elements have"
+                " more than max_nvert = " << max_nvert << " vertices or"
+                " intersection vertices.");
+  const Int npoly = exclusive_scan(np), nvert = exclusive_scan(nv);
+  // Fill. optr and ocme keep the last polygons alive for update.
+  ptr = np;
+  cme = IntList("OverlapMesh cme", npoly);
+  vptr = IntList("OverlapMesh vptr", npoly+1);
+  area = RealList("OverlapMesh area", npoly);
+  v = Vec3s("OverlapMesh v", nvert);
+  const OverlapMesh om = *this;
+  ko::parallel_for(ne, KOKKOS_LAMBDA (const Int& k) {
+    impl::OverlapWriter<geo> w(om, np(k), nv(k));
+    if (use_search(k)) {
+      Real ebb[6];
+      SearchT::calc_bb(p, const_slice(e, k), szslice(e), ebb);
+      impl::OverlapClipper<geo, impl::OverlapWriter<geo> >
+        clipper(cm, p, e, k, w);
+      search.apply(ebb, clipper);
+    } else {
+      Int c[max_ncand];
+      const Int nc = impl::get_seed_candidates(optr, ocme, nptr, nbr, k, c,
+                                               ncand);
+      impl::HitTracker<impl::OverlapWriter<geo> > ht(w);
+      impl::OverlapClipper<geo, impl::HitTracker<impl::OverlapWriter<geo> > >
+        clipper(cm, p, e, k, ht);
+      impl::clip_and_grow(clipper, ht, c, nc, ncand, nptr, nbr);
+    }
+    if (k == ne-1) om.vptr(npoly) = nvert;
+  });
+  // The last polygons are no longer needed, nor is the file they came from.
+  map_.reset();
+  Int nsearch = 0;
+  if (incremental)
+    ko::parallel_reduce(ne, KOKKOS_LAMBDA (const Int& k, Int& ns) {
+      if (use_search(k)) ++ns;
+    }, nsearch);
+  return nsearch;
+}
+
+template <typename geo>
+void OverlapMesh<geo>
+::calc_elem_neighbors (const ConstIdxs& e, IntList& nbrptr, IntList& nbrs) {
+  const auto e_hm = ko::create_mirror_view(e);
+  ko::deep_copy(e_hm, e);
+  const Int ne = nslices(e_hm), nv = szslice(e_hm);
+  // Vertex -> elements.
+  Int nvtx = 0;
+  for (Int k = 0; k < ne; ++k)
+    for (Int i = 0; i < nv && e_hm(k,i) != -1; ++i)
+      nvtx = max(nvtx, e_hm(k,i) + 1);
+  std::vector<std::vector<Int> > v2e(nvtx);
+  for (Int k = 0; k < ne; ++k)
+    for (Int i = 0; i < nv && e_hm(k,i) != -1; ++i)
+      v2e[e_hm(k,i)].push_back(k);
+  // Element -> elements sharing a vertex.
+  std::vector<Int> ptr(ne+1, 0), list;
+  for (Int k = 0; k < ne; ++k) {
+    std::vector<Int> nk;
+    for (Int i = 0; i < nv && e_hm(k,i) != -1; ++i)
+      nk.insert(nk.end(), v2e[e_hm(k,i)].begin(), v2e[e_hm(k,i)].end());
+    std::sort(nk.begin(), nk.end());
+    nk.erase(std::unique(nk.begin(), nk.end()), nk.end());
+    list.insert(list.end(), nk.begin(), nk.end());
+    ptr[k+1] = list.size();
+  }
+  nbrptr = IntList("OverlapMesh nbrptr", ne+1);
+  nbrs = IntList("OverlapMesh nbrs", list.size());
+  const auto nbrptr_hm = ko::create_mirror_view(nbrptr);
+  const auto nbrs_hm = ko::create_mirror_view(nbrs);
+  for (Int k = 0; k <= ne; ++k) nbrptr_hm(k) = ptr[k];
+  for (size_t i = 0; i < list.size(); ++i) nbrs_hm(i) = list[i];
+  ko::deep_copy(nbrptr, nbrptr_hm);
+  ko::deep_copy(nbrs, nbrs_hm);
+}
+
+namespace impl {
+template <typename geo, typename Integrand>
+struct OverlapIntegrator {
+  // Bind (k, j, ci) for geo::integrate.
+  struct Point {
+    const Integrand& f;
+    const Int k, j, ci;
+    KOKKOS_INLINE_FUNCTION
+    void operator() (const Real* x, const Real w) const { f(k, j, ci, x, w); }
+  };
+
+  const TriangleQuadrature quad;
+  const Integrand& f;
+  const Int order, k;
+  Int j; // Next polygon.
+
+  KOKKOS_INLINE_FUNCTION
+  OverlapIntegrator (const Integrand& f_, const Int order_, const Int k_)
+    : f(f_), order(order_), k(k_), j(0) {}
+
+  KOKKOS_INLINE_FUNCTION
+  void operator() (const Int ci, const RawVec3s& vo, const Int no) {
+    const Point pt = {f, k, j, ci};
+    geo::integrate(quad, order, vo, no, pt);
+    ++j;
+  }
+};
+} // namespace impl
+
+// Integrate over the overlap mesh of (p,e) against cm without forming it. Each
+// intersection polygon is integrated, using TriangleQuadrature order order on
+// its fan triangulation, as soon as it is clipped. At each quadrature point x
+// with weight w of the j'th polygon of element k of (p,e), which is the
+// intersection with element ci of cm,
+//     f(k, j, ci, x, w)
+// is called. j is the polygon's index in OverlapMesh::build's ordering, i.e.,
+// its OverlapMesh index is ptr(k) + j. f's operator() must be const. Elements
+// of (p,e) are processed in parallel, so f must write only to data of element
+// k, e.g., to accumulate moments per (k, ci) pair, or use atomics. Throws under
+// the same conditions as OverlapMesh::build.
+template <typename geo, typename SearchT, typename Integrand>
+void integrate_overlaps (const sh::Mesh<>& cm, const SearchT& search,
+                         const ConstVec3s& p, const ConstIdxs& e,
+                         const Int order, const Integrand& f) {
+  Int nfail = 0;
+  ko::parallel_reduce(nslices(e), KOKKOS_LAMBDA (const Int& k, Int& nf) {
+    Real ebb[6];
+    SearchT::calc_bb(p, const_slice(e, k), szslice(e), ebb);
+    impl::OverlapIntegrator<geo, Integrand> ig(f, order, k);
+    impl::OverlapClipper<geo, impl::OverlapIntegrator<geo, Integrand> >
+      clipper(cm, p, e, k, ig);
+    search.apply(ebb, clipper);
+    if ( ! clipper.ok()) ++nf;
+  }, nfail);
+  SIQK_THROW_IF(nfail > 0, "integrate_overlaps: " << nfail << " elements have"
+                " more than max_nvert = " << OverlapMesh<geo>::max_nvert <<
+                " vertices or intersection vertices.");
+}
+
+// Candidate pairs of an element of (p,e) and a cm element, from a search.
+// Element k's candidates are ci(ptr(k) : ptr(k+1)-1), and pair j's element is
+// elem(j).
+struct CandidatePairs {
+  typedef ko::View<Int*> IntList;
+  IntList ptr, elem, ci;
+  Int npair () const { return nslices(ci); }
+};
+
+namespace impl {
+struct PairCounter {
+  Int n;
+  KOKKOS_INLINE_FUNCTION PairCounter () : n(0) {}
+  KOKKOS_INLINE_FUNCTION void operator() (const Int) { ++n; }
+};
+
+struct PairWriter {
+  const CandidatePairs::IntList elem, ci;
+  const Int k;
+  Int j;
+  KOKKOS_INLINE_FUNCTION void operator() (const Int c) {
+    elem(j) = k;
+    ci(j) = c;
+    ++j;
+  }
+};
+
+template <typename geo>
+struct AreaAccumulator {
+  const TriangleQuadratureRule<8> quad;
+  Real area;
+  KOKKOS_INLINE_FUNCTION AreaAccumulator () : area(0) {}
+  KOKKOS_INLINE_FUNCTION
+  void operator() (const Int, const RawVec3s& vo, const Int no) {
+    area += geo::calc_area(quad, vo, no);
+  }
+};
+} // namespace impl
+
+// Stage 1 of a two-stage intersection: find the candidate pairs of (p,e) and
+// the mesh underlying search, using search's bounding-box test only.
+template <typename SearchT>
+void find_candidate_pairs (const SearchT& search, const ConstVec3s& p,
+                           const ConstIdxs& e, CandidatePairs& pairs) {
+  const Int ne = nslices(e);
+  const CandidatePairs::IntList ptr("CandidatePairs ptr", ne+1);
+  ko::parallel_for(ne, KOKKOS_LAMBDA (const Int& k) {
+    Real ebb[6];
+    SearchT::calc_bb(p, const_slice(e, k), szslice(e), ebb);
+    impl::PairCounter cnt;
+    search.apply(ebb, cnt);
+    ptr(k) = cnt.n;
+  });
+  const Int npair = exclusive_scan(ptr);
+  const CandidatePairs::IntList
+    elem("CandidatePairs elem", npair), ci("CandidatePairs ci", npair);
+  ko::parallel_for(ne, KOKKOS_LAMBDA (const Int& k) {
+    Real ebb[6];
+    SearchT::calc_bb(p, const_slice(e, k), szslice(e), ebb);
+    impl::PairWriter w{elem, ci, k, ptr(k)};
+    search.apply(ebb, w);
+  });
+  pairs.ptr = ptr;
+  pairs.elem = elem;
+  pairs.ci = ci;
+}
+
+// Stage 2: clip every pair, pairs_per_team pairs to a team, so that the work
+// is balanced however the number of candidates varies by element. pair_area(j)
+// is the area of pair j's intersection. Then sum the pairs of each element in
+// elem_area. cm must have edge normals.
+template <typename geo>
+void calc_pair_areas (const sh::Mesh<>& cm, const ConstVec3s& p,
+                      const ConstIdxs& e, const CandidatePairs& pairs,
+                      const ko::View<Real*>& pair_area,
+                      const ko::View<Real*>& elem_area) {
+  typedef ko::TeamPolicy<ko::DefaultExecutionSpace> TeamPolicy;
+  typedef typename TeamPolicy::member_type Member;
+  enum { pairs_per_team = 64 };
+  const Int npair = pairs.npair(), ne = nslices(e),
+    nleague = (npair + pairs_per_team - 1)/pairs_per_team;
+  assert(nslices(pair_area) == npair && nslices(elem_area) == ne);
+  const auto elem = pairs.elem, ci = pairs.ci, ptr = pairs.ptr;
+  Int nfail = 0;
+  ko::parallel_reduce(TeamPolicy(nleague, ko::AUTO),
+                      KOKKOS_LAMBDA (const Member& t, Int& nf) {
+    const Int j0 = t.league_rank()*pairs_per_team,
+      j1 = min<Int>(j0 + pairs_per_team, npair);
+    Int tnf = 0;
+    ko::parallel_reduce(ko::TeamThreadRange(t, j0, j1), [&] (const Int& j,
+                                                               Int& n) {
+      impl::AreaAccumulator<geo> acc;
+      impl::OverlapClipper<geo, impl::AreaAccumulator<geo> >
+        clipper(cm, p, e, elem(j), acc);
+      clipper(ci(j));
+      if ( ! clipper.ok()) ++n;
+      pair_area(j) = acc.area;
+    }, tnf);
+    if (t.team_rank() == 0) nf += tnf;
+  }, nfail);
+  SIQK_THROW_IF(nfail > 0, "calc_pair_areas: " << nfail << " pairs have more"
+                " than max_nvert = " << OverlapMesh<geo>::max_nvert <<
+                " vertices or intersection vertices.");
+  // Segmented reduction to the elements.
+  ko::parallel_for(ne, KOKKOS_LAMBDA (const Int& k) {
+    Real a = 0;
+    for (Int j = ptr(k); j < ptr(k+1); ++j) a += pair_area(j);
+    elem_area(k) = a;
+  });
+}
+
 namespace test {
 static constexpr Int max_nvert = 20;
 static constexpr Int max_hits = 25; // Covers at least a 2-halo.
@@ -221,7 +807,7 @@ void fill_normals (sh::Mesh<ko::HostSpace>& m) {
 // be small and static. Need to think about this.
 template <typename geo>
 class AreaOTFunctor {
-  const TriangleQuadrature quad_;
+  const TriangleQuadratureRule<8> quad_;
   const sh::Mesh<>& cm_;
   const ConstVec3s& p_;
   const ConstIdxs& e_;
@@ -300,7 +886,8 @@ public:
     OctreeT::calc_bb(p_, slice(e_, k), szslice(e_), ebb);
     // Get list of possible overlaps.
     AreaOTFunctor<geo> f(cm_, p_, e_, k);
-    //todo Team threads.
+    // One element per iteration; see calc_pair_areas for a load-balanced
+    // version.
     ot_.apply(ebb, f);
     area += f.area();
   }
@@ -310,12 +897,11 @@ public:
   { dst += src; }
 };
 
-template <typename geo> Real test_area_ot (
+// OctreeT is Octree or, for geo = SphereGeometry, CubedSphereIndex.
+template <typename geo, typename OctreeT = Octree<geo, 10> > Real test_area_ot (
   const ConstVec3s::HostMirror& cp, const ConstIdxs::HostMirror& ce,
   const ConstVec3s::HostMirror& p, const ConstIdxs::HostMirror& e)
 {
-  typedef Octree<geo, 10> OctreeT;
-
   // Clip mesh and edge normal calculation. (In practice, we'd like to use
   // higher-quality edge normals.)
   sh::Mesh<ko::HostSpace> cm; cm.p = cp; cm.e = ce;
@@ -335,6 +921,118 @@ template <typename geo> Real test_area_ot (
   print_times("test_area_ot", et, 2);
   return area;
 }
+
+// Same as test_area_ot, but with find_candidate_pairs and calc_pair_areas.
+template <typename geo, typename SearchT = Octree<geo, 10> >
+Real test_area_pairs (
+  const ConstVec3s::HostMirror& cp, const ConstIdxs::HostMirror& ce,
+  const ConstVec3s::HostMirror& p_hm, const ConstIdxs::HostMirror& e_hm)
+{
+  sh::Mesh<ko::HostSpace> cm_hm; cm_hm.p = cp; cm_hm.e = ce;
+  fill_normals<geo>(cm_hm);
+  const sh::Mesh<> cm(cm_hm);
+  Vec3s p; resize_and_copy(p, p_hm);
+  Idxs e; resize_and_copy(e, e_hm);
+  const SearchT search(cp, ce);
+
+  Real et[2] = {0};
+  auto t = tic();
+  CandidatePairs pairs;
+  find_candidate_pairs(search, p, e, pairs);
+  et[0] = toc(t);
+  const ko::View<Real*> pair_area("pair_area", pairs.npair()),
+    elem_area("elem_area", nslices(e));
+  t = tic();
+  calc_pair_areas<geo>(cm, p, e, pairs, pair_area, elem_area);
+  et[1] = toc(t);
+  print_times("test_area_pairs", et, 2);
+
+  Real a = 0;
+  ko::parallel_reduce(nslices(e), KOKKOS_LAMBDA (const Int& k, Real& s) {
+    s += elem_area(k);
+  }, a);
+  return a;
+}
+
+// Build the overlap mesh of (p,e) against (cp,ce), and return its area and,
+// optionally, its number of polygons.
+template <typename geo, typename SearchT = Octree<geo, 10> >
+Real test_area_overlap_mesh (
+  const ConstVec3s::HostMirror& cp, const ConstIdxs::HostMirror& ce,
+  const ConstVec3s::HostMirror& p_hm, const ConstIdxs::HostMirror& e_hm,
+  Int* npolygon = nullptr)
+{
+  sh::Mesh<ko::HostSpace> cm_hm; cm_hm.p = cp; cm_hm.e = ce;
+  fill_normals<geo>(cm_hm);
+  const sh::Mesh<> cm(cm_hm);
+  Vec3s p; resize_and_copy(p, p_hm);
+  Idxs e; resize_and_copy(e, e_hm);
+
+  Real et[2] = {0};
+  auto t = tic();
+  SearchT search(cp, ce);
+  et[0] = toc(t);
+
+  t = tic();
+  OverlapMesh<geo> om;
+  om.build(cm, search, p, e);
+  et[1] = toc(t);
+  print_times("test_area_overlap_mesh", et, 2);
+
+  const auto area = om.area;
+  Real a = 0;
+  ko::parallel_reduce(om.npolygon(), KOKKOS_LAMBDA (const Int& i, Real& s) {
+    s += area(i);
+  }, a);
+  if (npolygon) *npolygon = om.npolygon();
+  return a;
+}
+
+// Accumulate the moments 1 and x_d^2 over element k's overlaps.
+struct MomentsIntegrand {
+  typedef ko::View<Real*[2]> Moments;
+  Moments m;
+  Int d;
+  KOKKOS_INLINE_FUNCTION
+  void operator() (const Int k, const Int, const Int, const Real* x,
+                   const Real w) const {
+    m(k,0) += w;
+    m(k,1) += w*square(x[d]);
+  }
+};
+
+// Integrate 1 and x_d^2 over the overlap mesh of (p,e) against (cp,ce) using
+// integrate_overlaps.
+template <typename geo, typename SearchT = Octree<geo, 10> >
+void test_integrate_overlaps (
+  const ConstVec3s::HostMirror& cp, const ConstIdxs::HostMirror& ce,
+  const ConstVec3s::HostMirror& p_hm, const ConstIdxs::HostMirror& e_hm,
+  const Int d, Real moments[2])
+{
+  sh::Mesh<ko::HostSpace> cm_hm; cm_hm.p = cp; cm_hm.e = ce;
+  fill_normals<geo>(cm_hm);
+  const sh::Mesh<> cm(cm_hm);
+  Vec3s p; resize_and_copy(p, p_hm);
+  Idxs e; resize_and_copy(e, e_hm);
+  SearchT search(cp, ce);
+
+  MomentsIntegrand f;
+  f.m = MomentsIntegrand::Moments("moments", nslices(e));
+  f.d = d;
+  auto t = tic();
+  integrate_overlaps<geo>(cm, search, p, e, 8, f);
+  Real et = toc(t);
+  print_times("test_integrate_overlaps", &et, 1);
+
+  const auto m = f.m;
+  for (Int i = 0; i < 2; ++i) {
+    Real s = 0;
+    ko::parallel_reduce(nslices(m), KOKKOS_LAMBDA (const Int& k, Real& a) {
+      a += m(k,i);
+    }, s);
+    moments[i] = s;
+  }
+}
 } // namespace test
 } // namespace siqk
 
@@ -0,0 +1,245 @@
+// COMPOSE version 1.0: Copyright 2018 NTESS. This software is released under
+// the BSD license; see LICENSE in the top-level directory.
+
+#ifndef INCLUDE_SIQK_IO_HPP
+#define INCLUDE_SIQK_IO_HPP
+
+#include "siqk_defs.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Binary I/O of SIQK's arrays. A file is a header, a table of named arrays, and
+// the arrays' raw data, each aligned to 64 bytes:
+//     char magic[8]; int64 narray;
+//     narray x { char name[48]; int32 esize, kind; int64 n0, n1, offset; }
+//     data.
+// An array is written in the layout of the View it came from and must be read
+// into a View of the same type. Integers and reals are in the writer's native
+// representation, so a file is meant to be read on the machine type that wrote
+// it.
+//   A file is read through mmap. An array read into a View in HostSpace then
+// points into the mapped file, and no data are copied; otherwise the array is
+// copied from the map. Such a View is valid only while the map exists.
+//   Octree, OverlapMesh, and RemapOperator each have write and read methods
+// that use these, so a run can save its mesh, search structure, and remap data
+// and a restart can load them instead of building them again. Their read
+// methods keep the map alive, so the file object may be dropped after them.
+//      io::Writer w;
+//      w.add("p", p); w.add("e", e);
+//      octree.write(w, "octree.");
+//      w.write("mesh.siqk");
+//   Then, in another run:
+//      const io::MappedFile f("mesh.siqk");
+//      f.get("p", p); f.get("e", e);
+//      octree.read(f, "octree.");
+
+namespace siqk {
+namespace io {
+namespace impl {
+static const char magic[8] = {'S','I','Q','K','B','I','N','1'};
+enum { name_len = 48, alignment = 64 };
+
+struct Entry {
+  char name[name_len];
+  std::int32_t esize, kind;
+  std::int64_t n0, n1, offset;
+};
+
+template <typename T> struct Kind {
+  enum { value = std::is_integral<T>::value ? 0 : 1 };
+};
+
+inline std::int64_t align (const std::int64_t n) {
+  return ((n + alignment - 1)/alignment)*alignment;
+}
+
+// Make an unmanaged View of type V of ptr, passing only the runtime extents.
+template <typename V>
+V make_view (typename V::pointer_type ptr, const size_t n0, const size_t,
+             typename std::enable_if<V::rank_dynamic == 1>::type* = 0) {
+  return V(ptr, n0);
+}
+template <typename V>
+V make_view (typename V::pointer_type ptr, const size_t n0, const size_t n1,
+             typename std::enable_if<V::rank_dynamic == 2>::type* = 0) {
+  return V(ptr, n0, n1);
+}
+} // namespace impl
+
+// Collect arrays and write them to a file.
+class Writer {
+public:
+  // Add a copy of the contiguous View v, in any memory space, as array name.
+  template <typename V>
+  void add (const std::string& name, const V& v) {
+    const auto h = ko::create_mirror_view(v);
+    ko::deep_copy(h, v);
+    SIQK_THROW_IF(h.span() != h.extent(0)*(V::rank == 1 ? 1 : h.extent(1)),
+                  "io::Writer::add: " << name << " is not contiguous.");
+    add(name, h.data(), h.extent(0), V::rank == 1 ? 1 : h.extent(1));
+  }
+
+  // Add the host array data[0 : n0*n1-1] as array name.
+  template <typename T>
+  void add (const std::string& name, const T* const data, const size_t n0,
+            const size_t n1 = 1) {
+    typedef typename std::remove_const<T>::type Tnc;
+    SIQK_THROW_IF(name.size() >= impl::name_len,
+                  "io::Writer::add: " << name << " is too long.");
+    impl::Entry en;
+    std::memset(&en, 0, sizeof(en));
+    std::strcpy(en.name, name.c_str());
+    en.esize = sizeof(Tnc);
+    en.kind = impl::Kind<Tnc>::value;
+    en.n0 = n0;
+    en.n1 = n1;
+    entries_.push_back(en);
+    const size_t nbyte = n0*n1*sizeof(Tnc);
+    data_.push_back(std::vector<char>(nbyte));
+    if (nbyte) std::memcpy(data_.back().data(), data, nbyte);
+  }
+
+  void write (const std::string& filename) {
+    const std::int64_t narray = entries_.size();
+    std::int64_t offset = impl::align(sizeof(impl::magic) + sizeof(narray) +
+                                      narray*sizeof(impl::Entry));
+    for (std::int64_t i = 0; i < narray; ++i) {
+      entries_[i].offset = offset;
+      offset = impl::align(offset + data_[i].size());
+    }
+    std::unique_ptr<FILE, int(*)(FILE*)> fh(fopen(filename.c_str(), "wb"),
+                                            fclose);
+    SIQK_THROW_IF( ! fh, "io::Writer::write: could not open " << filename);
+    bool ok = fwrite(impl::magic, sizeof(impl::magic), 1, fh.get()) == 1;
+    ok = ok && fwrite(&narray, sizeof(narray), 1, fh.get()) == 1;
+    if (narray)
+      ok = ok && fwrite(entries_.data(), sizeof(impl::Entry), narray,
+                        fh.get()) == size_t(narray);
+    for (std::int64_t i = 0; i < narray; ++i) {
+      ok = ok && fseek(fh.get(), entries_[i].offset, SEEK_SET) == 0;
+      if ( ! data_[i].empty())
+        ok = ok && fwrite(data_[i].data(), data_[i].size(), 1, fh.get()) == 1;
+    }
+    SIQK_THROW_IF( ! ok, "io::Writer::write: could not write " << filename);
+  }
+
+private:
+  std::vector<impl::Entry> entries_;
+  std::vector<std::vector<char> > data_;
+};
+
+// A file written by Writer, mapped into memory. Copies share the map, which is
+// unmapped when the last copy or handle is destroyed. Views that get gives in
+// HostSpace point into the map and are valid only while it exists.
+class MappedFile {
+public:
+  MappedFile (const std::string& filename) : m_(std::make_shared<Map>()) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    SIQK_THROW_IF(fd < 0, "io::MappedFile: could not open " << filename);
+    struct stat st;
+    const bool ok = fstat(fd, &st) == 0;
+    m_->size = ok ? st.st_size : 0;
+    // A private map, so writes to Views of it do not reach the file.
+    if (m_->size > 0)
+      m_->addr = mmap(nullptr, m_->size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                      fd, 0);
+    close(fd);
+    SIQK_THROW_IF( ! ok || m_->addr == MAP_FAILED || m_->addr == nullptr,
+                   "io::MappedFile: could not map " << filename);
+    const char* const base = static_cast<const char*>(m_->addr);
+    std::int64_t narray = 0;
+    const size_t hdr = sizeof(impl::magic) + sizeof(narray);
+    SIQK_THROW_IF(m_->size < hdr ||
+                  std::memcmp(base, impl::magic, sizeof(impl::magic)) != 0,
+                  "io::MappedFile: " << filename << " is not a SIQK file.");
+    std::memcpy(&narray, base + sizeof(impl::magic), sizeof(narray));
+    SIQK_THROW_IF(narray < 0 || hdr + narray*sizeof(impl::Entry) > m_->size,
+                  "io::MappedFile: " << filename << " is truncated.");
+    entries_.resize(narray);
+    if (narray)
+      std::memcpy(entries_.data(), base + hdr, narray*sizeof(impl::Entry));
+    for (const auto& en : entries_)
+      SIQK_THROW_IF(en.offset + en.n0*en.n1*en.esize >
+                    static_cast<std::int64_t>(m_->size),
+                    "io::MappedFile: " << filename << " is truncated.");
+  }
+
+  bool has (const std::string& name) const { return find(name) != nullptr; }
+
+  // The map is unmapped only after every copy of the handle is destroyed, so
+  // an object that keeps Views from get holds one.
+  typedef std::shared_ptr<const void> Handle;
+  Handle handle () const { return m_; }
+
+  // Get array name into v, checking its type and extents.
+  template <typename V>
+  void get (const std::string& name, V& v) const {
+    typedef typename V::non_const_value_type T;
+    const impl::Entry& en = get_entry<T>(name);
+    SIQK_THROW_IF(V::rank_dynamic == 1 && V::rank == 2 &&
+                  en.n1 != static_cast<std::int64_t>(V().extent(1)),
+                  "io::MappedFile::get: " << name << " has extent " << en.n1);
+    T* const ptr = reinterpret_cast<T*>(static_cast<char*>(m_->addr) +
+                                        en.offset);
+    if (std::is_same<typename V::memory_space, ko::HostSpace>::value) {
+      v = impl::make_view<V>(ptr, en.n0, en.n1);
+    } else {
+      typedef ko::View<typename V::non_const_data_type, typename V::array_layout,
+                       ko::HostSpace, ko::MemoryTraits<ko::Unmanaged> > HostV;
+      const HostV h = impl::make_view<HostV>(ptr, en.n0, en.n1);
+      typename V::non_const_type d;
+      resize_and_copy(d, h);
+      v = d;
+    }
+  }
+
+  // Copy array name, which must have n entries, to the host array data.
+  template <typename T>
+  void get (const std::string& name, T* const data, const size_t n) const {
+    const impl::Entry& en = get_entry<T>(name);
+    SIQK_THROW_IF(static_cast<size_t>(en.n0*en.n1) != n,
+                  "io::MappedFile::get: " << name << " has " << en.n0*en.n1
+                  << " entries, not " << n);
+    if (n) std::memcpy(data, static_cast<char*>(m_->addr) + en.offset,
+                       n*sizeof(T));
+  }
+
+private:
+  struct Map {
+    void* addr;
+    size_t size;
+    Map () : addr(nullptr), size(0) {}
+    ~Map () { if (addr && addr != MAP_FAILED) munmap(addr, size); }
+  };
+
+  std::shared_ptr<Map> m_;
+  std::vector<impl::Entry> entries_;
+
+  const impl::Entry* find (const std::string& name) const {
+    for (const auto& en : entries_)
+      if (name == en.name) return &en;
+    return nullptr;
+  }
+
+  template <typename T>
+  const impl::Entry& get_entry (const std::string& name) const {
+    const impl::Entry* en = find(name);
+    SIQK_THROW_IF( ! en, "io::MappedFile: no array " << name);
+    SIQK_THROW_IF(en->esize != sizeof(T) || en->kind != impl::Kind<T>::value,
+                  "io::MappedFile: " << name << " has the wrong type.");
+    return *en;
+  }
+};
+} // namespace io
+} // namespace siqk
+
+#endif // INCLUDE_SIQK_IO_HPP
@@ -0,0 +1,287 @@
+// COMPOSE version 1.0: Copyright 2018 NTESS. This software is released under
+// the BSD license; see LICENSE in the top-level directory.
+
+#ifndef INCLUDE_SIQK_MESH_HPP
+#define INCLUDE_SIQK_MESH_HPP
+
+#include "siqk_geometry.hpp"
+
+// Simple meshes on the host for tests and benchmarks: a planar nxn quad mesh on
+// [-sqrt(1/2), sqrt(1/2)]^2 and a cubed-sphere mesh with nxn quads per face,
+// and transformations of them.
+
+namespace siqk {
+namespace mesh {
+inline void make_planar_mesh (Vec3s::HostMirror& p, Idxs::HostMirror& e,
+                              const Int n) {
+  const Real d = std::sqrt(0.5);
+  ko::resize(e, n*n, 4);
+  ko::resize(p, (n+1)*(n+1));
+  for (Int iy = 0; iy < n+1; ++iy)
+    for (Int ix = 0; ix < n+1; ++ix) {
+      const auto idx = (n+1)*iy + ix;
+      p(idx,0) = 2*(static_cast<Real>(ix)/n - 0.5)*d;
+      p(idx,1) = 2*(static_cast<Real>(iy)/n - 0.5)*d;
+      p(idx,2) = 0;
+    }
+  for (Int iy = 0; iy < n; ++iy)
+    for (Int ix = 0; ix < n; ++ix) {
+      const auto idx = n*iy + ix;
+      e(idx,0) = (n+1)*iy + ix;
+      e(idx,1) = (n+1)*iy + ix+1;
+      e(idx,2) = (n+1)*(iy+1) + ix+1;
+      e(idx,3) = (n+1)*(iy+1) + ix;
+    }
+}
+
+// Row-major R.
+inline void form_rotation (const Real axis[3], const Real angle, Real r[9]) {
+  const Real nrm = std::sqrt(SphereGeometry::norm2(axis));
+  const Real& x = axis[0] / nrm, & y = axis[1] / nrm, & z = axis[2] / nrm,
+    & th = angle;
+  const Real cth = std::cos(th), sth = std::sin(th), omcth = 1 - cth;
+  r[0] = cth + x*x*omcth;
+  r[3] = y*x*omcth + z*sth;
+  r[6] = z*x*omcth - y*sth;
+  r[1] = x*y*omcth - z*sth;
+  r[4] = cth + y*y*omcth;
+  r[7] = z*y*omcth + x*sth;
+  r[2] = x*z*omcth + y*sth;
+  r[5] = y*z*omcth - x*sth;
+  r[8] = cth + z*z*omcth;
+}
+
+template <typename V>
+void rotate (const Real R[9], V p) {
+  const Real x = p[0], y = p[1], z = p[2];
+  p[0] = R[0]*x + R[1]*y + R[2]*z;
+  p[1] = R[3]*x + R[4]*y + R[5]*z;
+  p[2] = R[6]*x + R[7]*y + R[8]*z;
+}
+
+template <typename V>
+void translate (const Real xlate[3], V p) {
+  for (Int i = 0; i < 3; ++i) p[i] += xlate[i];
+}
+
+inline void transform_planar_mesh (const Real R[9], const Real xlate[3],
+                                   Vec3s::HostMirror& p) {
+  for (Int i = 0; i < nslices(p); ++i) {
+    rotate(R, slice(p, i));
+    translate(xlate, slice(p, i));
+  }
+}
+
+// Remove vertices marked unused and adjust numbering.
+inline void remove_unused_vertices (Vec3s::HostMirror& p, Idxs::HostMirror& e,
+                                    const Real unused) {
+  // adjust[i] is the number to subtract from i. Hence if e(ei,0) was originally
+  // i, it is adjusted to i - adjust[i].
+  std::vector<Int> adjust(nslices(p), 0);
+  Int rmcnt = 0;
+  for (Int i = 0; i < nslices(p); ++i) {
+    if (p(i,0) != unused) continue;
+    adjust[i] = 1;
+    ++rmcnt;
+  }
+  // Cumsum.
+  for (Int i = 1; i < nslices(p); ++i)
+    adjust[i] += adjust[i-1];
+  // Adjust e.
+  for (Int ei = 0; ei < nslices(e); ++ei)
+    for (Int k = 0; k < szslice(e); ++k)
+      e(ei,k) -= adjust[e(ei,k)];
+  // Remove unused from p.
+  Vec3s::HostMirror pc("copy", nslices(p));
+  ko::deep_copy(pc, p);
+  ko::resize(p, nslices(p) - rmcnt);
+  for (Int i = 0, j = 0; i < nslices(pc); ++i) {
+    if (pc(i,0) == unused) continue;
+    for (Int k = 0; k < szslice(pc); ++k) p(j,k) = pc(i,k);
+    ++j;
+  }
+}
+
+// A very simple cube-sphere mesh with nxn elements per face. At least for now
+// I'm not bothering with making the elements well proportioned.
+inline void make_cubesphere_mesh (Vec3s::HostMirror& p, Idxs::HostMirror& e,
+                                  const Int n) {
+  // Transformation of the reference mesh make_planar_mesh to make each of the
+  // six faces.
+  const Real d = std::sqrt(0.5);
+  static Real R[6][9] = {{ 1, 0, 0, 0, 0, 0, 0, 1, 0},  // face 0, -y
+                         { 0, 0, 0, 1, 0, 0, 0, 1, 0},  //      1, +x
+                         {-1, 0, 0, 0, 0, 0, 0, 1, 0},  //      2, +y
+                         { 0, 0, 0,-1, 0, 0, 0, 1, 0},  //      3, -x
+                         { 1, 0, 0, 0, 1, 0, 0, 0, 0},  //      4, +z
+                         {-1, 0, 0, 0, 1, 0, 0, 0, 0}}; //      5, -z
+  static Real xlate[6][3] = {{ 0,-d, 0}, { d, 0, 0}, { 0, d, 0},
+                             {-d, 0, 0}, { 0, 0, d}, { 0, 0,-d}};
+  // Construct 6 uncoupled faces.
+  Vec3s::HostMirror ps[6];
+  Vec3s::HostMirror& p_ref = ps[0];
+  Idxs::HostMirror es[6];
+  Idxs::HostMirror& e_ref = es[0];
+  make_planar_mesh(p_ref, e_ref, n);
+  ko::resize(e, 6*nslices(e_ref), 4);
+  ko::resize(p, 6*nslices(p_ref));
+  for (Int i = 1; i < 6; ++i) {
+    ko::resize(es[i], nslices(e_ref), 4);
+    ko::deep_copy(es[i], e_ref);
+    ko::resize(ps[i], nslices(p_ref));
+    ko::deep_copy(ps[i], p_ref);
+    transform_planar_mesh(R[i], xlate[i], ps[i]);
+  }
+  transform_planar_mesh(R[0], xlate[0], ps[0]);
+  // Pack (p,e), accounting for equivalent vertices. For the moment, keep the p
+  // slot for an equivalent vertex to make node numbering simpler, but make the
+  // value bogus so we know if there's a problem in the numbering.
+  const Real unused = -2;
+  ko::deep_copy(p, unused);
+  Int p_base = 0, e_base = 0;
+  { // -y face
+    const Vec3s::HostMirror& fp = ps[0];
+    Idxs::HostMirror& fe = es[0];
+    for (Int j = 0; j < nslices(fp); ++j)
+      for (Int k = 0; k < 3; ++k) p(j,k) = fp(j,k);
+    for (Int j = 0; j < nslices(fe); ++j)
+      for (Int k = 0; k < 4; ++k) e(j,k) = fe(j,k);
+    p_base += nslices(p_ref);
+    e_base += nslices(e_ref);
+  }
+  for (Int fi = 1; fi <= 2; ++fi) { // +x, +y faces
+    const Vec3s::HostMirror& fp = ps[fi];
+    Idxs::HostMirror& fe = es[fi];
+    for (Int j = 0; j < nslices(fp); ++j) {
+      if (j % (n+1) == 0) continue; // equiv vertex
+      for (Int k = 0; k < 3; ++k) p(p_base+j,k) = fp(j,k);
+    }
+    for (Int j = 0; j < nslices(fe); ++j) {
+      for (Int k = 0; k < 4; ++k) fe(j,k) += p_base;
+      // Left 2 vertices of left elem on face fi equiv to right 2 vertices of
+      // right elem on face fi-1. Write to the face, then copy to e, so that
+      // other faces can use these updated data.
+      if (j % n == 0) {
+        fe(j,0) = es[fi-1](j+n-1,1);
+        fe(j,3) = es[fi-1](j+n-1,2);
+      }
+      for (Int k = 0; k < 4; ++k) e(e_base+j,k) = fe(j,k);
+    }
+    p_base += nslices(p_ref);
+    e_base += nslices(e_ref);
+  }
+  { // -x face
+    const Vec3s::HostMirror& fp = ps[3];
+    Idxs::HostMirror& fe = es[3];
+    for (Int j = 0; j < nslices(fp); ++j) {
+      if (j % (n+1) == 0 || (j+1) % (n+1) == 0) continue;
+      for (Int k = 0; k < 3; ++k) p(p_base+j,k) = fp(j,k);
+    }
+    for (Int j = 0; j < nslices(fe); ++j) {
+      for (Int k = 0; k < 4; ++k) fe(j,k) += p_base;
+      if (j % n == 0) {
+        fe(j,0) = es[2](j+n-1,1);
+        fe(j,3) = es[2](j+n-1,2);
+      } else if ((j+1) % n == 0) {
+        fe(j,1) = es[0]((j+1)-n,0);
+        fe(j,2) = es[0]((j+1)-n,3);
+      }
+      for (Int k = 0; k < 4; ++k) e(e_base+j,k) = fe(j,k);
+    }
+    p_base += nslices(p_ref);
+    e_base += nslices(e_ref);
+  }
+  { // +z face
+    const Vec3s::HostMirror& fp = ps[4];
+    Idxs::HostMirror& fe = es[4];
+    for (Int j = n+1; j < nslices(fp) - (n+1); ++j) {
+      if (j % (n+1) == 0 || (j+1) % (n+1) == 0) continue;
+      for (Int k = 0; k < 3; ++k) p(p_base+j,k) = fp(j,k);
+    }
+    for (Int j = 0; j < nslices(fe); ++j)
+      for (Int k = 0; k < 4; ++k) fe(j,k) += p_base;
+    for (Int j = 0; j < n; ++j) { // -y
+      fe(j,0) = es[0](n*(n-1)+j,3);
+      fe(j,1) = es[0](n*(n-1)+j,2);
+    }
+    for (Int j = 0; j < n; ++j) { // +y
+      fe(n*(n-1)+j,2) = es[2](n*n-1-j,3);
+      fe(n*(n-1)+j,3) = es[2](n*n-1-j,2);
+    }
+    for (Int j = 0, i3 = 0; j < nslices(fe); j += n, ++i3) { // -x
+      fe(j,0) = es[3](n*n-1-i3,2);
+      fe(j,3) = es[3](n*n-1-i3,3);
+    }
+    for (Int j = n-1, i1 = 0; j < nslices(fe); j += n, ++i1) { // +x
+      fe(j,1) = es[1](n*(n-1)+i1,3);
+      fe(j,2) = es[1](n*(n-1)+i1,2);
+    }
+    for (Int j = 0; j < nslices(fe); ++j)
+      for (Int k = 0; k < 4; ++k) e(e_base+j,k) = fe(j,k);
+    p_base += nslices(p_ref);
+    e_base += nslices(e_ref);
+  }
+  { // -z face
+    const Vec3s::HostMirror& fp = ps[5];
+    Idxs::HostMirror& fe = es[5];
+    for (Int j = n+1; j < nslices(fp) - (n+1); ++j) {
+      if (j % (n+1) == 0 || (j+1) % (n+1) == 0) continue;
+      for (Int k = 0; k < 3; ++k) p(p_base+j,k) = fp(j,k);
+    }
+    for (Int j = 0; j < nslices(fe); ++j)
+      for (Int k = 0; k < 4; ++k) fe(j,k) += p_base;
+    for (Int j = 0; j < n; ++j) { // -y
+      fe(j,0) = es[0](n-1-j,1);
+      fe(j,1) = es[0](n-1-j,0);
+    }
+    for (Int j = 0; j < n; ++j) { // +y
+      fe(n*(n-1)+j,2) = es[2](j,1);
+      fe(n*(n-1)+j,3) = es[2](j,0);
+    }
+    for (Int j = 0, i3 = 0; j < nslices(fe); j += n, ++i3) { // -x
+      fe(j,0) = es[1](i3,0);
+      fe(j,3) = es[1](i3,1);
+    }
+    for (Int j = n-1, i1 = 0; j < nslices(fe); j += n, ++i1) { // +x
+      fe(j,1) = es[3](n-1-i1,1);
+      fe(j,2) = es[3](n-1-i1,0);
+    }
+    for (Int j = 0; j < nslices(fe); ++j)
+      for (Int k = 0; k < 4; ++k) e(e_base+j,k) = fe(j,k);
+  }
+  // Now go back and remove the unused vertices and adjust the numbering.
+  remove_unused_vertices(p, e, unused);
+  // Project to the unit sphere.
+  for (Int i = 0; i < nslices(p); ++i)
+    SphereGeometry::normalize(slice(p, i));
+}
+
+inline void project_onto_sphere (Vec3s::HostMirror& p) {
+  for (Int ip = 0; ip < nslices(p); ++ip) {
+    p(ip,2) = 1;
+    SphereGeometry::normalize(slice(p, ip));
+  }
+}
+
+inline void
+perturb_mesh (Vec3s::HostMirror& p, const Real angle, const Real xlate,
+              const Real ylate) {
+  const Real cr = std::cos(angle), sr = std::sin(angle);
+  for (Int ip = 0; ip < nslices(p); ++ip) {
+    const Real x = p(ip,0), y = p(ip,1);
+    p(ip,0) =  cr*x - sr*y + xlate;
+    p(ip,1) = -sr*x + cr*y + ylate;
+  }
+}
+
+inline void
+rotate_mesh (Vec3s::HostMirror& p, const Real axis[3], const Real angle) {
+  Real R[9];
+  form_rotation(axis, angle, R);
+  for (Int i = 0; i < nslices(p); ++i)
+    rotate(R, slice(p,i));
+}
+} // namespace mesh
+} // namespace siqk
+
+#endif // INCLUDE_SIQK_MESH_HPP
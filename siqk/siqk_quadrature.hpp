@@ -538,28 +538,80 @@ namespace siqk {
    2.735502743194343e-02, 2.786441729563326e-02, 2.888671321165472e-02,  \
    2.926968908113495e-02, 3.045196253398069e-02, 3.186369822247498e-02}
 
-class TriangleQuadrature {
-  const Real trisym_order4_coord_  [ 18] = SIQK_QUADRATURE_TRISYM_ORDER4_COORD;
-  const Real trisym_order4_weight_ [  6] = SIQK_QUADRATURE_TRISYM_ORDER4_WEIGHT;
-  const Real tritay_order6_coord_  [ 33] = SIQK_QUADRATURE_TRITAY_ORDER6_COORD;
-  const Real tritay_order6_weight_ [ 11] = SIQK_QUADRATURE_TRITAY_ORDER6_WEIGHT;
-  const Real trisym_order8_coord_  [ 48] = SIQK_QUADRATURE_TRISYM_ORDER8_COORD;
-  const Real trisym_order8_weight_ [ 16] = SIQK_QUADRATURE_TRISYM_ORDER8_WEIGHT;
+namespace impl {
+// The order-order rule's interleaved barycentric coordinates and its weights.
+template <int order> struct TriangleQuadratureTable;
+
+#define SIQK_TRIANGLE_QUADRATURE_TABLE(order, n, coord_, weight_) \
+  template <> struct TriangleQuadratureTable<order> {             \
+    enum { npts = n };                                             \
+    const Real coord[3*n] = coord_;                                \
+    const Real weight[n] = weight_;                                \
+    KOKKOS_INLINE_FUNCTION TriangleQuadratureTable () {}           \
+  }
+SIQK_TRIANGLE_QUADRATURE_TABLE( 4,  6, SIQK_QUADRATURE_TRISYM_ORDER4_COORD,
+                               SIQK_QUADRATURE_TRISYM_ORDER4_WEIGHT);
+SIQK_TRIANGLE_QUADRATURE_TABLE( 6, 11, SIQK_QUADRATURE_TRITAY_ORDER6_COORD,
+                               SIQK_QUADRATURE_TRITAY_ORDER6_WEIGHT);
+SIQK_TRIANGLE_QUADRATURE_TABLE( 8, 16, SIQK_QUADRATURE_TRISYM_ORDER8_COORD,
+                               SIQK_QUADRATURE_TRISYM_ORDER8_WEIGHT);
 #ifdef SIQK_USE_TRITAY12
-  const Real tritay_order12_coord_ [ 96] = SIQK_QUADRATURE_TRITAY_ORDER12_COORD;
-  const Real tritay_order12_weight_[ 32] = SIQK_QUADRATURE_TRITAY_ORDER12_WEIGHT;
+SIQK_TRIANGLE_QUADRATURE_TABLE(12, 32, SIQK_QUADRATURE_TRITAY_ORDER12_COORD,
+                               SIQK_QUADRATURE_TRITAY_ORDER12_WEIGHT);
 #else
-  const Real trisym_order12_coord_ [ 99] = SIQK_QUADRATURE_TRISYM_ORDER12_COORD;
-  const Real trisym_order12_weight_[ 33] = SIQK_QUADRATURE_TRISYM_ORDER12_WEIGHT;
+SIQK_TRIANGLE_QUADRATURE_TABLE(12, 33, SIQK_QUADRATURE_TRISYM_ORDER12_COORD,
+                               SIQK_QUADRATURE_TRISYM_ORDER12_WEIGHT);
 #endif
-  const Real trisym_order14_coord_ [138] = SIQK_QUADRATURE_TRISYM_ORDER14_COORD;
-  const Real trisym_order14_weight_[ 46] = SIQK_QUADRATURE_TRISYM_ORDER14_WEIGHT;
-  const Real tritay_order16_coord_ [165] = SIQK_QUADRATURE_TRITAY_ORDER16_COORD;
-  const Real tritay_order16_weight_[ 55] = SIQK_QUADRATURE_TRITAY_ORDER16_WEIGHT;
-  const Real tritay_order18_coord_ [198] = SIQK_QUADRATURE_TRITAY_ORDER18_COORD;
-  const Real tritay_order18_weight_[ 66] = SIQK_QUADRATURE_TRITAY_ORDER18_WEIGHT;
-  const Real trisym_order20_coord_ [264] = SIQK_QUADRATURE_TRISYM_ORDER20_COORD;
-  const Real trisym_order20_weight_[ 88] = SIQK_QUADRATURE_TRISYM_ORDER20_WEIGHT;
+SIQK_TRIANGLE_QUADRATURE_TABLE(14, 46, SIQK_QUADRATURE_TRISYM_ORDER14_COORD,
+                               SIQK_QUADRATURE_TRISYM_ORDER14_WEIGHT);
+SIQK_TRIANGLE_QUADRATURE_TABLE(16, 55, SIQK_QUADRATURE_TRITAY_ORDER16_COORD,
+                               SIQK_QUADRATURE_TRITAY_ORDER16_WEIGHT);
+SIQK_TRIANGLE_QUADRATURE_TABLE(18, 66, SIQK_QUADRATURE_TRITAY_ORDER18_COORD,
+                               SIQK_QUADRATURE_TRITAY_ORDER18_WEIGHT);
+SIQK_TRIANGLE_QUADRATURE_TABLE(20, 88, SIQK_QUADRATURE_TRISYM_ORDER20_COORD,
+                               SIQK_QUADRATURE_TRISYM_ORDER20_WEIGHT);
+#undef SIQK_TRIANGLE_QUADRATURE_TABLE
+} // namespace impl
+
+// The order-order rule with its order and number of points known at compile
+// time, for loops with fixed trip counts. Unlike TriangleQuadrature's tables,
+// the barycentric coordinates are stored structure-of-arrays: point k is
+// (bary[0][k], bary[1][k], bary[2][k]) and has weight weight[k]. The arrays
+// are aligned for vector loads.
+template <int order_>
+struct TriangleQuadratureRule {
+  enum { order = order_,
+         npts = impl::TriangleQuadratureTable<order_>::npts };
+
+  alignas(64) Real bary[3][npts];
+  alignas(64) Real weight[npts];
+
+  KOKKOS_INLINE_FUNCTION TriangleQuadratureRule () {
+    const impl::TriangleQuadratureTable<order_> t;
+    for (Int k = 0; k < npts; ++k) {
+      for (Int j = 0; j < 3; ++j) bary[j][k] = t.coord[3*k + j];
+      weight[k] = t.weight[k];
+    }
+  }
+};
+
+// Select the order at run time.
+class TriangleQuadrature {
+  const impl::TriangleQuadratureTable< 4> t4_;
+  const impl::TriangleQuadratureTable< 6> t6_;
+  const impl::TriangleQuadratureTable< 8> t8_;
+  const impl::TriangleQuadratureTable<12> t12_;
+  const impl::TriangleQuadratureTable<14> t14_;
+  const impl::TriangleQuadratureTable<16> t16_;
+  const impl::TriangleQuadratureTable<18> t18_;
+  const impl::TriangleQuadratureTable<20> t20_;
+
+  template <typename TableT>
+  KOKKOS_INLINE_FUNCTION static void
+  get (const TableT& t, RawConstVec3s& coord, RawConstArray& weight) {
+    coord = RawConstVec3s(t.coord, TableT::npts);
+    weight = RawConstArray(t.weight, TableT::npts);
+  }
 
 public:
   KOKKOS_INLINE_FUNCTION TriangleQuadrature () {}
@@ -568,43 +620,14 @@ public:
   void get_coef (const int order, RawConstVec3s& coord,
                  RawConstArray& weight) const {
     switch (order) {
-    case 4:
-      coord = RawConstVec3s(trisym_order4_coord_, 6);
-      weight = RawConstArray(trisym_order4_weight_, 6);
-      break;
-    case 6:
-      coord = RawConstVec3s(tritay_order6_coord_, 11);
-      weight = RawConstArray(tritay_order6_weight_, 11);
-      break;
-    case 8:
-      coord = RawConstVec3s(trisym_order8_coord_, 16);
-      weight = RawConstArray(trisym_order8_weight_, 16);
-      break;
-    case 12:
-#ifdef SIQK_USE_TRITAY12
-      coord = RawConstVec3s(tritay_order12_coord_, 32);
-      weight = RawConstArray(tritay_order12_weight_, 32);
-#else
-      coord = RawConstVec3s(trisym_order12_coord_, 33);
-      weight = RawConstArray(trisym_order12_weight_, 33);
-#endif
-      break;
-    case 14:
-      coord = RawConstVec3s(trisym_order14_coord_, 46);
-      weight = RawConstArray(trisym_order14_weight_, 46);
-      break;
-    case 16:
-      coord = RawConstVec3s(tritay_order16_coord_, 55);
-      weight = RawConstArray(tritay_order16_weight_, 55);
-      break;
-    case 18:
-      coord = RawConstVec3s(tritay_order18_coord_, 66);
-      weight = RawConstArray(tritay_order18_weight_, 66);
-      break;
-    case 20:
-      coord = RawConstVec3s(trisym_order20_coord_, 88);
-      weight = RawConstArray(trisym_order20_weight_, 88);
-      break;
+    case  4: get(t4_, coord, weight); break;
+    case  6: get(t6_, coord, weight); break;
+    case  8: get(t8_, coord, weight); break;
+    case 12: get(t12_, coord, weight); break;
+    case 14: get(t14_, coord, weight); break;
+    case 16: get(t16_, coord, weight); break;
+    case 18: get(t18_, coord, weight); break;
+    case 20: get(t20_, coord, weight); break;
     default:
       ko::abort("TriangleQuadrature::get_coef: order not supported.");
     }
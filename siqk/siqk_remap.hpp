@@ -0,0 +1,412 @@
+// COMPOSE version 1.0: Copyright 2018 NTESS. This software is released under
+// the BSD license; see LICENSE in the top-level directory.
+
+#ifndef INCLUDE_SIQK_REMAP_HPP
+#define INCLUDE_SIQK_REMAP_HPP
+
+#include "siqk_defs.hpp"
+#include "siqk_intersect.hpp"
+#include "siqk_sqr.hpp"
+
+namespace siqk {
+
+// Remap between two quadrilateral meshes of the sphere for a basis of np x np
+// GLL points on each element. A basis function is the tensor product of 1D
+// Lagrange polynomials in the sqr reference coordinates (a,b) of its element;
+// basis function i + np*j of element ie is degree of freedom ie*np^2 + i + np*j
+// and has node (a,b) = (x_i, x_j), where x are the GLL points.
+//   build computes, once, the mixed mass matrix
+//     M_ts(r,c) = int phi_r^target phi_c^source
+// in block CSR format, with one np^2 x np^2 block for each (target element,
+// source element) pair that overlap, and the block diagonal target mass matrix
+//     M_tt(r,c) = int phi_r^target phi_c^target,
+// stored Cholesky factored. apply then is a block SpMV followed by small dense
+// solves:
+//     y = M_tt \ (M_ts x).
+// The integrals are over the overlap mesh of the source mesh against the
+// target mesh, with each polygon integrated by geo::integrate. M_tt is also
+// integrated over these polygons, so apply preserves constants to rounding in
+// the region the source mesh covers.
+class RemapOperator {
+public:
+  typedef ko::View<Int*> IntList;
+  typedef ko::View<Real*> RealList;
+  typedef ko::View<const Real*> ConstRealList;
+
+  enum { max_np = 4 };
+
+  struct Options {
+    // Number of GLL points per element edge, in 2:max_np.
+    Int np;
+    // TriangleQuadrature order to integrate each triangle of a polygon's fan
+    // triangulation.
+    Int quad_order;
+
+    Options () : np(4), quad_order(12) {}
+  };
+
+  RemapOperator () : np_(0), nsrc_(0), ntgt_(0) {}
+
+  // tm is the target mesh, with edge normals; search is a search structure over
+  // its elements. (p,e) is the source mesh. Every element of each mesh must be
+  // a quadrilateral.
+  template <typename SearchT>
+  void build(const sh::Mesh<>& tm, const SearchT& search, const ConstVec3s& p,
+             const ConstIdxs& e, const Options& o = Options());
+
+  Int np () const { return np_; }
+  // Number of source and target degrees of freedom.
+  Int nsrc () const { return nsrc_*np_*np_; }
+  Int ntgt () const { return ntgt_*np_*np_; }
+  Int nblock () const { return nslices(colelem); }
+
+  // y = M_tt \ (M_ts x).
+  void apply(const ConstRealList& x, const RealList& y) const;
+  // y = M_ts x.
+  void apply_mixed(const ConstRealList& x, const RealList& y) const;
+
+  // Add the operator to w as arrays whose names start with prefix, and read
+  // one so written.
+  void write (io::Writer& w, const std::string& prefix) const {
+    const Int dims[] = {np_, nsrc_, ntgt_};
+    w.add(prefix + "dims", dims, 3);
+    w.add(prefix + "rowptr", rowptr);
+    w.add(prefix + "colelem", colelem);
+    w.add(prefix + "mixed", mixed);
+    w.add(prefix + "mass_chol", mass_chol);
+  }
+  void read (const io::MappedFile& f, const std::string& prefix) {
+    Int dims[3];
+    f.get(prefix + "dims", dims, 3);
+    np_ = dims[0]; nsrc_ = dims[1]; ntgt_ = dims[2];
+    f.get(prefix + "rowptr", rowptr);
+    f.get(prefix + "colelem", colelem);
+    f.get(prefix + "mixed", mixed);
+    f.get(prefix + "mass_chol", mass_chol);
+    map_ = f.handle();
+  }
+
+  // Block row ti of M_ts is blocks rowptr(ti) : rowptr(ti+1)-1. Block b couples
+  // target element ti to source element colelem(b), with
+  //     M_ts(ti*np^2 + r, colelem(b)*np^2 + c) = mixed((b*np^2 + r)*np^2 + c).
+  // In a row, blocks are ordered by source element.
+  IntList rowptr, colelem;
+  RealList mixed;
+  // Element ti's block of M_tt is L L' with
+  //     L(r,c) = mass_chol((ti*np^2 + r)*np^2 + c), r >= c.
+  RealList mass_chol;
+
+private:
+  Int np_, nsrc_, ntgt_;
+  // The file read gave the Views, if any.
+  io::MappedFile::Handle map_;
+};
+
+namespace impl {
+// GLL points on [-1,1].
+KOKKOS_INLINE_FUNCTION
+void get_gll_points (const Int np, Real x[RemapOperator::max_np]) {
+  x[0] = -1;
+  x[np-1] = 1;
+  if (np == 3) x[1] = 0;
+  if (np == 4) {
+    const Real c = 1/std::sqrt(5.0);
+    x[1] = -c;
+    x[2] = c;
+  }
+}
+
+// v[i + np*j] is the value of basis function i + np*j at (a,b).
+KOKKOS_INLINE_FUNCTION
+void eval_basis (const Int np, const Real a, const Real b, Real* const v) {
+  Real x[RemapOperator::max_np], va[RemapOperator::max_np],
+    vb[RemapOperator::max_np];
+  get_gll_points(np, x);
+  for (Int i = 0; i < np; ++i) {
+    va[i] = vb[i] = 1;
+    for (Int j = 0; j < np; ++j) {
+      if (j == i) continue;
+      const Real den = x[i] - x[j];
+      va[i] *= (a - x[j])/den;
+      vb[i] *= (b - x[j])/den;
+    }
+  }
+  for (Int j = 0; j < np; ++j)
+    for (Int i = 0; i < np; ++i)
+      v[i + np*j] = va[i]*vb[j];
+}
+
+// Accumulate Mts(r,c) += w phi_r^t(x) phi_c^s(x) and Mtt(r,c) += w phi_r^t(x)
+// phi_c^t(x) at the quadrature points of a polygon.
+struct RemapBlockIntegrand {
+  const Real* Tt;
+  const Real* Ts;
+  Int np;
+  Real* Mts;
+  Real* Mtt;
+  Int* nfail;
+
+  KOKKOS_INLINE_FUNCTION
+  void operator() (const Real* x, const Real w) const {
+    enum { max_np2 = RemapOperator::max_np*RemapOperator::max_np };
+    const Int np2 = np*np;
+    Real vt[max_np2], vs[max_np2], a, b;
+    sqr::Info info;
+    sqr::calc_sphere_to_ref(Tt, x, a, b, &info);
+    if ( ! info.success) ++*nfail;
+    eval_basis(np, a, b, vt);
+    sqr::calc_sphere_to_ref(Ts, x, a, b, &info);
+    if ( ! info.success) ++*nfail;
+    eval_basis(np, a, b, vs);
+    for (Int r = 0; r < np2; ++r) {
+      const Real wr = w*vt[r];
+      for (Int c = 0; c < np2; ++c) {
+        Mts[r*np2 + c] += wr*vs[c];
+        Mtt[r*np2 + c] += wr*vt[c];
+      }
+    }
+  }
+};
+
+// In-place Cholesky factorization of the n x n SPD row-major matrix A. The
+// lower triangle holds L on output.
+KOKKOS_INLINE_FUNCTION
+void cholesky (const Int n, Real* const A) {
+  for (Int j = 0; j < n; ++j) {
+    Real d = A[j*n + j];
+    for (Int k = 0; k < j; ++k) d -= square(A[j*n + k]);
+    d = std::sqrt(d);
+    A[j*n + j] = d;
+    for (Int i = j+1; i < n; ++i) {
+      Real s = A[i*n + j];
+      for (Int k = 0; k < j; ++k) s -= A[i*n + k]*A[j*n + k];
+      A[i*n + j] = s/d;
+    }
+  }
+}
+
+// Solve L L' x = b in place, with L from cholesky.
+KOKKOS_INLINE_FUNCTION
+void cholesky_solve (const Int n, const Real* const L, Real* const x) {
+  for (Int i = 0; i < n; ++i) {
+    for (Int k = 0; k < i; ++k) x[i] -= L[i*n + k]*x[k];
+    x[i] /= L[i*n + i];
+  }
+  for (Int i = n-1; i >= 0; --i) {
+    for (Int k = i+1; k < n; ++k) x[i] -= L[k*n + i]*x[k];
+    x[i] /= L[i*n + i];
+  }
+}
+} // namespace impl
+
+template <typename SearchT>
+void RemapOperator
+::build (const sh::Mesh<>& tm, const SearchT& search, const ConstVec3s& p,
+         const ConstIdxs& e, const Options& o) {
+  typedef SphereGeometry geo;
+  SIQK_THROW_IF(o.np < 2 || o.np > max_np,
+                "RemapOperator::build: np must be in 2:" << max_np);
+  np_ = o.np;
+  nsrc_ = nslices(e);
+  ntgt_ = nslices(tm.e);
+  const Int np = np_, np2 = np*np, nt = nslices(tm.e), order = o.quad_order;
+
+  // The overlap mesh has the source element's polygons in ptr order.
+  OverlapMesh<geo> om;
+  om.build(tm, search, p, e);
+  const Int npoly = om.npolygon();
+
+  // Group the polygons by target element: count, scan, fill, and then sort
+  // each row by source element so the layout does not depend on the order of
+  // the atomics.
+  const IntList src("RemapOperator src", npoly), perm("RemapOperator perm", npoly);
+  const IntList rp("RemapOperator rowptr", nt+1), cnt("RemapOperator cnt", nt);
+  {
+    const auto optr = om.ptr;
+    const auto cme = om.cme;
+    ko::parallel_for(nsrc_, KOKKOS_LAMBDA (const Int& k) {
+      for (Int i = optr(k); i < optr(k+1); ++i) {
+        src(i) = k;
+        ko::atomic_increment(&rp(cme(i)));
+      }
+    });
+    exclusive_scan(rp);
+    ko::parallel_for(npoly, KOKKOS_LAMBDA (const Int& i) {
+      const Int ti = cme(i);
+      perm(rp(ti) + ko::atomic_fetch_add(&cnt(ti), 1)) = i;
+    });
+    ko::parallel_for(nt, KOKKOS_LAMBDA (const Int& ti) {
+      for (Int i = rp(ti) + 1; i < rp(ti+1); ++i) {
+        const Int pi = perm(i);
+        Int j = i;
+        for ( ; j > rp(ti) && src(perm(j-1)) > src(pi); --j)
+          perm(j) = perm(j-1);
+        perm(j) = pi;
+      }
+    });
+  }
+
+  // Integrate each block of M_ts over its polygon. Integrate M_tt over the
+  // same polygons, rather than over the target element directly, so that
+  // M_ts 1 = M_tt 1 to rounding and apply preserves constants. Then factor
+  // M_tt's blocks.
+  const IntList ce("RemapOperator colelem", npoly);
+  const RealList
+    mx("RemapOperator mixed", npoly*np2*np2),
+    mc("RemapOperator mass_chol", nt*np2*np2);
+  Int nfail = 0;
+  {
+    const auto vptr = om.vptr;
+    const auto v = om.v;
+    const auto cme = om.cme;
+    // A source element is in the blocks of each target element it overlaps, so
+    // get each element's coefficients once.
+    const sqr::QuadCoefs tc(tm.p, tm.e), sc(p, e);
+    ko::parallel_reduce(nt, KOKKOS_LAMBDA (const Int& ti, Int& nf) {
+      enum { max_nvert = OverlapMesh<geo>::max_nvert };
+      Real Tt[12], Ts[12], buf[3*max_nvert];
+      tc.get_T(ti, Tt);
+      Real* const Mtt = mc.data() + ti*np2*np2;
+      const TriangleQuadrature quad;
+      for (Int b = rp(ti); b < rp(ti+1); ++b) {
+        const Int pi = perm(b), si = src(pi);
+        ce(b) = si;
+        sc.get_T(si, Ts);
+        const Int nv = vptr(pi+1) - vptr(pi);
+        RawVec3s vp(buf, max_nvert);
+        for (Int j = 0; j < nv; ++j)
+          copy(slice(vp, j), slice(v, vptr(pi) + j), 3);
+        const impl::RemapBlockIntegrand f = {Tt, Ts, np, mx.data() + b*np2*np2,
+                                             Mtt, &nf};
+        geo::integrate(quad, order, vp, nv, f);
+      }
+      impl::cholesky(np2, Mtt);
+    }, nfail);
+  }
+  SIQK_THROW_IF(nfail > 0, "RemapOperator::build: calc_sphere_to_ref failed at "
+                << nfail << " quadrature points.");
+
+  rowptr = rp;
+  colelem = ce;
+  mixed = mx;
+  mass_chol = mc;
+  map_.reset();
+}
+
+inline void RemapOperator
+::apply_mixed (const ConstRealList& x, const RealList& y) const {
+  const Int np2 = np_*np_;
+  const auto rp = rowptr;
+  const auto ce = colelem;
+  const auto mx = mixed;
+  ko::parallel_for(ntgt_, KOKKOS_LAMBDA (const Int& ti) {
+    for (Int r = 0; r < np2; ++r) y(ti*np2 + r) = 0;
+    for (Int b = rp(ti); b < rp(ti+1); ++b) {
+      const Real* const M = mx.data() + b*np2*np2;
+      const Int c0 = ce(b)*np2;
+      for (Int r = 0; r < np2; ++r) {
+        Real s = 0;
+        for (Int c = 0; c < np2; ++c) s += M[r*np2 + c]*x(c0 + c);
+        y(ti*np2 + r) += s;
+      }
+    }
+  });
+}
+
+inline void RemapOperator
+::apply (const ConstRealList& x, const RealList& y) const {
+  enum { max_np2 = max_np*max_np };
+  const Int np2 = np_*np_;
+  const auto rp = rowptr;
+  const auto ce = colelem;
+  const auto mx = mixed;
+  const auto mc = mass_chol;
+  ko::parallel_for(ntgt_, KOKKOS_LAMBDA (const Int& ti) {
+    Real yt[max_np2] = {0};
+    for (Int b = rp(ti); b < rp(ti+1); ++b) {
+      const Real* const M = mx.data() + b*np2*np2;
+      const Int c0 = ce(b)*np2;
+      for (Int r = 0; r < np2; ++r) {
+        Real s = 0;
+        for (Int c = 0; c < np2; ++c) s += M[r*np2 + c]*x(c0 + c);
+        yt[r] += s;
+      }
+    }
+    impl::cholesky_solve(np2, mc.data() + ti*np2*np2, yt);
+    for (Int r = 0; r < np2; ++r) y(ti*np2 + r) = yt[r];
+  });
+}
+
+namespace test {
+// Sample the field x_d, or 1 if d < 0, at the GLL nodes of (p,e).
+inline void sample_at_gll_nodes (const ConstVec3s& p, const ConstIdxs& e,
+                                 const Int np, const Int d,
+                                 const RemapOperator::RealList& f) {
+  const Int np2 = np*np;
+  ko::parallel_for(nslices(e), KOKKOS_LAMBDA (const Int& ie) {
+    Real xg[RemapOperator::max_np], q[3];
+    impl::get_gll_points(np, xg);
+    for (Int j = 0; j < np; ++j)
+      for (Int i = 0; i < np; ++i) {
+        sqr::calc_ref_to_sphere(p, const_slice(e, ie), xg[i], xg[j], q);
+        f(ie*np2 + i + np*j) = d < 0 ? 1 : q[d];
+      }
+  });
+}
+
+// Remap the constant 1 and the field z from (p,e) to (cp,ce). Constants must be
+// preserved to round-off. The z error must be within 2 n^-np, where n =
+// sqrt(#target elements/6) is the resolution of a cubed sphere with as many
+// elements; measured errors on rotated cubed spheres are at most about a third
+// of that. Optionally return the z error in zerr.
+inline Int test_remap (
+  const ConstVec3s::HostMirror& cp, const ConstIdxs::HostMirror& ce_hm,
+  const ConstVec3s::HostMirror& p_hm, const ConstIdxs::HostMirror& e_hm,
+  const Int np, Real* zerr = nullptr)
+{
+  sh::Mesh<ko::HostSpace> cm_hm; cm_hm.p = cp; cm_hm.e = ce_hm;
+  fill_normals<SphereGeometry>(cm_hm);
+  const sh::Mesh<> cm(cm_hm);
+  Vec3s p; resize_and_copy(p, p_hm);
+  Idxs e; resize_and_copy(e, e_hm);
+  Octree<SphereGeometry, 10> search(cp, ce_hm);
+
+  Real et[2];
+  auto t = tic();
+  RemapOperator op;
+  RemapOperator::Options o;
+  o.np = np;
+  op.build(cm, search, p, e, o);
+  et[0] = toc(t);
+
+  const RemapOperator::RealList
+    x("x", op.nsrc()), y("y", op.ntgt()), yz("yz", op.ntgt()),
+    z("z", op.ntgt());
+  sample_at_gll_nodes(p, e, np, -1, x);
+  t = tic();
+  op.apply(x, y);
+  et[1] = toc(t);
+  print_times("test_remap", et, 2);
+  sample_at_gll_nodes(p, e, np, 2, x);
+  op.apply(x, yz);
+  sample_at_gll_nodes(cm.p, cm.e, np, 2, z);
+
+  Real cerr = 0, err = 0;
+  ko::parallel_reduce(op.ntgt(), KOKKOS_LAMBDA (const Int& i, Real& m) {
+    m = max(m, std::abs(y(i) - 1));
+  }, ko::Max<Real>(cerr));
+  ko::parallel_reduce(op.ntgt(), KOKKOS_LAMBDA (const Int& i, Real& m) {
+    m = max(m, std::abs(yz(i) - z(i)));
+  }, ko::Max<Real>(err));
+  const Real
+    n = std::sqrt(Real(nslices(ce_hm))/6),
+    bound = 2*std::pow(n, -np) + 1e-12;
+  fprintf(stderr, "remap np %d: #blocks %d constant err %1.3e z err %1.3e"
+          " (bound %1.3e)\n", np, op.nblock(), cerr, err, bound);
+  if (zerr) *zerr = err;
+  return cerr <= 1e-12 && err <= bound ? 0 : 1;
+}
+} // namespace test
+} // namespace siqk
+
+#endif // INCLUDE_SIQK_REMAP_HPP
@@ -22,17 +22,18 @@ cnt = 0
 if testno == 0:
     for n in [4, 50, 511, biggest]:
         if quick and n > 50: break
-        for angle in angles:
-            for xlate in xlates:
-                for ylate in ylates:
-                    cmd = ('OMP_NUM_THREADS=8 {exe:s} --testno 0 --xlate {xlate:1.15e} --ylate {ylate:1.14e} --angle {angle:1.15e} -n {n:d}'.
-                           format(exe=exe, xlate=xlate, ylate=ylate, angle=angle, n=n))
-                    stat = os.system(cmd)
-                    if stat:
-                        fails.append(cmd)
-                    else:
-                        cnt += 1
-        print len(fails)
+        for plane in ['', ' --plane']:
+            for angle in angles:
+                for xlate in xlates:
+                    for ylate in ylates:
+                        cmd = ('OMP_NUM_THREADS=8 {exe:s} --testno 0{plane:s} --xlate {xlate:1.15e} --ylate {ylate:1.14e} --angle {angle:1.15e} -n {n:d}'.
+                               format(exe=exe, plane=plane, xlate=xlate, ylate=ylate, angle=angle, n=n))
+                        stat = os.system(cmd)
+                        if stat:
+                            fails.append(cmd)
+                        else:
+                            cnt += 1
+        print(len(fails))
 
 elif testno == 1:
     for n in [4, 20, 40, 79]:
@@ -45,13 +46,13 @@ elif testno == 1:
                 fails.append(cmd)
             else:
                 cnt += 1
-        print len(fails)
+        print(len(fails))
     
 if len(fails) > 0:
-    print 'FAILED'
+    print('FAILED')
     for f in fails:
-        print f
+        print(f)
     sys.exit(-1)
 else:
-    print 'PASSED ({0:d})'.format(cnt)
+    print('PASSED ({0:d})'.format(cnt))
     sys.exit(0)
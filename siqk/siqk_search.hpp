@@ -6,10 +6,24 @@
 
 #include "siqk_defs.hpp"
 #include "siqk_geometry.hpp"
+#include "siqk_io.hpp"
+#include <cfloat>
 #include <vector>
 
 namespace siqk {
 
+// In place, replace a by its exclusive prefix sum, and return the total.
+inline Int exclusive_scan (const ko::View<Int*>& a) {
+  Int total = 0;
+  ko::parallel_scan(
+    nslices(a), KOKKOS_LAMBDA (const Int& i, Int& accum, const bool final) {
+      const Int v = a(i);
+      if (final) a(i) = accum;
+      accum += v;
+    }, total);
+  return total;
+}
+
 // Oct-tree. Might do something else better suited to the sphere later.
 template <typename Geo, Int max_depth_ = 10>
 class Octree {
@@ -22,7 +36,11 @@ public:
     // constraInt, try to go deep enough so that a leaf has no more than
     // max_nelem elements.
     Int max_nelem;
-    Options () : max_nelem(8) {}
+    // Place elements in the tree using their bounding boxes enlarged by slack
+    // in each direction. Then refit can reuse the tree for moved elements
+    // until an element's box leaves its enlarged box.
+    Real slack;
+    Options () : max_nelem(8), slack(0) {}
   };
 
   // Bounding box for a cluster of points ps (possibly vertices).
@@ -87,6 +105,9 @@ public:
 
   // p is a 3xNp array of points. e is a KxNe array of elements. An entry <0 is
   // ignored. All <0 entries must be at the end of an element's list.
+  //   The tree is built in parallel in the default execution space. These
+  // constructors and init copy p and e there first; build takes (p, e) already
+  // there and so is the cheap way to rebuild the tree every step.
   Octree (const ConstVec3s::HostMirror& p, const ConstIdxs::HostMirror& e,
           const Options& o) {
     init(p, e, o);
@@ -101,8 +122,28 @@ public:
     Options o;
     init(p, e, o);
   }
+  void init (const ConstVec3s::HostMirror& p_hm, const ConstIdxs::HostMirror& e_hm,
+             const Options& o) {
+    Vec3s p; resize_and_copy(p, p_hm);
+    Idxs e; resize_and_copy(e, e_hm);
+    build(p, e, o);
+  }
+
+  void build (const ConstVec3s& p, const ConstIdxs& e,
+              const Options& o = Options());
 
-  // Apply f to every element in leaf nodes with which bb overlaps. f must have
+  // Update the elements' bounding boxes for the moved points p, keeping the
+  // tree's structure. e must be the elements given to build. If an element's
+  // box is no longer in its build-time box enlarged by Options::slack, return
+  // false and leave the tree unchanged; then the caller must build again.
+  bool refit(const ConstVec3s& p, const ConstIdxs& e);
+
+  // Add the tree to w as arrays whose names start with prefix. read restores
+  // a tree so written, without its elements and points.
+  void write(io::Writer& w, const std::string& prefix) const;
+  void read(const io::MappedFile& f, const std::string& prefix);
+
+  // Apply f once to every element whose bounding box bb overlaps. f must have
   // function
   //     void operator(const Int element).
   template <typename CV, typename Functor>
@@ -110,53 +151,43 @@ public:
   void apply (const CV bb, Functor& f) const {
     if (nslices(nodes_) == 0) {
       for (Int i = 0; i < offsets_[1]; ++i)
-        f(elems_[i]);
+        if (do_bb_overlap(const_slice(ebbs_, elems_[i]), bb))
+          f(elems_[i]);
       return;
     }
-#ifdef SIQK_NONRECURSIVE
-    // Non-recursive impl.
-    {
-      // Stack.
-      Real snbb[8*max_depth_];
-      Int sni[max_depth_], si[max_depth_];
-      Int sp = 0;
-      // Args for top-level call.
-      copy(snbb, bb_, 8);
-      sni[sp] = 0;
-      si[sp] = 0;
-      while (sp >= 0) {
-        // Get stack frame's (nbb, ni, current i) values.
-        const Int i = si[sp];
-        if (i == 8) {
-          --sp;
-          continue;
-        }
-        // Increment stored value of i for next iteration. Current value is
-        // stored in 'i' above.
-        ++si[sp];
-        const Int ni = sni[sp];
-        const Real* const nbb = snbb + 8*sp;
-        // Can use the next stack frame's bb space for a child bb.
-        Real* const child_bb = snbb + 8*(sp+1);
-        fill_child_bb(nbb, i, child_bb);
-        if ( ! do_bb_overlap(child_bb, bb)) continue;
-        Int e = nodes_(ni,i);
-        if (e < 0) {
-          // Leaf, so apply functor to each element.
-          e = std::abs(e + 1);
-          for (Int k = offsets_[e]; k < offsets_[e+1]; ++k)
+    // Depth-first traversal with an explicit stack. Each node's bounding box is
+    // stored, so a frame is just the node and its next child to visit, and the
+    // stack's size is bounded by the depth of the tree.
+    Int sni[max_depth_], si[max_depth_];
+    Int sp = 0;
+    sni[0] = 0;
+    si[0] = 0;
+    while (sp >= 0) {
+      const Int i = si[sp];
+      if (i == 8) {
+        --sp;
+        continue;
+      }
+      ++si[sp];
+      const Int ni = sni[sp];
+      BoundingBox child_bb;
+      fill_child_bb(const_slice(nodebbs_, ni), i, child_bb);
+      if ( ! do_bb_overlap(child_bb, bb)) continue;
+      Int e = nodes_(ni,i);
+      if (e < 0) {
+        // Leaf, so apply functor to each element, unless the element is
+        // visited in another leaf.
+        e = -(e + 1);
+        for (Int k = offsets_[e]; k < offsets_[e+1]; ++k)
+          if (is_elem_first_leaf(child_bb, const_slice(ebbs_, elems_[k]), bb))
             f(elems_[k]);
-        } else if (e > 0) {
-          // Recurse.
-          ++sp;
-          sni[sp] = e;
-          si[sp] = 0;
-        }
+      } else if (e > 0) {
+        // Descend.
+        ++sp;
+        sni[sp] = e;
+        si[sp] = 0;
       }
     }
-#else
-    apply_r(0, bb_, bb, f);
-#endif
   }
 
 private:
@@ -171,152 +202,79 @@ private:
      Each segment of 'elems' contains a list of element indices covered by a
      leaf node. Element indices refer to the list of elements the caller
      provides during oct-tree construction.
+
+     Nodes are numbered breadth first, and leaves in order of their level.
   */
 
+  typedef ko::View<Int*> IntList;
+
   // Static data structures holding the completed octree.
-  //   nodes(:,i) is a list. The list includes children of node i (>0) and leaf
+  //   nodes(i,:) is a list. The list includes children of node i (>0) and leaf
   // node data (<=0).
-  //todo Make these const once ready to do full GPU stuff.
   Nodes nodes_;
+  // nodebbs(i,:) is node i's bounding box.
+  Vec6s nodebbs_;
+  // ebbs(i,:) is element i's bounding box, and pbbs(i,:) is the box, enlarged
+  // by the slack, that placed it in the tree.
+  Vec6s ebbs_, pbbs_;
   // A leaf node corresponding to -k covers elements
   //     elems[offset[k] : offset[k]-1].
-  ko::View<int*> offsets_, elems_;
+  IntList offsets_, elems_;
   // Root node's bounding box.
   BoundingBox bb_;
+  // The file read gave the Views, if any.
+  io::MappedFile::Handle map_;
 
-  // Dynamic data structures for construction phase.
-  class IntList {
-    Int* const buf_;
-    Int i_;
-  public:
-    IntList (Int* const buf) : buf_(buf), i_(0) {}
-    void reset () { i_ = 0; }
-    void push (const Int& i) { buf_[i_++] = i; }
-    Int* data () { return buf_; }
-    Int n () const { return i_; }
-    const Int& operator[] (const Int& i) const { return buf_[i]; }
-  };
-
-  class DynIntList {
-    std::vector<Int> buf_;
-  public:
-    DynIntList () {}
-    void push (const Int& i) { buf_.push_back(i); }
-    Int& back () { return buf_.back(); }
-    Int& operator[] (const size_t i) {
-      if (i >= buf_.size())
-        buf_.resize(i+1);
-      return buf_[i];
+  // Bounding box for the points p, as a reduction.
+  struct CalcPointsBb {
+    struct value_type { Real bb[6]; };
+    ConstVec3s p;
+    CalcPointsBb (const ConstVec3s& p_) : p(p_) {}
+    KOKKOS_INLINE_FUNCTION void init (value_type& v) const {
+      for (Int j = 0; j < 3; ++j) {
+        v.bb[j] = DBL_MAX;
+        v.bb[j+3] = -DBL_MAX;
+      }
     }
-    const Int& operator[] (const size_t i) const { return buf_[i]; }
-    Int n () const { return static_cast<Int>(buf_.size()); }
-    const Int* data () const { return buf_.data(); }
-  };
-
-  // Opposite index slot convention.
-  class DynNodes {
-    std::vector<Int> buf_;
-  public:
-    Int n () const { return static_cast<Int>(buf_.size()) >> 3; }
-    const Int* data () const { return buf_.data(); }
-    Int& operator() (const Int& r, const Int& c) {
-      const size_t ec = (c+1) << 3;
-      if (ec >= buf_.size())
-        buf_.resize(ec);
-      return const_cast<Int&>(
-        const_cast<const DynNodes*>(this)->operator()(r, c));
+    KOKKOS_INLINE_FUNCTION void operator() (const Int i, value_type& v) const {
+      for (Int j = 0; j < 3; ++j) {
+        v.bb[j] = min(v.bb[j], p(i,j));
+        v.bb[j+3] = max(v.bb[j+3], p(i,j));
+      }
     }
-    const Int& operator() (const Int& r, const Int& c) const {
-      assert(((c << 3) + r) >= 0);
-      assert(((c << 3) + r) < (Int) buf_.size());
-      return buf_[(c << 3) + r];
+    KOKKOS_INLINE_FUNCTION
+    void join (volatile value_type& dst, volatile value_type const& src) const {
+      for (Int j = 0; j < 3; ++j) {
+        if (src.bb[j] < dst.bb[j]) dst.bb[j] = src.bb[j];
+        if (src.bb[j+3] > dst.bb[j+3]) dst.bb[j+3] = src.bb[j+3];
+      }
     }
   };
 
-  void init (const ConstVec3s::HostMirror& p, const ConstIdxs::HostMirror& e,
-             const Options& o) {
-    if (nslices(e) == 0) return;
-    // Get OT's bounding box.
-    calc_bb(p, bb_);
-    // Get elements' bounding boxes.
-    Vec6s::HostMirror ebbs("ebbs", nslices(e));
-    calc_bb(p, e, ebbs);
-    // Static element lists for work. Each level has active work space.
-    std::vector<Int> buf(max_depth_*nslices(e));
-    IntList es(buf.data()), wrk(buf.data() + nslices(e));
-    for (Int i = 0, ilim = nslices(e); i < ilim; ++i)
-      es.push(i);
-    // Dynamic element lists.
-    DynIntList offsets, elems;
-    offsets[0] = 0;
-    // Dynamic node data structure.
-    DynNodes nodes;
-    // Recurse. We don't care about the return value. If it's 0 and nodes.n() ==
-    // 0, we'll detect as much in 'apply'.
-    init_r(1, bb_, ebbs, o, es, wrk, offsets, elems, nodes);
-    // Build the static data structures.
-    if (elems.n() == 0) return;
-    init_static_ds(nodes, offsets, elems);
-  }
-
-  Int init_r (const Int depth, // Tree's depth at this point, including root.
-              const BoundingBox& nbb, // My bounding box.
-              const ConstVec6s::HostMirror& ebbs, // All elements' bounding boxes.
-              const Options& o, // Options controlling construct of the tree.
-              IntList& es, // List of elements in my bounding box.
-              IntList& wrk, // Work space to store working element lists.
-              DynIntList& offsets, // Offsetss Into elems.
-              DynIntList& elems, // Elements belonging to leaf nodes.
-              DynNodes& nodes) // Dynamic nodes data structure.
-  {
-    const Int my_idx = nodes.n(); // My node index.
-    // Decide what to do.
-    if (es.n() == 0) {
-      // I have no elements, so return 0 to indicate I'm a leaf node containing
-      // nothing.
-      return 0;
-    } else if (es.n() <= o.max_nelem || depth == max_depth_) {
-      // I'm a leaf node with elements. Store my list of elements and return the
-      // storage location.
-      const Int os = offsets.back();
-      offsets.push(os + es.n());
-      for (Int i = 0, n = es.n(); i < n; ++i)
-        elems[os + i] = es[i];
-      return 1 - offsets.n();
-    } else {
-      // I'm not a leaf node.
-      nodes(0, my_idx) = 0; // Insert myself Into the nodes array.
-      for (Int ic = 0; ic < 8; ++ic) {
-        BoundingBox child_bb;
-        fill_child_bb(nbb, ic, child_bb);
-        // Find the elements that are in this child's bb.
-        IntList ces(wrk.data());
-        for (Int i = 0, n = es.n(); i < n; ++i)
-          if (do_bb_overlap(child_bb, slice(ebbs, es[i])))
-            ces.push(es[i]);
-        // Create some work space.
-        IntList cwrk(wrk.data() + ces.n());
-        // Recurse.
-        const Int child_idx = init_r(depth+1, child_bb, ebbs, o, ces, cwrk,
-                                     offsets, elems, nodes);
-        nodes(ic, my_idx) = child_idx;
-      }
-      return my_idx;
+  // An element is in every leaf its box overlaps. Visit it only in the leaf
+  // lbb that contains the low corner of the intersection of its box ebb and
+  // the query box bb; leaves are half open except at the root's boundary. If
+  // ebb and bb do not intersect, the element is not visited at all. This
+  // requires each leaf to have nonzero width in every dimension, which build
+  // ensures.
+  template <typename CBB, typename CV>
+  KOKKOS_INLINE_FUNCTION
+  bool is_elem_first_leaf (const BoundingBox lbb, const CBB ebb,
+                           const CV bb) const {
+    for (Int j = 0; j < 3; ++j) {
+      const Real lo = max<Real>(ebb[j], bb[j]);
+      if (lo > min<Real>(ebb[j+3], bb[j+3])) return false;
+      if (lo < lbb[j] && lbb[j] > bb_[j]) return false;
+      if (lo >= lbb[j+3] && lbb[j+3] < bb_[j+3]) return false;
     }
+    return true;
   }
 
-  void init_static_ds (const DynNodes nodes, const DynIntList& offsets,
-                       const DynIntList& elems) {
-    {
-      ko::resize(nodes_, nodes.n());
-      auto nodes_hm = ko::create_mirror_view(nodes_);
-      for (Int i = 0; i < nodes.n(); ++i)
-        for (Int j = 0; j < 8; ++j)
-          nodes_hm(i,j) = nodes(j,i);
-      ko::deep_copy(nodes_, nodes_hm);
-    }
-    hm_resize_and_copy(offsets_, offsets, offsets.n());
-    hm_resize_and_copy(elems_, elems, elems.n());
+  // Bounding box for the child ic of node ni.
+  KOKKOS_INLINE_FUNCTION
+  static void get_child_bb (const ConstVec6s& nodebbs, const Int& ni,
+                            const Int& ic, BoundingBox child_bb) {
+    fill_child_bb(const_slice(nodebbs, ni), ic, child_bb);
   }
 
   // Using parent bb p, fill child bb c, with child_idx in 0:7.
@@ -342,9 +300,9 @@ private:
   }
 
   // Do bounding boxes a and b overlap?
-  template <typename BB>
+  template <typename BBA, typename BBB>
   KOKKOS_INLINE_FUNCTION
-  static bool do_bb_overlap (const BoundingBox a, const BB b) {
+  static bool do_bb_overlap (const BBA& a, const BBB& b) {
     for (Int i = 0; i < 3; ++i)
       if ( ! do_lines_overlap(a[i], a[i+3], b[i], b[i+3]))
         return false;
@@ -356,26 +314,452 @@ private:
                                 const Real& b1, const Real& b2) {
     return ! (a2 < b1 || a1 > b2);
   }
+};
 
-  template <typename CV, typename Functor> KOKKOS_INLINE_FUNCTION
-  void apply_r (const Int ni, const BoundingBox& nbb, const CV bb,
-                Functor& f) const {
-    for (Int i = 0; i < 8; ++i) {
-      BoundingBox child_bb;
-      fill_child_bb(nbb, i, child_bb);
-      if ( ! do_bb_overlap(child_bb, bb)) continue;
-      Int e = nodes_(ni,i);
-      if (e > 0)
-        apply_r(e, child_bb, bb, f);
-      else if (e < 0) {
-        e = std::abs(e + 1);
-        for (Int k = offsets_[e]; k < offsets_[e+1]; ++k)
-          f(elems_[k]);
+template <typename Geo, Int max_depth_>
+void Octree<Geo, max_depth_>
+::build (const ConstVec3s& p, const ConstIdxs& e, const Options& o) {
+  const Int ne = nslices(e), max_nelem = o.max_nelem;
+  const Real slack = o.slack;
+  nodes_ = Nodes();
+  nodebbs_ = Vec6s();
+  ebbs_ = pbbs_ = Vec6s();
+  offsets_ = IntList("Octree offsets", 2);
+  elems_ = IntList();
+  map_.reset();
+  if (ne == 0) return;
+  // Get OT's bounding box.
+  {
+    typename CalcPointsBb::value_type v;
+    ko::parallel_reduce(nslices(p), CalcPointsBb(p), v);
+    copy(bb_, v.bb, 6);
+    pad_bb(bb_);
+    // A dimension of zero width, e.g., z in a planar mesh, would make both
+    // children along it contain every element and break is_elem_first_leaf, so
+    // give it some width.
+    Real w = 0;
+    for (Int j = 0; j < 3; ++j) w = max(w, bb_[j+3] - bb_[j]);
+    if (w == 0) w = 1;
+    for (Int j = 0; j < 3; ++j) {
+      if (bb_[j+3] - bb_[j] <= 1e-3*w) {
+        bb_[j] -= 1e-3*w;
+        bb_[j+3] += 1e-3*w;
+      }
+      bb_[j] -= slack;
+      bb_[j+3] += slack;
+    }
+  }
+  // Get elements' bounding boxes and the enlarged ones that place them.
+  Vec6s ebbs("ebbs", ne), pbbs = slack > 0 ? Vec6s("pbbs", ne) : ebbs;
+  ko::parallel_for(ne, KOKKOS_LAMBDA (const Int& k) {
+    calc_bb(p, const_slice(e, k), szslice(e), slice(ebbs, k));
+    if (slack > 0)
+      for (Int j = 0; j < 3; ++j) {
+        pbbs(k,j) = ebbs(k,j) - slack;
+        pbbs(k,j+3) = ebbs(k,j+3) + slack;
+      }
+  });
+  ebbs_ = ebbs;
+  pbbs_ = pbbs;
+  // The root's element list is all elements.
+  IntList lvl_ptr("lvl_ptr", 2), lvl_elems("lvl_elems", ne);
+  ko::parallel_for(ne, KOKKOS_LAMBDA (const Int& k) {
+    lvl_elems(k) = k;
+    if (k == 0) lvl_ptr(1) = ne;
+  });
+  if (ne <= max_nelem || max_depth_ == 1) {
+    // The root is a leaf.
+    elems_ = lvl_elems;
+    offsets_ = lvl_ptr;
+    return;
+  }
+  nodebbs_ = Vec6s("Octree nodebbs", 1);
+  {
+    auto nodebbs_hm = ko::create_mirror_view(nodebbs_);
+    copy(slice(nodebbs_hm, 0), bb_, 6);
+    ko::deep_copy(nodebbs_, nodebbs_hm);
+  }
+  // Build the tree one level at a time. The level's nodes are [nb, nb+nlvl),
+  // and node nb+i has elements lvl_elems(lvl_ptr(i) : lvl_ptr(i+1)-1). For each
+  // (node, child) pair, count the elements in the child, then prefix-sum the
+  // counts to place each child in the next level or among the leaves.
+  Int nb = 0, nlvl = 1, nleaf = 0, nleafelem = 0;
+  for (Int depth = 1; nlvl > 0; ++depth) {
+    const Int npair = 8*nlvl;
+    const bool kids_are_leaves = depth+1 == max_depth_;
+    IntList cnt("cnt", npair);
+    {
+      const Vec6s nodebbs = nodebbs_;
+      ko::parallel_for(npair, KOKKOS_LAMBDA (const Int& k) {
+        const Int i = k / 8;
+        BoundingBox child_bb;
+        get_child_bb(nodebbs, nb + i, k % 8, child_bb);
+        Int c = 0;
+        for (Int j = lvl_ptr(i); j < lvl_ptr(i+1); ++j)
+          if (do_bb_overlap(child_bb, const_slice(pbbs, lvl_elems(j)))) ++c;
+        cnt(k) = c;
+      });
+    }
+    // Number of nodes and elements for the next level's nodes and for the
+    // leaves.
+    IntList inode("inode", npair), ielem("ielem", npair), ileaf("ileaf", npair),
+      ileafelem("ileafelem", npair);
+    ko::parallel_for(npair, KOKKOS_LAMBDA (const Int& k) {
+      const Int c = cnt(k);
+      const bool leaf = c <= max_nelem || kids_are_leaves;
+      inode(k) = c > 0 && ! leaf ? 1 : 0;
+      ielem(k) = leaf ? 0 : c;
+      ileaf(k) = c > 0 && leaf ? 1 : 0;
+      ileafelem(k) = leaf ? c : 0;
+    });
+    const Int nnxt = exclusive_scan(inode), nnxtelem = exclusive_scan(ielem),
+      nlf = exclusive_scan(ileaf), nlfelem = exclusive_scan(ileafelem);
+    // Grow the static data structures.
+    ko::resize(nodes_, nb + nlvl);
+    ko::resize(nodebbs_, nb + nlvl + nnxt);
+    ko::resize(offsets_, nleaf + nlf + 1);
+    ko::resize(elems_, nleafelem + nlfelem);
+    IntList nxt_ptr("lvl_ptr", nnxt + 1), nxt_elems("lvl_elems", nnxtelem);
+    {
+      const Nodes nodes = nodes_;
+      const Vec6s nodebbs = nodebbs_;
+      const IntList offsets = offsets_, elems = elems_;
+      const Int nbnxt = nb + nlvl;
+      ko::parallel_for(npair, KOKKOS_LAMBDA (const Int& k) {
+        const Int i = k / 8, ic = k % 8, c = cnt(k);
+        if (c == 0) {
+          nodes(nb + i, ic) = 0;
+          return;
+        }
+        BoundingBox child_bb;
+        get_child_bb(nodebbs, nb + i, ic, child_bb);
+        const bool leaf = c <= max_nelem || kids_are_leaves;
+        Int* dst;
+        if (leaf) {
+          const Int li = nleaf + ileaf(k);
+          nodes(nb + i, ic) = -(li + 1);
+          offsets(li) = nleafelem + ileafelem(k);
+          dst = &elems(offsets(li));
+        } else {
+          const Int ci = nbnxt + inode(k);
+          nodes(nb + i, ic) = ci;
+          copy(slice(nodebbs, ci), child_bb, 6);
+          nxt_ptr(inode(k)) = ielem(k);
+          dst = &nxt_elems(ielem(k));
+        }
+        for (Int j = lvl_ptr(i), n = 0; j < lvl_ptr(i+1); ++j) {
+          const Int ei = lvl_elems(j);
+          if (do_bb_overlap(child_bb, const_slice(pbbs, ei))) dst[n++] = ei;
+        }
+      });
+      const Int nleaf_tot = nleaf + nlf, nleafelem_tot = nleafelem + nlfelem;
+      ko::parallel_for(1, KOKKOS_LAMBDA (const Int&) {
+        nxt_ptr(nnxt) = nnxtelem;
+        offsets(nleaf_tot) = nleafelem_tot;
+      });
+    }
+    nleaf += nlf;
+    nleafelem += nlfelem;
+    nb += nlvl;
+    nlvl = nnxt;
+    lvl_ptr = nxt_ptr;
+    lvl_elems = nxt_elems;
+  }
+}
+
+template <typename Geo, Int max_depth_>
+bool Octree<Geo, max_depth_>
+::refit (const ConstVec3s& p, const ConstIdxs& e) {
+  const Int ne = nslices(e);
+  assert(ne == nslices(ebbs_));
+  const Vec6s ebbs("ebbs", ne);
+  const Vec6s pbbs = pbbs_;
+  Int nout = 0;
+  ko::parallel_reduce(ne, KOKKOS_LAMBDA (const Int& k, Int& n) {
+    calc_bb(p, const_slice(e, k), szslice(e), slice(ebbs, k));
+    for (Int j = 0; j < 3; ++j)
+      if (ebbs(k,j) < pbbs(k,j) || ebbs(k,j+3) > pbbs(k,j+3)) {
+        ++n;
+        break;
+      }
+  }, nout);
+  if (nout > 0) return false;
+  ebbs_ = ebbs;
+  return true;
+}
+
+template <typename Geo, Int max_depth_>
+void Octree<Geo, max_depth_>
+::write (io::Writer& w, const std::string& prefix) const {
+  const Int max_depth = max_depth_;
+  w.add(prefix + "max_depth", &max_depth, 1);
+  w.add(prefix + "bb", bb_, 6);
+  w.add(prefix + "nodes", nodes_);
+  w.add(prefix + "nodebbs", nodebbs_);
+  w.add(prefix + "ebbs", ebbs_);
+  w.add(prefix + "pbbs", pbbs_);
+  w.add(prefix + "offsets", offsets_);
+  w.add(prefix + "elems", elems_);
+}
+
+template <typename Geo, Int max_depth_>
+void Octree<Geo, max_depth_>
+::read (const io::MappedFile& f, const std::string& prefix) {
+  Int max_depth;
+  f.get(prefix + "max_depth", &max_depth, 1);
+  SIQK_THROW_IF(max_depth != max_depth_, "Octree::read: max_depth is "
+                << max_depth << ", not " << max_depth_);
+  f.get(prefix + "bb", bb_, 6);
+  f.get(prefix + "nodes", nodes_);
+  f.get(prefix + "nodebbs", nodebbs_);
+  f.get(prefix + "ebbs", ebbs_);
+  f.get(prefix + "pbbs", pbbs_);
+  f.get(prefix + "offsets", offsets_);
+  f.get(prefix + "elems", elems_);
+  map_ = f.handle();
+}
+
+// Index over a mesh on the unit sphere, with the same apply contract as
+// Octree. Each of the six faces of the cube is split into an n x n equiangular
+// grid of cells, and a cell lists the elements that might overlap it. Unlike an
+// octree's cells, every cell is on the sphere; and an element's cells come
+// from the gnomonic projection of its vertices, which maps its edges to line
+// segments, so the element's bounding box is not padded. apply calls f once
+// per candidate element.
+class CubedSphereIndex {
+public:
+  typedef Real BoundingBox[6];
+
+  struct Options {
+    // Number of cells along a face's edge. If <= 0, choose it from the number
+    // of elements.
+    Int n;
+    Options () : n(0) {}
+  };
+
+  // Bounding box for an element, for calls to apply.
+  template <typename CV3s, typename CIV, typename BB>
+  KOKKOS_INLINE_FUNCTION
+  static void calc_bb (const CV3s& p, const CIV e, const Int ne, BB ebb) {
+    Octree<SphereGeometry>::calc_bb(p, e, ne, ebb);
+  }
+
+  // p and e are as for Octree. The HostMirror versions copy them to the device
+  // and build there.
+  CubedSphereIndex (const ConstVec3s::HostMirror& p, const ConstIdxs::HostMirror& e,
+                    const Options& o = Options()) {
+    init(p, e, o);
+  }
+
+  CubedSphereIndex () : n_(0) {}
+  void init (const ConstVec3s::HostMirror& p_hm, const ConstIdxs::HostMirror& e_hm,
+             const Options& o = Options()) {
+    Vec3s p; resize_and_copy(p, p_hm);
+    Idxs e; resize_and_copy(e, e_hm);
+    build(p, e, o);
+  }
+
+  void build (const ConstVec3s& p, const ConstIdxs& e,
+              const Options& o = Options());
+
+  // Apply f to every element with which bb might overlap. f must have function
+  //     void operator(const Int element).
+  template <typename CV, typename Functor>
+  KOKKOS_INLINE_FUNCTION
+  void apply (const CV bb, Functor& f) const {
+    Int qr[6][4];
+    for (Int fi = 0; fi < 6; ++fi)
+      box_range(bb, fi, n_, qr[fi]);
+    for (Int fi = 0; fi < 6; ++fi) {
+      const Int* const q = qr[fi];
+      for (Int i = q[0]; i <= q[1]; ++i)
+        for (Int j = q[2]; j <= q[3]; ++j) {
+          const Int ci = (fi*n_ + i)*n_ + j;
+          for (Int k = cellptr_(ci); k < cellptr_(ci+1); ++k) {
+            const Int ei = cellelems_(k);
+            // Visit ei only in the first cell of the first face in which it and
+            // bb both lie.
+            const Int* const r = &elemranges_(ei, 4*fi);
+            if (i != max(q[0], r[0]) || j != max(q[2], r[2])) continue;
+            bool first = true;
+            for (Int fj = 0; fj < fi; ++fj)
+              if (do_ranges_overlap(qr[fj], &elemranges_(ei, 4*fj))) {
+                first = false;
+                break;
+              }
+            if (first) f(ei);
+          }
+        }
+    }
+  }
+
+private:
+  typedef ko::View<Int*> IntList;
+  typedef ko::View<Int*[24], ko::LayoutRight> ElemRanges;
+
+  // Cells per face edge.
+  Int n_;
+  // Cell (f,i,j), with index (f*n + i)*n + j, lists elements
+  //     cellelems[cellptr[c] : cellptr[c+1]-1].
+  IntList cellptr_, cellelems_;
+  // elemranges(e, 4*f : 4*f+3) is (i_first, i_last, j_first, j_last) for
+  // element e's cells on face f, empty if i_first > i_last.
+  ElemRanges elemranges_;
+
+  // Face f is normal to axis k = f % 3, on the side sign(f < 3 ? 1 : -1). For
+  // a point x on it, the gnomonic coordinates are x_a/w and x_b/w with
+  // w = sign x_k, a = (k+1) % 3, b = (k+2) % 3.
+  KOKKOS_INLINE_FUNCTION
+  static void get_face_axes (const Int f, Int& k, Int& a, Int& b, Real& sign) {
+    k = f % 3;
+    a = (k+1) % 3;
+    b = (k+2) % 3;
+    sign = f < 3 ? 1 : -1;
+  }
+
+  // Equiangular cell index for gnomonic coordinate u, widened by a little to
+  // be safe against rounding.
+  KOKKOS_INLINE_FUNCTION
+  static Int get_cell (const Real u, const Int n, const bool lo) {
+    const Real eps = 1e-12, quarter_pi = 0.25*M_PI;
+    const Real v = max(-1.0, min(1.0, lo ? u - eps : u + eps));
+    const Int c = static_cast<Int>(std::floor((std::atan(v) + quarter_pi)/
+                                              (2*quarter_pi)*n));
+    return max(0, min(n-1, c));
+  }
+
+  // Fill r with the cell range [ulo,uhi] x [vlo,vhi], clamped to the face, or
+  // with an empty range.
+  KOKKOS_INLINE_FUNCTION
+  static void set_range (const Real ulo, const Real uhi, const Real vlo,
+                         const Real vhi, const Int n, Int* const r) {
+    if (ulo > 1 || uhi < -1 || vlo > 1 || vhi < -1) {
+      r[0] = r[2] = 0;
+      r[1] = r[3] = -1;
+      return;
+    }
+    r[0] = get_cell(ulo, n, true);
+    r[1] = get_cell(uhi, n, false);
+    r[2] = get_cell(vlo, n, true);
+    r[3] = get_cell(vhi, n, false);
+  }
+
+  // Range of cells of face f containing the points of the sphere in bb. The
+  // face's points have w >= 1/sqrt(3), and in the box, x_a/w and x_b/w are
+  // extremal at the corners.
+  template <typename CV>
+  KOKKOS_INLINE_FUNCTION
+  static void box_range (const CV bb, const Int f, const Int n, Int* const r) {
+    Int k, a, b;
+    Real sign;
+    get_face_axes(f, k, a, b, sign);
+    const Real wlo = max(1/std::sqrt(3.0), sign > 0 ? bb[k] : -bb[k+3]),
+      whi = min(1.0, sign > 0 ? bb[k+3] : -bb[k]);
+    if (wlo > whi) {
+      set_range(2, 2, 2, 2, n, r);
+      return;
+    }
+    Real ulo = 2, uhi = -2, vlo = 2, vhi = -2;
+    for (Int iw = 0; iw < 2; ++iw) {
+      const Real w = iw ? whi : wlo;
+      for (Int ie = 0; ie < 2; ++ie) {
+        const Real u = bb[a + 3*ie]/w, v = bb[b + 3*ie]/w;
+        ulo = min(ulo, u); uhi = max(uhi, u);
+        vlo = min(vlo, v); vhi = max(vhi, v);
+      }
+    }
+    set_range(ulo, uhi, vlo, vhi, n, r);
+  }
+
+  // Range of cells of face f that element e, with vertices p(e[0:ne-1]), might
+  // overlap. If every vertex is in the face's hemisphere, the range is that of
+  // the projected vertices. Otherwise, the element is very large, and the range
+  // is that of its bounding box.
+  template <typename CV3s, typename CIV>
+  KOKKOS_INLINE_FUNCTION
+  static void elem_range (const CV3s& p, const CIV e, const Int ne, const Int f,
+                          const Int n, Int* const r) {
+    Int k, a, b;
+    Real sign;
+    get_face_axes(f, k, a, b, sign);
+    Real ulo = 2, uhi = -2, vlo = 2, vhi = -2;
+    for (Int i = 0; i < ne; ++i) {
+      if (e[i] == -1) break;
+      const Real w = sign*p(e[i],k);
+      if (w <= 0) {
+        BoundingBox bb;
+        calc_bb(p, e, ne, bb);
+        box_range(bb, f, n, r);
+        return;
       }
+      const Real u = p(e[i],a)/w, v = p(e[i],b)/w;
+      ulo = min(ulo, u); uhi = max(uhi, u);
+      vlo = min(vlo, v); vhi = max(vhi, v);
     }
+    set_range(ulo, uhi, vlo, vhi, n, r);
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  static bool do_ranges_overlap (const Int* const q, const Int* const r) {
+    return (q[0] <= q[1] && r[0] <= r[1] &&
+            ! (q[1] < r[0] || r[1] < q[0] || q[3] < r[2] || r[3] < q[2]));
   }
 };
 
+inline void CubedSphereIndex
+::build (const ConstVec3s& p, const ConstIdxs& e, const Options& o) {
+  const Int ne = nslices(e);
+  // By default, for a cubed-sphere mesh, use twice as many cells along a face's
+  // edge as the mesh has elements. Finer cells cost memory for little further
+  // cut in the number of candidates.
+  const Int n = o.n > 0 ? o.n : max(1, static_cast<Int>(std::sqrt(ne/1.5)));
+  const Int ncell = 6*n*n;
+  n_ = n;
+  const ElemRanges elemranges("CubedSphereIndex elemranges", ne);
+  ko::parallel_for(ne, KOKKOS_LAMBDA (const Int& k) {
+    for (Int fi = 0; fi < 6; ++fi)
+      elem_range(p, const_slice(e, k), szslice(e), fi, n, &elemranges(k, 4*fi));
+  });
+  // Count each cell's elements, and then prefix-sum the counts to get the
+  // cells' offsets.
+  const IntList cellptr("CubedSphereIndex cellptr", ncell+1);
+  ko::parallel_for(ne, KOKKOS_LAMBDA (const Int& k) {
+    for (Int fi = 0; fi < 6; ++fi) {
+      const Int* const r = &elemranges(k, 4*fi);
+      for (Int i = r[0]; i <= r[1]; ++i)
+        for (Int j = r[2]; j <= r[3]; ++j)
+          ko::atomic_increment(&cellptr((fi*n + i)*n + j));
+    }
+  });
+  const Int nentry = exclusive_scan(cellptr);
+  // Fill the cells' lists, then sort each so that the order does not depend on
+  // the order of the atomics.
+  const IntList cellelems("CubedSphereIndex cellelems", nentry),
+    cellcnt("CubedSphereIndex cellcnt", ncell);
+  ko::parallel_for(ne, KOKKOS_LAMBDA (const Int& k) {
+    for (Int fi = 0; fi < 6; ++fi) {
+      const Int* const r = &elemranges(k, 4*fi);
+      for (Int i = r[0]; i <= r[1]; ++i)
+        for (Int j = r[2]; j <= r[3]; ++j) {
+          const Int ci = (fi*n + i)*n + j;
+          cellelems(cellptr(ci) + ko::atomic_fetch_add(&cellcnt(ci), 1)) = k;
+        }
+    }
+  });
+  ko::parallel_for(ncell, KOKKOS_LAMBDA (const Int& ci) {
+    for (Int k = cellptr(ci) + 1; k < cellptr(ci+1); ++k) {
+      const Int v = cellelems(k);
+      Int j = k;
+      for ( ; j > cellptr(ci) && cellelems(j-1) > v; --j)
+        cellelems(j) = cellelems(j-1);
+      cellelems(j) = v;
+    }
+  });
+  cellptr_ = cellptr;
+  cellelems_ = cellelems;
+  elemranges_ = elemranges;
+}
+
 } // namespace siqk
 
 #endif // INCLUDE_SIQK_SEARCH_HPP
@@ -40,26 +40,39 @@ void calc_T_row (const ConstVec3sT& p, const Quad& e, const Int i,
   t1 = -t2 + p(e[2],i) - p(e[3],i);
 }
 
-// Compute T(:,1)*a*b + T(:,2)*a + T(:,3)*b + T(:,4).
+// Compute all of T, with T(i,:) in T[4*i : 4*i+3].
 template <typename ConstVec3sT, typename Quad>
 KOKKOS_INLINE_FUNCTION
-void calc_ref_to_bilinear (const ConstVec3sT& p, const Quad& e,
-                           Real a, Real b, Real q[3]) {
+void calc_T (const ConstVec3sT& p, const Quad& e, Real T[12]) {
+  for (Int i = 0; i < 3; ++i)
+    calc_T_row(p, e, i, T[4*i], T[4*i+1], T[4*i+2], T[4*i+3]);
+}
+
+// Compute T(:,1)*a*b + T(:,2)*a + T(:,3)*b + T(:,4).
+KOKKOS_INLINE_FUNCTION
+void calc_ref_to_bilinear (const Real T[12], Real a, Real b, Real q[3]) {
   a = 0.5*(a + 1);
   b = 0.5*(b + 1);
   for (Int i = 0; i < 3; ++i) {
-    Real t1, t2, t3, t4;
-    impl::calc_T_row(p, e, i, t1, t2, t3, t4);
-    q[i] = t1*a*b + t2*a + t3*b + t4;
+    const Real* const t = T + 4*i;
+    q[i] = t[0]*a*b + t[1]*a + t[2]*b + t[3];
   }
 }
 
-// The residual function is r(a,b) = f(a,b)/g(a,b) - q.
 template <typename ConstVec3sT, typename Quad>
 KOKKOS_INLINE_FUNCTION
-void calc_residual (const ConstVec3sT& p, const Quad& e, const Real a,
-                    const Real b, const Real q[3], Real r[3]) {
-  calc_ref_to_bilinear(p, e, a, b, r);
+void calc_ref_to_bilinear (const ConstVec3sT& p, const Quad& e,
+                           Real a, Real b, Real q[3]) {
+  Real T[12];
+  calc_T(p, e, T);
+  calc_ref_to_bilinear(T, a, b, q);
+}
+
+// The residual function is r(a,b) = f(a,b)/g(a,b) - q.
+KOKKOS_INLINE_FUNCTION
+void calc_residual (const Real T[12], const Real a, const Real b,
+                    const Real q[3], Real r[3]) {
+  calc_ref_to_bilinear(T, a, b, r);
   const Real rnorm = std::sqrt(SphereGeometry::norm2(r));
   for (Int i = 0; i < 3; ++i)
     r[i] = r[i]/rnorm - q[i];  
@@ -70,19 +83,16 @@ void calc_residual (const ConstVec3sT& p, const Quad& e, const Real a,
 //   TODO Consider rewriting this in terms of the p=1 basis isoparametric
 // interpolation formulation. Better performance? See
 // calc_isoparametric_jacobian in slmmir.cpp.
-template <typename ConstVec3sT, typename Quad>
 KOKKOS_INLINE_FUNCTION
-void calc_Jacobian (const ConstVec3sT& p, const Quad& e, Real a, Real b,
-                    Real J[6]) {
+void calc_Jacobian (const Real T[12], Real a, Real b, Real J[6]) {
   a = 0.5*(a + 1);
   b = 0.5*(b + 1);  
   Real r[3];
   for (Int i = 0; i < 3; ++i) {
-    Real t1, t2, t3, t4;
-    calc_T_row(p, e, i, t1, t2, t3, t4);
-    r[  i] = t1*a*b + t2*a + t3*b + t4;
-    J[  i] = t1*b + t2;
-    J[3+i] = t1*a + t3;
+    const Real* const t = T + 4*i;
+    r[  i] = t[0]*a*b + t[1]*a + t[2]*b + t[3];
+    J[  i] = t[0]*b + t[1];
+    J[3+i] = t[0]*a + t[2];
   }
   Real rtJ[2] = {0};
   for (Int j = 0; j < 2; ++j) {
@@ -126,6 +136,46 @@ struct Info {
   Int n_iterations;
 };
 
+// Statistics over a batch of points.
+struct BatchInfo {
+  Int nfails, sum_iterations, max_iterations;
+};
+
+// These take the quad's coefficients T from impl::calc_T or QuadCoefs.
+KOKKOS_INLINE_FUNCTION
+void calc_ref_to_sphere (const Real T[12], const Real a, const Real b,
+                         Real q[3]) {
+  impl::calc_ref_to_bilinear(T, a, b, q);
+  SphereGeometry::normalize(q);
+}
+
+KOKKOS_INLINE_FUNCTION
+void calc_sphere_to_ref (
+  const Real T[12], const Real q[3], Real& a, Real& b,
+  Info* const info = nullptr, const Int max_its = 10,
+  const Real tol = 1e2*std::numeric_limits<Real>::epsilon())
+{
+  const Real tol2 = square(tol);
+  Real rnorm2 = 1;
+  a = b = 0;
+  Int it = 0;
+  for (it = 1; it <= max_its; ++it) { // Newton's method.
+    Real r[3], J[6];
+    impl::calc_residual(T, a, b, q, r);
+    rnorm2 = SphereGeometry::norm2(r);
+    if (rnorm2 <= tol2) break;
+    impl::calc_Jacobian(T, a, b, J);
+    Real dx[2];
+    impl::solve_Jxr(J, r, dx);
+    a -= dx[0];
+    b -= dx[1];
+  }
+  if (info) {
+    info->success = rnorm2 <= tol2;
+    info->n_iterations = it;
+  }
+}
+
 template <typename ConstVec3sT, typename Quad>
 KOKKOS_INLINE_FUNCTION
 void calc_ref_to_sphere (
@@ -136,8 +186,9 @@ void calc_ref_to_sphere (
   // The point on the sphere.
   Real q[3])
 {
-  impl::calc_ref_to_bilinear(p, e, a, b, q);
-  SphereGeometry::normalize(q);
+  Real T[12];
+  impl::calc_T(p, e, T);
+  calc_ref_to_sphere(T, a, b, q);
 }
 
 template <typename ConstVec3sT, typename Quad>
@@ -156,27 +207,130 @@ void calc_sphere_to_ref (
   // Tolerance for Newton iteration.
   const Real tol = 1e2*std::numeric_limits<Real>::epsilon())
 {
+  Real T[12];
+  impl::calc_T(p, e, T);
+  calc_sphere_to_ref(T, q, a, b, info, max_its, tol);
+}
+
+// calc_sphere_to_ref for n points q(0:n-1,:) in the same spherical quad. The
+// quad's coefficients T are computed once, or come from the caller, and the
+// points are solved batch_width at a time, each Newton step a fixed-width loop
+// over the batch so it vectorizes. A point takes the same Newton steps and
+// stops as in calc_sphere_to_ref, so (a[i], b[i]) agree with those from
+// calc_sphere_to_ref to within rounding. They need not be identical, as the
+// compiler may round the vectorized loops differently, e.g., by using FMAs.
+enum { batch_width = 8 };
+
+template <typename CV3s>
+KOKKOS_INLINE_FUNCTION
+void calc_sphere_to_ref_batch (
+  // The spherical quad's coefficients.
+  const Real T[12],
+  // The points on the sphere, q(i,:) for i = 0:n-1.
+  const Int n, const CV3s& q,
+  // (a[i],b[i]) in [-1,1]
+  Real* const a, Real* const b,
+  // Optional info output for the whole batch.
+  BatchInfo* const info = nullptr,
+  const Int max_its = 10,
+  const Real tol = 1e2*std::numeric_limits<Real>::epsilon())
+{
+  enum { W = batch_width };
   const Real tol2 = square(tol);
-  Real rnorm2 = 1;
-  a = b = 0;
-  Int it = 0;
-  for (it = 1; it <= max_its; ++it) { // Newton's method.
-    Real r[3], J[6];
-    impl::calc_residual(p, e, a, b, q, r);
-    rnorm2 = SphereGeometry::norm2(r);
-    if (rnorm2 <= tol2) break;
-    impl::calc_Jacobian(p, e, a, b, J);
-    Real dx[2];
-    impl::solve_Jxr(J, r, dx);
-    a -= dx[0];
-    b -= dx[1];
-  }
-  if (info) {
-    info->success = rnorm2 <= tol2;
-    info->n_iterations = it;
+  if (info) info->nfails = info->sum_iterations = info->max_iterations = 0;
+  for (Int i0 = 0; i0 < n; i0 += W) {
+    const Int nw = min<Int>(W, n - i0);
+    // Lane data. Unused lanes repeat the last point.
+    Real qw[3][W], aw[W], bw[W], rnorm2[W];
+    Int its[W];
+    bool done[W];
+    for (Int j = 0; j < W; ++j) {
+      const Int i = i0 + min(j, nw-1);
+      for (Int d = 0; d < 3; ++d) qw[d][j] = q(i,d);
+      aw[j] = bw[j] = 0;
+      rnorm2[j] = 1;
+      its[j] = max_its + 1;
+      done[j] = false;
+    }
+    for (Int it = 1; it <= max_its; ++it) {
+      // Residual.
+      Real r[3][W], f[3][W];
+      siqk_pragma_simd
+      for (Int j = 0; j < W; ++j) {
+        const Real as = 0.5*(aw[j] + 1), bs = 0.5*(bw[j] + 1);
+        for (Int d = 0; d < 3; ++d) {
+          const Real* const t = T + 4*d;
+          f[d][j] = t[0]*as*bs + t[1]*as + t[2]*bs + t[3];
+        }
+        const Real fnorm = std::sqrt(square(f[0][j]) + square(f[1][j]) +
+                                     square(f[2][j]));
+        for (Int d = 0; d < 3; ++d)
+          r[d][j] = f[d][j]/fnorm - qw[d][j];
+        rnorm2[j] = square(r[0][j]) + square(r[1][j]) + square(r[2][j]);
+      }
+      bool all_done = true;
+      for (Int j = 0; j < W; ++j) {
+        if ( ! done[j] && rnorm2[j] <= tol2) {
+          done[j] = true;
+          its[j] = it;
+        }
+        all_done = all_done && done[j];
+      }
+      if (all_done) break;
+      // Jacobian and Newton update, as in impl::calc_Jacobian and
+      // impl::solve_Jxr.
+      siqk_pragma_simd
+      for (Int j = 0; j < W; ++j) {
+        const Real as = 0.5*(aw[j] + 1), bs = 0.5*(bw[j] + 1);
+        Real J[6];
+        for (Int d = 0; d < 3; ++d) {
+          const Real* const t = T + 4*d;
+          J[  d] = t[0]*bs + t[1];
+          J[3+d] = t[0]*as + t[2];
+        }
+        const Real fv[] = {f[0][j], f[1][j], f[2][j]};
+        Real rtJ[2] = {0};
+        for (Int k = 0; k < 2; ++k)
+          for (Int d = 0; d < 3; ++d)
+            rtJ[k] += fv[d]*J[3*k+d];
+        const Real fnorm2 = SphereGeometry::norm2(fv), fnorm = std::sqrt(fnorm2);
+        for (Int k = 0; k < 2; ++k)
+          for (Int d = 0; d < 3; ++d)
+            J[3*k+d] = (J[3*k+d] - fv[d]*rtJ[k]/fnorm2)/fnorm;
+        const Real rv[] = {r[0][j], r[1][j], r[2][j]};
+        Real dx[2];
+        impl::solve_Jxr(J, rv, dx);
+        if ( ! done[j]) {
+          aw[j] -= dx[0];
+          bw[j] -= dx[1];
+        }
+      }
+    }
+    for (Int j = 0; j < nw; ++j) {
+      a[i0+j] = aw[j];
+      b[i0+j] = bw[j];
+      if ( ! info) continue;
+      // As in calc_sphere_to_ref, a failed point reports max_its + 1.
+      if ( ! done[j]) ++info->nfails;
+      info->sum_iterations += its[j];
+      info->max_iterations = max(info->max_iterations, its[j]);
+    }
   }
 }
 
+template <typename ConstVec3sT, typename Quad, typename CV3s>
+KOKKOS_INLINE_FUNCTION
+void calc_sphere_to_ref_batch (
+  const ConstVec3sT& p, const Quad& e, const Int n, const CV3s& q,
+  Real* const a, Real* const b, BatchInfo* const info = nullptr,
+  const Int max_its = 10,
+  const Real tol = 1e2*std::numeric_limits<Real>::epsilon())
+{
+  Real T[12];
+  impl::calc_T(p, e, T);
+  calc_sphere_to_ref_batch(T, n, q, a, b, info, max_its, tol);
+}
+
 // Ref coords, packed (x,y), CCW, starting from (-1,-1).
 KOKKOS_INLINE_FUNCTION
 const Real* get_ref_vertices () {
@@ -184,6 +338,38 @@ const Real* get_ref_vertices () {
   return c;
 }
 
+// Optional cache of the coefficients T of impl::calc_T of each quad of a mesh
+// used more than once, e.g., a static Eulerian mesh, built once in the default
+// execution space. T is LayoutLeft, i.e., structure of arrays with the element
+// index fastest, so that consecutive threads or SIMD lanes, one per element,
+// read consecutive memory. T(ie,:) is defined only for elements having four
+// vertices.
+struct QuadCoefs {
+  typedef ko::View<Real*[12], ko::LayoutLeft> Coefs;
+
+  Coefs T;
+
+  QuadCoefs () {}
+  QuadCoefs (const ConstVec3s& p, const ConstIdxs& e) { init(p, e); }
+
+  void init (const ConstVec3s& p, const ConstIdxs& e) {
+    const Int ne = nslices(e), nv = szslice(e);
+    const Coefs tT("QuadCoefs T", ne);
+    ko::parallel_for(ne, KOKKOS_LAMBDA (const Int& ie) {
+      const auto ev = const_slice(e, ie);
+      const bool quad = nv >= 4 && ev[3] != -1 && (nv == 4 || ev[4] == -1);
+      Real buf[12];
+      if (quad) impl::calc_T(p, ev, buf);
+      for (Int j = 0; j < 12; ++j) tT(ie,j) = quad ? buf[j] : 0;
+    });
+    T = tT;
+  }
+
+  KOKKOS_INLINE_FUNCTION void get_T (const Int ie, Real t[12]) const {
+    for (Int j = 0; j < 12; ++j) t[j] = T(ie,j);
+  }
+};
+
 namespace test {
 struct Info {
   Int sum_nits, max_nits, nfails;
@@ -251,17 +437,103 @@ public:
   }
 };
 
+// Same as TestSphereToRefKernel, but invert all of an element's points in one
+// call to calc_sphere_to_ref_batch.
+class TestSphereToRefBatchKernel {
+  enum { n_a_test = 9 };
+  const Real a_test[n_a_test] = {-0.1, -1e-16, 0, 1e-15, 0.1, 0.7, 1, 1-1e-14,
+                                 1.1};
+
+  const Real tol_;
+  mutable ConstVec3s p_;
+  mutable ConstIdxs e_;
+
+public:
+  typedef Info value_type;
+
+  TestSphereToRefBatchKernel (
+    const ConstVec3s::HostMirror& p_hm, const ConstIdxs::HostMirror& e_hm,
+    const Real tol = 1e1*std::numeric_limits<Real>::epsilon())
+    : tol_(tol)
+  {
+    { Vec3s p; resize_and_copy(p, p_hm); p_ = p; }
+    { Idxs e; resize_and_copy(e, e_hm); e_ = e; }
+  }
+
+  Int n () const { return nslices(e_); }
+  Int npts () const { return nslices(e_)*n_a_test*n_a_test; }
+
+  KOKKOS_INLINE_FUNCTION
+  void operator() (const Int ei, value_type& jinfo) const {
+    enum { np = n_a_test*n_a_test };
+    Real qbuf[3*np], a[np], b[np];
+    RawVec3s q(qbuf, np);
+    for (Int k = 0; k < np; ++k)
+      sqr::calc_ref_to_sphere(p_, slice(e_, ei), a_test[k / n_a_test],
+                              a_test[k % n_a_test], slice(q, k));
+    sqr::BatchInfo info;
+    sqr::calc_sphere_to_ref_batch(p_, slice(e_, ei), np, q, a, b, &info, 100,
+                                  tol_);
+    jinfo.nfails += info.nfails;
+    for (Int k = 0; k < np; ++k) {
+      const Real err = std::sqrt(square(a_test[k / n_a_test] - a[k]) +
+                                 square(a_test[k % n_a_test] - b[k]));
+      // The batch must agree with calc_sphere_to_ref to within rounding.
+      Real as, bs;
+      sqr::calc_sphere_to_ref(p_, slice(e_, ei), slice(q, k), as, bs, nullptr,
+                              100, tol_);
+      const Real derr = std::sqrt(square(as - a[k]) + square(bs - b[k]));
+      if (err > 1e4*tol_ || derr > 1e2*tol_) {
+        jinfo.nfails++;
+        printf("calc_sphere_to_ref_batch ei %d k %d: re %1.1e diff %1.1e\n", ei,
+               k, err, derr);
+      }
+    }
+    jinfo.sum_nits += info.sum_iterations;
+    jinfo.max_nits = max(jinfo.max_nits, info.max_iterations);
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  void init (value_type& info) {
+    info.sum_nits = 0;
+    info.max_nits = 0;
+    info.nfails = 0;
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  void join (volatile value_type& dst, volatile value_type const& src) const {
+    dst.max_nits = max(dst.max_nits, src.max_nits);
+    dst.sum_nits += src.sum_nits;
+    dst.nfails += src.nfails;
+  }
+};
+
 inline Int test_sphere_to_ref (const ConstVec3s::HostMirror& p,
                                const ConstIdxs::HostMirror& e) {
-  TestSphereToRefKernel k(p, e);
-  Info info;
-  auto t = tic();
-  ko::parallel_reduce(k.n(), k, info);
-  const auto et = toc(t);
-  fprintf(stderr, "sqr: #fails %d #iterations mean %1.1f max %d\n",
-          info.nfails, (Real) info.sum_nits / k.n(), info.max_nits);
-  print_times("test_sphere_to_ref", et);
-  return info.nfails;
+  Int nfails = 0;
+  {
+    TestSphereToRefKernel k(p, e);
+    Info info;
+    auto t = tic();
+    ko::parallel_reduce(k.n(), k, info);
+    const auto et = toc(t);
+    fprintf(stderr, "sqr: #fails %d #iterations mean %1.1f max %d\n",
+            info.nfails, (Real) info.sum_nits / k.n(), info.max_nits);
+    print_times("test_sphere_to_ref", et);
+    nfails += info.nfails;
+  }
+  {
+    TestSphereToRefBatchKernel k(p, e);
+    Info info;
+    auto t = tic();
+    ko::parallel_reduce(k.n(), k, info);
+    const auto et = toc(t);
+    fprintf(stderr, "sqr batch: #fails %d #iterations mean %1.1f max %d\n",
+            info.nfails, (Real) info.sum_nits / k.npts(), info.max_nits);
+    print_times("test_sphere_to_ref_batch", et);
+    nfails += info.nfails;
+  }
+  return nfails;
 }
 } // namespace test
 } // namespace sqr
@@ -5,10 +5,13 @@
 // ./a.out -m | grep "mat=1" > foo.m
 // >> msik('draw_unit_test0', 'foo');
 
+#include <algorithm>
 #include <limits>
+#include <vector>
 
 #include "siqk.hpp"
 using namespace siqk;
+using namespace siqk::mesh;
 
 #define INSTANTIATE_PLANE
 
@@ -34,250 +37,6 @@ void write_matlab (const std::string& name, const CV3s& p, const CIs& e) {
   printf("].';\n");
 }
 
-static void make_planar_mesh (Vec3s::HostMirror& p, Idxs::HostMirror& e,
-                              const Int n) {
-  const Real d = std::sqrt(0.5);
-  ko::resize(e, n*n, 4);
-  ko::resize(p, (n+1)*(n+1));
-  for (Int iy = 0; iy < n+1; ++iy)
-    for (Int ix = 0; ix < n+1; ++ix) {
-      const auto idx = (n+1)*iy + ix;
-      p(idx,0) = 2*(static_cast<Real>(ix)/n - 0.5)*d;
-      p(idx,1) = 2*(static_cast<Real>(iy)/n - 0.5)*d;
-      p(idx,2) = 0;
-    }
-  for (Int iy = 0; iy < n; ++iy)
-    for (Int ix = 0; ix < n; ++ix) {
-      const auto idx = n*iy + ix;
-      e(idx,0) = (n+1)*iy + ix;
-      e(idx,1) = (n+1)*iy + ix+1;
-      e(idx,2) = (n+1)*(iy+1) + ix+1;
-      e(idx,3) = (n+1)*(iy+1) + ix;
-    }
-}
-
-// Row-major R.
-inline void form_rotation (const Real axis[3], const Real angle, Real r[9]) {
-  const Real nrm = std::sqrt(SphereGeometry::norm2(axis));
-  const Real& x = axis[0] / nrm, & y = axis[1] / nrm, & z = axis[2] / nrm,
-    & th = angle;
-  const Real cth = std::cos(th), sth = std::sin(th), omcth = 1 - cth;
-  r[0] = cth + x*x*omcth;
-  r[3] = y*x*omcth + z*sth;
-  r[6] = z*x*omcth - y*sth;
-  r[1] = x*y*omcth - z*sth;
-  r[4] = cth + y*y*omcth;
-  r[7] = z*y*omcth + x*sth;
-  r[2] = x*z*omcth + y*sth;
-  r[5] = y*z*omcth - x*sth;
-  r[8] = cth + z*z*omcth;
-}
-
-template <typename V>
-static void rotate (const Real R[9], V p) {
-  const Real x = p[0], y = p[1], z = p[2];
-  p[0] = R[0]*x + R[1]*y + R[2]*z;
-  p[1] = R[3]*x + R[4]*y + R[5]*z;
-  p[2] = R[6]*x + R[7]*y + R[8]*z;
-}
-
-template <typename V>
-static void translate (const Real xlate[3], V p) {
-  for (Int i = 0; i < 3; ++i) p[i] += xlate[i];
-}
-
-static void transform_planar_mesh (const Real R[9], const Real xlate[3],
-                                   Vec3s::HostMirror& p) {
-  for (Int i = 0; i < nslices(p); ++i) {
-    rotate(R, slice(p, i));
-    translate(xlate, slice(p, i));
-  }
-}
-
-// Remove vertices marked unused and adjust numbering.
-static void remove_unused_vertices (Vec3s::HostMirror& p, Idxs::HostMirror& e,
-                                    const Real unused) {
-  // adjust[i] is the number to subtract from i. Hence if e(ei,0) was originally
-  // i, it is adjusted to i - adjust[i].
-  std::vector<Int> adjust(nslices(p), 0);
-  Int rmcnt = 0;
-  for (Int i = 0; i < nslices(p); ++i) {
-    if (p(i,0) != unused) continue;
-    adjust[i] = 1;
-    ++rmcnt;
-  }
-  // Cumsum.
-  for (Int i = 1; i < nslices(p); ++i)
-    adjust[i] += adjust[i-1];
-  // Adjust e.
-  for (Int ei = 0; ei < nslices(e); ++ei)
-    for (Int k = 0; k < szslice(e); ++k)
-      e(ei,k) -= adjust[e(ei,k)];
-  // Remove unused from p.
-  Vec3s::HostMirror pc("copy", nslices(p));
-  ko::deep_copy(pc, p);
-  ko::resize(p, nslices(p) - rmcnt);
-  for (Int i = 0, j = 0; i < nslices(pc); ++i) {
-    if (pc(i,0) == unused) continue;
-    for (Int k = 0; k < szslice(pc); ++k) p(j,k) = pc(i,k);
-    ++j;
-  }
-}
-
-// A very simple cube-sphere mesh with nxn elements per face. At least for now
-// I'm not bothering with making the elements well proportioned.
-void make_cubesphere_mesh (Vec3s::HostMirror& p, Idxs::HostMirror& e,
-                           const Int n) {
-  // Transformation of the reference mesh make_planar_mesh to make each of the
-  // six faces.
-  const Real d = std::sqrt(0.5);
-  static Real R[6][9] = {{ 1, 0, 0, 0, 0, 0, 0, 1, 0},  // face 0, -y
-                         { 0, 0, 0, 1, 0, 0, 0, 1, 0},  //      1, +x
-                         {-1, 0, 0, 0, 0, 0, 0, 1, 0},  //      2, +y
-                         { 0, 0, 0,-1, 0, 0, 0, 1, 0},  //      3, -x
-                         { 1, 0, 0, 0, 1, 0, 0, 0, 0},  //      4, +z
-                         {-1, 0, 0, 0, 1, 0, 0, 0, 0}}; //      5, -z
-  static Real xlate[6][3] = {{ 0,-d, 0}, { d, 0, 0}, { 0, d, 0},
-                             {-d, 0, 0}, { 0, 0, d}, { 0, 0,-d}};
-  // Construct 6 uncoupled faces.
-  Vec3s::HostMirror ps[6];
-  Vec3s::HostMirror& p_ref = ps[0];
-  Idxs::HostMirror es[6];
-  Idxs::HostMirror& e_ref = es[0];
-  make_planar_mesh(p_ref, e_ref, n);
-  ko::resize(e, 6*nslices(e_ref), 4);
-  ko::resize(p, 6*nslices(p_ref));
-  for (Int i = 1; i < 6; ++i) {
-    ko::resize(es[i], nslices(e_ref), 4);
-    ko::deep_copy(es[i], e_ref);
-    ko::resize(ps[i], nslices(p_ref));
-    ko::deep_copy(ps[i], p_ref);
-    transform_planar_mesh(R[i], xlate[i], ps[i]);
-  }
-  transform_planar_mesh(R[0], xlate[0], ps[0]);
-  // Pack (p,e), accounting for equivalent vertices. For the moment, keep the p
-  // slot for an equivalent vertex to make node numbering simpler, but make the
-  // value bogus so we know if there's a problem in the numbering.
-  const Real unused = -2;
-  ko::deep_copy(p, unused);
-  Int p_base = 0, e_base = 0;
-  { // -y face
-    const Vec3s::HostMirror& fp = ps[0];
-    Idxs::HostMirror& fe = es[0];
-    for (Int j = 0; j < nslices(fp); ++j)
-      for (Int k = 0; k < 3; ++k) p(j,k) = fp(j,k);
-    for (Int j = 0; j < nslices(fe); ++j)
-      for (Int k = 0; k < 4; ++k) e(j,k) = fe(j,k);
-    p_base += nslices(p_ref);
-    e_base += nslices(e_ref);
-  }
-  for (Int fi = 1; fi <= 2; ++fi) { // +x, +y faces
-    const Vec3s::HostMirror& fp = ps[fi];
-    Idxs::HostMirror& fe = es[fi];
-    for (Int j = 0; j < nslices(fp); ++j) {
-      if (j % (n+1) == 0) continue; // equiv vertex
-      for (Int k = 0; k < 3; ++k) p(p_base+j,k) = fp(j,k);
-    }
-    for (Int j = 0; j < nslices(fe); ++j) {
-      for (Int k = 0; k < 4; ++k) fe(j,k) += p_base;
-      // Left 2 vertices of left elem on face fi equiv to right 2 vertices of
-      // right elem on face fi-1. Write to the face, then copy to e, so that
-      // other faces can use these updated data.
-      if (j % n == 0) {
-        fe(j,0) = es[fi-1](j+n-1,1);
-        fe(j,3) = es[fi-1](j+n-1,2);
-      }
-      for (Int k = 0; k < 4; ++k) e(e_base+j,k) = fe(j,k);
-    }
-    p_base += nslices(p_ref);
-    e_base += nslices(e_ref);
-  }
-  { // -x face
-    const Vec3s::HostMirror& fp = ps[3];
-    Idxs::HostMirror& fe = es[3];
-    for (Int j = 0; j < nslices(fp); ++j) {
-      if (j % (n+1) == 0 || (j+1) % (n+1) == 0) continue;
-      for (Int k = 0; k < 3; ++k) p(p_base+j,k) = fp(j,k);
-    }
-    for (Int j = 0; j < nslices(fe); ++j) {
-      for (Int k = 0; k < 4; ++k) fe(j,k) += p_base;
-      if (j % n == 0) {
-        fe(j,0) = es[2](j+n-1,1);
-        fe(j,3) = es[2](j+n-1,2);
-      } else if ((j+1) % n == 0) {
-        fe(j,1) = es[0]((j+1)-n,0);
-        fe(j,2) = es[0]((j+1)-n,3);
-      }
-      for (Int k = 0; k < 4; ++k) e(e_base+j,k) = fe(j,k);
-    }
-    p_base += nslices(p_ref);
-    e_base += nslices(e_ref);
-  }
-  { // +z face
-    const Vec3s::HostMirror& fp = ps[4];
-    Idxs::HostMirror& fe = es[4];
-    for (Int j = n+1; j < nslices(fp) - (n+1); ++j) {
-      if (j % (n+1) == 0 || (j+1) % (n+1) == 0) continue;
-      for (Int k = 0; k < 3; ++k) p(p_base+j,k) = fp(j,k);
-    }
-    for (Int j = 0; j < nslices(fe); ++j)
-      for (Int k = 0; k < 4; ++k) fe(j,k) += p_base;
-    for (Int j = 0; j < n; ++j) { // -y
-      fe(j,0) = es[0](n*(n-1)+j,3);
-      fe(j,1) = es[0](n*(n-1)+j,2);
-    }
-    for (Int j = 0; j < n; ++j) { // +y
-      fe(n*(n-1)+j,2) = es[2](n*n-1-j,3);
-      fe(n*(n-1)+j,3) = es[2](n*n-1-j,2);
-    }
-    for (Int j = 0, i3 = 0; j < nslices(fe); j += n, ++i3) { // -x
-      fe(j,0) = es[3](n*n-1-i3,2);
-      fe(j,3) = es[3](n*n-1-i3,3);
-    }
-    for (Int j = n-1, i1 = 0; j < nslices(fe); j += n, ++i1) { // +x
-      fe(j,1) = es[1](n*(n-1)+i1,3);
-      fe(j,2) = es[1](n*(n-1)+i1,2);
-    }
-    for (Int j = 0; j < nslices(fe); ++j)
-      for (Int k = 0; k < 4; ++k) e(e_base+j,k) = fe(j,k);
-    p_base += nslices(p_ref);
-    e_base += nslices(e_ref);
-  }
-  { // -z face
-    const Vec3s::HostMirror& fp = ps[5];
-    Idxs::HostMirror& fe = es[5];
-    for (Int j = n+1; j < nslices(fp) - (n+1); ++j) {
-      if (j % (n+1) == 0 || (j+1) % (n+1) == 0) continue;
-      for (Int k = 0; k < 3; ++k) p(p_base+j,k) = fp(j,k);
-    }
-    for (Int j = 0; j < nslices(fe); ++j)
-      for (Int k = 0; k < 4; ++k) fe(j,k) += p_base;
-    for (Int j = 0; j < n; ++j) { // -y
-      fe(j,0) = es[0](n-1-j,1);
-      fe(j,1) = es[0](n-1-j,0);
-    }
-    for (Int j = 0; j < n; ++j) { // +y
-      fe(n*(n-1)+j,2) = es[2](j,1);
-      fe(n*(n-1)+j,3) = es[2](j,0);
-    }
-    for (Int j = 0, i3 = 0; j < nslices(fe); j += n, ++i3) { // -x
-      fe(j,0) = es[1](i3,0);
-      fe(j,3) = es[1](i3,1);
-    }
-    for (Int j = n-1, i1 = 0; j < nslices(fe); j += n, ++i1) { // +x
-      fe(j,1) = es[3](n-1-i1,1);
-      fe(j,2) = es[3](n-1-i1,0);
-    }
-    for (Int j = 0; j < nslices(fe); ++j)
-      for (Int k = 0; k < 4; ++k) e(e_base+j,k) = fe(j,k);
-  }
-  // Now go back and remove the unused vertices and adjust the numbering.
-  remove_unused_vertices(p, e, unused);
-  // Project to the unit sphere.
-  for (Int i = 0; i < nslices(p); ++i)
-    SphereGeometry::normalize(slice(p, i));
-}
-
 void calc_elem_ctr (const Vec3s::HostMirror& p, const Idxs::HostMirror& e,
                     const Int ei, Real ctr[3]) {
   for (Int j = 0; j < 3; ++j) ctr[j] = 0;
@@ -327,32 +86,6 @@ struct Input {
   void print(std::ostream& os) const;
 };
 
-static void project_onto_sphere (Vec3s::HostMirror& p) {
-  for (Int ip = 0; ip < nslices(p); ++ip) {
-    p(ip,2) = 1;
-    SphereGeometry::normalize(slice(p, ip));
-  }
-}
-
-static void
-perturb_mesh (Vec3s::HostMirror& p, const Real angle, const Real xlate,
-              const Real ylate) {
-  const Real cr = std::cos(angle), sr = std::sin(angle);
-  for (Int ip = 0; ip < nslices(p); ++ip) {
-    const Real x = p(ip,0), y = p(ip,1);
-    p(ip,0) =  cr*x - sr*y + xlate;
-    p(ip,1) = -sr*x + cr*y + ylate;
-  }  
-}
-
-static void
-rotate_mesh (Vec3s::HostMirror& p, const Real axis[3], const Real angle) {
-  Real R[9];
-  form_rotation(axis, angle, R);
-  for (Int i = 0; i < nslices(p); ++i)
-    rotate(R, slice(p,i));
-}
-
 static void fill_quad (const ConstVec3s::HostMirror& p,
                        Vec3s::HostMirror& poly) {
   const Int n = static_cast<int>(std::sqrt(nslices(p) - 1));
@@ -416,11 +149,426 @@ test_area (const Int n, const Real angle, const Real xlate, const Real ylate,
 
   const Real re = std::abs(a - ta)/ta;
   fprintf(stderr, "true area %1.4e mesh area %1.4e relerr %1.4e\n", ta, a, re);
+  const Real
+    aom = test::test_area_overlap_mesh<Geo>(cp, ce, p, e),
+    reom = std::abs(aom - ta)/ta;
+  fprintf(stderr, "true area %1.4e overlap mesh area %1.4e relerr %1.4e\n",
+          ta, aom, reom);
+  // The two-stage intersection must agree with the one-stage one.
+  const Real
+    ap = test::test_area_pairs<Geo>(cp, ce, p, e),
+    rep = std::abs(ap - a)/a;
+  fprintf(stderr, "pairs area %1.4e relerr vs one-stage %1.4e\n", ap, rep);
   if (wm) {
     write_matlab("cm", cp, ce);
     write_matlab("m", p, e);
   }
-  return re < 1e-8 ? 0 : 1;
+  return re < 1e-8 && reom < 1e-8 && rep < 1e-12 ? 0 : 1;
+}
+
+// Check that the fixed-size clipper gives the same result as the general one
+// whenever it succeeds. It may run out of space because of roundoff, but
+// should nearly never.
+static Int test_clip_against_poly_n (
+  const ConstVec3s::HostMirror& cp, const ConstIdxs::HostMirror& ce,
+  const ConstVec3s::HostMirror& p, const ConstIdxs::HostMirror& e)
+{
+  sh::Mesh<ko::HostSpace> cm; cm.p = cp; cm.e = ce;
+  test::fill_normals<SphereGeometry>(cm);
+  static const Int max_nvert = test::max_nvert;
+  Real buf[12*max_nvert];
+  RawVec3s
+    vi(buf, max_nvert),
+    vo(buf + 3*max_nvert, max_nvert),
+    wrk(buf + 6*max_nvert, max_nvert),
+    von(buf + 9*max_nvert, max_nvert);
+  Int nerr = 0, nclip = 0, nfail = 0, ntry = 0;
+  for (Int k = 0; k < nslices(e); ++k) {
+    for (Int i = 0; i < 4; ++i) copy(slice(vi, i), slice(p, e(k,i)), 3);
+    for (Int ci = std::max(0, k-2); ci < std::min(nslices(ce), k+3); ++ci)
+      for (Int ni = 3; ni <= 4; ++ni) {
+        Int no, non;
+        const bool ok =
+          sh::clip_against_poly<SphereGeometry>(cm, ci, vi, ni, vo, no, wrk);
+        const bool okn = ni == 3 ?
+          sh::clip_against_poly_n<SphereGeometry,3,4>(cm, ci, vi, von, non) :
+          sh::clip_against_poly_n<SphereGeometry,4,4>(cm, ci, vi, von, non);
+        ++ntry;
+        if ( ! ok) ++nerr;
+        if ( ! okn) {
+          ++nfail;
+          continue;
+        }
+        if (no) ++nclip;
+        bool same = no == non;
+        for (Int j = 0; same && j < no; ++j)
+          for (Int d = 0; d < 3; ++d)
+            if (std::abs(vo(j,d) - von(j,d)) > 1e-14) same = false;
+        if ( ! same) ++nerr;
+      }
+  }
+  const bool fail = nerr || ! nclip || 100*nfail > ntry;
+  if (fail)
+    std::cerr << "FAIL: test_clip_against_poly_n: nerr " << nerr << " nclip "
+              << nclip << " nfail " << nfail << " of " << ntry << "\n";
+  return fail ? 1 : 0;
+}
+
+// Clipping the self-intersecting quad below against a square gives 9 vertices
+// after the second edge, more than the 8 of clip_against_poly_n<4,4>'s
+// buffers, as roundoff can on nearly coincident edges. Check that
+// OverlapMesh::build then falls back to the general clipper.
+static Int test_clip_fallback () {
+  typedef PlaneGeometry geo;
+  Vec3s::HostMirror cp;
+  Idxs::HostMirror ce;
+  mesh::make_planar_mesh(cp, ce, 1);
+  sh::Mesh<ko::HostSpace> cm_hm; cm_hm.p = cp; cm_hm.e = ce;
+  test::fill_normals<geo>(cm_hm);
+  // Vertices in the square's reference coordinates, in which it is [0,1]^2.
+  const Real q[][2] = {{-1, -0.5}, {1.5, 1.5}, {-0.5, -1}, {0.5, 1.5}};
+  Vec3s::HostMirror p_hm("p", 4);
+  Idxs::HostMirror e_hm("e", 1, 4);
+  for (Int i = 0; i < 4; ++i) {
+    for (Int j = 0; j < 2; ++j)
+      p_hm(i,j) = cp(ce(0,0),j) + q[i][j]*(cp(ce(0,2),j) - cp(ce(0,0),j));
+    p_hm(i,2) = 0;
+    e_hm(0,i) = i;
+  }
+  static const Int max_nvert = test::max_nvert;
+  Real buf[9*max_nvert];
+  RawVec3s
+    vo(buf, max_nvert),
+    wrk(buf + 3*max_nvert, max_nvert),
+    von(buf + 6*max_nvert, max_nvert);
+  Int no, non;
+  const bool ok = sh::clip_against_poly<geo>(cm_hm, 0, p_hm, 4, vo, no, wrk);
+  const bool okn = sh::clip_against_poly_n<geo,4,4>(cm_hm, 0, p_hm, von, non);
+  Int nerr = ok && ! okn && no > 0 ? 0 : 1;
+  const sh::Mesh<> cm(cm_hm);
+  Vec3s p; resize_and_copy(p, p_hm);
+  Idxs e; resize_and_copy(e, e_hm);
+  const Octree<geo, 10> search(cp, ce);
+  OverlapMesh<geo> om;
+  try {
+    om.build(cm, search, p, e);
+    if (om.npolygon() != 1 || om.nvertex() != no) ++nerr;
+  } catch (const std::exception& ex) {
+    std::cerr << ex.what() << "\n";
+    ++nerr;
+  }
+  if (nerr)
+    std::cerr << "FAIL: test_clip_fallback: ok " << ok << " okn " << okn
+              << " no " << no << " npolygon " << om.npolygon() << " nvertex "
+              << om.nvertex() << "\n";
+  return nerr;
+}
+
+// Check that TriangleQuadratureRule<order> holds get_coef(order)'s rule.
+template <int order>
+static Int check_triangle_quadrature_rule (const TriangleQuadrature& q) {
+  const TriangleQuadratureRule<order> r;
+  RawConstVec3s coord;
+  RawConstArray weight;
+  q.get_coef(order, coord, weight);
+  Int nerr = nslices(coord) == r.npts ? 0 : 1;
+  for (Int k = 0; k < r.npts; ++k) {
+    for (Int j = 0; j < 3; ++j)
+      if (r.bary[j][k] != coord(k,j)) ++nerr;
+    if (r.weight[k] != weight[k]) ++nerr;
+  }
+  return nerr;
+}
+
+static Int test_triangle_quadrature () {
+  const TriangleQuadrature q;
+  Int nerr = 0;
+  nerr += check_triangle_quadrature_rule< 4>(q);
+  nerr += check_triangle_quadrature_rule< 6>(q);
+  nerr += check_triangle_quadrature_rule< 8>(q);
+  nerr += check_triangle_quadrature_rule<12>(q);
+  nerr += check_triangle_quadrature_rule<14>(q);
+  nerr += check_triangle_quadrature_rule<16>(q);
+  nerr += check_triangle_quadrature_rule<18>(q);
+  nerr += check_triangle_quadrature_rule<20>(q);
+  { // The compile- and run-time order integrals must agree.
+    Real buf[9] = {1, 0, 0, 1, 0.1, 0, 1, 0, 0.1};
+    const RawVec3s v(buf, 3);
+    for (Int i = 0; i < 3; ++i) SphereGeometry::normalize(slice(v, i));
+    const Real ta = SphereGeometry::calc_area_formula(v, 3);
+    Real a[2] = {0};
+    SphereGeometry::integrate(q, 12, v, 3, [&] (const Real*, const Real w) {
+      a[0] += w; });
+    SphereGeometry::integrate<12>(v, 3, [&] (const Real*, const Real w) {
+      a[1] += w; });
+    if (a[0] != a[1] || std::abs(a[0] - ta) > 1e-12*ta) ++nerr;
+  }
+  if (nerr) std::cerr << "FAIL: test_triangle_quadrature: nerr " << nerr << "\n";
+  return nerr;
+}
+
+// Check QuadCoefs's cached values against those computed on the fly.
+static Int test_quad_coefs (const ConstVec3s::HostMirror& p_hm,
+                            const ConstIdxs::HostMirror& e_hm) {
+  Vec3s p; resize_and_copy(p, p_hm);
+  Idxs e; resize_and_copy(e, e_hm);
+  const sqr::QuadCoefs c(p, e);
+  Int nerr = 0;
+  ko::parallel_reduce(nslices(e), KOKKOS_LAMBDA (const Int& ie, Int& ne) {
+    const auto ev = const_slice(e, ie);
+    Real T[12], q[3], cq[3];
+    c.get_T(ie, T);
+    sqr::calc_ref_to_sphere(p, ev, 0.3, -0.7, q);
+    sqr::calc_ref_to_sphere(T, 0.3, -0.7, cq);
+    for (Int d = 0; d < 3; ++d) if (q[d] != cq[d]) ++ne;
+  }, nerr);
+  if (nerr) std::cerr << "FAIL: test_quad_coefs: nerr " << nerr << "\n";
+  return nerr;
+}
+
+// Return the number of elements of (p,e) whose polygons in om and omb differ,
+// as multisets of (cme, area) pairs.
+static Int compare_overlap_meshes (const OverlapMesh<SphereGeometry>& om,
+                                   const OverlapMesh<SphereGeometry>& omb,
+                                   const Int ne) {
+  typedef std::pair<Int,Real> Poly;
+  const auto get = [&] (const OverlapMesh<SphereGeometry>& m,
+                        std::vector<std::vector<Poly> >& polys) {
+    const auto ptr = ko::create_mirror_view(m.ptr);
+    const auto cme = ko::create_mirror_view(m.cme);
+    const auto area = ko::create_mirror_view(m.area);
+    ko::deep_copy(ptr, m.ptr); ko::deep_copy(cme, m.cme);
+    ko::deep_copy(area, m.area);
+    polys.resize(ne);
+    for (Int k = 0; k < ne; ++k) {
+      for (Int i = ptr(k); i < ptr(k+1); ++i)
+        polys[k].push_back(Poly(cme(i), area(i)));
+      std::sort(polys[k].begin(), polys[k].end());
+    }
+  };
+  std::vector<std::vector<Poly> > polys, polysb;
+  get(om, polys);
+  get(omb, polysb);
+  Int nerr = 0;
+  for (Int k = 0; k < ne; ++k) {
+    const auto& a = polys[k];
+    const auto& b = polysb[k];
+    bool ok = a.size() == b.size();
+    Real tot = 0;
+    for (const auto& pb : b) tot += pb.second;
+    for (size_t i = 0; ok && i < a.size(); ++i)
+      ok = (a[i].first == b[i].first &&
+            std::abs(a[i].second - b[i].second) <= 1e-14*tot);
+    if ( ! ok) ++nerr;
+  }
+  return nerr;
+}
+
+// Move (p,e) a fraction of a cell each step, and check that
+// OverlapMesh::update gives the same overlap mesh as build.
+static Int test_overlap_mesh_update (const ConstVec3s::HostMirror& cp,
+                                     const ConstIdxs::HostMirror& ce,
+                                     const ConstVec3s::HostMirror& p0,
+                                     const ConstIdxs::HostMirror& e_hm,
+                                     const Int n) {
+  sh::Mesh<ko::HostSpace> cm_hm; cm_hm.p = cp; cm_hm.e = ce;
+  test::fill_normals<SphereGeometry>(cm_hm);
+  const sh::Mesh<> cm(cm_hm);
+  const Octree<SphereGeometry, 10> search(cp, ce);
+  Vec3s::HostMirror p_hm; resize_and_copy(p_hm, p0);
+  Vec3s p; resize_and_copy(p, p_hm);
+  Idxs e; resize_and_copy(e, e_hm);
+  const Int ne = nslices(e);
+  OverlapMesh<SphereGeometry> om;
+  om.build(cm, search, p, e);
+  const Real axis[] = {-0.2, 0.4, 0.1}, dx = (M_PI/2)/n;
+  // Steps of a fraction of a cell, which the seeded candidates cover; then a
+  // step of up to three cells, after which the seeds miss for elements far
+  // from the axis, which must fall back to search; then small steps with few
+  // allowed candidates, so that elements fall back when the seeds or their
+  // growth overflow. On steps marked must_search, some element must search.
+  struct Step { Real dangle; Int ncand; bool must_search; };
+  const Step steps[] = {{0.2*dx, 0, false}, {0.2*dx, 0, false},
+                        {0.2*dx, 0, false}, {0.2*dx, 0, false},
+                        {3*dx, 0, true},
+                        {0.2*dx, 4, true}, {0.2*dx, 12, false},
+                        {0.2*dx, 24, false}};
+  const Int nstep = sizeof(steps)/sizeof(*steps);
+  Int nerr = 0;
+  for (Int step = 0; step < nstep; ++step) {
+    const Step& s = steps[step];
+    rotate_mesh(p_hm, axis, s.dangle);
+    ko::deep_copy(p, p_hm);
+    const Int nsearch = (s.ncand ? om.update(cm, search, p, e, s.ncand) :
+                         om.update(cm, search, p, e));
+    OverlapMesh<SphereGeometry> omb;
+    omb.build(cm, search, p, e);
+    // Each element must have the same polygons and area.
+    const Int ne_diff = compare_overlap_meshes(om, omb, ne);
+    if (s.must_search && nsearch == 0) {
+      std::cerr << "FAIL: test_overlap_mesh_update: no element searched in"
+                << " step " << step << "\n";
+      ++nerr;
+    }
+    fprintf(stderr, "OverlapMesh::update: step %1.2f cells, ncand %d, %d of %d"
+            " elements searched\n", s.dangle/dx,
+            s.ncand ? s.ncand : (Int) OverlapMesh<SphereGeometry>::max_ncand,
+            nsearch, ne);
+    nerr += ne_diff;
+  }
+  if (nerr) std::cerr << "FAIL: test_overlap_mesh_update: nerr " << nerr << "\n";
+  return nerr;
+}
+
+// Count and sum the elements an Octree query visits.
+struct OctreeQueryTally {
+  Int n, sum;
+  KOKKOS_INLINE_FUNCTION OctreeQueryTally () : n(0), sum(0) {}
+  KOKKOS_INLINE_FUNCTION void operator() (const Int k) { ++n; sum += k; }
+};
+
+// Refit an Octree built with slack after small and large motions, and check
+// that queries agree with a tree built on the moved mesh.
+static Int test_octree_refit (const ConstVec3s::HostMirror& cp,
+                              const ConstIdxs::HostMirror& ce,
+                              const ConstVec3s::HostMirror& p0,
+                              const ConstIdxs::HostMirror& e_hm, const Int n) {
+  typedef Octree<SphereGeometry, 10> Oct;
+  const Real dx = (M_PI/2)/n, axis[] = {0.3, 0.1, -0.2};
+  Vec3s::HostMirror p_hm; resize_and_copy(p_hm, p0);
+  Vec3s p; resize_and_copy(p, p_hm);
+  Idxs e; resize_and_copy(e, e_hm);
+  Oct::Options o;
+  o.slack = 0.25*dx;
+  Oct ot;
+  ot.build(p, e, o);
+  Int nerr = 0;
+  rotate_mesh(p_hm, axis, 0.05*dx);
+  ko::deep_copy(p, p_hm);
+  if ( ! ot.refit(p, e)) {
+    std::cerr << "FAIL: test_octree_refit: refit failed for a small motion\n";
+    ++nerr;
+  }
+  // Query with cm's elements' boxes.
+  Oct otb;
+  otb.build(p, e);
+  Vec3s cpd; resize_and_copy(cpd, cp);
+  Idxs ced; resize_and_copy(ced, ce);
+  Int nq = 0;
+  ko::parallel_reduce(nslices(ced), KOKKOS_LAMBDA (const Int& k, Int& nf) {
+    Real bb[6];
+    Oct::calc_bb(cpd, const_slice(ced, k), szslice(ced), bb);
+    OctreeQueryTally t, tb;
+    ot.apply(bb, t);
+    otb.apply(bb, tb);
+    if (t.n != tb.n || t.sum != tb.sum) ++nf;
+  }, nq);
+  nerr += nq;
+  rotate_mesh(p_hm, axis, 2*dx);
+  ko::deep_copy(p, p_hm);
+  if (ot.refit(p, e)) {
+    std::cerr << "FAIL: test_octree_refit: refit succeeded for a large motion\n";
+    ++nerr;
+  }
+  if (nerr) std::cerr << "FAIL: test_octree_refit: nerr " << nerr << "\n";
+  return nerr;
+}
+
+// Write the mesh, an Octree, the overlap mesh, and a remap operator, map the
+// file, and check that what comes back gives the same results.
+static Int test_io (const ConstVec3s::HostMirror& cp,
+                    const ConstIdxs::HostMirror& ce,
+                    const ConstVec3s::HostMirror& p_hm,
+                    const ConstIdxs::HostMirror& e_hm) {
+  typedef Octree<SphereGeometry, 10> Oct;
+  sh::Mesh<ko::HostSpace> cm_hm; cm_hm.p = cp; cm_hm.e = ce;
+  test::fill_normals<SphereGeometry>(cm_hm);
+  const sh::Mesh<> cm(cm_hm);
+  Vec3s p; resize_and_copy(p, p_hm);
+  Idxs e; resize_and_copy(e, e_hm);
+  const Oct search(cp, ce);
+  OverlapMesh<SphereGeometry> om;
+  om.build(cm, search, p, e);
+  RemapOperator op;
+  RemapOperator::Options o;
+  o.np = 3;
+  op.build(cm, search, p, e, o);
+  const char* const filename = "siqk_test_io.siqk";
+  {
+    io::Writer w;
+    w.add("p", p);
+    w.add("e", e);
+    search.write(w, "octree.");
+    om.write(w, "om.");
+    op.write(w, "remap.");
+    w.write(filename);
+  }
+  Int nerr = 0, ne = 0;
+  {
+    const io::MappedFile f(filename);
+    Vec3s p_r;
+    Idxs e_r;
+    f.get("p", p_r);
+    f.get("e", e_r);
+    if (nslices(p_r) != nslices(p) || nslices(e_r) != nslices(e))
+      ++nerr;
+    ko::parallel_reduce(nslices(p), KOKKOS_LAMBDA (const Int& k, Int& nf) {
+      for (Int j = 0; j < 3; ++j) if (p_r(k,j) != p(k,j)) ++nf;
+    }, ne);
+    nerr += ne;
+    ko::parallel_reduce(nslices(e), KOKKOS_LAMBDA (const Int& k, Int& nf) {
+      for (Int j = 0; j < szslice(e); ++j) if (e_r(k,j) != e(k,j)) ++nf;
+    }, ne);
+    nerr += ne;
+  }
+  // Load each object as a restart does, dropping the file object once the
+  // object is read, and use the object before anything else maps the file, so
+  // that the object must keep its map alive.
+  {
+    Oct searchr;
+    { const io::MappedFile f(filename); searchr.read(f, "octree."); }
+    // Query each search with the target elements' boxes.
+    const ConstIdxs cme = cm.e;
+    const ConstVec3s cmp = cm.p;
+    ko::parallel_reduce(nslices(cme), KOKKOS_LAMBDA (const Int& k, Int& nf) {
+      Real bb[6];
+      Oct::calc_bb(cmp, const_slice(cme, k), szslice(cme), bb);
+      OctreeQueryTally t, tr;
+      search.apply(bb, t);
+      searchr.apply(bb, tr);
+      if (t.n != tr.n || t.sum != tr.sum) ++nf;
+    }, ne);
+    nerr += ne;
+  }
+  {
+    OverlapMesh<SphereGeometry> omr;
+    { const io::MappedFile f(filename); omr.read(f, "om."); }
+    if (omr.npolygon() != om.npolygon() || omr.nvertex() != om.nvertex())
+      ++nerr;
+    const auto area = om.area, arear = omr.area;
+    ko::parallel_reduce(om.npolygon(), KOKKOS_LAMBDA (const Int& i, Int& nf) {
+      if (arear(i) != area(i)) ++nf;
+    }, ne);
+    nerr += ne;
+  }
+  {
+    RemapOperator opr;
+    { const io::MappedFile f(filename); opr.read(f, "remap."); }
+    if (opr.nblock() != op.nblock() || opr.nsrc() != op.nsrc())
+      ++nerr;
+    const RemapOperator::RealList
+      x("x", op.nsrc()), y("y", op.ntgt()), yr("yr", op.ntgt());
+    test::sample_at_gll_nodes(p, e, o.np, 2, x);
+    op.apply(x, y);
+    opr.apply(x, yr);
+    ko::parallel_reduce(op.ntgt(), KOKKOS_LAMBDA (const Int& i, Int& nf) {
+      if (yr(i) != y(i)) ++nf;
+    }, ne);
+    nerr += ne;
+  }
+  std::remove(filename);
+  if (nerr) std::cerr << "FAIL: test_io: nerr " << nerr << "\n";
+  return nerr;
 }
 
 static Int test_cube (const Input& in) {
@@ -446,9 +594,63 @@ static Int test_cube (const Input& in) {
     fprintf(stderr, "true area %1.4e mesh area %1.4e relerr %1.4e\n",
             ta, a, re);
     nerr += re < 1e-8 ? 0 : 1;
+    // Same, but search with the sphere-native index.
+    const Real
+      ai = test::test_area_ot<SphereGeometry, CubedSphereIndex>(cp, ce, p, e),
+      rei = std::abs(ai - ta)/ta;
+    fprintf(stderr, "true area %1.4e mesh area %1.4e relerr %1.4e (index)\n",
+            ta, ai, rei);
+    nerr += rei < 1e-8 ? 0 : 1;
+    // Same, but with the two-stage intersection over candidate pairs.
+    const Real
+      ap = test::test_area_pairs<SphereGeometry>(cp, ce, p, e),
+      api = test::test_area_pairs<SphereGeometry, CubedSphereIndex>(
+        cp, ce, p, e),
+      rep = std::max(std::abs(ap - a), std::abs(api - ai))/ta;
+    fprintf(stderr, "pairs area %1.4e %1.4e relerr vs one-stage %1.4e\n",
+            ap, api, rep);
+    nerr += rep < 1e-12 ? 0 : 1;
+    // Build the overlap mesh with each search structure.
+    Int np[2];
+    const Real
+      aom = test::test_area_overlap_mesh<SphereGeometry>(cp, ce, p, e, &np[0]),
+      aomi = test::test_area_overlap_mesh<SphereGeometry, CubedSphereIndex>(
+        cp, ce, p, e, &np[1]),
+      reom = std::max(std::abs(aom - ta), std::abs(aomi - ta))/ta;
+    fprintf(stderr, "true area %1.4e overlap mesh area %1.4e relerr %1.4e"
+            " #polygons %d %d\n", ta, aom, reom, np[0], np[1]);
+    nerr += reom < 1e-8 && np[0] == np[1] ? 0 : 1;
+    // Integrate 1 and z^2, whose integral is 4 pi/3, over the overlap mesh
+    // without forming it.
+    Real m[2];
+    test::test_integrate_overlaps<SphereGeometry>(cp, ce, p, e, 2, m);
+    const Real
+      rem0 = std::abs(m[0] - ta)/ta,
+      rem1 = std::abs(m[1] - ta/3)/(ta/3);
+    fprintf(stderr, "integrate_overlaps: area relerr %1.4e z^2 relerr %1.4e\n",
+            rem0, rem1);
+    nerr += rem0 < 1e-8 && rem1 < 1e-8 ? 0 : 1;
+    nerr += test_clip_against_poly_n(cp, ce, p, e);
+    nerr += test_clip_fallback();
+    nerr += test_overlap_mesh_update(cp, ce, p, e, in.n);
+    nerr += test_octree_refit(cp, ce, p, e, in.n);
+    nerr += test_io(cp, ce, p, e);
   }
   // Test ref square <-> spherical quad transformations.
   nerr += sqr::test::test_sphere_to_ref(p, e);
+  nerr += test_quad_coefs(p, e);
+  nerr += test_triangle_quadrature();
+  // Remap from the rotated mesh to the original, using each basis. Unless the
+  // error is already at round-off, it must fall as np increases.
+  Real zerr[RemapOperator::max_np + 1];
+  for (Int np = 2; np <= RemapOperator::max_np; ++np) {
+    nerr += test::test_remap(cp, ce, p, e, np, &zerr[np]);
+    if (np > 2 && zerr[np-1] > 1e-12 && zerr[np] >= zerr[np-1]) {
+      std::cerr << "FAIL: test_remap: z error does not fall from np " << np-1
+                << " to " << np << "\n";
+      ++nerr;
+    }
+  }
   if (in.write_matlab) {
     write_matlab("cm", cp, ce);
     write_matlab("m", p, e);
@@ -504,9 +706,9 @@ void Input::print (std::ostream& os) const {
 
 int main (int argc, char** argv) {
   Kokkos::initialize(argc, argv);
+  Int nerr = 0;
   {
     Input in(argc, argv);
-    Int nerr = 0;
     if (in.geo_sphere)
       nerr += run<SphereGeometry>(in);
     else {
@@ -519,4 +721,5 @@ int main (int argc, char** argv) {
     std::cerr << (nerr ? "FAIL" : "PASS") << "ED\n";
   }
   Kokkos::finalize_all();
+  return nerr ? -1 : 0;
 }